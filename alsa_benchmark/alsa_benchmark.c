@@ -0,0 +1,1431 @@
+/*******************************************************************************
+ * @file          alsa_benchmark.c
+ *
+ * @brief         Benchmarks of the alsa_utils kernels and of configure_hw
+ *
+ * Measures the cost of:
+ *      @li @ref generate_sin, @ref generate_sin_channels and the
+ *          @ref oscillator in ns/sample
+ *      @li the format conversions of each instruction set supported and the
+ *          render kernels that @ref configure_hw selects for each format,
+ *          channel count and layout
+ *      @li the biquad and FIR filters of each instruction set and the
+ *          partitioned FFT convolver, plus the decay of a resonant biquad
+ *          fed with silence after a burst (the denormal case). The filters
+ *          of each instruction set are checked bit by bit against the
+ *          scalar ones
+ *      @li the @ref mixer of each instruction set with many voices, checked
+ *          bit by bit against the scalar one too
+ *      @li the Q15/Q31 mix and dot products of each instruction set, cross
+ *          checked against the same operations done in floating point
+ *      @li the handoff of a block through a @ref spsc_ring, in the same thread
+ *          and between two threads
+ *      @li a round trip open + @ref configure_hw + close of some PCMs, the
+ *          same with the parameters of a @ref hw_cache and a warm restart
+ *          (@ref pcm_warm_stop) of an open stream
+ *
+ * for several buffer sizes and channel counts. Each measurement is repeated
+ * and the fastest run is kept, so two runs in the same machine can be
+ * compared with diff. The results are written in CSV:
+ *      @li benchmark,variant,frames,channels,ns_per_call,ns_per_sample
+ *
+ * Usage: alsa_benchmark [results.csv] [pcm ...], by default the results go
+ * to stdout and the PCMs are null and hw:0,0
+ *
+ * @note          Link using -lasound, -lm, -lpthread, -lalsa_utils,
+ *                -L${workspace_loc:/alsa_utils/Debug/} and
+ *                -I${workspace_loc:/alsa_utils}
+ *
+ * @author        hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 Hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <alsa/asoundlib.h>
+#include "alsa_utils.h"
+#include "dsp_scheduler.h"
+#include "fft_convolver.h"
+#include "filter.h"
+#include "fixed_point.h"
+#include "hw_cache.h"
+#include "mixer.h"
+#include "oscillator.h"
+#include "resampler.h"
+#include "sample_convert.h"
+#include "spsc_ring.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#define BENCH_MIN_RUN_NS        (10000000u) /**< minimum time of each run */
+#define BENCH_RUNS              (3u) /**< runs of each benchmark, the fastest
+                                          one is reported */
+#define BENCH_MAX_FRAMES        (4096u) /**< biggest buffer measured */
+#define BENCH_MAX_CHANNELS      (8u) /**< most channels measured */
+#define RING_BLOCKS             (8u) /**< blocks of the ring benchmarks */
+#define RING_HANDOFFS           (20000u) /**< blocks sent between threads */
+#define BENCH_SECTIONS          (4u) /**< sections of the biquad cascade */
+#define BENCH_RESONANCE_Q       (20.0f) /**< Q of the biquads of the decay
+                                             benchmark */
+#define BENCH_FIR_TAPS          (32u) /**< taps of the direct FIR */
+#define BENCH_FFT_TAPS          (4096u) /**< taps of the partitioned FIR */
+#define BENCH_VOICES            (256u) /**< voices of the mixer benchmark */
+#define CHECK_VOICES            (8u) /**< voices of each mixer compared */
+#define BENCH_FIXED_GAIN        (0.70710677f) /**< gain of the fixed point
+                                                   mix */
+#define BENCH_SRC_IN_RATE       (44100u) /**< input rate of the resampler */
+#define BENCH_SRC_OUT_RATE      (48000u) /**< output rate of the resampler */
+#define SCHED_CHANNELS          (64u) /**< channels of the scheduler benchmark */
+#define SCHED_JOBS              (SCHED_CHANNELS/FILTER_LANES) /**< one job for
+                                                each group of channels */
+
+/*------------------------------------------------------------------------------
+ * Module Typedefs
+ -----------------------------------------------------------------------------*/
+/** Function measured, it's called many times with the same context */
+typedef void (*bench_function) (void *context);
+
+/** Context of the DSP benchmarks */
+typedef struct
+{
+  uint32_t frames; /**< frames of each call */
+  uint32_t num_channels; /**< channels of each call */
+  snd_pcm_format_t format; /**< format of the conversions */
+  int16_t *samples; /**< buffer for the sine generators */
+  float *floats[BENCH_MAX_CHANNELS]; /**< buffers for the oscillator */
+  void *converted; /**< buffer for the conversions */
+  void *rendered[BENCH_MAX_CHANNELS]; /**< @a converted split in channels */
+  render_kernel render; /**< kernel of the render benchmark */
+  oscillator osc; /**< oscillator measured */
+  spsc_ring ring; /**< ring of the handoff benchmarks */
+  biquad_cascade cascade; /**< EQ of the biquad benchmark */
+  fir_filter fir; /**< filter of the direct FIR benchmark */
+  fft_convolver convolver; /**< filter of the partitioned FIR benchmark */
+  resampler rs; /**< converter of the resampler benchmark */
+  float *resampled[BENCH_MAX_CHANNELS]; /**< output of the resampler */
+  mixer mix; /**< mixer of the voices benchmark */
+  oscillator voices[BENCH_VOICES]; /**< sources of the mixer */
+  q15_t q15[2][BENCH_MAX_FRAMES*BENCH_MAX_CHANNELS]; /**< Q15 operands */
+  q31_t q31[2][BENCH_MAX_FRAMES*BENCH_MAX_CHANNELS]; /**< Q31 operands */
+} dsp_context;
+
+/** Context of the scheduler benchmark */
+typedef struct
+{
+  dsp_scheduler scheduler; /**< pool measured */
+  biquad_cascade cascades[SCHED_JOBS]; /**< filters of each job */
+  dsp_stage_task tasks[SCHED_JOBS]; /**< arguments of the jobs */
+  dsp_job jobs[SCHED_JOBS]; /**< jobs of each period */
+  float *channels[SCHED_CHANNELS]; /**< buffers of the period */
+} sched_context;
+
+/** Context of the configure_hw benchmark */
+typedef struct
+{
+  const char *pcm_name; /**< PCM opened */
+  hw_configuration hw_config; /**< configuration applied */
+  hw_cache cache; /**< cache of the cached round trips */
+  snd_pcm_t *handle; /**< stream of the warm restarts */
+  int8_t status; /**< @a S_ERROR if any round trip failed */
+} hw_context;
+
+/*------------------------------------------------------------------------------
+ * Module Variable Definitions
+ -----------------------------------------------------------------------------*/
+static const uint32_t bench_frames[] = { 64u, 256u, 1024u, BENCH_MAX_FRAMES };
+static const uint32_t bench_channels[] = { 1u, 2u, BENCH_MAX_CHANNELS };
+static const snd_pcm_format_t bench_formats[] = { SND_PCM_FORMAT_S16_LE,
+    SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_FLOAT_LE };
+static const convert_isa bench_isas[] = { E_ISA_SCALAR, E_ISA_SSE2,
+    E_ISA_AVX2, E_ISA_NEON };
+
+/** Keeps the compiler from removing the work of the benchmarks */
+static volatile uint32_t bench_sink;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn uint64_t get_time_ns (void)
+ *
+ * @brief Get the monotonic time in nanoseconds
+ *
+ ******************************************************************************/
+static uint64_t get_time_ns (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec*1000000000u+(uint64_t)now.tv_nsec;
+}
+
+/******************************************************************************
+ *
+ * @fn double run_benchmark (bench_function, void*)
+ *
+ * @brief Measure the time of a function
+ *
+ * The function is called once to warm up the caches, then the number of
+ * calls is doubled until a run lasts at least @ref BENCH_MIN_RUN_NS, then
+ * @ref BENCH_RUNS runs are made with that number of calls
+ *
+ * @param function  function to measure
+ * @param context   context given to the function
+ *
+ * @return double time of the fastest call in nanoseconds
+ *
+ ******************************************************************************/
+static double run_benchmark (bench_function function, void *context)
+{
+  uint64_t calls = 1u;
+  uint64_t start;
+  uint64_t elapsed;
+  double best = 0.0;
+  double ns_per_call;
+
+  function (context);
+  do
+  {
+    start = get_time_ns ();
+    for (uint64_t n = 0; n<calls; n++)
+    {
+      function (context);
+    }
+    elapsed = get_time_ns ()-start;
+    if ( BENCH_MIN_RUN_NS>elapsed )
+    {
+      calls *= 2u;
+    }
+  }
+  while ( BENCH_MIN_RUN_NS>elapsed );
+
+  for (uint32_t run = 0; run<BENCH_RUNS; run++)
+  {
+    start = get_time_ns ();
+    for (uint64_t n = 0; n<calls; n++)
+    {
+      function (context);
+    }
+    ns_per_call = (double)(get_time_ns ()-start)/(double)calls;
+    if ( (0u==run)||(ns_per_call<best) )
+    {
+      best = ns_per_call;
+    }
+  }
+
+  return best;
+}
+
+/******************************************************************************
+ *
+ * @fn void print_result (FILE*, const char*, const char*, uint32_t, uint32_t,
+ *                        double)
+ *
+ * @brief Write a line of the CSV
+ *
+ ******************************************************************************/
+static void print_result (FILE *output, const char *benchmark,
+                          const char *variant, uint32_t frames,
+                          uint32_t num_channels, double ns_per_call)
+{
+  uint32_t samples = frames*num_channels;
+
+  fprintf (output, "%s,%s,%u,%u,%.1f,%.3f\n", benchmark, variant, frames,
+           num_channels, ns_per_call,
+           (0u!=samples) ? ns_per_call/samples : ns_per_call);
+  fflush (output);
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_generate_sin (void*)
+ *
+ * @brief Stereo sine with @ref generate_sin
+ *
+ ******************************************************************************/
+static void bench_generate_sin (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  generate_sin (dsp->samples, 469u, 48000u, dsp->frames);
+  bench_sink += (uint32_t)dsp->samples[1];
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_generate_sin_channels (void*)
+ *
+ * @brief Interleaved sine with @ref generate_sin_channels
+ *
+ ******************************************************************************/
+static void bench_generate_sin_channels (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+  int16_t *channels[1] = { dsp->samples };
+
+  generate_sin_channels (channels, 469u, 48000u, dsp->frames,
+                         dsp->num_channels, E_LAYOUT_INTERLEAVED);
+  bench_sink += (uint32_t)dsp->samples[1];
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_oscillator_fill (void*)
+ *
+ * @brief Planar float sine with @ref oscillator_fill
+ *
+ ******************************************************************************/
+static void bench_oscillator_fill (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  oscillator_fill (&dsp->osc, dsp->floats, dsp->frames, dsp->num_channels,
+                   E_LAYOUT_PLANAR);
+  bench_sink += (uint32_t)dsp->floats[0][1];
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_convert (void*)
+ *
+ * @brief Conversion of frames*channels floats with the current kernels
+ *
+ ******************************************************************************/
+static void bench_convert (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  convert_float_to_format (dsp->floats[0], dsp->converted,
+                           dsp->frames*dsp->num_channels, dsp->format);
+  bench_sink += *(uint8_t*)dsp->converted;
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_render (void*)
+ *
+ * @brief Planar floats to the format and layout of a render kernel
+ *
+ ******************************************************************************/
+static void bench_render (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  dsp->render (dsp->floats, dsp->rendered, dsp->frames, dsp->num_channels);
+  bench_sink += *(uint8_t*)dsp->converted;
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_biquad (void*)
+ *
+ * @brief Cascade of @ref BENCH_SECTIONS biquads over all the channels
+ *
+ ******************************************************************************/
+static void bench_biquad (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  biquad_cascade_process (&dsp->cascade, dsp->floats, dsp->frames);
+  bench_sink += (uint32_t)dsp->floats[0][0];
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_biquad_decay (void*)
+ *
+ * @brief Cascade of @ref BENCH_SECTIONS biquads fed with silence, the state
+ *        left by the previous blocks decays towards 0
+ *
+ ******************************************************************************/
+static void bench_biquad_decay (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  for (uint32_t ch = 0; ch<dsp->num_channels; ch++)
+  {
+    memset (dsp->floats[ch], 0, dsp->frames*sizeof(float));
+  }
+  biquad_cascade_process (&dsp->cascade, dsp->floats, dsp->frames);
+  bench_sink += (uint32_t)dsp->floats[0][0];
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_fir (void*)
+ *
+ * @brief Direct FIR of @ref BENCH_FIR_TAPS taps over all the channels
+ *
+ ******************************************************************************/
+static void bench_fir (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  fir_filter_process (&dsp->fir, dsp->floats, dsp->frames);
+  bench_sink += (uint32_t)dsp->floats[0][0];
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_fft_convolver (void*)
+ *
+ * @brief Partitioned FIR of @ref BENCH_FFT_TAPS taps over all the channels,
+ *        with partitions of the size of the buffer
+ *
+ ******************************************************************************/
+static void bench_fft_convolver (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  fft_convolver_process (&dsp->convolver, dsp->floats, dsp->frames);
+  bench_sink += (uint32_t)dsp->floats[0][0];
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_resampler (void*)
+ *
+ * @brief Convert the buffer from @ref BENCH_SRC_IN_RATE to
+ *        @ref BENCH_SRC_OUT_RATE
+ *
+ ******************************************************************************/
+static void bench_resampler (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+  uint32_t produced;
+
+  resampler_process (&dsp->rs, dsp->floats, dsp->frames, dsp->resampled,
+                     2u*dsp->frames, &produced);
+  bench_sink += produced;
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_mixer (void*)
+ *
+ * @brief Mix @ref BENCH_VOICES oscillators with their own pan
+ *
+ ******************************************************************************/
+static void bench_mixer (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  mixer_process (&dsp->mix, dsp->floats, dsp->frames);
+  bench_sink += (uint32_t)dsp->floats[0][0];
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_q15_mix (void*)
+ *
+ * @brief Mix a Q15 block into another with @ref q15_mix
+ *
+ ******************************************************************************/
+static void bench_q15_mix (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  q15_mix (dsp->q15[0], dsp->q15[1], dsp->frames*dsp->num_channels,
+           (q15_t)(BENCH_FIXED_GAIN*Q_15));
+  bench_sink += (uint32_t)dsp->q15[0][0];
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_q15_dot (void*)
+ *
+ * @brief Multiply and accumulate two Q15 blocks with @ref q15_dot
+ *
+ ******************************************************************************/
+static void bench_q15_dot (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  bench_sink += (uint32_t)q15_dot (dsp->q15[0], dsp->q15[1],
+                                   dsp->frames*dsp->num_channels);
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_q31_mix (void*)
+ *
+ * @brief Mix a Q31 block into another with @ref q31_mix
+ *
+ ******************************************************************************/
+static void bench_q31_mix (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  q31_mix (dsp->q31[0], dsp->q31[1], dsp->frames*dsp->num_channels,
+           (q31_t)(BENCH_FIXED_GAIN*Q_31));
+  bench_sink += (uint32_t)dsp->q31[0][0];
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_q31_dot (void*)
+ *
+ * @brief Multiply and accumulate two Q31 blocks with @ref q31_dot
+ *
+ ******************************************************************************/
+static void bench_q31_dot (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+
+  bench_sink += (uint32_t)q31_dot (dsp->q31[0], dsp->q31[1],
+                                   dsp->frames*dsp->num_channels);
+}
+
+/******************************************************************************
+ *
+ * @fn double saturate_reference (double, double)
+ *
+ * @brief Limit a value to a fixed point range, @a one is the scale of the
+ *        format
+ *
+ ******************************************************************************/
+static double saturate_reference (double value, double one)
+{
+  return (one-1.0<value) ? one-1.0 : (-one>value) ? -one : value;
+}
+
+/******************************************************************************
+ *
+ * @fn double fixed_reference (double, double, double)
+ *
+ * @brief Round to the nearest (half up) and saturate a product done in
+ *        floating point, @a one is the scale of the format
+ *
+ ******************************************************************************/
+static double fixed_reference (double a, double b, double one)
+{
+  return saturate_reference (floor (a*b/one+0.5), one);
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t check_fixed_point (dsp_context*)
+ *
+ * @brief Compare the fixed point kernels of the instruction set selected with
+ *        the same operations done in double over the sine of the oscillator
+ *
+ * The operands come from float samples so they have 24 significant bits and
+ * every product is exact in double, the rounding is the only difference. The
+ * first samples are the extremes, to check the saturation.
+ *
+ * @return uint32_t number of results that don't match
+ *
+ ******************************************************************************/
+static uint32_t check_fixed_point (dsp_context *dsp)
+{
+  const uint32_t samples = dsp->frames*dsp->num_channels;
+  const q15_t gain15 = (q15_t)(BENCH_FIXED_GAIN*Q_15);
+  const q31_t gain31 = (q31_t)(BENCH_FIXED_GAIN*Q_31);
+  const float extremes[] = { -1.0f, -1.0f, 1.0f, -1.0f, 0.99f, 0.99f };
+  uint32_t errors = 0;
+  double dot15 = 0.0;
+  double dot31 = 0.0;
+
+  /* a sine for the first operand and its negation for the second */
+  memcpy (dsp->converted, dsp->floats[0], samples*sizeof(float));
+  memcpy (dsp->converted, extremes, sizeof(extremes));
+  q15_from_float ((const float*)dsp->converted, dsp->q15[0], samples);
+  q31_from_float ((const float*)dsp->converted, dsp->q31[0], samples);
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    dsp->q15[1][n] = (Q15_MIN==dsp->q15[0][n]) ? Q15_MIN :
+        (q15_t)-dsp->q15[0][n];
+    dsp->q31[1][n] = (Q31_MIN==dsp->q31[0][n]) ? Q31_MIN : -dsp->q31[0][n];
+    dot15 += fixed_reference (dsp->q15[0][n], dsp->q15[1][n], Q_15);
+    dot31 += fixed_reference (dsp->q31[0][n], dsp->q31[1][n], Q_31);
+  }
+
+  if ( (dot15!=(double)q15_dot (dsp->q15[0], dsp->q15[1], samples))||
+       (dot31!=(double)q31_dot (dsp->q31[0], dsp->q31[1], samples)) )
+  {
+    errors++;
+  }
+
+  /* out = out+in*gain with out = in*gain*2 saturated */
+  memcpy (dsp->q15[1], dsp->q15[0], samples*sizeof(q15_t));
+  memcpy (dsp->q31[1], dsp->q31[0], samples*sizeof(q31_t));
+  q15_gain (dsp->q15[1], samples, gain15, 1u);
+  q31_gain (dsp->q31[1], samples, gain31, 1u);
+  q15_mix (dsp->q15[1], dsp->q15[0], samples, gain15);
+  q31_mix (dsp->q31[1], dsp->q31[0], samples, gain31);
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    double scaled15 = fixed_reference (dsp->q15[0][n], gain15, Q_15);
+    double scaled31 = fixed_reference (dsp->q31[0][n], gain31, Q_31);
+    double gained15 = saturate_reference (2.0*scaled15, Q_15);
+    double gained31 = saturate_reference (2.0*scaled31, Q_31);
+
+    if ( (saturate_reference (gained15+scaled15, Q_15)!=dsp->q15[1][n])||
+         (saturate_reference (gained31+scaled31, Q_31)!=dsp->q31[1][n]) )
+    {
+      errors++;
+    }
+  }
+
+  return errors;
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t check_filters (dsp_context*, convert_isa,
+ *                             const biquad_coefficients*)
+ *
+ * @brief Compare the biquad and FIR filters of an instruction set with the
+ *        scalar ones, the results must be the same bits
+ *
+ * The sine of the oscillator goes through the cascade and then the FIR for
+ * two calls, so the state is carried between them. One frame less than the
+ * buffer is processed to go through the tails of the kernels too.
+ *
+ * @return uint32_t number of samples that don't match, or 1 if a filter
+ *         can't be created
+ *
+ ******************************************************************************/
+static uint32_t check_filters (dsp_context *dsp, convert_isa isa,
+                               const biquad_coefficients *eq)
+{
+  const uint32_t frames = dsp->frames-1u;
+  const convert_isa isas[2] = { E_ISA_SCALAR, isa };
+  float taps[BENCH_FIR_TAPS];
+  float *outputs[2][BENCH_MAX_CHANNELS];
+  biquad_cascade cascade;
+  fir_filter fir;
+  uint32_t errors = 0;
+
+  /* a crude low pass, the taps only need products that round */
+  for (uint32_t n = 0; n<BENCH_FIR_TAPS; n++)
+  {
+    taps[n] = sinf (0.3f*(float)(n+1u))/(float)(n+1u);
+  }
+
+  /* the output of the resampler is big enough for both copies */
+  for (uint32_t ch = 0; ch<dsp->num_channels; ch++)
+  {
+    outputs[0][ch] = dsp->resampled[0]+ch*dsp->frames;
+    outputs[1][ch] = outputs[0][ch]+dsp->num_channels*dsp->frames;
+  }
+
+  for (uint32_t k = 0; k<2u; k++)
+  {
+    /* the kernels are taken when the filters are created */
+    sample_convert_set_isa (isas[k]);
+    if ( S_SUCCESS!=biquad_cascade_init (&cascade, dsp->num_channels,
+                                         BENCH_SECTIONS, frames) )
+    {
+      return 1u;
+    }
+    if ( S_SUCCESS!=fir_filter_init (&fir, dsp->num_channels, taps,
+                                     BENCH_FIR_TAPS, frames) )
+    {
+      biquad_cascade_destroy (&cascade);
+      return 1u;
+    }
+    for (uint32_t sec = 0; sec<BENCH_SECTIONS; sec++)
+    {
+      biquad_cascade_set_section (&cascade, FILTER_ALL_CHANNELS, sec, eq);
+    }
+
+    for (uint32_t ch = 0; ch<dsp->num_channels; ch++)
+    {
+      memcpy (outputs[k][ch], dsp->floats[ch], frames*sizeof(float));
+    }
+    for (uint32_t call = 0; call<2u; call++)
+    {
+      biquad_cascade_process (&cascade, outputs[k], frames);
+      fir_filter_process (&fir, outputs[k], frames);
+    }
+    fir_filter_destroy (&fir);
+    biquad_cascade_destroy (&cascade);
+  }
+
+  for (uint32_t ch = 0; ch<dsp->num_channels; ch++)
+  {
+    for (uint32_t n = 0; n<frames; n++)
+    {
+      if ( 0!=memcmp (&outputs[0][ch][n], &outputs[1][ch][n], sizeof(float)) )
+      {
+        errors++;
+      }
+    }
+  }
+
+  return errors;
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t check_mixer (dsp_context*, convert_isa)
+ *
+ * @brief Compare the mixer of an instruction set with the scalar one, the
+ *        results must be the same bits
+ *
+ * Each mixer gets @ref CHECK_VOICES oscillators of its own, the first call
+ * fades them in and the second ramps a new gain, both with one frame less
+ * than the buffer so the tails of the kernels ramp too.
+ *
+ * @return uint32_t number of samples that don't match, or 1 if a mixer
+ *         can't be created
+ *
+ ******************************************************************************/
+static uint32_t check_mixer (dsp_context *dsp, convert_isa isa)
+{
+  const uint32_t frames = dsp->frames-1u;
+  const convert_isa isas[2] = { E_ISA_SCALAR, isa };
+  float *outputs[2][BENCH_MAX_CHANNELS];
+  mixer mix;
+  uint32_t ids[CHECK_VOICES];
+  uint32_t errors = 0;
+
+  for (uint32_t ch = 0; ch<dsp->num_channels; ch++)
+  {
+    outputs[0][ch] = dsp->resampled[0]+ch*dsp->frames;
+    outputs[1][ch] = outputs[0][ch]+dsp->num_channels*dsp->frames;
+  }
+
+  for (uint32_t k = 0; k<2u; k++)
+  {
+    /* the kernel is taken when the mixer is created */
+    sample_convert_set_isa (isas[k]);
+    if ( S_SUCCESS!=mixer_init (&mix, dsp->num_channels, dsp->frames) )
+    {
+      return 1u;
+    }
+    for (uint32_t v = 0; v<CHECK_VOICES; v++)
+    {
+      oscillator *osc = &dsp->voices[k*CHECK_VOICES+v];
+      signal_source voice = { .fill = signal_oscillator_fill, .context = osc,
+          .gain = 1.0f };
+
+      oscillator_init (osc, 100.0f+37.0f*v, 48000u, 1.0f/CHECK_VOICES);
+      ids[v] = mixer_add_voice (&mix, &voice, 0.9f,
+                                2.0f*v/CHECK_VOICES-1.0f, NULL);
+    }
+
+    mixer_process (&mix, outputs[k], frames);
+    for (uint32_t v = 0; v<CHECK_VOICES; v++)
+    {
+      mixer_set_gain (&mix, ids[v], 0.3f);
+    }
+    mixer_process (&mix, outputs[k], frames);
+    mixer_destroy (&mix);
+  }
+
+  for (uint32_t ch = 0; ch<dsp->num_channels; ch++)
+  {
+    for (uint32_t n = 0; n<frames; n++)
+    {
+      if ( 0!=memcmp (&outputs[0][ch][n], &outputs[1][ch][n], sizeof(float)) )
+      {
+        errors++;
+      }
+    }
+  }
+
+  return errors;
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_scheduler (void*)
+ *
+ * @brief A period of @ref SCHED_CHANNELS channels filtered in the pool
+ *
+ ******************************************************************************/
+static void bench_scheduler (void *context)
+{
+  sched_context *sched = (sched_context*)context;
+
+  dsp_scheduler_run (&sched->scheduler, sched->jobs, SCHED_JOBS);
+  bench_sink += (uint32_t)sched->channels[0][0];
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_ring_local (void*)
+ *
+ * @brief Write and read a block of the ring in the same thread, this is the
+ *        cost of the ring without the cache line transfers
+ *
+ ******************************************************************************/
+static void bench_ring_local (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+  uint32_t block_bytes = dsp->frames*dsp->num_channels*sizeof(int16_t);
+  void *block;
+
+  block = spsc_ring_write_block (&dsp->ring);
+  memcpy (block, dsp->samples, block_bytes);
+  spsc_ring_commit_write (&dsp->ring);
+
+  block = spsc_ring_read_block (&dsp->ring);
+  memcpy (dsp->samples, block, block_bytes);
+  spsc_ring_release_read (&dsp->ring);
+}
+
+/******************************************************************************
+ *
+ * @fn void* ring_consumer (void*)
+ *
+ * @brief Thread reading @ref RING_HANDOFFS blocks of the ring
+ *
+ ******************************************************************************/
+static void* ring_consumer (void *context)
+{
+  dsp_context *dsp = (dsp_context*)context;
+  uint32_t block_bytes = dsp->frames*dsp->num_channels*sizeof(int16_t);
+  uint32_t received = 0u;
+  void *block;
+
+  while ( RING_HANDOFFS>received )
+  {
+    block = spsc_ring_read_block (&dsp->ring);
+    if ( NULL==block )
+    {
+      sched_yield ();
+      continue;
+    }
+    memcpy (dsp->samples, block, block_bytes);
+    spsc_ring_release_read (&dsp->ring);
+    received++;
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn double bench_ring_threads (dsp_context*)
+ *
+ * @brief Time of a block sent from one thread to another through the ring
+ *
+ * @return double nanoseconds per block, 0 if the thread couldn't be created
+ *
+ ******************************************************************************/
+static double bench_ring_threads (dsp_context *dsp)
+{
+  uint32_t block_bytes = dsp->frames*dsp->num_channels*sizeof(int16_t);
+  pthread_t consumer;
+  uint64_t start;
+  void *block;
+  double best = 0.0;
+  double ns_per_block;
+
+  for (uint32_t run = 0; run<BENCH_RUNS; run++)
+  {
+    start = get_time_ns ();
+    if ( 0!=pthread_create (&consumer, NULL, ring_consumer, dsp) )
+    {
+      return 0.0;
+    }
+
+    for (uint32_t sent = 0; sent<RING_HANDOFFS;)
+    {
+      block = spsc_ring_write_block (&dsp->ring);
+      if ( NULL==block )
+      {
+        sched_yield ();
+        continue;
+      }
+      memset (block, (int)sent, block_bytes);
+      spsc_ring_commit_write (&dsp->ring);
+      sent++;
+    }
+
+    pthread_join (consumer, NULL);
+    ns_per_block = (double)(get_time_ns ()-start)/RING_HANDOFFS;
+    if ( (0u==run)||(ns_per_block<best) )
+    {
+      best = ns_per_block;
+    }
+  }
+
+  return best;
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_configure_hw (void*)
+ *
+ * @brief Open a PCM, configure it with @ref configure_hw and close it
+ *
+ ******************************************************************************/
+static void bench_configure_hw (void *context)
+{
+  hw_context *hw = (hw_context*)context;
+  hw_configuration hw_config = hw->hw_config;
+  snd_pcm_t *handle;
+
+  if ( S_SUCCESS>snd_pcm_open (&handle, hw->pcm_name, SND_PCM_STREAM_PLAYBACK,
+                               PCM_OPEN_STANDARD_MODE) )
+  {
+    hw->status = S_ERROR;
+    return;
+  }
+
+  if ( S_SUCCESS!=configure_hw (handle, &hw_config) )
+  {
+    hw->status = S_ERROR;
+  }
+  snd_pcm_close (handle);
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_configure_hw_cached (void*)
+ *
+ * @brief Open a PCM, configure it with @ref hw_cache_configure and close it
+ *
+ ******************************************************************************/
+static void bench_configure_hw_cached (void *context)
+{
+  hw_context *hw = (hw_context*)context;
+  hw_configuration hw_config = hw->hw_config;
+  snd_pcm_t *handle;
+
+  if ( S_SUCCESS>snd_pcm_open (&handle, hw->pcm_name, SND_PCM_STREAM_PLAYBACK,
+                               PCM_OPEN_STANDARD_MODE) )
+  {
+    hw->status = S_ERROR;
+    return;
+  }
+
+  if ( S_SUCCESS!=hw_cache_configure (&hw->cache, handle, hw->pcm_name,
+                                      &hw_config) )
+  {
+    hw->status = S_ERROR;
+  }
+  snd_pcm_close (handle);
+}
+
+/******************************************************************************
+ *
+ * @fn void bench_warm_restart (void*)
+ *
+ * @brief Stop and prepare an open stream with @ref pcm_warm_stop, this is
+ *        what a restart costs compared to a close + open + configure
+ *
+ ******************************************************************************/
+static void bench_warm_restart (void *context)
+{
+  hw_context *hw = (hw_context*)context;
+
+  if ( S_SUCCESS!=pcm_warm_stop (hw->handle) )
+  {
+    hw->status = S_ERROR;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t run_dsp_benchmarks (FILE*)
+ *
+ * @brief Run the benchmarks that don't need a sound card
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the buffers
+ *         can't be allocated, the fixed point kernels of an instruction
+ *         set don't give the bits of the reference or its filters or mixer
+ *         don't give the bits of the scalar ones
+ *
+ ******************************************************************************/
+static int8_t run_dsp_benchmarks (FILE *output)
+{
+  static dsp_context dsp;
+  static float taps[BENCH_FFT_TAPS];
+  const uint32_t max_samples = BENCH_MAX_FRAMES*BENCH_MAX_CHANNELS;
+  biquad_coefficients eq;
+  biquad_coefficients resonance;
+  int8_t result = S_SUCCESS;
+  double ns;
+
+  /* the filters run in place over and over the same buffer, they don't
+   * change the signal so it doesn't grow or decay to denormals, the cost is
+   * the same with any coefficients. The decay to silence is measured apart
+   * with a resonant low pass that rings after a burst */
+  taps[0] = 1.0f;
+  biquad_design (&eq, E_BIQUAD_PEAKING, 1000.0f, 48000u, 1.0f, 0.0f);
+  biquad_design (&resonance, E_BIQUAD_LOWPASS, 1000.0f, 48000u,
+                 BENCH_RESONANCE_Q, 0.0f);
+
+  /* 4 bytes per sample is the biggest format */
+  dsp.samples = (int16_t*)calloc (max_samples, sizeof(int16_t));
+  dsp.converted = calloc (max_samples, sizeof(float));
+  dsp.floats[0] = (float*)calloc (max_samples, sizeof(float));
+  dsp.resampled[0] = (float*)calloc (2u*max_samples, sizeof(float));
+  if ( (NULL==dsp.samples)||(NULL==dsp.converted)||(NULL==dsp.floats[0])||
+       (NULL==dsp.resampled[0])||
+       (S_SUCCESS!=oscillator_init (&dsp.osc, 469.0f, 48000u, 0.5f)) )
+  {
+    printf ("run_dsp_benchmarks Error: allocating the buffers\n");
+    free (dsp.samples);
+    free (dsp.converted);
+    free (dsp.floats[0]);
+    free (dsp.resampled[0]);
+    return S_ERROR;
+  }
+
+  for (uint32_t f = 0; f<sizeof(bench_frames)/sizeof(bench_frames[0]); f++)
+  {
+    for (uint32_t c = 0;
+        c<sizeof(bench_channels)/sizeof(bench_channels[0]); c++)
+    {
+      dsp.frames = bench_frames[f];
+      dsp.num_channels = bench_channels[c];
+      for (uint32_t ch = 0; ch<dsp.num_channels; ch++)
+      {
+        dsp.floats[ch] = dsp.floats[0]+ch*dsp.frames;
+        dsp.resampled[ch] = dsp.resampled[0]+2u*ch*dsp.frames;
+      }
+
+      if ( 2u==dsp.num_channels )
+      {
+        ns = run_benchmark (bench_generate_sin, &dsp);
+        print_result (output, "generate_sin", "q14", dsp.frames,
+                      dsp.num_channels, ns);
+      }
+
+      ns = run_benchmark (bench_generate_sin_channels, &dsp);
+      print_result (output, "generate_sin_channels", "interleaved",
+                    dsp.frames, dsp.num_channels, ns);
+
+      ns = run_benchmark (bench_oscillator_fill, &dsp);
+      print_result (output, "oscillator_fill", "planar", dsp.frames,
+                    dsp.num_channels, ns);
+
+      /* the oscillator leaves a sine in the input of the conversions */
+      for (uint32_t i = 0; i<sizeof(bench_isas)/sizeof(bench_isas[0]); i++)
+      {
+        if ( S_SUCCESS!=sample_convert_set_isa (bench_isas[i]) )
+        {
+          continue;
+        }
+
+        for (uint32_t fmt = 0;
+            fmt<sizeof(bench_formats)/sizeof(bench_formats[0]); fmt++)
+        {
+          char variant[64];
+
+          dsp.format = bench_formats[fmt];
+          snprintf (variant, sizeof(variant), "%s_%s",
+                    sample_convert_isa_name (bench_isas[i]),
+                    snd_pcm_format_name (dsp.format));
+          ns = run_benchmark (bench_convert, &dsp);
+          print_result (output, "convert_float", variant, dsp.frames,
+                        dsp.num_channels, ns);
+
+          for (uint32_t lay = E_LAYOUT_INTERLEAVED; lay<=E_LAYOUT_PLANAR;
+              lay++)
+          {
+            const char *layout_names[] = { "interleaved", "planar" };
+            ssize_t sample_bytes = snd_pcm_format_size (dsp.format, 1u);
+
+            dsp.render = sample_convert_get_render_kernel (
+                dsp.format, dsp.num_channels, (channel_layout)lay);
+            if ( NULL==dsp.render )
+            {
+              continue;
+            }
+            for (uint32_t ch = 0; ch<dsp.num_channels; ch++)
+            {
+              dsp.rendered[ch] = (uint8_t*)dsp.converted+
+                  ch*dsp.frames*sample_bytes;
+            }
+            snprintf (variant, sizeof(variant), "%s_%s_%s",
+                      sample_convert_isa_name (bench_isas[i]),
+                      snd_pcm_format_name (dsp.format), layout_names[lay]);
+            ns = run_benchmark (bench_render, &dsp);
+            print_result (output, "render", variant, dsp.frames,
+                          dsp.num_channels, ns);
+          }
+        }
+
+        if ( 0u!=check_filters (&dsp, bench_isas[i], &eq) )
+        {
+          printf ("run_dsp_benchmarks Error: the %s filters don't match the "
+                  "scalar ones\n", sample_convert_isa_name (bench_isas[i]));
+          result = S_ERROR;
+        }
+        if ( 0u!=check_mixer (&dsp, bench_isas[i]) )
+        {
+          printf ("run_dsp_benchmarks Error: the %s mixer doesn't match the "
+                  "scalar one\n", sample_convert_isa_name (bench_isas[i]));
+          result = S_ERROR;
+        }
+        sample_convert_set_isa (bench_isas[i]);
+
+        /* the filters take the kernels of the instruction set selected */
+        if ( S_SUCCESS==biquad_cascade_init (&dsp.cascade, dsp.num_channels,
+                                             BENCH_SECTIONS, dsp.frames) )
+        {
+          for (uint32_t sec = 0; sec<BENCH_SECTIONS; sec++)
+          {
+            biquad_cascade_set_section (&dsp.cascade, FILTER_ALL_CHANNELS, sec,
+                                        &eq);
+          }
+          ns = run_benchmark (bench_biquad, &dsp);
+          print_result (output, "biquad_cascade",
+                        sample_convert_isa_name (bench_isas[i]), dsp.frames,
+                        dsp.num_channels, ns);
+
+          /* the sine in the buffer is the burst, the calls to warm up the
+           * benchmark let the ringing decay, so the runs measure the tail
+           * (denormals when the state isn't flushed) */
+          biquad_cascade_reset (&dsp.cascade);
+          for (uint32_t sec = 0; sec<BENCH_SECTIONS; sec++)
+          {
+            biquad_cascade_set_section (&dsp.cascade, FILTER_ALL_CHANNELS, sec,
+                                        &resonance);
+          }
+          bench_oscillator_fill (&dsp);
+          biquad_cascade_process (&dsp.cascade, dsp.floats, dsp.frames);
+          ns = run_benchmark (bench_biquad_decay, &dsp);
+          print_result (output, "biquad_decay",
+                        sample_convert_isa_name (bench_isas[i]), dsp.frames,
+                        dsp.num_channels, ns);
+          biquad_cascade_destroy (&dsp.cascade);
+          bench_oscillator_fill (&dsp);
+        }
+
+        if ( S_SUCCESS==fir_filter_init (&dsp.fir, dsp.num_channels, taps,
+                                         BENCH_FIR_TAPS, dsp.frames) )
+        {
+          ns = run_benchmark (bench_fir, &dsp);
+          print_result (output, "fir_filter",
+                        sample_convert_isa_name (bench_isas[i]), dsp.frames,
+                        dsp.num_channels, ns);
+          fir_filter_destroy (&dsp.fir);
+        }
+
+        for (uint32_t q = E_SRC_FAST; q<=E_SRC_BEST; q++)
+        {
+          const char *quality[] = { "fast", "medium", "best" };
+          char variant[64];
+
+          if ( S_SUCCESS!=resampler_init (&dsp.rs, dsp.num_channels,
+                                          BENCH_SRC_IN_RATE,
+                                          BENCH_SRC_OUT_RATE,
+                                          (resampler_quality)q, dsp.frames) )
+          {
+            continue;
+          }
+          snprintf (variant, sizeof(variant), "%s_%s",
+                    sample_convert_isa_name (bench_isas[i]), quality[q]);
+          ns = run_benchmark (bench_resampler, &dsp);
+          print_result (output, "resampler", variant, dsp.frames,
+                        dsp.num_channels, ns);
+          resampler_destroy (&dsp.rs);
+        }
+
+        if ( (2u==dsp.num_channels)&&
+             (S_SUCCESS==mixer_init (&dsp.mix, dsp.num_channels,
+                                     dsp.frames)) )
+        {
+          for (uint32_t v = 0; v<BENCH_VOICES; v++)
+          {
+            signal_source voice = { .fill = signal_oscillator_fill,
+                .context = &dsp.voices[v], .gain = 1.0f };
+
+            oscillator_init (&dsp.voices[v], 100.0f+10.0f*v, 48000u,
+                             1.0f/BENCH_VOICES);
+            mixer_add_voice (&dsp.mix, &voice, 1.0f,
+                             2.0f*v/BENCH_VOICES-1.0f, NULL);
+          }
+          ns = run_benchmark (bench_mixer, &dsp);
+          print_result (output, "mixer",
+                        sample_convert_isa_name (bench_isas[i]), dsp.frames,
+                        dsp.num_channels, ns);
+          mixer_destroy (&dsp.mix);
+        }
+
+        if ( 0u!=check_fixed_point (&dsp) )
+        {
+          printf ("run_dsp_benchmarks Error: the %s fixed point kernels "
+                  "don't match the float reference\n",
+                  sample_convert_isa_name (bench_isas[i]));
+          result = S_ERROR;
+        }
+        ns = run_benchmark (bench_q15_mix, &dsp);
+        print_result (output, "q15_mix",
+                      sample_convert_isa_name (bench_isas[i]), dsp.frames,
+                      dsp.num_channels, ns);
+        ns = run_benchmark (bench_q15_dot, &dsp);
+        print_result (output, "q15_dot",
+                      sample_convert_isa_name (bench_isas[i]), dsp.frames,
+                      dsp.num_channels, ns);
+        ns = run_benchmark (bench_q31_mix, &dsp);
+        print_result (output, "q31_mix",
+                      sample_convert_isa_name (bench_isas[i]), dsp.frames,
+                      dsp.num_channels, ns);
+        ns = run_benchmark (bench_q31_dot, &dsp);
+        print_result (output, "q31_dot",
+                      sample_convert_isa_name (bench_isas[i]), dsp.frames,
+                      dsp.num_channels, ns);
+      }
+      sample_convert_init ();
+
+      if ( S_SUCCESS==fft_convolver_init (&dsp.convolver, dsp.num_channels,
+                                          taps, BENCH_FFT_TAPS, dsp.frames) )
+      {
+        ns = run_benchmark (bench_fft_convolver, &dsp);
+        print_result (output, "fft_convolver", "4096_taps", dsp.frames,
+                      dsp.num_channels, ns);
+        fft_convolver_destroy (&dsp.convolver);
+      }
+
+      if ( S_SUCCESS==spsc_ring_init (&dsp.ring, RING_BLOCKS,
+                                      dsp.frames*dsp.num_channels*
+                                      sizeof(int16_t)) )
+      {
+        ns = run_benchmark (bench_ring_local, &dsp);
+        print_result (output, "spsc_ring", "same_thread", dsp.frames,
+                      dsp.num_channels, ns);
+
+        ns = bench_ring_threads (&dsp);
+        print_result (output, "spsc_ring", "two_threads", dsp.frames,
+                      dsp.num_channels, ns);
+        spsc_ring_destroy (&dsp.ring);
+      }
+    }
+  }
+
+  free (dsp.samples);
+  free (dsp.converted);
+  free (dsp.floats[0]);
+  free (dsp.resampled[0]);
+
+  return result;
+}
+
+/******************************************************************************
+ *
+ * @fn void run_scheduler_benchmarks (FILE*)
+ *
+ * @brief Time a period of @ref SCHED_CHANNELS channels with the biquads of
+ *        each group of channels in a job, with 1 thread up to the number of
+ *        CPUs, the time should go down with each thread added
+ *
+ ******************************************************************************/
+static void run_scheduler_benchmarks (FILE *output)
+{
+  static sched_context sched;
+  const uint32_t frames = 256u;
+  long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  biquad_coefficients eq;
+  float *buffer;
+  uint32_t ready = 0;
+  double ns;
+
+  buffer = (float*)calloc (SCHED_CHANNELS*frames, sizeof(float));
+  if ( NULL==buffer )
+  {
+    printf ("run_scheduler_benchmarks Error: allocating the buffers\n");
+    return;
+  }
+
+  biquad_design (&eq, E_BIQUAD_PEAKING, 1000.0f, 48000u, 1.0f, 0.0f);
+  for (uint32_t ch = 0; ch<SCHED_CHANNELS; ch++)
+  {
+    sched.channels[ch] = buffer+ch*frames;
+  }
+  for (; ready<SCHED_JOBS; ready++)
+  {
+    if ( S_SUCCESS!=biquad_cascade_init (&sched.cascades[ready], FILTER_LANES,
+                                         BENCH_SECTIONS, frames) )
+    {
+      break;
+    }
+    for (uint32_t sec = 0; sec<BENCH_SECTIONS; sec++)
+    {
+      biquad_cascade_set_section (&sched.cascades[ready], FILTER_ALL_CHANNELS,
+                                  sec, &eq);
+    }
+    sched.tasks[ready].process = biquad_cascade_stage;
+    sched.tasks[ready].user_data = &sched.cascades[ready];
+    sched.tasks[ready].channels = &sched.channels[ready*FILTER_LANES];
+    sched.tasks[ready].num_channels = FILTER_LANES;
+    sched.tasks[ready].frames = frames;
+    sched.jobs[ready].function = dsp_stage_job;
+    sched.jobs[ready].argument = &sched.tasks[ready];
+  }
+
+  for (uint32_t threads = 1;
+      (ready==SCHED_JOBS)&&(threads<=(uint32_t)cpus)&&
+      (threads<=DSP_MAX_WORKERS+1u); threads *= 2u)
+  {
+    char variant[32];
+
+    if ( S_SUCCESS!=dsp_scheduler_init (&sched.scheduler, threads, NULL) )
+    {
+      break;
+    }
+    snprintf (variant, sizeof(variant), "%u_threads", threads);
+    ns = run_benchmark (bench_scheduler, &sched);
+    print_result (output, "dsp_scheduler", variant, frames, SCHED_CHANNELS,
+                  ns);
+    dsp_scheduler_destroy (&sched.scheduler);
+  }
+
+  for (uint32_t j = 0; j<ready; j++)
+  {
+    biquad_cascade_destroy (&sched.cascades[j]);
+  }
+  free (buffer);
+}
+
+/******************************************************************************
+ *
+ * @fn void run_hw_benchmarks (FILE*, const char*)
+ *
+ * @brief Time the round trips of @ref configure_hw in a PCM
+ *
+ * The channels measured depend on what the PCM supports, a configuration
+ * that can't be applied is reported as a comment in the CSV
+ *
+ ******************************************************************************/
+static void run_hw_benchmarks (FILE *output, const char *pcm_name)
+{
+  hw_context hw = { .pcm_name = pcm_name, .hw_config = { .sample_rate =
+      48000u, .periods = 2, .period_size = 1024,
+      .sample_rate_direction = E_EXACT_CONFIG, .access_type =
+          SND_PCM_ACCESS_RW_INTERLEAVED, .num_channels = 2,
+      .frame_size_direction = E_EXACT_CONFIG, .format = SND_PCM_FORMAT_S16_LE } };
+  double ns;
+
+  for (uint32_t f = 0; f<sizeof(bench_frames)/sizeof(bench_frames[0]); f++)
+  {
+    for (uint32_t c = 0;
+        c<sizeof(bench_channels)/sizeof(bench_channels[0]); c++)
+    {
+      hw.hw_config.period_size = bench_frames[f];
+      hw.hw_config.num_channels = bench_channels[c];
+      hw.status = S_SUCCESS;
+
+      bench_configure_hw (&hw);
+      if ( S_SUCCESS!=hw.status )
+      {
+        fprintf (output, "# configure_hw,%s,%u,%u,unavailable\n", pcm_name,
+                 bench_frames[f], bench_channels[c]);
+        continue;
+      }
+
+      ns = run_benchmark (bench_configure_hw, &hw);
+      print_result (output, "configure_hw", pcm_name, bench_frames[f],
+                    bench_channels[c], ns);
+
+      hw_cache_init (&hw.cache);
+      ns = run_benchmark (bench_configure_hw_cached, &hw);
+      print_result (output, "configure_hw_cached", pcm_name,
+                    bench_frames[f], bench_channels[c], ns);
+      hw_cache_destroy (&hw.cache);
+
+      if ( S_SUCCESS<=snd_pcm_open (&hw.handle, pcm_name,
+                                    SND_PCM_STREAM_PLAYBACK,
+                                    PCM_OPEN_STANDARD_MODE) )
+      {
+        hw_configuration hw_config = hw.hw_config;
+
+        if ( S_SUCCESS==configure_hw (hw.handle, &hw_config) )
+        {
+          ns = run_benchmark (bench_warm_restart, &hw);
+          print_result (output, "warm_restart", pcm_name, bench_frames[f],
+                        bench_channels[c], ns);
+        }
+        snd_pcm_close (hw.handle);
+      }
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int main (int, char**)
+ *
+ * @brief Main function of the program
+ *
+ * @param argc  number of arguments
+ * @param argv  optional CSV file followed by the PCMs to measure
+ *
+ * @return int  @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int main (int argc, char **argv)
+{
+  const char *default_pcms[] = { "null", "hw:0,0" };
+  const char **pcms = default_pcms;
+  int num_pcms = 2;
+  FILE *output = stdout;
+  int8_t err;
+
+  if ( 1<argc )
+  {
+    output = fopen (argv[1], "w");
+    if ( NULL==output )
+    {
+      printf ("Error opening %s\n", argv[1]);
+      return S_ERROR;
+    }
+  }
+  if ( 2<argc )
+  {
+    pcms = (const char**)&argv[2];
+    num_pcms = argc-2;
+  }
+
+  sample_convert_init ();
+  fprintf (output, "benchmark,variant,frames,channels,ns_per_call,"
+           "ns_per_sample\n");
+
+  err = run_dsp_benchmarks (output);
+  run_scheduler_benchmarks (output);
+  for (int n = 0; n<num_pcms; n++)
+  {
+    run_hw_benchmarks (output, pcms[n]);
+  }
+
+  if ( stdout!=output )
+  {
+    fclose (output);
+  }
+
+  return (S_SUCCESS==err) ? S_SUCCESS : S_ERROR;
+}
+
+/*-------------- END OF FILE -------------------------------------------------*/
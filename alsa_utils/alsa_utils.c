@@ -43,6 +43,10 @@
  * Includes
  ------------------------------------------------------------------------------*/
 #include "alsa_utils.h"
+#include "device_probe.h"
+#include "oscillator.h"
+#include "rt_log.h"
+#include "sample_convert.h"
 
 /*------------------------------------------------------------------------------
  * Module Preprocessor Constants
@@ -56,42 +60,47 @@
  * Function Prototypes
  ------------------------------------------------------------------------------*/
 /******************************************************************************
- * @fn int8_t configure_hw(snd_pcm_t*, hw_configuration*)
+ * @fn int8_t negotiate_hw(snd_pcm_t*, hw_configuration*, snd_pcm_hw_params_t*)
  *
- * @brief Configure the HW of the sound card
+ * @brief Restrict the HW parameters of the sound card to a configuration
+ *        without applying them
  *
- * Set HW parameters defined in hw_configuration, part of this can
- * be done also with @a snd_pcm_set_params but I prefer to do it manually to
- * learn a little more of the APIs ¯\_(ツ)_/¯
+ * This is the negotiation part of @ref configure_hw, the result can be
+ * applied with @a snd_pcm_hw_params or kept to be applied again later (see
+ * @ref hw_cache_configure). If the device was loaded with
+ * @ref device_cache_load the request is checked first with
+ * @ref device_cache_fit
  *
- * @param[in] *sound_card_handle     pointer to the handle of the sound card
- * @param[in] *hw_config             pointer to desired hw configuration
+ * @param[in]     *sound_card_handle  pointer to the handle of the sound card
+ * @param[in,out] *hw_config          pointer to desired hw configuration, the
+ *                                    rate, period size and periods are
+ *                                    updated with the values supported
+ * @param[out]    *hw_params          negotiated parameters
  *
  * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
  *
  ******************************************************************************/
-int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config)
+int8_t negotiate_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config,
+                     snd_pcm_hw_params_t *hw_params)
 {
   int8_t err;
   snd_pcm_uframes_t buffer_size;
 
-  /* This structure contains information about    */
-  /* the hardware and can be used to specify the  */
-  /* configuration for the PCM stream. */
-  snd_pcm_hw_params_t *hw_params;
-
-  /**  @b snd_pcm_hw_params_alloca Allocate snd_pcm_hw_params_t structure
-   * on the stack.W e can also use @a snd_pcm_hw_params_malloc() to allocate the
-   * memory, but we'll be responsible for free it when we finish using
-   * @a snd_pcm_hw_params_free() */
-  snd_pcm_hw_params_alloca(&hw_params);
+  /* with the capabilities of @ref device_cache_load the requests that the
+   * device can't play fail here and the rest start inside its ranges */
+  err = device_cache_fit (snd_pcm_name (sound_card_handle),
+                          snd_pcm_stream (sound_card_handle), hw_config);
+  if ( S_SUCCESS!=err )
+  {
+    return S_ERROR;
+  }
 
   /** @b snd_pcm_hw_params_any Read all the hardware configuration for the
    * sound card before setting the configuration we want*/
   err = snd_pcm_hw_params_any (sound_card_handle, hw_params);
   if ( S_SUCCESS>err )
   {
-    printf ("configure_hw Error: getting HW configuration\n");
+    rt_log_printf ("configure_hw Error: getting HW configuration\n");
     return S_ERROR;
   }
 
@@ -110,7 +119,7 @@ int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config)
                                       hw_config->access_type);
   if ( S_SUCCESS>err )
   {
-    printf ("configure_hw Error: setting access type, Err = %d\n", err);
+    rt_log_printf ("configure_hw Error: setting access type, Err = %d\n", err);
     return S_ERROR;
   }
 
@@ -118,7 +127,8 @@ int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config)
                                       hw_config->format);
   if ( S_SUCCESS>err )
   {
-    printf ("configure_hw Error: setting audio format type, Err = %d\n", err);
+    rt_log_printf ("configure_hw Error: setting audio format type, Err = %d\n",
+                   err);
     return S_ERROR;
   }
 
@@ -133,20 +143,22 @@ int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config)
                                          &hw_config->sample_rate_direction);
   if ( S_SUCCESS>err )
   {
-    printf ("configure_hw Error: setting sample rate, Err = %d\n", err);
+    rt_log_printf ("configure_hw Error: setting sample rate, Err = %d\n", err);
     return S_ERROR;
   }
   if ( hw_config->sample_rate!=desired_sample_rate )
   {
-    printf ("configure_hw Warning: rate %d not supported, using = %d Hz\n",
-            desired_sample_rate, hw_config->sample_rate);
+    rt_log_printf ("configure_hw Warning: rate %d not supported, "
+                   "using = %d Hz\n",
+                   desired_sample_rate, hw_config->sample_rate);
   }
 
   err = snd_pcm_hw_params_set_channels (sound_card_handle, hw_params,
                                         hw_config->num_channels);
   if ( S_SUCCESS>err )
   {
-    printf ("configure_hw Error: setting number of channels, Err = %d\n", err);
+    rt_log_printf ("configure_hw Error: setting number of channels, Err = %d\n",
+                   err);
     return S_ERROR;
   }
 
@@ -155,7 +167,7 @@ int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config)
                                             &hw_config->frame_size_direction);
   if ( S_SUCCESS>err )
   {
-    printf ("configure_hw Error: setting number of periods\n");
+    rt_log_printf ("configure_hw Error: setting number of periods\n");
     return S_ERROR;
   }
 
@@ -182,7 +194,50 @@ int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config)
                                                 &buffer_size);
   if ( S_SUCCESS>err )
   {
-    printf ("configure_hw Error: setting number buffer size, Err = %d\n", err);
+    rt_log_printf ("configure_hw Error: setting number buffer size, Err = %d\n",
+                   err);
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ * @fn int8_t configure_hw(snd_pcm_t*, hw_configuration*)
+ *
+ * @brief Configure the HW of the sound card
+ *
+ * Set HW parameters defined in hw_configuration, part of this can
+ * be done also with @a snd_pcm_set_params but I prefer to do it manually to
+ * learn a little more of the APIs ¯\_(ツ)_/¯
+ *
+ * On success @a render gets the kernel of the negotiated tuple, see
+ * @ref sample_convert_get_render_kernel
+ *
+ * @param[in] *sound_card_handle     pointer to the handle of the sound card
+ * @param[in] *hw_config             pointer to desired hw configuration
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config)
+{
+  int8_t err;
+
+  /* This structure contains information about    */
+  /* the hardware and can be used to specify the  */
+  /* configuration for the PCM stream. */
+  snd_pcm_hw_params_t *hw_params;
+
+  /**  @b snd_pcm_hw_params_alloca Allocate snd_pcm_hw_params_t structure
+   * on the stack.W e can also use @a snd_pcm_hw_params_malloc() to allocate the
+   * memory, but we'll be responsible for free it when we finish using
+   * @a snd_pcm_hw_params_free() */
+  snd_pcm_hw_params_alloca(&hw_params);
+
+  err = negotiate_hw (sound_card_handle, hw_config, hw_params);
+  if ( S_SUCCESS!=err )
+  {
     return S_ERROR;
   }
 
@@ -192,14 +247,195 @@ int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config)
   err = snd_pcm_hw_params (sound_card_handle, hw_params);
   if ( S_SUCCESS>err )
   {
-    printf ("configure_hw Error: setting HW params, Err = %d\n", err);
+    rt_log_printf ("configure_hw Error: setting HW params, Err = %d\n", err);
+    return S_ERROR;
+  }
+
+  /* the hot loop of the stream doesn't need to check the configuration */
+  hw_config->render = sample_convert_get_render_kernel (
+      hw_config->format, hw_config->num_channels,
+      get_channel_layout (hw_config->access_type));
+
+  rt_log_printf ("HW configuration successful\n");
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ * @fn int8_t configure_sw(snd_pcm_t*, sw_configuration*)
+ *
+ * @brief Configure the SW parameters of the sound card
+ *
+ * The SW parameters must be set after the HW parameters (@ref configure_hw)
+ * and they can be changed at any time, even while the stream is running.
+ * They control:
+ * @li when @a snd_pcm_wait / poll wakes up the application (avail_min)
+ * @li when the stream starts by itself (start_threshold), a bigger value
+ *     means more data buffered before starting, so more margin against the
+ *     first underrun
+ * @li when the stream stops on underrun (stop_threshold)
+ * @li silence filling of the played area (silence_threshold/size), so an
+ *     underrun plays silence instead of repeating old data
+ * @li the timestamps reported by @a snd_pcm_status (timestamps)
+ *
+ * @param[in] *sound_card_handle     pointer to the handle of the sound card
+ * @param[in] *sw_config             pointer to desired sw configuration
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t configure_sw (snd_pcm_t *sound_card_handle, sw_configuration *sw_config)
+{
+  int err;
+  snd_pcm_uframes_t boundary;
+  snd_pcm_uframes_t value;
+  snd_pcm_sw_params_t *sw_params;
+
+  snd_pcm_sw_params_alloca(&sw_params);
+
+  /** @b snd_pcm_sw_params_current Read the current configuration, this
+   * already contains the defaults calculated from the HW parameters */
+  err = snd_pcm_sw_params_current (sound_card_handle, sw_params);
+  if ( S_SUCCESS>err )
+  {
+    rt_log_printf ("configure_sw Error: getting SW configuration, Err = %d\n",
+                   err);
+    return S_ERROR;
+  }
+
+  /** @b snd_pcm_sw_params_get_boundary The boundary is the biggest value
+   * that the ring buffer pointers can take, used as "infinite" */
+  err = snd_pcm_sw_params_get_boundary (sw_params, &boundary);
+  if ( S_SUCCESS>err )
+  {
+    rt_log_printf ("configure_sw Error: getting boundary, Err = %d\n", err);
+    return S_ERROR;
+  }
+
+  if ( SW_KEEP_DEFAULT!=sw_config->avail_min )
+  {
+    err = snd_pcm_sw_params_set_avail_min (sound_card_handle, sw_params,
+                                           sw_config->avail_min);
+    if ( S_SUCCESS>err )
+    {
+      rt_log_printf ("configure_sw Error: setting avail_min, Err = %d\n", err);
+      return S_ERROR;
+    }
+  }
+
+  if ( SW_KEEP_DEFAULT!=sw_config->start_threshold )
+  {
+    value = (SW_BOUNDARY==sw_config->start_threshold) ?
+        boundary : sw_config->start_threshold;
+    err = snd_pcm_sw_params_set_start_threshold (sound_card_handle, sw_params,
+                                                 value);
+    if ( S_SUCCESS>err )
+    {
+      rt_log_printf ("configure_sw Error: setting start threshold, Err = %d\n",
+                     err);
+      return S_ERROR;
+    }
+  }
+
+  if ( SW_KEEP_DEFAULT!=sw_config->stop_threshold )
+  {
+    value = (SW_BOUNDARY==sw_config->stop_threshold) ?
+        boundary : sw_config->stop_threshold;
+    err = snd_pcm_sw_params_set_stop_threshold (sound_card_handle, sw_params,
+                                                value);
+    if ( S_SUCCESS>err )
+    {
+      rt_log_printf ("configure_sw Error: setting stop threshold, Err = %d\n",
+                     err);
+      return S_ERROR;
+    }
+  }
+
+  err = snd_pcm_sw_params_set_silence_threshold (sound_card_handle, sw_params,
+                                                 sw_config->silence_threshold);
+  if ( S_SUCCESS>err )
+  {
+    rt_log_printf ("configure_sw Error: setting silence threshold, Err = %d\n",
+                   err);
+    return S_ERROR;
+  }
+
+  value = (SW_BOUNDARY==sw_config->silence_size) ?
+      boundary : sw_config->silence_size;
+  err = snd_pcm_sw_params_set_silence_size (sound_card_handle, sw_params,
+                                            value);
+  if ( S_SUCCESS>err )
+  {
+    rt_log_printf ("configure_sw Error: setting silence size, Err = %d\n", err);
+    return S_ERROR;
+  }
+
+  err = snd_pcm_sw_params_set_period_event (sound_card_handle, sw_params,
+                                            sw_config->period_event);
+  if ( S_SUCCESS>err )
+  {
+    rt_log_printf ("configure_sw Error: setting period event, Err = %d\n", err);
+    return S_ERROR;
+  }
+
+  err = snd_pcm_sw_params_set_tstamp_mode (
+      sound_card_handle, sw_params,
+      (0u!=sw_config->timestamps) ? SND_PCM_TSTAMP_ENABLE : SND_PCM_TSTAMP_NONE);
+  if ( S_SUCCESS>err )
+  {
+    rt_log_printf ("configure_sw Error: setting timestamp mode, Err = %d\n",
+                   err);
+    return S_ERROR;
+  }
+
+  /** @b snd_pcm_sw_params Apply the configuration to the sound card */
+  err = snd_pcm_sw_params (sound_card_handle, sw_params);
+  if ( S_SUCCESS>err )
+  {
+    rt_log_printf ("configure_sw Error: setting SW params, Err = %d\n", err);
     return S_ERROR;
   }
 
-  printf ("HW configuration successful\n");
   return S_SUCCESS;
 }
 
+/******************************************************************************
+ *
+ * @fn int8_t set_monotonic_timestamps (snd_pcm_t*)
+ *
+ * @brief Take the timestamps of the PCM from CLOCK_MONOTONIC
+ *
+ * By default the timestamps of @a snd_pcm_status / @a snd_pcm_htimestamp
+ * come from @a gettimeofday, with CLOCK_MONOTONIC they can be compared with
+ * @a clock_gettime and timers, and they don't jump when the wall clock is
+ * set. The timestamps must be enabled (@ref sw_configuration timestamps)
+ *
+ * @param[in] *sound_card_handle     pointer to the handle of the sound card
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the device
+ *         or the kernel don't support it
+ *
+ ******************************************************************************/
+int8_t set_monotonic_timestamps (snd_pcm_t *sound_card_handle)
+{
+  int err;
+  snd_pcm_sw_params_t *sw_params;
+
+  snd_pcm_sw_params_alloca(&sw_params);
+
+  err = snd_pcm_sw_params_current (sound_card_handle, sw_params);
+  if ( S_SUCCESS<=err )
+  {
+    err = snd_pcm_sw_params_set_tstamp_type (sound_card_handle, sw_params,
+                                             SND_PCM_TSTAMP_TYPE_MONOTONIC);
+  }
+  if ( S_SUCCESS<=err )
+  {
+    err = snd_pcm_sw_params (sound_card_handle, sw_params);
+  }
+
+  return (S_SUCCESS>err) ? S_ERROR : S_SUCCESS;
+}
+
 /******************************************************************************
  *
  * @fn int8_t generate_sin (int16_t*, uint16_t, uint16_t, uint32_t)
@@ -207,7 +443,8 @@ int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config)
  * @brief Generate a sine wave
  *
  * Generate a sine wave with the predefined frequency and it will returned in
- * Q14
+ * Q14, the samples come from an @ref oscillator so we don't call @a sin() for
+ * each sample
  *
  * @note This function is supposed to be used in interleaved mode, for this
  *       reason the samples are stored directly in interleaved mode, e.g.
@@ -216,6 +453,9 @@ int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config)
  *       3. data[2] = val2, data for channel 1
  *       4. data[3] = val2, data for channel 2
  *
+ * @note The wave always starts with phase 0, use an @ref oscillator directly
+ *       to keep the phase between calls
+ *
  * @param[out] *data    Buffer to store the generated wave
  * @param       f       Frequency of the sine wave
  * @param       fs      Sampling frequency
@@ -227,21 +467,392 @@ int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config)
 int8_t generate_sin (int16_t *data, uint16_t f, uint16_t fs,
                      uint32_t data_length)
 {
+  int16_t *channels[1] = { data };
 
-  float sin_val;
-  uint8_t err = S_ERROR;
+  return generate_sin_channels (channels, f, fs, data_length, 2u,
+                                E_LAYOUT_INTERLEAVED);
+}
 
-  if ( NULL!=data )
+/******************************************************************************
+ *
+ * @fn int8_t generate_sin_channels (int16_t**, uint16_t, uint32_t, uint32_t,
+ *                                   uint32_t, channel_layout)
+ *
+ * @brief Generate a sine wave in Q14 for any number of channels
+ *
+ * All the channels get the same sine wave, see @ref channel_layout for the
+ * organization of the buffers:
+ * @li interleaved: data[0] must have space for frames*num_channels samples
+ * @li planar: data[0]..data[num_channels-1] must have space for frames
+ *     samples, they can be given directly to @a snd_pcm_writen
+ *
+ * @param[out] *data            Buffers to store the generated wave
+ * @param       f               Frequency of the sine wave
+ * @param       fs              Sampling frequency
+ * @param       frames          Number of frames to generate
+ * @param       num_channels    Number of channels of the buffers
+ * @param       layout          Organization of the buffers
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t generate_sin_channels (int16_t **data, uint16_t f, uint32_t fs,
+                              uint32_t frames, uint32_t num_channels,
+                              channel_layout layout)
+{
+  oscillator osc;
+  int16_t sample;
+  int16_t *buffer;
+
+  if ( (NULL==data)||(NULL==data[0])||(0u==num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  if ( S_SUCCESS!=oscillator_init (&osc, f, fs, Q_14) )
+  {
+    return S_ERROR;
+  }
+
+  if ( E_LAYOUT_INTERLEAVED==layout )
   {
-    for (uint32_t n = 0; n<data_length; n++)
+    buffer = data[0];
+    for (uint32_t n = 0; n<frames; n++)
+    {
+      sample = (int16_t)oscillator_tick (&osc);
+      for (uint32_t ch = 0; ch<num_channels; ch++)
+      {
+        buffer[n*num_channels+ch] = sample;
+      }
+    }
+  }
+  else
+  {
+    /* generate the first channel and copy it to the rest */
+    for (uint32_t n = 0; n<frames; n++)
+    {
+      data[0][n] = (int16_t)oscillator_tick (&osc);
+    }
+    for (uint32_t ch = 1; ch<num_channels; ch++)
+    {
+      if ( NULL==data[ch] )
+      {
+        return S_ERROR;
+      }
+      memcpy (data[ch], data[0], frames*sizeof(int16_t));
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn channel_layout get_channel_layout (snd_pcm_access_t)
+ *
+ * @brief Get the layout of the buffers used by an access type
+ *
+ * @param access_type   access type configured in the sound card
+ *
+ * @return channel_layout @a E_LAYOUT_PLANAR for the non interleaved access
+ *         types, @a E_LAYOUT_INTERLEAVED otherwise
+ *
+ ******************************************************************************/
+channel_layout get_channel_layout (snd_pcm_access_t access_type)
+{
+  if ( (SND_PCM_ACCESS_RW_NONINTERLEAVED==access_type)||
+       (SND_PCM_ACCESS_MMAP_NONINTERLEAVED==access_type) )
+  {
+    return E_LAYOUT_PLANAR;
+  }
+
+  return E_LAYOUT_INTERLEAVED;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t setup_channel_areas (snd_pcm_channel_area_t*, void*,
+ *                                 snd_pcm_uframes_t, uint32_t, channel_layout,
+ *                                 snd_pcm_format_t)
+ *
+ * @brief Describe one of our buffers with channel areas
+ *
+ * This way the same @ref mmap_render_callback can render in the ring buffer
+ * of the sound card (MMAP access) or in a buffer that is written later with
+ * @a snd_pcm_writei / @a snd_pcm_writen (RW access). In planar mode the
+ * channels are consecutive in the buffer (ch0 frames, ch1 frames, ...)
+ *
+ * @param[out] *areas          one area per channel
+ * @param[in]  *buffer         buffer described by the areas
+ * @param       frames         frames of each channel in the buffer
+ * @param       num_channels   number of channels
+ * @param       layout         organization of the buffer
+ * @param       format         format of the samples
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t setup_channel_areas (snd_pcm_channel_area_t *areas, void *buffer,
+                            snd_pcm_uframes_t frames, uint32_t num_channels,
+                            channel_layout layout, snd_pcm_format_t format)
+{
+  int width = snd_pcm_format_physical_width (format);
+
+  if ( (NULL==areas)||(NULL==buffer)||(0>=width) )
+  {
+    return S_ERROR;
+  }
+
+  for (uint32_t ch = 0; ch<num_channels; ch++)
+  {
+    if ( E_LAYOUT_INTERLEAVED==layout )
+    {
+      areas[ch].addr = buffer;
+      areas[ch].first = ch*(unsigned int)width;
+      areas[ch].step = num_channels*(unsigned int)width;
+    }
+    else
+    {
+      areas[ch].addr = (uint8_t*)buffer+ch*frames*((unsigned int)width/8u);
+      areas[ch].first = 0u;
+      areas[ch].step = (unsigned int)width;
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void* mmap_area_address (const snd_pcm_channel_area_t*,
+ *                              snd_pcm_uframes_t)
+ *
+ * @brief Get the address of a sample inside a channel area
+ *
+ * The channel areas describe where the samples of each channel live inside
+ * the ring buffer, @a first and @a step are given in bits so this is the
+ * same for interleaved and non interleaved buffers
+ *
+ * @param[in] *area     channel area of the channel we want to access
+ * @param      offset   frame inside the area
+ *
+ * @return void* pointer to the sample of the channel at the given frame
+ *
+ ******************************************************************************/
+void* mmap_area_address (const snd_pcm_channel_area_t *area,
+                         snd_pcm_uframes_t offset)
+{
+  return (uint8_t*)area->addr+((area->first+offset*area->step)>>3);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t mmap_write_period (snd_pcm_t*, snd_pcm_uframes_t,
+ *                               mmap_render_callback, void*)
+ *
+ * @brief Write a period using the MMAP access, the data is rendered directly
+ *        in the ring buffer of the sound card
+ *
+ * Instead of generating the audio in our own buffer and copying it with
+ * @a snd_pcm_writei, we ask ALSA for the free area of the ring buffer with
+ * @b snd_pcm_mmap_begin, let the callback render there and give the frames
+ * back with @b snd_pcm_mmap_commit. The free area can be smaller than a period
+ * (e.g. when it wraps at the end of the ring buffer) so the callback can be
+ * called several times for the same period.
+ *
+ * @note The sound card must be configured with
+ *       @a SND_PCM_ACCESS_MMAP_INTERLEAVED or
+ *       @a SND_PCM_ACCESS_MMAP_NONINTERLEAVED, with MMAP nobody starts the
+ *       stream for us, so it's started here once the ring buffer is full
+ *
+ * @param[in] *sound_card_handle     pointer to the handle of the sound card
+ * @param      period_size           number of frames to write
+ * @param      render                callback used to render the frames
+ * @param[in] *user_data             pointer given to the callback
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t mmap_write_period (snd_pcm_t *sound_card_handle,
+                          snd_pcm_uframes_t period_size,
+                          mmap_render_callback render, void *user_data)
+{
+  int err;
+  const snd_pcm_channel_area_t *areas;
+  snd_pcm_uframes_t offset;
+  snd_pcm_uframes_t frames;
+  snd_pcm_sframes_t avail;
+  snd_pcm_sframes_t committed;
+  snd_pcm_uframes_t remaining = period_size;
+
+  if ( (NULL==sound_card_handle)||(NULL==render) )
+  {
+    return S_ERROR;
+  }
+
+  while ( 0<remaining )
+  {
+    /** @b snd_pcm_avail_update Get the number of frames that can be written,
+     * in MMAP mode this also synchronizes the ring buffer pointers */
+    avail = snd_pcm_avail_update (sound_card_handle);
+    if ( 0>avail )
+    {
+      err = snd_pcm_recover (sound_card_handle, (int)avail, 1);
+      if ( S_SUCCESS>err )
+      {
+        rt_log_printf ("mmap_write_period Error: recovering stream, Err = %d\n",
+                       err);
+        return S_ERROR;
+      }
+      continue;
+    }
+
+    if ( 0==avail )
+    {
+      /* the ring buffer is full, start the stream if it's still waiting for
+       * data, otherwise wait until the sound card consumes something */
+      if ( SND_PCM_STATE_PREPARED==snd_pcm_state (sound_card_handle) )
+      {
+        err = snd_pcm_start (sound_card_handle);
+      }
+      else
+      {
+        err = snd_pcm_wait (sound_card_handle, -1);
+      }
+
+      if ( S_SUCCESS>err )
+      {
+        err = snd_pcm_recover (sound_card_handle, err, 1);
+        if ( S_SUCCESS>err )
+        {
+          rt_log_printf ("mmap_write_period Error: waiting for the sound "
+                         "card, Err = %d\n", err);
+          return S_ERROR;
+        }
+      }
+      continue;
+    }
+
+    /** @b snd_pcm_mmap_begin Get the channel areas of the ring buffer, on
+     * input @a frames is what we want to write, on output is the number of
+     * contiguous frames that we can actually write */
+    frames = remaining;
+    err = snd_pcm_mmap_begin (sound_card_handle, &areas, &offset, &frames);
+    if ( S_SUCCESS>err )
+    {
+      err = snd_pcm_recover (sound_card_handle, err, 1);
+      if ( S_SUCCESS>err )
+      {
+        rt_log_printf ("mmap_write_period Error: mmap begin, Err = %d\n", err);
+        return S_ERROR;
+      }
+      continue;
+    }
+
+    if ( S_SUCCESS!=render (areas, offset, frames, user_data) )
+    {
+      /* nothing was rendered, but the transaction must be closed */
+      snd_pcm_mmap_commit (sound_card_handle, offset, 0);
+      rt_log_printf ("mmap_write_period Error: rendering audio\n");
+      return S_ERROR;
+    }
+
+    /** @b snd_pcm_mmap_commit Give the rendered frames to the sound card */
+    committed = snd_pcm_mmap_commit (sound_card_handle, offset, frames);
+    if ( (0>committed)||((snd_pcm_uframes_t)committed!=frames) )
+    {
+      err = snd_pcm_recover (sound_card_handle,
+                             (0>committed) ? (int)committed : -EPIPE, 1);
+      if ( S_SUCCESS>err )
+      {
+        rt_log_printf ("mmap_write_period Error: mmap commit, Err = %d\n", err);
+        return S_ERROR;
+      }
+      continue;
+    }
+
+    remaining -= frames;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn snd_pcm_sframes_t mmap_write_available (snd_pcm_t*, snd_pcm_uframes_t,
+ *                                             mmap_render_callback, void*)
+ *
+ * @brief Render in the ring buffer only the frames that are free now
+ *
+ * Non blocking version of @ref mmap_write_period, it never waits for the
+ * sound card so it can be called from the callback of a
+ * @ref pcm_event_loop.
+ *
+ * @note Unlike @ref mmap_write_period the stream is not started here, the
+ *       caller decides when (e.g. linked devices must start together)
+ *
+ * @param[in] *sound_card_handle     pointer to the handle of the sound card
+ * @param      max_frames            maximum number of frames to write
+ * @param      render                callback used to render the frames
+ * @param[in] *user_data             pointer given to the callback
+ *
+ * @return snd_pcm_sframes_t number of frames written, negative error code on
+ *         failure (after trying to recover)
+ *
+ ******************************************************************************/
+snd_pcm_sframes_t mmap_write_available (snd_pcm_t *sound_card_handle,
+                                        snd_pcm_uframes_t max_frames,
+                                        mmap_render_callback render,
+                                        void *user_data)
+{
+  int err;
+  const snd_pcm_channel_area_t *areas;
+  snd_pcm_uframes_t offset;
+  snd_pcm_uframes_t frames;
+  snd_pcm_sframes_t avail;
+  snd_pcm_sframes_t committed;
+  snd_pcm_uframes_t written = 0;
+
+  avail = snd_pcm_avail_update (sound_card_handle);
+  if ( 0>avail )
+  {
+    err = snd_pcm_recover (sound_card_handle, (int)avail, 1);
+    return (S_SUCCESS>err) ? err : 0;
+  }
+
+  if ( (snd_pcm_uframes_t)avail>max_frames )
+  {
+    avail = (snd_pcm_sframes_t)max_frames;
+  }
+
+  /* the free area can wrap at the end of the ring buffer */
+  while ( written<(snd_pcm_uframes_t)avail )
+  {
+    frames = (snd_pcm_uframes_t)avail-written;
+    err = snd_pcm_mmap_begin (sound_card_handle, &areas, &offset, &frames);
+    if ( S_SUCCESS>err )
+    {
+      err = snd_pcm_recover (sound_card_handle, err, 1);
+      return (S_SUCCESS>err) ? err : (snd_pcm_sframes_t)written;
+    }
+
+    if ( S_SUCCESS!=render (areas, offset, frames, user_data) )
+    {
+      /* nothing was rendered, but the transaction must be closed */
+      snd_pcm_mmap_commit (sound_card_handle, offset, 0);
+      return -EIO;
+    }
+
+    committed = snd_pcm_mmap_commit (sound_card_handle, offset, frames);
+    if ( (0>committed)||((snd_pcm_uframes_t)committed!=frames) )
     {
-      sin_val = sin (2*M_PI*n*f/fs);
-      data[2*n] = (uint16_t)(sin_val*Q_14);
-      data[2*n+1] = data[2*n];
+      err = snd_pcm_recover (sound_card_handle,
+                             (0>committed) ? (int)committed : -EPIPE, 1);
+      return (S_SUCCESS>err) ? err : (snd_pcm_sframes_t)written;
     }
-    err = S_SUCCESS;
+    written += frames;
   }
 
-  return err;
+  return (snd_pcm_sframes_t)written;
 }
 /*-------------- END OF FILE -------------------------------------------------*/
@@ -54,7 +54,18 @@
 #define S_SUCCESS               (0x00) /**< used to return success */
 #define S_ERROR                 (0x01) /**< used to return error */
 #define PCM_OPEN_STANDARD_MODE  (0x00) /**< define standard mode */
+#define PCM_OPEN_NONBLOCK_MODE  (SND_PCM_NONBLOCK) /**< non blocking mode, see
+                                                        @ref pcm_event_loop */
 #define Q_14                    (1<<14)/**< Used to convert from float to Q14*/
+#define MAX_CHANNELS            (64u)  /**< Maximum number of channels handled
+                                            by the generators */
+
+#define SW_KEEP_DEFAULT         (0u)   /**< keep the ALSA default of a sw
+                                            threshold */
+#define SW_BOUNDARY             ((snd_pcm_uframes_t)-1) /**< replaced by the
+                                            boundary of the ring buffer, used
+                                            to never stop on xrun or to fill
+                                            all the played area with silence */
 
 /*------------------------------------------------------------------------------
  * Configuration Constants
@@ -94,6 +105,19 @@ typedef enum
 
 } sub_unit_direction;
 
+/** Kernel that converts a period of float audio, one buffer per channel, to
+ * the format and layout of the sound card, see
+ * @ref sample_convert_get_render_kernel
+ *
+ * @param[in]  **in           one float buffer for each channel
+ * @param[out] **out          output buffers, only the first one is used when
+ *                            the access is interleaved
+ * @param        frames       number of frames to convert
+ * @param        num_channels number of channels, only used by the generic
+ *                            kernels */
+typedef void (*render_kernel) (float **in, void **out, uint32_t frames,
+                               uint32_t num_channels);
+
 /** Structure used to setup the desired hw configuration */
 typedef struct
 {
@@ -115,13 +139,106 @@ typedef struct
   uint32_t num_channels; /**< Number of channels to use */
   snd_pcm_format_t format; /**< Audio format to be used, seed@ref configure_hw
    @b snd_pcm_hw_params_set_format*/
+
+  render_kernel render; /**< set by @ref configure_hw to the kernel of the
+   negotiated format, channels and access, NULL if the format has none */
 } hw_configuration;
 
+/** Structure used to setup the software parameters of the PCM, they control
+ * when the application is woken up and when the stream starts/stops. All the
+ * values are in frames */
+typedef struct
+{
+  snd_pcm_uframes_t avail_min; /**< minimum free frames (playback) or frames
+   available (capture) to wake up the application, @ref SW_KEEP_DEFAULT to
+   use one period */
+
+  snd_pcm_uframes_t start_threshold; /**< frames that must be written before
+   the stream starts automatically, @ref SW_KEEP_DEFAULT to keep the ALSA
+   default (start with the first write) */
+
+  snd_pcm_uframes_t stop_threshold; /**< when the free frames reach this
+   value the stream stops (xrun), @ref SW_KEEP_DEFAULT to use the buffer size
+   or @ref SW_BOUNDARY to never stop */
+
+  snd_pcm_uframes_t silence_threshold; /**< when the frames left to play are
+   less than this, silence is written ahead, 0 disables it */
+
+  snd_pcm_uframes_t silence_size; /**< frames of silence written when the
+   silence threshold is reached, @ref SW_BOUNDARY to overwrite all the
+   played area */
+
+  uint8_t period_event; /**< 1 to wake up also on each period interrupt,
+   needed when avail_min is bigger than a period */
+
+  uint8_t timestamps; /**< 1 to get in snd_pcm_status the time of the last
+   hardware pointer update instead of the time of the call */
+} sw_configuration;
+
+/** Organization of the channels in the audio buffers, the buffers are always
+ * given as an array of pointers:
+ * @li @a E_LAYOUT_INTERLEAVED only the first pointer is used, the samples of
+ *     all the channels of a frame are consecutive (L R L R ...), this is what
+ *     @a snd_pcm_writei expects
+ * @li @a E_LAYOUT_PLANAR one pointer per channel, each buffer contains only
+ *     the samples of its channel, this is what @a snd_pcm_writen expects */
+typedef enum
+{
+  E_LAYOUT_INTERLEAVED = 0, /**< all the channels in one buffer */
+  E_LAYOUT_PLANAR = 1 /**< one buffer per channel (non interleaved) */
+} channel_layout;
+
+/** Callback used by @ref mmap_write_period to render audio directly in the
+ * ring buffer of the sound card
+ *
+ * @param[in] *areas      channel areas returned by @b snd_pcm_mmap_begin
+ * @param      offset     first frame of the areas that can be written
+ * @param      frames     number of frames to render
+ * @param[in] *user_data  pointer given to @ref mmap_write_period
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise */
+typedef int8_t (*mmap_render_callback) (const snd_pcm_channel_area_t *areas,
+                                        snd_pcm_uframes_t offset,
+                                        snd_pcm_uframes_t frames,
+                                        void *user_data);
+
+/** Callback processing a period of audio in place, used for the stages of
+ * a @ref duplex_engine and by the filters
+ *
+ * @param[in,out] **channels     one float buffer for each channel
+ * @param           num_channels number of channels
+ * @param           frames       number of frames of each buffer
+ * @param[in]      *user_data    pointer registered with the callback
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR to stop */
+typedef int8_t (*dsp_stage_callback) (float **channels, uint32_t num_channels,
+                                      uint32_t frames, void *user_data);
+
 /*------------------------------------------------------------------------------
  * Function Prototypes
  -----------------------------------------------------------------------------*/
+int8_t negotiate_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config,
+                     snd_pcm_hw_params_t *hw_params);
 int8_t configure_hw (snd_pcm_t *sound_card_handle, hw_configuration *hw_config);
+int8_t configure_sw (snd_pcm_t *sound_card_handle, sw_configuration *sw_config);
+int8_t set_monotonic_timestamps (snd_pcm_t *sound_card_handle);
 int8_t generate_sin (int16_t *data, uint16_t f, uint16_t fs,
                      uint32_t data_length);
+int8_t generate_sin_channels (int16_t **data, uint16_t f, uint32_t fs,
+                              uint32_t frames, uint32_t num_channels,
+                              channel_layout layout);
+channel_layout get_channel_layout (snd_pcm_access_t access_type);
+int8_t setup_channel_areas (snd_pcm_channel_area_t *areas, void *buffer,
+                            snd_pcm_uframes_t frames, uint32_t num_channels,
+                            channel_layout layout, snd_pcm_format_t format);
+int8_t mmap_write_period (snd_pcm_t *sound_card_handle,
+                          snd_pcm_uframes_t period_size,
+                          mmap_render_callback render, void *user_data);
+snd_pcm_sframes_t mmap_write_available (snd_pcm_t *sound_card_handle,
+                                        snd_pcm_uframes_t max_frames,
+                                        mmap_render_callback render,
+                                        void *user_data);
+void* mmap_area_address (const snd_pcm_channel_area_t *area,
+                         snd_pcm_uframes_t offset);
 #endif
 /*-------------- END OF FILE -------------------------------------------------*/
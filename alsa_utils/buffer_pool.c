@@ -0,0 +1,312 @@
+/*******************************************************************************
+ * @file      buffer_pool.c
+ *
+ * @brief      Pool of preallocated audio blocks
+ *
+ * The storage is an anonymous mapping so it can be backed by huge pages,
+ * explicit huge pages (@a MAP_HUGETLB) are tried first and then transparent
+ * huge pages (@a MADV_HUGEPAGE). The list of free blocks is kept out of the
+ * blocks, so a block can be written by its owner while other threads pop and
+ * push the list.
+ *
+ * @note
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "buffer_pool.h"
+#include "alsa_utils.h"
+#include "spsc_ring.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define HUGE_PAGE_SIZE          (2u*1024u*1024u) /**< size of a huge page */
+#define POOL_END                (0xFFFFFFFFu) /**< index of the end of the
+                                                   free list */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn void* map_storage (size_t*, uint32_t, uint8_t*)
+ *
+ * @brief Map the storage of the pool, on huge pages when asked and possible
+ *
+ ******************************************************************************/
+static void* map_storage (size_t *bytes, uint32_t flags, uint8_t *huge_pages)
+{
+  long page_size = sysconf (_SC_PAGESIZE);
+  size_t page = (0<page_size) ? (size_t)page_size : 4096u;
+  size_t huge_bytes = (*bytes+HUGE_PAGE_SIZE-1u)&~((size_t)HUGE_PAGE_SIZE-1u);
+  void *storage;
+
+  *huge_pages = 0u;
+  if ( 0u!=(flags&BUFFER_POOL_HUGE_PAGES) )
+  {
+    storage = mmap (NULL, huge_bytes, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if ( MAP_FAILED!=storage )
+    {
+      *bytes = huge_bytes;
+      *huge_pages = 1u;
+      return storage;
+    }
+  }
+
+  /* transparent huge pages only back whole and aligned huge pages */
+  if ( (0u!=(flags&BUFFER_POOL_HUGE_PAGES))&&(HUGE_PAGE_SIZE<=*bytes) )
+  {
+    *bytes = huge_bytes;
+  }
+  else
+  {
+    *bytes = (*bytes+page-1u)&~(page-1u);
+  }
+
+  storage = mmap (NULL, *bytes, PROT_READ|PROT_WRITE,
+                  MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if ( MAP_FAILED==storage )
+  {
+    return NULL;
+  }
+
+  if ( (0u!=(flags&BUFFER_POOL_HUGE_PAGES))&&(HUGE_PAGE_SIZE<=*bytes)&&
+       (0==madvise (storage, *bytes, MADV_HUGEPAGE)) )
+  {
+    *huge_pages = 1u;
+  }
+
+  return storage;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t buffer_pool_init (buffer_pool*, size_t, uint32_t, uint32_t)
+ *
+ * @brief Create a pool and touch all its blocks
+ *
+ * The blocks are zeroed, so a block never used is silence for the signed
+ * formats
+ *
+ * @param[out] *pool         pointer to the pool
+ * @param       block_bytes  usable size of each block in bytes
+ * @param       num_blocks   number of blocks
+ * @param       flags        @ref BUFFER_POOL_DEFAULT or a combination of
+ *                           @ref BUFFER_POOL_HUGE_PAGES and
+ *                           @ref BUFFER_POOL_LOCK
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t buffer_pool_init (buffer_pool *pool, size_t block_bytes,
+                         uint32_t num_blocks, uint32_t flags)
+{
+  size_t bytes;
+
+  if ( (NULL==pool)||(0u==block_bytes)||(0u==num_blocks)||
+       (POOL_END==num_blocks) )
+  {
+    return S_ERROR;
+  }
+
+  pool->block_bytes = block_bytes;
+  pool->block_stride = (block_bytes+CACHE_LINE_SIZE-1u)&
+      ~((size_t)CACHE_LINE_SIZE-1u);
+  pool->num_blocks = num_blocks;
+  pool->locked = 0u;
+
+  pool->next = (atomic_uint*)malloc (sizeof(*pool->next)*num_blocks);
+  if ( NULL==pool->next )
+  {
+    return S_ERROR;
+  }
+
+  bytes = pool->block_stride*num_blocks;
+  pool->storage = (uint8_t*)map_storage (&bytes, flags, &pool->huge_pages);
+  if ( NULL==pool->storage )
+  {
+    printf ("buffer_pool_init Error: mapping %zu bytes\n", bytes);
+    free (pool->next);
+    return S_ERROR;
+  }
+  pool->storage_bytes = bytes;
+
+  if ( 0u!=(flags&BUFFER_POOL_LOCK) )
+  {
+    if ( 0==mlock (pool->storage, pool->storage_bytes) )
+    {
+      pool->locked = 1u;
+    }
+    else
+    {
+      printf ("buffer_pool_init Warning: mlock failed\n");
+    }
+  }
+
+  /* touch all the pages now so we don't get page faults while streaming */
+  memset (pool->storage, 0, pool->storage_bytes);
+
+  for (uint32_t n = 0; n<num_blocks; n++)
+  {
+    atomic_init (&pool->next[n], (n+1u<num_blocks) ? n+1u : POOL_END);
+  }
+  atomic_init (&pool->free_head, 0u);
+  atomic_init (&pool->available, num_blocks);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void buffer_pool_destroy (buffer_pool*)
+ *
+ * @brief Unmap the pool, no block can be in use
+ *
+ * @param[in] *pool  pointer to the pool
+ *
+ ******************************************************************************/
+void buffer_pool_destroy (buffer_pool *pool)
+{
+  if ( (NULL!=pool)&&(NULL!=pool->storage) )
+  {
+    munmap (pool->storage, pool->storage_bytes);
+    free (pool->next);
+    pool->storage = NULL;
+    pool->next = NULL;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void* buffer_pool_acquire (buffer_pool*)
+ *
+ * @brief Take a free block of the pool
+ *
+ * Lock-free, it can be called from any thread, including the real time ones
+ *
+ * @param[in] *pool  pointer to the pool
+ *
+ * @return void* pointer to the block, NULL if all the blocks are in use
+ *
+ ******************************************************************************/
+void* buffer_pool_acquire (buffer_pool *pool)
+{
+  uint_fast64_t head = atomic_load_explicit (&pool->free_head,
+                                             memory_order_acquire);
+  uint_fast64_t new_head;
+  uint32_t index;
+
+  do
+  {
+    index = (uint32_t)head;
+    if ( POOL_END==index )
+    {
+      return NULL;
+    }
+    /* the counter changes on every pop, so a head popped and pushed back
+     * by other threads meanwhile doesn't match */
+    new_head = ((head>>32)+1u)<<32|
+        atomic_load_explicit (&pool->next[index], memory_order_relaxed);
+  }
+  while ( !atomic_compare_exchange_weak_explicit (&pool->free_head, &head,
+                                                  new_head,
+                                                  memory_order_acquire,
+                                                  memory_order_acquire) );
+
+  atomic_fetch_sub_explicit (&pool->available, 1u, memory_order_relaxed);
+
+  return pool->storage+(size_t)index*pool->block_stride;
+}
+
+/******************************************************************************
+ *
+ * @fn void buffer_pool_release (buffer_pool*, void*)
+ *
+ * @brief Give a block back to the pool
+ *
+ * Lock-free, it can be called from any thread, not only from the one that
+ * took the block
+ *
+ * @param[in] *pool   pointer to the pool
+ * @param[in] *block  block returned by @ref buffer_pool_acquire
+ *
+ ******************************************************************************/
+void buffer_pool_release (buffer_pool *pool, void *block)
+{
+  uint32_t index;
+  uint_fast64_t head;
+  uint_fast64_t new_head;
+
+  if ( NULL==block )
+  {
+    return;
+  }
+
+  index = (uint32_t)(((uint8_t*)block-pool->storage)/pool->block_stride);
+  head = atomic_load_explicit (&pool->free_head, memory_order_relaxed);
+  do
+  {
+    atomic_store_explicit (&pool->next[index], (uint32_t)head,
+                           memory_order_relaxed);
+    new_head = (head&~(uint_fast64_t)POOL_END)|index;
+  }
+  while ( !atomic_compare_exchange_weak_explicit (&pool->free_head, &head,
+                                                  new_head,
+                                                  memory_order_release,
+                                                  memory_order_relaxed) );
+
+  atomic_fetch_add_explicit (&pool->available, 1u, memory_order_relaxed);
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t buffer_pool_available (buffer_pool*)
+ *
+ * @brief Get the number of free blocks, the value can be old if other threads
+ *        are using the pool
+ *
+ * @param[in] *pool  pointer to the pool
+ *
+ * @return uint32_t number of free blocks
+ *
+ ******************************************************************************/
+uint32_t buffer_pool_available (buffer_pool *pool)
+{
+  return (uint32_t)atomic_load_explicit (&pool->available,
+                                         memory_order_relaxed);
+}
+/*-------------- END OF FILE -------------------------------------------------*/
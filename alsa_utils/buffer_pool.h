@@ -0,0 +1,93 @@
+/*******************************************************************************
+ * @file      buffer_pool.h
+ *
+ * @brief      Pool of preallocated audio blocks
+ *
+ * All the memory of the pool is reserved, aligned and touched when it's
+ * created, after that getting and giving back a block is a lock-free pop/push
+ * of a free list, so the render, conversion and I/O paths can borrow blocks
+ * while streaming without calling the allocator:
+ *      @li each block starts on a cache line and the storage on a page
+ *      @li with @ref BUFFER_POOL_HUGE_PAGES the storage is taken from huge
+ *          pages when the system has them (explicit or transparent ones)
+ *      @li with @ref BUFFER_POOL_LOCK the storage is locked in RAM
+ *
+ * Any thread can get or give back blocks, the free list is a Treiber stack
+ * with a tag to avoid the ABA problem.
+ *
+ * @note
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _BUFFER_POOL_
+#define _BUFFER_POOL_
+
+#define BUFFER_POOL_DEFAULT     (0u) /**< normal pages, not locked */
+#define BUFFER_POOL_HUGE_PAGES  (1u) /**< use huge pages if available */
+#define BUFFER_POOL_LOCK        (2u) /**< lock the storage in RAM */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Pool of blocks of the same size, @a free_head keeps the index of the first
+ * free block in the low 32 bits and a counter of pops in the high 32 bits */
+typedef struct
+{
+  _Alignas(64) atomic_uint_fast64_t free_head; /**< top of the free list */
+  atomic_uint available; /**< number of free blocks */
+
+  _Alignas(64) uint8_t *storage; /**< memory of all the blocks */
+  size_t storage_bytes; /**< size of the mapping */
+  size_t block_bytes; /**< usable size of each block */
+  size_t block_stride; /**< distance between blocks (cache line multiple) */
+  uint32_t num_blocks; /**< number of blocks */
+  atomic_uint *next; /**< next free block of each block */
+  uint8_t huge_pages; /**< 1 if the storage is on huge pages */
+  uint8_t locked; /**< 1 if the storage is locked in RAM */
+} buffer_pool;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t buffer_pool_init (buffer_pool *pool, size_t block_bytes,
+                         uint32_t num_blocks, uint32_t flags);
+void buffer_pool_destroy (buffer_pool *pool);
+void* buffer_pool_acquire (buffer_pool *pool);
+void buffer_pool_release (buffer_pool *pool, void *block);
+uint32_t buffer_pool_available (buffer_pool *pool);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,670 @@
+/*******************************************************************************
+ * @file      capture_engine.c
+ *
+ * @brief      Capture of a sound card to disk without copies between threads
+ *
+ * The capture thread only reads the sound card, commits blocks and posts
+ * a semaphore, all the file I/O is made by the writer thread.
+ *
+ * @a O_DIRECT needs the size of the writes aligned, so the last block is
+ * written complete and the file is truncated to the real size at the
+ * end.
+ *
+ * @note Link using -lasound and -lpthread
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "capture_engine.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define CAPTURE_WAIT_MS         (1000) /**< maximum wait for the sound card */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn void put_le (uint8_t*, uint32_t, uint32_t)
+ *
+ * @brief Store a little endian integer of 2 or 4 bytes
+ *
+ ******************************************************************************/
+static void put_le (uint8_t *bytes, uint32_t value, uint32_t size)
+{
+  for (uint32_t n = 0; n<size; n++)
+  {
+    bytes[n] = (uint8_t)(value>>(8u*n));
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t write_wav_header (capture_engine*, uint64_t)
+ *
+ * @brief Write the WAV header for the audio written so far
+ *
+ * The header takes @ref CAPTURE_IO_ALIGNMENT bytes, a JUNK chunk fills the
+ * space between the fmt and the data chunks
+ *
+ * @param[in] *engine      capture engine
+ * @param      data_bytes  bytes of audio in the file
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+static int8_t write_wav_header (capture_engine *engine, uint64_t data_bytes)
+{
+  uint8_t *header = (uint8_t*)engine->header;
+  uint32_t bits = (uint32_t)snd_pcm_format_width (engine->format);
+  uint32_t junk_size = CAPTURE_IO_ALIGNMENT-12u-24u-8u-8u;
+
+  /* the sizes are 32 bits, longer files keep the maximum size */
+  if ( UINT32_MAX-CAPTURE_IO_ALIGNMENT<data_bytes )
+  {
+    data_bytes = UINT32_MAX-CAPTURE_IO_ALIGNMENT;
+  }
+
+  memset (header, 0, CAPTURE_IO_ALIGNMENT);
+  memcpy (&header[0], "RIFF", 4);
+  put_le (&header[4], (uint32_t)(CAPTURE_IO_ALIGNMENT-8u+data_bytes), 4u);
+  memcpy (&header[8], "WAVE", 4);
+  memcpy (&header[12], "fmt ", 4);
+  put_le (&header[16], 16u, 4u);
+  put_le (&header[20], (SND_PCM_FORMAT_FLOAT_LE==engine->format) ? 3u : 1u,
+          2u);
+  put_le (&header[22], engine->num_channels, 2u);
+  put_le (&header[24], engine->sample_rate, 4u);
+  put_le (&header[28], engine->sample_rate*engine->frame_bytes, 4u);
+  put_le (&header[32], engine->frame_bytes, 2u);
+  put_le (&header[34], bits, 2u);
+  memcpy (&header[36], "JUNK", 4);
+  put_le (&header[40], junk_size, 4u);
+  memcpy (&header[CAPTURE_IO_ALIGNMENT-8u], "data", 4);
+  put_le (&header[CAPTURE_IO_ALIGNMENT-4u], (uint32_t)data_bytes, 4u);
+
+  if ( CAPTURE_IO_ALIGNMENT!=pwrite (engine->fd, header, CAPTURE_IO_ALIGNMENT,
+                                     0) )
+  {
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn snd_pcm_sframes_t read_frames (capture_engine*, uint8_t*,
+ *                                    snd_pcm_uframes_t)
+ *
+ * @brief Read frames from the sound card into a block
+ *
+ * In MMAP mode the frames are copied from the ring buffer of the sound
+ * card, waiting for them if needed
+ *
+ * @param[in]  *engine  capture engine
+ * @param[out] *data    where to store the frames (interleaved)
+ * @param       frames  frames wanted
+ *
+ * @return snd_pcm_sframes_t frames read, a negative error code of ALSA
+ *         otherwise
+ *
+ ******************************************************************************/
+static snd_pcm_sframes_t read_frames (capture_engine *engine, uint8_t *data,
+                                      snd_pcm_uframes_t frames)
+{
+  const snd_pcm_channel_area_t *areas;
+  snd_pcm_channel_area_t block_areas[MAX_CHANNELS];
+  snd_pcm_uframes_t offset;
+  snd_pcm_uframes_t contiguous;
+  snd_pcm_sframes_t avail;
+  snd_pcm_sframes_t committed;
+  uint32_t sample_bits;
+  int err;
+
+  if ( 0u==engine->use_mmap )
+  {
+    return snd_pcm_readi (engine->sound_card_handle, data, frames);
+  }
+
+  avail = snd_pcm_avail_update (engine->sound_card_handle);
+  if ( 0>avail )
+  {
+    return avail;
+  }
+  if ( (snd_pcm_uframes_t)avail<frames )
+  {
+    err = snd_pcm_wait (engine->sound_card_handle, CAPTURE_WAIT_MS);
+    return (0>err) ? err : 0;
+  }
+
+  contiguous = frames;
+  err = snd_pcm_mmap_begin (engine->sound_card_handle, &areas, &offset,
+                            &contiguous);
+  if ( 0>err )
+  {
+    return err;
+  }
+
+  sample_bits = engine->frame_bytes*8u/engine->num_channels;
+  for (uint32_t ch = 0; ch<engine->num_channels; ch++)
+  {
+    block_areas[ch].addr = data;
+    block_areas[ch].first = ch*sample_bits;
+    block_areas[ch].step = engine->frame_bytes*8u;
+  }
+  snd_pcm_areas_copy (block_areas, 0, areas, offset, engine->num_channels,
+                      contiguous, engine->format);
+
+  committed = snd_pcm_mmap_commit (engine->sound_card_handle, offset,
+                                   contiguous);
+
+  return committed;
+}
+
+/******************************************************************************
+ *
+ * @fn void* capture_thread (void*)
+ *
+ * @brief Thread reading the sound card into the blocks of the ring
+ *
+ * @param[in] *arg  pointer to the capture engine
+ *
+ * @return void* NULL
+ *
+ ******************************************************************************/
+static void* capture_thread (void *arg)
+{
+  capture_engine *engine = (capture_engine*)arg;
+  uint8_t *block = NULL;
+  uint8_t in_scratch = 0u;
+  snd_pcm_uframes_t filled = 0;
+  snd_pcm_uframes_t wanted;
+  snd_pcm_sframes_t frames;
+  uint64_t captured = 0;
+  uint64_t committed = 0;
+
+  if ( NULL!=engine->capture_rt_config )
+  {
+    configure_rt_thread (engine->capture_rt_config);
+  }
+
+  if ( S_SUCCESS>snd_pcm_start (engine->sound_card_handle) )
+  {
+    atomic_store (&engine->error, S_ERROR);
+    atomic_store (&engine->running, 0u);
+  }
+
+  while ( atomic_load_explicit (&engine->running, memory_order_acquire) )
+  {
+    if ( (0u!=engine->total_frames)&&(captured>=engine->total_frames) )
+    {
+      break;
+    }
+
+    if ( NULL==block )
+    {
+      /* if the writer is late the audio is read and thrown away, stopping
+       * the reads would just cause an overrun */
+      block = (uint8_t*)spsc_ring_write_block (&engine->ring);
+      in_scratch = (NULL==block) ? 1u : 0u;
+      if ( 0u!=in_scratch )
+      {
+        block = (uint8_t*)engine->scratch;
+      }
+      filled = 0;
+    }
+
+    wanted = engine->block_frames-filled;
+    if ( wanted>engine->period_size )
+    {
+      wanted = engine->period_size;
+    }
+    if ( (0u!=engine->total_frames)&&(wanted>engine->total_frames-captured) )
+    {
+      wanted = (snd_pcm_uframes_t)(engine->total_frames-captured);
+    }
+
+    frames = read_frames (engine, block+filled*engine->frame_bytes, wanted);
+    if ( 0>frames )
+    {
+      atomic_fetch_add_explicit (&engine->xruns, 1u, memory_order_relaxed);
+      if ( (0>snd_pcm_recover (engine->sound_card_handle, (int)frames, 1))||
+           (0>snd_pcm_start (engine->sound_card_handle)) )
+      {
+        atomic_store (&engine->error, S_ERROR);
+        break;
+      }
+      continue;
+    }
+
+    filled += (snd_pcm_uframes_t)frames;
+    captured += (uint64_t)frames;
+    atomic_store_explicit (&engine->frames_captured, captured,
+                           memory_order_relaxed);
+
+    if ( filled==engine->block_frames )
+    {
+      if ( 0u!=in_scratch )
+      {
+        atomic_fetch_add_explicit (&engine->dropped_blocks, 1u,
+                                   memory_order_relaxed);
+      }
+      else
+      {
+        spsc_ring_commit_write (&engine->ring);
+        committed++;
+        sem_post (&engine->filled_blocks);
+      }
+      block = NULL;
+    }
+  }
+
+  snd_pcm_drop (engine->sound_card_handle);
+
+  /* the last block is written even if it isn't full */
+  engine->final_block_bytes = engine->ring.block_bytes;
+  if ( (NULL!=block)&&(0u==in_scratch)&&(0u<filled) )
+  {
+    engine->final_block_bytes = filled*engine->frame_bytes;
+    spsc_ring_commit_write (&engine->ring);
+    committed++;
+  }
+  engine->final_blocks = committed;
+  atomic_store_explicit (&engine->capture_done, 1u, memory_order_release);
+  sem_post (&engine->filled_blocks);
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn void* writer_thread (void*)
+ *
+ * @brief Thread writing the full blocks of the ring to the file
+ *
+ * @param[in] *arg  pointer to the capture engine
+ *
+ * @return void* NULL
+ *
+ ******************************************************************************/
+static void* writer_thread (void *arg)
+{
+  capture_engine *engine = (capture_engine*)arg;
+  uint64_t written_blocks = 0;
+  uint64_t offset = engine->data_offset;
+  ssize_t result;
+  uint8_t *block;
+  uint8_t done;
+
+  for (;;)
+  {
+    /* capture_done is read before the ring, so a block committed before
+     * it was set is always seen */
+    done = (uint8_t)atomic_load_explicit (&engine->capture_done,
+                                          memory_order_acquire);
+    block = (uint8_t*)spsc_ring_read_block (&engine->ring);
+    if ( NULL==block )
+    {
+      if ( 0u!=done )
+      {
+        break;
+      }
+      sem_wait (&engine->filled_blocks);
+      continue;
+    }
+
+    /* O_DIRECT writes the whole aligned block, the file is truncated to
+     * the real size at the end */
+    result = pwrite (engine->fd, block, engine->ring.block_bytes,
+                     (off_t)offset);
+    spsc_ring_release_read (&engine->ring);
+    if ( (ssize_t)engine->ring.block_bytes!=result )
+    {
+      printf ("capture_engine Error: writing the file, Err = %d\n", errno);
+      atomic_store (&engine->error, S_ERROR);
+      atomic_store (&engine->running, 0u);
+      continue;
+    }
+
+    written_blocks++;
+    offset += engine->ring.block_bytes;
+    atomic_store_explicit (&engine->bytes_written,
+                           written_blocks*engine->ring.block_bytes,
+                           memory_order_relaxed);
+  }
+
+  /* the last block wasn't full */
+  if ( (0u<written_blocks)&&(written_blocks==engine->final_blocks) )
+  {
+    atomic_store_explicit (&engine->bytes_written,
+                           (written_blocks-1u)*engine->ring.block_bytes+
+                           engine->final_block_bytes, memory_order_relaxed);
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t open_output (capture_engine*, const char*)
+ *
+ * @brief Open the output file, with O_DIRECT if the file system supports it
+ *
+ ******************************************************************************/
+static int8_t open_output (capture_engine *engine, const char *path)
+{
+  size_t length = strlen (path);
+
+  engine->fd = open (path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC|O_DIRECT, 0644);
+  engine->direct_io = 1u;
+  if ( (0>engine->fd)&&(EINVAL==errno) )
+  {
+    /* e.g. tmpfs doesn't support O_DIRECT */
+    printf ("capture_engine_init Warning: O_DIRECT not supported\n");
+    engine->fd = open (path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+    engine->direct_io = 0u;
+  }
+  if ( 0>engine->fd )
+  {
+    printf ("capture_engine_init Error: opening %s\n", path);
+    return S_ERROR;
+  }
+
+  engine->wav = 0u;
+  engine->data_offset = 0u;
+  if ( (4u<length)&&(0==strcasecmp (&path[length-4u], ".wav")) )
+  {
+    engine->wav = 1u;
+    engine->data_offset = CAPTURE_IO_ALIGNMENT;
+    if ( S_SUCCESS!=write_wav_header (engine, 0u) )
+    {
+      printf ("capture_engine_init Error: writing the WAV header\n");
+      close (engine->fd);
+      return S_ERROR;
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t capture_engine_init (capture_engine*, snd_pcm_t*,
+ *                                 hw_configuration*, const char*, uint32_t)
+ *
+ * @brief Create a capture engine for a configured sound card
+ *
+ * All the memory is allocated and touched here, nothing is allocated while
+ * capturing. Each block has at least @ref CAPTURE_BLOCK_PERIODS periods
+ * and its size is a multiple of @ref CAPTURE_IO_ALIGNMENT
+ *
+ * @param[out] *engine             pointer to the engine
+ * @param[in]  *sound_card_handle  capture stream configured with
+ *                                 @ref configure_hw (RW or MMAP
+ *                                 interleaved access)
+ * @param[in]  *hw_config          configuration returned by
+ *                                 @ref configure_hw
+ * @param[in]  *path               file to create
+ * @param       num_blocks         number of blocks in the ring (power of 2)
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t capture_engine_init (capture_engine *engine,
+                            snd_pcm_t *sound_card_handle,
+                            hw_configuration *hw_config, const char *path,
+                            uint32_t num_blocks)
+{
+  ssize_t frame_bytes;
+  uint32_t align_frames;
+  uint32_t a;
+  uint32_t b;
+
+  if ( (NULL==engine)||(NULL==sound_card_handle)||(NULL==hw_config)||
+       (NULL==path)||(0u==hw_config->period_size)||
+       (MAX_CHANNELS<hw_config->num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  if ( (SND_PCM_ACCESS_RW_INTERLEAVED!=hw_config->access_type)&&
+       (SND_PCM_ACCESS_MMAP_INTERLEAVED!=hw_config->access_type) )
+  {
+    printf ("capture_engine_init Error: the access must be interleaved\n");
+    return S_ERROR;
+  }
+
+  frame_bytes = snd_pcm_format_size (hw_config->format,
+                                     hw_config->num_channels);
+  if ( 0>=frame_bytes )
+  {
+    printf ("capture_engine_init Error: unsupported format\n");
+    return S_ERROR;
+  }
+
+  memset (engine, 0, sizeof(*engine));
+  engine->sound_card_handle = sound_card_handle;
+  engine->period_size = hw_config->period_size;
+  engine->sample_rate = hw_config->sample_rate;
+  engine->num_channels = hw_config->num_channels;
+  engine->format = hw_config->format;
+  engine->frame_bytes = (uint32_t)frame_bytes;
+  engine->use_mmap = (SND_PCM_ACCESS_MMAP_INTERLEAVED==hw_config->access_type) ?
+      1u : 0u;
+
+  /* the blocks must hold whole frames and be aligned for O_DIRECT, the
+   * smallest such block has align_frames = alignment/gcd(frame, alignment) */
+  a = engine->frame_bytes;
+  b = CAPTURE_IO_ALIGNMENT;
+  while ( 0u!=b )
+  {
+    uint32_t r = a%b;
+    a = b;
+    b = r;
+  }
+  align_frames = CAPTURE_IO_ALIGNMENT/a;
+  engine->block_frames = (uint32_t)(((CAPTURE_BLOCK_PERIODS*
+      engine->period_size+align_frames-1u)/align_frames)*align_frames);
+
+  if ( S_SUCCESS!=spsc_ring_init (&engine->ring, num_blocks,
+                                  (size_t)engine->block_frames*
+                                  engine->frame_bytes) )
+  {
+    printf ("capture_engine_init Error: creating the ring\n");
+    return S_ERROR;
+  }
+
+  if ( (0!=posix_memalign (&engine->scratch, CAPTURE_IO_ALIGNMENT,
+                           engine->ring.block_bytes))||
+       (0!=posix_memalign (&engine->header, CAPTURE_IO_ALIGNMENT,
+                           CAPTURE_IO_ALIGNMENT)) )
+  {
+    free (engine->scratch);
+    spsc_ring_destroy (&engine->ring);
+    return S_ERROR;
+  }
+  memset (engine->scratch, 0, engine->ring.block_bytes);
+
+  if ( (S_SUCCESS!=open_output (engine, path))||
+       (0!=sem_init (&engine->filled_blocks, 0, 0u)) )
+  {
+    free (engine->header);
+    free (engine->scratch);
+    spsc_ring_destroy (&engine->ring);
+    return S_ERROR;
+  }
+
+  atomic_init (&engine->running, 0u);
+  atomic_init (&engine->capture_done, 0u);
+  atomic_init (&engine->frames_captured, 0u);
+  atomic_init (&engine->bytes_written, 0u);
+  atomic_init (&engine->dropped_blocks, 0u);
+  atomic_init (&engine->xruns, 0u);
+  atomic_init (&engine->error, S_SUCCESS);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t capture_engine_start (capture_engine*, uint64_t)
+ *
+ * @brief Start the writer and capture threads
+ *
+ * @param[in] *engine        pointer to the engine
+ * @param      total_frames  frames to capture, 0 to capture until
+ *                           @ref capture_engine_stop is called
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t capture_engine_start (capture_engine *engine, uint64_t total_frames)
+{
+  if ( NULL==engine )
+  {
+    return S_ERROR;
+  }
+
+  engine->total_frames = total_frames;
+  atomic_store (&engine->running, 1u);
+  if ( 0!=pthread_create (&engine->writer_thread, NULL, writer_thread,
+                          engine) )
+  {
+    atomic_store (&engine->running, 0u);
+    printf ("capture_engine_start Error: creating writer thread\n");
+    return S_ERROR;
+  }
+
+  if ( 0!=pthread_create (&engine->capture_thread, NULL, capture_thread,
+                          engine) )
+  {
+    atomic_store (&engine->running, 0u);
+    atomic_store (&engine->capture_done, 1u);
+    sem_post (&engine->filled_blocks);
+    pthread_join (engine->writer_thread, NULL);
+    printf ("capture_engine_start Error: creating capture thread\n");
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t capture_engine_wait (capture_engine*)
+ *
+ * @brief Wait until all the frames were captured and written, then update
+ *        the size of the file
+ *
+ * @param[in] *engine  pointer to the engine
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if any of the
+ *         threads failed
+ *
+ ******************************************************************************/
+int8_t capture_engine_wait (capture_engine *engine)
+{
+  uint64_t bytes;
+
+  if ( NULL==engine )
+  {
+    return S_ERROR;
+  }
+
+  pthread_join (engine->capture_thread, NULL);
+  pthread_join (engine->writer_thread, NULL);
+
+  bytes = atomic_load (&engine->bytes_written);
+  if ( (0!=ftruncate (engine->fd, (off_t)(engine->data_offset+bytes)))||
+       ((0u!=engine->wav)&&(S_SUCCESS!=write_wav_header (engine, bytes))) )
+  {
+    printf ("capture_engine_wait Error: finishing the file\n");
+    atomic_store (&engine->error, S_ERROR);
+  }
+
+  return (int8_t)atomic_load (&engine->error);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t capture_engine_stop (capture_engine*)
+ *
+ * @brief Stop the capture, the frames already captured are written
+ *
+ * @param[in] *engine  pointer to the engine
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if any of the
+ *         threads failed
+ *
+ ******************************************************************************/
+int8_t capture_engine_stop (capture_engine *engine)
+{
+  if ( NULL==engine )
+  {
+    return S_ERROR;
+  }
+
+  atomic_store (&engine->running, 0u);
+
+  return capture_engine_wait (engine);
+}
+
+/******************************************************************************
+ *
+ * @fn void capture_engine_destroy (capture_engine*)
+ *
+ * @brief Close the file and free the memory, the threads must be stopped
+ *
+ * @param[in] *engine  pointer to the engine
+ *
+ ******************************************************************************/
+void capture_engine_destroy (capture_engine *engine)
+{
+  if ( NULL!=engine )
+  {
+    close (engine->fd);
+    sem_destroy (&engine->filled_blocks);
+    free (engine->header);
+    free (engine->scratch);
+    engine->header = NULL;
+    engine->scratch = NULL;
+    spsc_ring_destroy (&engine->ring);
+  }
+}
+/*-------------- END OF FILE -------------------------------------------------*/
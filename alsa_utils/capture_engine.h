@@ -0,0 +1,129 @@
+/*******************************************************************************
+ * @file      capture_engine.h
+ *
+ * @brief      Capture of a sound card to disk without copies between threads
+ *
+ * Two threads record a stream:
+ *      @li the capture thread reads the sound card (@a snd_pcm_readi or MMAP)
+ *          directly into the free blocks of a @ref spsc_ring
+ *      @li the writer thread writes the full blocks to the file with
+ *          @a O_DIRECT, each block is a multiple of the page size so the
+ *          writes are large and aligned and skip the page cache
+ *
+ * Neither thread waits for the other: if the writer is late and the ring is
+ * full the capture thread keeps reading the sound card into a scratch block
+ * and counts the block as dropped, the writer only sleeps when there is
+ * nothing to write.
+ *
+ * Files ending in .wav get a WAV header, the header is padded to a page so
+ * the audio stays aligned for O_DIRECT. Any other file gets the raw
+ * interleaved samples.
+ *
+ * @note Link using -lasound and -lpthread
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "alsa_utils.h"
+#include "spsc_ring.h"
+#include "rt_setup.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _CAPTURE_ENGINE_
+#define _CAPTURE_ENGINE_
+
+#define CAPTURE_IO_ALIGNMENT    (4096u) /**< alignment of the O_DIRECT writes,
+                                             also the size of the WAV header */
+#define CAPTURE_BLOCK_PERIODS   (4u) /**< minimum periods in each block */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Capture of a sound card to a file */
+typedef struct
+{
+  snd_pcm_t *sound_card_handle; /**< configured capture stream */
+  snd_pcm_uframes_t period_size; /**< frames read at once */
+  uint32_t sample_rate; /**< rate of the stream */
+  uint32_t num_channels; /**< channels of the stream */
+  snd_pcm_format_t format; /**< format of the samples */
+  uint32_t frame_bytes; /**< bytes of each frame */
+  uint8_t use_mmap; /**< 1 for the MMAP interleaved access */
+
+  spsc_ring ring; /**< blocks shared between the threads */
+  uint32_t block_frames; /**< frames of each block */
+  void *scratch; /**< block used while the ring is full */
+
+  int fd; /**< output file */
+  uint8_t direct_io; /**< 1 if the file was opened with O_DIRECT */
+  uint8_t wav; /**< 1 if the file has a WAV header */
+  uint64_t data_offset; /**< offset of the audio in the file */
+  void *header; /**< aligned buffer of the WAV header */
+
+  const rt_configuration *capture_rt_config; /**< real time setup of the
+   capture thread, NULL by default, it can be set before starting */
+
+  pthread_t capture_thread; /**< reads the sound card */
+  pthread_t writer_thread; /**< writes the blocks to the file */
+  sem_t filled_blocks; /**< posted by the capture thread for each block */
+  atomic_uint running; /**< cleared to stop the capture */
+  atomic_uint capture_done; /**< set when the capture thread finished */
+  uint64_t total_frames; /**< frames to capture, 0 until stopped */
+  uint64_t final_blocks; /**< blocks committed by the capture thread, valid
+   when @a capture_done is set */
+  size_t final_block_bytes; /**< bytes of the last block, valid when
+   @a capture_done is set */
+
+  atomic_uint_fast64_t frames_captured; /**< frames read from the card */
+  atomic_uint_fast64_t bytes_written; /**< audio bytes in the file */
+  atomic_uint_fast64_t dropped_blocks; /**< blocks lost because the ring
+   was full */
+  atomic_uint_fast64_t xruns; /**< overruns of the sound card */
+  atomic_int error; /**< @a S_ERROR if any of the threads failed */
+} capture_engine;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t capture_engine_init (capture_engine *engine,
+                            snd_pcm_t *sound_card_handle,
+                            hw_configuration *hw_config, const char *path,
+                            uint32_t num_blocks);
+int8_t capture_engine_start (capture_engine *engine, uint64_t total_frames);
+int8_t capture_engine_wait (capture_engine *engine);
+int8_t capture_engine_stop (capture_engine *engine);
+void capture_engine_destroy (capture_engine *engine);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,276 @@
+/*******************************************************************************
+ * @file      clock_drift.c
+ *
+ * @brief      Clock drift estimation between devices
+ *
+ * Estimation of the clock of a device with a delay locked loop, see
+ * @ref drift_estimator.
+ *
+ * @note Link using -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <math.h>
+#include <string.h>
+#include "clock_drift.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define DRIFT_MAX_LOOP_GAIN     (0.5) /**< limit of the gain of the loop for
+                                           long intervals between samples */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t drift_estimator_init (drift_estimator*, uint32_t, double)
+ *
+ * @brief Initialize the estimation of the clock of a device
+ *
+ * @param[out] *estimator     pointer to the estimator
+ * @param       nominal_rate  rate configured in the device
+ * @param       bandwidth     bandwidth of the loop in Hz, e.g.
+ *                            @ref DRIFT_DEFAULT_BANDWIDTH, a lower value
+ *                            filters more jitter but follows the changes of
+ *                            the clock (temperature) slower
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t drift_estimator_init (drift_estimator *estimator, uint32_t nominal_rate,
+                             double bandwidth)
+{
+  if ( (NULL==estimator)||(0u==nominal_rate)||(0.0>=bandwidth) )
+  {
+    return S_ERROR;
+  }
+
+  memset (estimator, 0, sizeof(*estimator));
+  estimator->nominal_rate = nominal_rate;
+  estimator->bandwidth = bandwidth;
+  drift_estimator_reset (estimator);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void drift_estimator_reset (drift_estimator*)
+ *
+ * @brief Restart the estimation, e.g. after the stream was restarted
+ *
+ * The rate goes back to the nominal one, the next sample anchors the
+ * position
+ *
+ * @param[in,out] *estimator  pointer to the estimator
+ *
+ ******************************************************************************/
+void drift_estimator_reset (drift_estimator *estimator)
+{
+  if ( NULL==estimator )
+  {
+    return;
+  }
+
+  estimator->updates = 0u;
+  estimator->time_ns = 0u;
+  estimator->position = 0.0;
+  estimator->rate = (double)estimator->nominal_rate;
+}
+
+/******************************************************************************
+ *
+ * @fn void drift_estimator_update (drift_estimator*, uint64_t, double)
+ *
+ * @brief Give a sample of the position of the device to the loop
+ *
+ * The loop predicts the position with the rate estimated, the error of the
+ * prediction corrects the position with a gain of @f$ \sqrt{2}\omega @f$ and
+ * the rate with @f$ \omega^2 @f$, where @f$ \omega = 2\pi B \Delta t @f$,
+ * a critically damped second order loop. The samples with the same
+ * timestamp as the last one (the pointer wasn't updated) are ignored
+ *
+ * @param[in,out] *estimator  pointer to the estimator
+ * @param          time_ns    timestamp of the sample (CLOCK_MONOTONIC)
+ * @param          position   frames played by the device at @a time_ns
+ *
+ ******************************************************************************/
+void drift_estimator_update (drift_estimator *estimator, uint64_t time_ns,
+                             double position)
+{
+  double dt;
+  double omega;
+  double error;
+  double nominal;
+
+  if ( (NULL==estimator)||(time_ns<=estimator->time_ns) )
+  {
+    return;
+  }
+
+  nominal = (double)estimator->nominal_rate;
+  dt = (double)(time_ns-estimator->time_ns)*1e-9;
+  error = position-(estimator->position+estimator->rate*dt);
+  if ( (0u==estimator->updates)||(fabs (error)>DRIFT_MAX_JUMP_S*nominal) )
+  {
+    /* first sample or the stream jumped, the loop starts again from here */
+    estimator->rate = nominal;
+    estimator->position = position;
+    estimator->time_ns = time_ns;
+    estimator->updates = 1u;
+    return;
+  }
+
+  omega = 2.0*M_PI*estimator->bandwidth*dt;
+  if ( omega>DRIFT_MAX_LOOP_GAIN )
+  {
+    omega = DRIFT_MAX_LOOP_GAIN;
+  }
+  estimator->position += estimator->rate*dt+M_SQRT2*omega*error;
+  estimator->rate += omega*omega*error/dt;
+
+  if ( estimator->rate>nominal*(1.0+DRIFT_MAX_RATE_ERROR) )
+  {
+    estimator->rate = nominal*(1.0+DRIFT_MAX_RATE_ERROR);
+  }
+  else if ( estimator->rate<nominal*(1.0-DRIFT_MAX_RATE_ERROR) )
+  {
+    estimator->rate = nominal*(1.0-DRIFT_MAX_RATE_ERROR);
+  }
+  estimator->time_ns = time_ns;
+  estimator->updates++;
+}
+
+/******************************************************************************
+ *
+ * @fn double drift_estimator_position (const drift_estimator*, uint64_t)
+ *
+ * @brief Get the filtered position of the device at any time
+ *
+ * @param[in] *estimator  pointer to the estimator
+ * @param      time_ns    time of the position (CLOCK_MONOTONIC)
+ *
+ * @return double frames played by the device at @a time_ns
+ *
+ ******************************************************************************/
+double drift_estimator_position (const drift_estimator *estimator,
+                                 uint64_t time_ns)
+{
+  double dt;
+
+  if ( NULL==estimator )
+  {
+    return 0.0;
+  }
+
+  /* the time can be before the last sample of this device */
+  dt = (time_ns>=estimator->time_ns) ?
+      (double)(time_ns-estimator->time_ns)*1e-9 :
+      -(double)(estimator->time_ns-time_ns)*1e-9;
+
+  return estimator->position+estimator->rate*dt;
+}
+
+/******************************************************************************
+ *
+ * @fn double drift_estimator_ppm (const drift_estimator*)
+ *
+ * @brief Get the deviation of the clock from the nominal rate
+ *
+ * @param[in] *estimator  pointer to the estimator
+ *
+ * @return double deviation in parts per million, positive if the device
+ *         plays faster than the nominal rate (measured with CLOCK_MONOTONIC)
+ *
+ ******************************************************************************/
+double drift_estimator_ppm (const drift_estimator *estimator)
+{
+  if ( NULL==estimator )
+  {
+    return 0.0;
+  }
+
+  return (estimator->rate/(double)estimator->nominal_rate-1.0)*1e6;
+}
+
+/******************************************************************************
+ *
+ * @fn double drift_sync_ratio (const drift_estimator*,
+ *                              const drift_estimator*, double)
+ *
+ * @brief Get the adjustment of the resampler of a slave device
+ *
+ * The slave consumes the content of the master through a resampler, to be
+ * in sync it must consume @f$ rate_{master} @f$ frames of content per
+ * second while it plays @f$ rate_{slave} @f$ frames, relative to the
+ * nominal ratio that is
+ * @f$ \frac{rate_{master}/nominal_{master}}{rate_{slave}/nominal_{slave}} @f$.
+ * The alignment error left (initial offset, errors of the estimation) is
+ * corrected in proportion, removing it in @ref DRIFT_SYNC_TIME_S, up to
+ * @ref DRIFT_MAX_CORRECTION
+ *
+ * @param[in] *master        estimator of the master device
+ * @param[in] *slave         estimator of the slave device
+ * @param      error_frames  content frames the slave is ahead of the master
+ *                           (negative if it's behind)
+ *
+ * @return double factor for @ref resampler_set_ratio
+ *
+ ******************************************************************************/
+double drift_sync_ratio (const drift_estimator *master,
+                         const drift_estimator *slave, double error_frames)
+{
+  double ratio;
+  double correction;
+
+  if ( (NULL==master)||(NULL==slave) )
+  {
+    return 1.0;
+  }
+
+  ratio = (master->rate/(double)master->nominal_rate)/
+      (slave->rate/(double)slave->nominal_rate);
+
+  /* ahead means too much content consumed, the slave has to slow down */
+  correction = -error_frames/((double)master->nominal_rate*DRIFT_SYNC_TIME_S);
+  if ( correction>DRIFT_MAX_CORRECTION )
+  {
+    correction = DRIFT_MAX_CORRECTION;
+  }
+  else if ( correction<-DRIFT_MAX_CORRECTION )
+  {
+    correction = -DRIFT_MAX_CORRECTION;
+  }
+
+  return ratio*(1.0+correction);
+}
+/*-------------- END OF FILE -------------------------------------------------*/
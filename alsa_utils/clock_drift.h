@@ -0,0 +1,101 @@
+/*******************************************************************************
+ * @file      clock_drift.h
+ *
+ * @brief      Clock drift estimation between devices
+ *
+ * Estimation of the clock of a device and of the ratio that keeps two devices
+ * with independent clocks aligned:
+ *      @li the position played by the device (frames written minus
+ *          @a snd_pcm_status delay) is sampled with the timestamp of the
+ *          hardware pointer update, on CLOCK_MONOTONIC
+ *      @li a second order delay locked loop (DLL) filters the samples, the
+ *          jitter of the pointer (DMA bursts, USB packets) is removed and the
+ *          rate of the device is tracked, a few ppm off the nominal one
+ *      @li @ref drift_sync_ratio gives the adjustment of the resampler of a
+ *          slave device: the ratio between the rates of the master and the
+ *          slave, corrected in proportion to the alignment error so the error
+ *          decays in @ref DRIFT_SYNC_TIME_S instead of accumulating
+ *
+ * The slave is never corrected by dropping or inserting frames, the
+ * resampler follows the clock continuously.
+ *
+ * @note Link using -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _CLOCK_DRIFT_
+#define _CLOCK_DRIFT_
+
+#define DRIFT_DEFAULT_BANDWIDTH (0.1) /**< bandwidth of the DLL in Hz, it
+                                           settles in ~1/bandwidth seconds */
+#define DRIFT_MAX_RATE_ERROR    (0.005) /**< biggest deviation of a clock
+                                             from its nominal rate */
+#define DRIFT_MAX_JUMP_S        (0.05) /**< position error that restarts the
+                                            estimation (stream restarted) */
+#define DRIFT_SYNC_TIME_S       (2.0) /**< time constant of the correction
+                                           of the alignment error */
+#define DRIFT_MAX_CORRECTION    (0.001) /**< biggest correction of the ratio
+                                             for the alignment error */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Estimation of the clock of a device */
+typedef struct
+{
+  uint32_t nominal_rate; /**< rate configured in the device */
+  double bandwidth; /**< bandwidth of the loop in Hz */
+  uint64_t updates; /**< samples given to the loop */
+  uint64_t time_ns; /**< timestamp of the last sample */
+  double position; /**< filtered position at @a time_ns in frames */
+  double rate; /**< filtered rate in frames per second */
+} drift_estimator;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t drift_estimator_init (drift_estimator *estimator, uint32_t nominal_rate,
+                             double bandwidth);
+void drift_estimator_reset (drift_estimator *estimator);
+void drift_estimator_update (drift_estimator *estimator, uint64_t time_ns,
+                             double position);
+double drift_estimator_position (const drift_estimator *estimator,
+                                 uint64_t time_ns);
+double drift_estimator_ppm (const drift_estimator *estimator);
+double drift_sync_ratio (const drift_estimator *master,
+                         const drift_estimator *slave, double error_frames);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,539 @@
+/*******************************************************************************
+ * @file      device_probe.c
+ *
+ * @brief      Capabilities of the PCM devices and cache file of them
+ *
+ * The devices are opened in non blocking mode, so a device in use by another
+ * program fails at once with @a -EBUSY instead of blocking the probe.
+ *
+ * Each line of the cache file is:
+ *      @li name stream rate_min rate_max rates formats access channels_min
+ *          channels_max period_min period_max buffer_min buffer_max
+ *
+ * with the masks in hexadecimal, the lines starting with # are comments. The
+ * file is written to a temporary file and renamed, like the result file of
+ * @ref tuner_save_result.
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <string.h>
+#include "device_probe.h"
+#include "rt_log.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define DEVICE_LINE_SIZE        (256u) /**< maximum line of the cache file */
+#define DEVICE_MAX_FORMATS      (64u) /**< formats that fit in the mask */
+
+/*------------------------------------------------------------------------------
+ * Module Variable Definitions
+ ------------------------------------------------------------------------------*/
+/** rates of the bits of @ref device_caps.rates */
+static const uint32_t standard_rates[DEVICE_PROBE_NUM_RATES] = { 8000u,
+    11025u, 16000u, 22050u, 32000u, 44100u, 48000u, 64000u, 88200u, 96000u,
+    176400u, 192000u, 352800u, 384000u };
+
+/** devices loaded by @ref device_cache_load */
+static device_caps cached_devices[DEVICE_PROBE_MAX_DEVICES];
+
+/** entries used of @ref cached_devices */
+static uint32_t num_cached_devices = 0;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t device_probe (const char*, snd_pcm_stream_t, device_caps*)
+ *
+ * @brief Read the capabilities of a PCM
+ *
+ * @param[in]  *device_name  PCM to probe, e.g. hw:0,0
+ * @param       stream       direction to probe
+ * @param[out] *caps         capabilities of the PCM
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the device
+ *         can't be opened
+ *
+ ******************************************************************************/
+int8_t device_probe (const char *device_name, snd_pcm_stream_t stream,
+                     device_caps *caps)
+{
+  snd_pcm_hw_params_t *hw_params;
+  snd_pcm_t *handle;
+  int dir = 0;
+
+  if ( (NULL==device_name)||(NULL==caps) )
+  {
+    return S_ERROR;
+  }
+
+  if ( S_SUCCESS>snd_pcm_open (&handle, device_name, stream,
+                               PCM_OPEN_NONBLOCK_MODE) )
+  {
+    return S_ERROR;
+  }
+
+  snd_pcm_hw_params_alloca(&hw_params);
+  if ( S_SUCCESS>snd_pcm_hw_params_any (handle, hw_params) )
+  {
+    snd_pcm_close (handle);
+    return S_ERROR;
+  }
+
+  memset (caps, 0, sizeof(*caps));
+  strncpy (caps->device_name, device_name, sizeof(caps->device_name)-1u);
+  caps->stream = stream;
+  snd_pcm_hw_params_get_rate_min (hw_params, &caps->rate_min, &dir);
+  snd_pcm_hw_params_get_rate_max (hw_params, &caps->rate_max, &dir);
+  snd_pcm_hw_params_get_channels_min (hw_params, &caps->channels_min);
+  snd_pcm_hw_params_get_channels_max (hw_params, &caps->channels_max);
+  snd_pcm_hw_params_get_period_size_min (hw_params, &caps->period_min, &dir);
+  snd_pcm_hw_params_get_period_size_max (hw_params, &caps->period_max, &dir);
+  snd_pcm_hw_params_get_buffer_size_min (hw_params, &caps->buffer_min);
+  snd_pcm_hw_params_get_buffer_size_max (hw_params, &caps->buffer_max);
+
+  /* the test functions don't modify the configuration space */
+  for (uint32_t n = 0; n<DEVICE_PROBE_NUM_RATES; n++)
+  {
+    if ( S_SUCCESS==snd_pcm_hw_params_test_rate (handle, hw_params,
+                                                 standard_rates[n], 0) )
+    {
+      caps->rates |= 1u<<n;
+    }
+  }
+  for (uint32_t n = 0; (n<=SND_PCM_FORMAT_LAST)&&(DEVICE_MAX_FORMATS>n); n++)
+  {
+    if ( S_SUCCESS==snd_pcm_hw_params_test_format (handle, hw_params,
+                                                   (snd_pcm_format_t)n) )
+    {
+      caps->formats |= 1ull<<n;
+    }
+  }
+  for (uint32_t n = 0; n<=SND_PCM_ACCESS_LAST; n++)
+  {
+    if ( S_SUCCESS==snd_pcm_hw_params_test_access (handle, hw_params,
+                                                   (snd_pcm_access_t)n) )
+    {
+      caps->access |= 1u<<n;
+    }
+  }
+
+  snd_pcm_close (handle);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t device_probe_all (device_caps*, uint32_t, uint32_t*)
+ *
+ * @brief Probe both directions of every PCM of every card
+ *
+ * The devices are named hw:card,device, the devices in use are skipped with
+ * a warning
+ *
+ * @param[out] *caps         capabilities of the PCMs found
+ * @param       max_devices  size of @a caps
+ * @param[out] *num_devices  entries written in @a caps
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the cards
+ *         can't be listed
+ *
+ ******************************************************************************/
+int8_t device_probe_all (device_caps *caps, uint32_t max_devices,
+                         uint32_t *num_devices)
+{
+  const snd_pcm_stream_t streams[] = { SND_PCM_STREAM_PLAYBACK,
+      SND_PCM_STREAM_CAPTURE };
+  char name[DEVICE_PROBE_NAME_SIZE];
+  snd_pcm_info_t *info;
+  snd_ctl_t *ctl;
+  int card = -1;
+  int device;
+
+  if ( (NULL==caps)||(NULL==num_devices) )
+  {
+    return S_ERROR;
+  }
+
+  snd_pcm_info_alloca(&info);
+  *num_devices = 0;
+  while ( (S_SUCCESS==snd_card_next (&card))&&(0<=card) )
+  {
+    snprintf (name, sizeof(name), "hw:%d", card);
+    if ( S_SUCCESS>snd_ctl_open (&ctl, name, 0) )
+    {
+      printf ("device_probe_all Warning: opening the control of %s\n", name);
+      continue;
+    }
+
+    device = -1;
+    while ( (S_SUCCESS==snd_ctl_pcm_next_device (ctl, &device))&&(0<=device) )
+    {
+      for (uint32_t s = 0; s<sizeof(streams)/sizeof(streams[0]); s++)
+      {
+        snd_pcm_info_set_device (info, (unsigned int)device);
+        snd_pcm_info_set_subdevice (info, 0);
+        snd_pcm_info_set_stream (info, streams[s]);
+        /* the device doesn't have this direction */
+        if ( S_SUCCESS>snd_ctl_pcm_info (ctl, info) )
+        {
+          continue;
+        }
+
+        snprintf (name, sizeof(name), "hw:%d,%d", card, device);
+        if ( max_devices<=*num_devices )
+        {
+          printf ("device_probe_all Warning: more than %u devices\n",
+                  max_devices);
+          snd_ctl_close (ctl);
+          return S_SUCCESS;
+        }
+        if ( S_SUCCESS==device_probe (name, streams[s], &caps[*num_devices]) )
+        {
+          (*num_devices)++;
+        }
+        else
+        {
+          printf ("device_probe_all Warning: %s (%s) busy or not available\n",
+                  name, snd_pcm_stream_name (streams[s]));
+        }
+      }
+    }
+    snd_ctl_close (ctl);
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void device_caps_print (FILE*, const device_caps*)
+ *
+ * @brief Write the capabilities of a PCM in a readable way
+ *
+ * @param[in] *output  file to write, e.g. stdout
+ * @param[in] *caps    capabilities to write
+ *
+ ******************************************************************************/
+void device_caps_print (FILE *output, const device_caps *caps)
+{
+  if ( (NULL==output)||(NULL==caps) )
+  {
+    return;
+  }
+
+  fprintf (output, "%s %s\n", caps->device_name,
+           snd_pcm_stream_name (caps->stream));
+  fprintf (output, "  rates: %u - %u Hz:", caps->rate_min, caps->rate_max);
+  for (uint32_t n = 0; n<DEVICE_PROBE_NUM_RATES; n++)
+  {
+    if ( 0u!=(caps->rates&(1u<<n)) )
+    {
+      fprintf (output, " %u", standard_rates[n]);
+    }
+  }
+  fprintf (output, "\n  formats:");
+  for (uint32_t n = 0; n<DEVICE_MAX_FORMATS; n++)
+  {
+    if ( 0u!=(caps->formats&(1ull<<n)) )
+    {
+      fprintf (output, " %s", snd_pcm_format_name ((snd_pcm_format_t)n));
+    }
+  }
+  fprintf (output, "\n  access:");
+  for (uint32_t n = 0; n<=SND_PCM_ACCESS_LAST; n++)
+  {
+    if ( 0u!=(caps->access&(1u<<n)) )
+    {
+      fprintf (output, " %s", snd_pcm_access_name ((snd_pcm_access_t)n));
+    }
+  }
+  fprintf (output, "\n  channels: %u - %u\n", caps->channels_min,
+           caps->channels_max);
+  fprintf (output, "  period: %lu - %lu frames\n",
+           (unsigned long)caps->period_min, (unsigned long)caps->period_max);
+  fprintf (output, "  buffer: %lu - %lu frames\n",
+           (unsigned long)caps->buffer_min, (unsigned long)caps->buffer_max);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t device_cache_save (const char*, const device_caps*, uint32_t)
+ *
+ * @brief Write the capabilities of some devices in a cache file, replacing
+ *        the previous file
+ *
+ * @param[in] *path         path of the cache file
+ * @param[in] *caps         capabilities to store
+ * @param      num_devices  entries of @a caps
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t device_cache_save (const char *path, const device_caps *caps,
+                          uint32_t num_devices)
+{
+  char tmp_path[DEVICE_LINE_SIZE];
+  FILE *file;
+
+  if ( (NULL==path)||((NULL==caps)&&(0u!=num_devices)) )
+  {
+    return S_ERROR;
+  }
+
+  snprintf (tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  file = fopen (tmp_path, "w");
+  if ( NULL==file )
+  {
+    printf ("device_cache_save Error: opening %s\n", tmp_path);
+    return S_ERROR;
+  }
+
+  fprintf (file, "# alsa-lib %s\n", snd_asoundlib_version ());
+  fprintf (file, "# name stream rate_min rate_max rates formats access "
+           "channels_min channels_max period_min period_max buffer_min "
+           "buffer_max\n");
+  for (uint32_t n = 0; n<num_devices; n++)
+  {
+    fprintf (file, "%s %d %u %u %#x %#llx %#x %u %u %lu %lu %lu %lu\n",
+             caps[n].device_name, (int)caps[n].stream, caps[n].rate_min,
+             caps[n].rate_max, caps[n].rates,
+             (unsigned long long)caps[n].formats, caps[n].access,
+             caps[n].channels_min, caps[n].channels_max,
+             (unsigned long)caps[n].period_min,
+             (unsigned long)caps[n].period_max,
+             (unsigned long)caps[n].buffer_min,
+             (unsigned long)caps[n].buffer_max);
+  }
+  if ( 0!=fclose (file) )
+  {
+    return S_ERROR;
+  }
+
+  return (0==rename (tmp_path, path)) ? S_SUCCESS : S_ERROR;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t device_cache_load (const char*)
+ *
+ * @brief Load a cache file written by @ref device_cache_save, replacing the
+ *        devices loaded before
+ *
+ * @param[in] *path  path of the cache file
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the file
+ *         can't be read
+ *
+ ******************************************************************************/
+int8_t device_cache_load (const char *path)
+{
+  char line[DEVICE_LINE_SIZE];
+  device_caps *caps;
+  unsigned long long formats;
+  unsigned long frames[4];
+  int stream;
+  FILE *file;
+
+  if ( NULL==path )
+  {
+    return S_ERROR;
+  }
+
+  file = fopen (path, "r");
+  if ( NULL==file )
+  {
+    return S_ERROR;
+  }
+
+  num_cached_devices = 0;
+  while ( (DEVICE_PROBE_MAX_DEVICES>num_cached_devices)&&
+          (NULL!=fgets (line, sizeof(line), file)) )
+  {
+    caps = &cached_devices[num_cached_devices];
+    memset (caps, 0, sizeof(*caps));
+    if ( ('#'!=line[0])&&
+         (13==sscanf (line, "%63s %d %u %u %x %llx %x %u %u %lu %lu %lu %lu",
+                      caps->device_name, &stream, &caps->rate_min,
+                      &caps->rate_max, &caps->rates, &formats, &caps->access,
+                      &caps->channels_min, &caps->channels_max, &frames[0],
+                      &frames[1], &frames[2], &frames[3])) )
+    {
+      caps->stream = (snd_pcm_stream_t)stream;
+      caps->formats = formats;
+      caps->period_min = frames[0];
+      caps->period_max = frames[1];
+      caps->buffer_min = frames[2];
+      caps->buffer_max = frames[3];
+      num_cached_devices++;
+    }
+  }
+  fclose (file);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn const device_caps* device_cache_find (const char*, snd_pcm_stream_t)
+ *
+ * @brief Get the capabilities of a device loaded with @ref device_cache_load
+ *
+ * @param[in] *device_name  PCM to look for
+ * @param      stream       direction to look for
+ *
+ * @return const device_caps* capabilities of the device, NULL if it's not in
+ *         the cache
+ *
+ ******************************************************************************/
+const device_caps* device_cache_find (const char *device_name,
+                                      snd_pcm_stream_t stream)
+{
+  if ( NULL==device_name )
+  {
+    return NULL;
+  }
+
+  for (uint32_t n = 0; n<num_cached_devices; n++)
+  {
+    if ( (stream==cached_devices[n].stream)&&
+         (0==strcmp (device_name, cached_devices[n].device_name)) )
+    {
+      return &cached_devices[n];
+    }
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t device_cache_fit (const char*, snd_pcm_stream_t,
+ *                              hw_configuration*)
+ *
+ * @brief Adapt a configuration to the cached capabilities of a device
+ *
+ * The access, format and channels must be supported, the rate, period size
+ * and periods are moved inside the ranges of the device, with a warning if
+ * the rate changes. It can be called before opening the device, to skip the
+ * devices that can't play a configuration, it doesn't replace the
+ * negotiation. Nothing is changed if the device is not in the cache, which
+ * is keyed by the literal PCM name: only the @a hw:X,Y devices are there,
+ * not @a default or @a plughw:X,Y.
+ *
+ * @param[in]     *device_name  PCM to configure
+ * @param          stream       direction of the stream
+ * @param[in,out] *hw_config    configuration to adapt
+ *
+ * @return int8_t @a S_SUCCESS if the configuration can be used or the device
+ *         is unknown, @a S_ERROR if the device doesn't support it
+ *
+ ******************************************************************************/
+int8_t device_cache_fit (const char *device_name, snd_pcm_stream_t stream,
+                         hw_configuration *hw_config)
+{
+  const device_caps *caps = device_cache_find (device_name, stream);
+  snd_pcm_uframes_t buffer_size;
+  uint32_t rate;
+
+  if ( NULL==hw_config )
+  {
+    return S_ERROR;
+  }
+  if ( NULL==caps )
+  {
+    return S_SUCCESS;
+  }
+
+  if ( (SND_PCM_ACCESS_LAST<hw_config->access_type)||
+       (0u==(caps->access&(1u<<hw_config->access_type))) )
+  {
+    rt_log_printf ("device_cache_fit Error: %s doesn't support the access "
+                   "%s\n", device_name,
+                   snd_pcm_access_name (hw_config->access_type));
+    return S_ERROR;
+  }
+  if ( (0>(int)hw_config->format)||
+       (DEVICE_MAX_FORMATS<=(uint32_t)hw_config->format)||
+       (0u==(caps->formats&(1ull<<hw_config->format))) )
+  {
+    rt_log_printf ("device_cache_fit Error: %s doesn't support the format "
+                   "%s\n", device_name,
+                   snd_pcm_format_name (hw_config->format));
+    return S_ERROR;
+  }
+  if ( (caps->channels_min>hw_config->num_channels)||
+       (caps->channels_max<hw_config->num_channels) )
+  {
+    rt_log_printf ("device_cache_fit Error: %s doesn't support %u "
+                   "channels\n", device_name, hw_config->num_channels);
+    return S_ERROR;
+  }
+
+  if ( (caps->rate_min>hw_config->sample_rate)||
+       (caps->rate_max<hw_config->sample_rate) )
+  {
+    rate = (caps->rate_min>hw_config->sample_rate) ? caps->rate_min :
+        caps->rate_max;
+    rt_log_printf ("device_cache_fit Warning: %s doesn't support %u Hz, "
+                   "using %u Hz\n", device_name, hw_config->sample_rate, rate);
+    hw_config->sample_rate = rate;
+  }
+
+  if ( caps->period_min>hw_config->period_size )
+  {
+    hw_config->period_size = caps->period_min;
+  }
+  if ( caps->period_max<hw_config->period_size )
+  {
+    hw_config->period_size = caps->period_max;
+  }
+
+  /* the buffer is period_size*periods */
+  buffer_size = hw_config->period_size*hw_config->periods;
+  if ( (caps->buffer_min>buffer_size)&&(0u<hw_config->period_size) )
+  {
+    hw_config->periods = (uint32_t)((caps->buffer_min+
+        hw_config->period_size-1u)/hw_config->period_size);
+  }
+  if ( (caps->buffer_max<buffer_size)&&(caps->buffer_max>=
+      hw_config->period_size) )
+  {
+    hw_config->periods = (uint32_t)(caps->buffer_max/hw_config->period_size);
+  }
+
+  return S_SUCCESS;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,114 @@
+/*******************************************************************************
+ * @file      device_probe.h
+ *
+ * @brief      Capabilities of the PCM devices and cache file of them
+ *
+ * @ref device_probe_all walks every card and PCM and reads the rates,
+ * formats, channels, period and buffer sizes and access types that each one
+ * supports, @ref device_cache_save stores them in a text file (one line per
+ * device and stream). The programs load the file at startup with
+ * @ref device_cache_load, then @ref device_cache_fit rejects a configuration
+ * that a device can't play without opening it, and moves the rest inside
+ * the known ranges. It's only a check before the negotiation:
+ * @ref negotiate_hw (and so @ref configure_hw) still runs the whole ALSA
+ * negotiation, which decides the final values.
+ *
+ * The period and buffer ranges are the ones of the whole configuration space,
+ * the real limits of a configuration can be narrower.
+ *
+ * The devices are found by the name given to @a snd_pcm_open, the probe only
+ * walks the @a hw:X,Y devices so @a default, @a plughw:X,Y or any other
+ * plugin is never in the cache and goes straight to the negotiation. A
+ * plugin can't use the capabilities of its card anyway, e.g. @a plughw
+ * converts the formats and rates that the hardware doesn't have.
+ *
+ * @note The cache is not thread safe, load it before starting the audio threads
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <alsa/asoundlib.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _DEVICE_PROBE_
+#define _DEVICE_PROBE_
+
+#define DEVICE_PROBE_NAME_SIZE  (64u) /**< maximum length of a device name */
+#define DEVICE_PROBE_MAX_DEVICES (64u) /**< devices kept in the cache */
+#define DEVICE_PROBE_NUM_RATES  (14u) /**< standard rates tested */
+#define DEVICE_CACHE_PATH       ("alsa_devices.cache") /**< default cache
+                                                          file */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Capabilities of a PCM in one direction */
+typedef struct
+{
+  char device_name[DEVICE_PROBE_NAME_SIZE]; /**< PCM, e.g. hw:0,0 */
+  snd_pcm_stream_t stream; /**< direction probed */
+  uint32_t rate_min; /**< minimum rate in Hz */
+  uint32_t rate_max; /**< maximum rate in Hz */
+  uint32_t rates; /**< bit n set if the n-th standard rate is supported, see
+   @ref device_caps_print */
+  uint64_t formats; /**< bit n set if the @a snd_pcm_format_t n is
+   supported */
+  uint32_t access; /**< bit n set if the @a snd_pcm_access_t n is supported,
+   bits 0 and 1 are the MMAP interleaved and non interleaved access */
+  uint32_t channels_min; /**< minimum number of channels */
+  uint32_t channels_max; /**< maximum number of channels */
+  snd_pcm_uframes_t period_min; /**< minimum period size in frames */
+  snd_pcm_uframes_t period_max; /**< maximum period size in frames */
+  snd_pcm_uframes_t buffer_min; /**< minimum buffer size in frames */
+  snd_pcm_uframes_t buffer_max; /**< maximum buffer size in frames */
+} device_caps;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t device_probe (const char *device_name, snd_pcm_stream_t stream,
+                     device_caps *caps);
+int8_t device_probe_all (device_caps *caps, uint32_t max_devices,
+                         uint32_t *num_devices);
+void device_caps_print (FILE *output, const device_caps *caps);
+int8_t device_cache_save (const char *path, const device_caps *caps,
+                          uint32_t num_devices);
+int8_t device_cache_load (const char *path);
+const device_caps* device_cache_find (const char *device_name,
+                                      snd_pcm_stream_t stream);
+int8_t device_cache_fit (const char *device_name, snd_pcm_stream_t stream,
+                         hw_configuration *hw_config);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
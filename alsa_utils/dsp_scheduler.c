@@ -0,0 +1,604 @@
+/*******************************************************************************
+ * @file      dsp_scheduler.c
+ *
+ * @brief      Period synchronous scheduler of DSP jobs
+ *
+ * The deques are only filled by @ref dsp_scheduler_run before a period
+ * starts, when no worker is using them, so the owners never push and the
+ * deque doesn't need to grow. A period starts when the epoch is incremented
+ * and ends when there are no pending jobs and every worker has acknowledged
+ * the epoch, after that no worker touches the deques until the next epoch.
+ *
+ * The workers that went to sleep get a post in their semaphore, the
+ * ones still spinning see the new epoch directly.
+ *
+ * @note Link using -lpthread
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <string.h>
+#include "dsp_scheduler.h"
+#include "pcm_stats.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define SPIN_CHECK_INTERVAL     (64u) /**< spins between reads of the clock */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn void cpu_relax (void)
+ *
+ * @brief Hint the CPU that this is a spin loop
+ *
+ ******************************************************************************/
+static inline void cpu_relax (void)
+{
+#if defined(__x86_64__)||defined(__i386__)
+  __builtin_ia32_pause ();
+#elif defined(__aarch64__)
+  __asm__ volatile ("yield");
+#endif
+}
+
+/******************************************************************************
+ *
+ * @fn void spin_wait (const dsp_scheduler*, uint32_t*, uint64_t*)
+ *
+ * @brief One iteration of a busy wait, after spinning @a spin_ns the CPU is
+ *        given to the other threads, e.g. workers sharing the same core
+ *
+ ******************************************************************************/
+static void spin_wait (const dsp_scheduler *scheduler, uint32_t *spins,
+                       uint64_t *spin_end)
+{
+  if ( 0u==*spins )
+  {
+    *spin_end = pcm_stats_now_ns ()+scheduler->spin_ns;
+  }
+  (*spins)++;
+  if ( (0u==*spins%SPIN_CHECK_INTERVAL)&&
+       (pcm_stats_now_ns ()>*spin_end) )
+  {
+    sched_yield ();
+  }
+  else
+  {
+    cpu_relax ();
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn dsp_job* deque_pop (dsp_deque*)
+ *
+ * @brief Take the newest job of a deque (owner side)
+ *
+ ******************************************************************************/
+static dsp_job* deque_pop (dsp_deque *deque)
+{
+  long bottom = atomic_load_explicit (&deque->bottom, memory_order_relaxed)-1;
+  long top;
+  dsp_job *job = NULL;
+
+  atomic_store_explicit (&deque->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence (memory_order_seq_cst);
+  top = atomic_load_explicit (&deque->top, memory_order_relaxed);
+
+  if ( top<=bottom )
+  {
+    job = deque->jobs[bottom&(long)(DSP_DEQUE_SIZE-1u)];
+    if ( top==bottom )
+    {
+      /* last job, a thief can be taking it too */
+      if ( !atomic_compare_exchange_strong_explicit (&deque->top, &top,
+                                                     top+1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed) )
+      {
+        job = NULL;
+      }
+      atomic_store_explicit (&deque->bottom, bottom+1, memory_order_relaxed);
+    }
+  }
+  else
+  {
+    atomic_store_explicit (&deque->bottom, bottom+1, memory_order_relaxed);
+  }
+
+  return job;
+}
+
+/******************************************************************************
+ *
+ * @fn dsp_job* deque_steal (dsp_deque*)
+ *
+ * @brief Take the oldest job of a deque (thief side)
+ *
+ ******************************************************************************/
+static dsp_job* deque_steal (dsp_deque *deque)
+{
+  long top = atomic_load_explicit (&deque->top, memory_order_acquire);
+  long bottom;
+  dsp_job *job;
+
+  atomic_thread_fence (memory_order_seq_cst);
+  bottom = atomic_load_explicit (&deque->bottom, memory_order_acquire);
+  if ( top>=bottom )
+  {
+    return NULL;
+  }
+
+  job = deque->jobs[top&(long)(DSP_DEQUE_SIZE-1u)];
+  if ( !atomic_compare_exchange_strong_explicit (&deque->top, &top, top+1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed) )
+  {
+    return NULL;
+  }
+
+  return job;
+}
+
+/******************************************************************************
+ *
+ * @fn uint8_t claim_epoch (dsp_worker*, uint32_t)
+ *
+ * @brief Take the period of a worker, either the worker joining it or the
+ *        scheduler closing it without the worker, only one of them succeeds
+ *
+ * Only a period newer than the last claimed one can be taken, a worker
+ * preempted after reading an old epoch must not take a period that the
+ * scheduler already closed for it.
+ *
+ ******************************************************************************/
+static uint8_t claim_epoch (dsp_worker *worker, uint32_t epoch)
+{
+  uint32_t last = atomic_load (&worker->claimed_epoch);
+
+  while ( 0<(int32_t)(epoch-last) )
+  {
+    if ( atomic_compare_exchange_strong (&worker->claimed_epoch, &last,
+                                         epoch) )
+    {
+      return 1u;
+    }
+  }
+
+  return 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn void work_period (dsp_scheduler*, dsp_worker*)
+ *
+ * @brief Run the jobs of the worker and steal from the others until all the
+ *        jobs of the period are finished
+ *
+ ******************************************************************************/
+static void work_period (dsp_scheduler *scheduler, dsp_worker *worker)
+{
+  uint32_t victim = worker->index;
+  uint32_t spins = 0;
+  uint64_t spin_end = 0;
+  dsp_job *job;
+
+  while ( 0u<atomic_load_explicit (&scheduler->pending, memory_order_acquire) )
+  {
+    job = deque_pop (&worker->deque);
+    for (uint32_t n = 1; (NULL==job)&&(n<scheduler->num_workers); n++)
+    {
+      victim = (victim+1u==scheduler->num_workers) ? 0u : victim+1u;
+      if ( victim!=worker->index )
+      {
+        job = deque_steal (&scheduler->workers[victim].deque);
+        if ( NULL!=job )
+        {
+          atomic_fetch_add_explicit (&worker->jobs_stolen, 1u,
+                                     memory_order_relaxed);
+        }
+      }
+    }
+
+    if ( NULL==job )
+    {
+      /* the last jobs are running in other workers */
+      spin_wait (scheduler, &spins, &spin_end);
+      continue;
+    }
+
+    if ( S_SUCCESS!=job->function (job->argument) )
+    {
+      atomic_store_explicit (&scheduler->error, S_ERROR, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit (&worker->jobs_run, 1u, memory_order_relaxed);
+    atomic_fetch_sub_explicit (&scheduler->pending, 1u, memory_order_acq_rel);
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t wait_epoch (dsp_scheduler*, dsp_worker*, uint32_t)
+ *
+ * @brief Wait for the next period, spinning first and then sleeping
+ *
+ ******************************************************************************/
+static uint32_t wait_epoch (dsp_scheduler *scheduler, dsp_worker *worker,
+                            uint32_t last_epoch)
+{
+  uint64_t spin_end = pcm_stats_now_ns ()+scheduler->spin_ns;
+  uint32_t epoch;
+
+  for (uint32_t n = 1;; n++)
+  {
+    epoch = atomic_load_explicit (&scheduler->epoch, memory_order_acquire);
+    if ( (epoch!=last_epoch)||
+         (!atomic_load_explicit (&scheduler->running, memory_order_relaxed)) )
+    {
+      return epoch;
+    }
+    if ( (0u==n%SPIN_CHECK_INTERVAL)&&(pcm_stats_now_ns ()>spin_end) )
+    {
+      break;
+    }
+    cpu_relax ();
+  }
+
+  /* the flag is set before checking the epoch again, so either we see the
+   * new epoch or the scheduler sees the flag and posts the semaphore */
+  atomic_store (&worker->sleeping, 1u);
+  epoch = atomic_load (&scheduler->epoch);
+  if ( (epoch!=last_epoch)||(!atomic_load (&scheduler->running)) )
+  {
+    if ( 0u!=atomic_exchange (&worker->sleeping, 0u) )
+    {
+      return epoch;
+    }
+    /* the scheduler took the flag, its post must be consumed */
+  }
+
+  while ( 0!=sem_wait (&worker->wakeup) )
+  {
+  }
+
+  return atomic_load_explicit (&scheduler->epoch, memory_order_acquire);
+}
+
+/******************************************************************************
+ *
+ * @fn void* worker_thread (void*)
+ *
+ * @brief Thread of a worker, it runs the jobs of each period
+ *
+ * @param[in] *arg  pointer to the worker
+ *
+ * @return void* NULL
+ *
+ ******************************************************************************/
+static void* worker_thread (void *arg)
+{
+  dsp_worker *worker = (dsp_worker*)arg;
+  dsp_scheduler *scheduler = worker->scheduler;
+  rt_configuration rt_config = scheduler->worker_rt_config;
+  /* epoch of the init, a thread starting late must not skip a period */
+  uint32_t epoch = atomic_load (&worker->done_epoch);
+  uint64_t delay;
+
+  if ( RT_KEEP_AFFINITY!=scheduler->first_cpu )
+  {
+    rt_config.cpu = scheduler->first_cpu+(int)worker->index;
+  }
+  configure_rt_thread (&rt_config);
+
+  for (;;)
+  {
+    epoch = wait_epoch (scheduler, worker, epoch);
+    if ( !atomic_load_explicit (&scheduler->running, memory_order_acquire) )
+    {
+      break;
+    }
+    if ( 0u==claim_epoch (worker, epoch) )
+    {
+      /* the period finished before this worker woke up */
+      continue;
+    }
+    if ( epoch!=atomic_load (&scheduler->epoch) )
+    {
+      /* stale period, acknowledge it without touching the deques */
+      atomic_store_explicit (&worker->done_epoch, epoch, memory_order_release);
+      continue;
+    }
+
+    delay = pcm_stats_now_ns ()-atomic_load_explicit (
+        &scheduler->epoch_start_ns, memory_order_relaxed);
+    if ( delay>atomic_load_explicit (&worker->max_wakeup_ns,
+                                     memory_order_relaxed) )
+    {
+      atomic_store_explicit (&worker->max_wakeup_ns, delay,
+                             memory_order_relaxed);
+    }
+
+    work_period (scheduler, worker);
+    atomic_store_explicit (&worker->done_epoch, epoch, memory_order_release);
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn void wake_workers (dsp_scheduler*)
+ *
+ * @brief Post the semaphore of the workers that went to sleep
+ *
+ ******************************************************************************/
+static void wake_workers (dsp_scheduler *scheduler)
+{
+  for (uint32_t w = 1; w<scheduler->num_workers; w++)
+  {
+    if ( 0u!=atomic_exchange (&scheduler->workers[w].sleeping, 0u) )
+    {
+      sem_post (&scheduler->workers[w].wakeup);
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t dsp_scheduler_init (dsp_scheduler*, uint32_t,
+ *                                const rt_configuration*)
+ *
+ * @brief Create the pool of workers
+ *
+ * @param[out] *scheduler    pointer to the scheduler
+ * @param       num_threads  threads running the jobs, including the one
+ *                           calling @ref dsp_scheduler_run (1 runs all the
+ *                           jobs in the caller), usually the number of
+ *                           cores available for the audio
+ * @param[in]  *rt_config    priority of the workers and CPU of the caller,
+ *                           the workers are pinned to the next CPUs, NULL
+ *                           to keep the defaults. The memory is not locked
+ *                           by the workers, it's done once by the caller
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t dsp_scheduler_init (dsp_scheduler *scheduler, uint32_t num_threads,
+                           const rt_configuration *rt_config)
+{
+  void *workers;
+  uint32_t created;
+
+  if ( (NULL==scheduler)||(0u==num_threads)||
+       (DSP_MAX_WORKERS+1u<num_threads) )
+  {
+    return S_ERROR;
+  }
+
+  if ( 0!=posix_memalign (&workers, 64u, sizeof(dsp_worker)*num_threads) )
+  {
+    return S_ERROR;
+  }
+  memset (workers, 0, sizeof(dsp_worker)*num_threads);
+
+  scheduler->workers = (dsp_worker*)workers;
+  scheduler->num_workers = num_threads;
+  scheduler->spin_ns = DSP_DEFAULT_SPIN_NS;
+  scheduler->first_cpu = RT_KEEP_AFFINITY;
+  scheduler->worker_rt_config.priority = RT_KEEP_POLICY;
+  scheduler->worker_rt_config.cpu = RT_KEEP_AFFINITY;
+  scheduler->worker_rt_config.lock_memory = 0u;
+  scheduler->worker_rt_config.stack_prefault_size = RT_DEFAULT_STACK_SIZE;
+  if ( NULL!=rt_config )
+  {
+    scheduler->worker_rt_config.priority = rt_config->priority;
+    scheduler->first_cpu = rt_config->cpu;
+  }
+  atomic_init (&scheduler->epoch, 0u);
+  atomic_init (&scheduler->epoch_start_ns, 0u);
+  atomic_init (&scheduler->pending, 0u);
+  atomic_init (&scheduler->error, S_SUCCESS);
+  atomic_init (&scheduler->running, 1u);
+
+  for (created = 0; created<num_threads; created++)
+  {
+    dsp_worker *worker = &scheduler->workers[created];
+
+    worker->scheduler = scheduler;
+    worker->index = created;
+    atomic_init (&worker->deque.top, 0);
+    atomic_init (&worker->deque.bottom, 0);
+    atomic_init (&worker->sleeping, 0u);
+    atomic_init (&worker->done_epoch, 0u);
+    atomic_init (&worker->claimed_epoch, 0u);
+    if ( 0!=sem_init (&worker->wakeup, 0, 0u) )
+    {
+      break;
+    }
+    if ( (0u<created)&&
+         (0!=pthread_create (&worker->thread, NULL, worker_thread, worker)) )
+    {
+      sem_destroy (&worker->wakeup);
+      break;
+    }
+  }
+
+  if ( created!=num_threads )
+  {
+    printf ("dsp_scheduler_init Error: creating worker %u\n", created);
+    scheduler->num_workers = created;
+    dsp_scheduler_destroy (scheduler);
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t dsp_scheduler_run (dsp_scheduler*, dsp_job*, uint32_t)
+ *
+ * @brief Run the jobs of a period and wait until all of them are finished
+ *
+ * Only one thread can call this function, it works as the worker 0
+ *
+ * @param[in] *scheduler  pointer to the scheduler
+ * @param[in] *jobs       jobs of the period, they can run in any order
+ * @param      num_jobs   number of jobs, up to @ref DSP_DEQUE_SIZE for each
+ *                        thread
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if any job
+ *         failed
+ *
+ ******************************************************************************/
+int8_t dsp_scheduler_run (dsp_scheduler *scheduler, dsp_job *jobs,
+                          uint32_t num_jobs)
+{
+  uint32_t workers;
+  uint32_t epoch;
+  uint32_t spins = 0;
+  uint64_t spin_end = 0;
+  dsp_deque *deque;
+
+  if ( (NULL==scheduler)||(NULL==jobs)||
+       (num_jobs>DSP_DEQUE_SIZE*scheduler->num_workers) )
+  {
+    return S_ERROR;
+  }
+
+  workers = scheduler->num_workers;
+  for (uint32_t w = 0; w<workers; w++)
+  {
+    atomic_store_explicit (&scheduler->workers[w].deque.top, 0,
+                           memory_order_relaxed);
+    atomic_store_explicit (&scheduler->workers[w].deque.bottom, 0,
+                           memory_order_relaxed);
+  }
+  for (uint32_t n = 0; n<num_jobs; n++)
+  {
+    deque = &scheduler->workers[n%workers].deque;
+    deque->jobs[n/workers] = &jobs[n];
+  }
+  for (uint32_t w = 0; w<workers; w++)
+  {
+    atomic_store_explicit (&scheduler->workers[w].deque.bottom,
+                           (long)((num_jobs+workers-1u-w)/workers),
+                           memory_order_relaxed);
+  }
+  atomic_store_explicit (&scheduler->error, S_SUCCESS, memory_order_relaxed);
+  atomic_store_explicit (&scheduler->pending, num_jobs, memory_order_relaxed);
+  atomic_store_explicit (&scheduler->epoch_start_ns, pcm_stats_now_ns (),
+                         memory_order_relaxed);
+
+  /* publishes the deques to the workers */
+  epoch = atomic_fetch_add (&scheduler->epoch, 1u)+1u;
+  wake_workers (scheduler);
+
+  work_period (scheduler, &scheduler->workers[0]);
+
+  /* barrier, the deques can't be reused while a worker looks at them, the
+   * workers that didn't join the period yet are kept out of it */
+  for (uint32_t w = 1; w<workers; w++)
+  {
+    if ( 0u!=claim_epoch (&scheduler->workers[w], epoch) )
+    {
+      continue;
+    }
+    while ( epoch!=atomic_load_explicit (&scheduler->workers[w].done_epoch,
+                                         memory_order_acquire) )
+    {
+      spin_wait (scheduler, &spins, &spin_end);
+    }
+  }
+
+  return (int8_t)atomic_load_explicit (&scheduler->error,
+                                       memory_order_relaxed);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t dsp_stage_job (void*)
+ *
+ * @brief @ref dsp_job_function running a @ref dsp_stage_callback over some
+ *        channels, e.g. one job per channel or per group of channels
+ *
+ * @param[in] *argument  pointer to a @ref dsp_stage_task
+ *
+ * @return int8_t result of the stage
+ *
+ ******************************************************************************/
+int8_t dsp_stage_job (void *argument)
+{
+  dsp_stage_task *task = (dsp_stage_task*)argument;
+
+  return task->process (task->channels, task->num_channels, task->frames,
+                        task->user_data);
+}
+
+/******************************************************************************
+ *
+ * @fn void dsp_scheduler_destroy (dsp_scheduler*)
+ *
+ * @brief Stop the workers and free the pool
+ *
+ * @param[in] *scheduler  pointer to the scheduler
+ *
+ ******************************************************************************/
+void dsp_scheduler_destroy (dsp_scheduler *scheduler)
+{
+  if ( (NULL==scheduler)||(NULL==scheduler->workers) )
+  {
+    return;
+  }
+
+  atomic_store (&scheduler->running, 0u);
+  for (uint32_t w = 1; w<scheduler->num_workers; w++)
+  {
+    sem_post (&scheduler->workers[w].wakeup);
+  }
+  for (uint32_t w = 0; w<scheduler->num_workers; w++)
+  {
+    if ( 0u<w )
+    {
+      pthread_join (scheduler->workers[w].thread, NULL);
+    }
+    sem_destroy (&scheduler->workers[w].wakeup);
+  }
+
+  free (scheduler->workers);
+  scheduler->workers = NULL;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
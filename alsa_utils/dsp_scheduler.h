@@ -0,0 +1,155 @@
+/*******************************************************************************
+ * @file      dsp_scheduler.h
+ *
+ * @brief      Period synchronous scheduler of DSP jobs
+ *
+ * Runs the jobs of a period (e.g. the filters of each channel) in a fixed
+ * pool of worker threads and returns when all of them are done, so the
+ * period can be given to the sound card:
+ *      @li each worker has a work stealing deque, the jobs are spread between
+ *          the deques and a worker without jobs steals from the others
+ *      @li the thread calling @ref dsp_scheduler_run works too, it doesn't
+ *          sleep while the workers process the period
+ *      @li the workers spin for @a spin_ns after a period before sleeping, so
+ *          the wake up of the next period is only a store if the periods are
+ *          short
+ *      @li a worker has to join a period before looking at the deques, the
+ *          caller only waits for the workers that joined, so a worker that
+ *          wakes up after the last job doesn't delay the period
+ *      @li the workers can be pinned to consecutive CPUs and run with the
+ *          real time priority of the caller
+ *
+ * The @ref dsp_job array and everything used by the jobs must not change
+ * while @ref dsp_scheduler_run is running.
+ *
+ * @note Link using -lpthread
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "alsa_utils.h"
+#include "rt_setup.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _DSP_SCHEDULER_
+#define _DSP_SCHEDULER_
+
+#define DSP_MAX_WORKERS         (63u) /**< worker threads, plus the caller */
+#define DSP_DEQUE_SIZE          (256u) /**< jobs of each deque, power of 2 */
+#define DSP_DEFAULT_SPIN_NS     (100000u) /**< spin before sleeping */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Function of a job
+ *
+ * @param[in] *argument  pointer given in the @ref dsp_job
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise */
+typedef int8_t (*dsp_job_function) (void *argument);
+
+/** Job of a period */
+typedef struct
+{
+  dsp_job_function function; /**< work to do */
+  void *argument; /**< pointer given to @a function */
+} dsp_job;
+
+/** Argument of @ref dsp_stage_job, a stage over some channels */
+typedef struct
+{
+  dsp_stage_callback process; /**< stage to run */
+  void *user_data; /**< pointer given to the stage */
+  float **channels; /**< first channel of the job */
+  uint32_t num_channels; /**< channels of the job */
+  uint32_t frames; /**< frames of the period */
+} dsp_stage_task;
+
+/** Work stealing deque (Chase-Lev) with a fixed size, the owner takes jobs
+ * from the bottom and the thieves from the top */
+typedef struct
+{
+  _Alignas(64) atomic_long top; /**< next job to steal */
+  _Alignas(64) atomic_long bottom; /**< next free slot */
+  _Alignas(64) dsp_job *jobs[DSP_DEQUE_SIZE]; /**< jobs of the period */
+} dsp_deque;
+
+struct dsp_scheduler_s;
+
+/** Worker of the scheduler, index 0 is the thread calling
+ * @ref dsp_scheduler_run */
+typedef struct
+{
+  dsp_deque deque; /**< jobs of this worker */
+  _Alignas(64) struct dsp_scheduler_s *scheduler; /**< owner */
+  uint32_t index; /**< position in the pool */
+  pthread_t thread; /**< thread of the worker */
+  sem_t wakeup; /**< posted when the worker sleeps and a period starts */
+  atomic_uint sleeping; /**< 1 while the worker waits in @a wakeup */
+  atomic_uint done_epoch; /**< last period finished by the worker */
+  atomic_uint claimed_epoch; /**< last period joined by the worker or
+   closed without it by @ref dsp_scheduler_run */
+  atomic_uint_fast64_t jobs_run; /**< jobs executed */
+  atomic_uint_fast64_t jobs_stolen; /**< jobs taken from the others */
+  atomic_uint_fast64_t max_wakeup_ns; /**< longest delay between the start
+   of a period and the wake up of the worker */
+} dsp_worker;
+
+/** Scheduler */
+typedef struct dsp_scheduler_s
+{
+  _Alignas(64) atomic_uint epoch; /**< incremented for each period */
+  atomic_uint_fast64_t epoch_start_ns; /**< start time of the period */
+  _Alignas(64) atomic_uint pending; /**< jobs not finished */
+  atomic_int error; /**< @a S_ERROR if a job failed */
+  atomic_uint running; /**< cleared to stop the workers */
+  uint32_t num_workers; /**< workers, including the caller */
+  uint64_t spin_ns; /**< spin of the workers before sleeping */
+  rt_configuration worker_rt_config; /**< priority of the workers */
+  int first_cpu; /**< CPU of the caller, the workers use the next ones */
+  dsp_worker *workers; /**< pool of workers */
+} dsp_scheduler;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t dsp_scheduler_init (dsp_scheduler *scheduler, uint32_t num_threads,
+                           const rt_configuration *rt_config);
+int8_t dsp_scheduler_run (dsp_scheduler *scheduler, dsp_job *jobs,
+                          uint32_t num_jobs);
+int8_t dsp_stage_job (void *argument);
+void dsp_scheduler_destroy (dsp_scheduler *scheduler);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,564 @@
+/*******************************************************************************
+ * @file      duplex_engine.c
+ *
+ * @brief      Full duplex capture, processing and playback
+ *
+ * The loop waits in @a snd_pcm_readi for a captured period, processes it
+ * and writes it with @a snd_pcm_writei, the playback buffer keeps the
+ * periods of silence written before the start, that is the margin the
+ * processing has.
+ *
+ * On any xrun both streams are stopped, prepared, filled again and started
+ * together, so the alignment between capture and playback (and so the
+ * latency) is the same after the recovery.
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "duplex_engine.h"
+#include "sample_convert.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define IMPULSE_LEVEL           (0.5f) /**< value of the impulse sent */
+#define IMPULSE_THRESHOLD       (0.1f) /**< captured value seen as impulse */
+#define IMPULSE_INTERVAL_DIV    (4u) /**< impulses sent each second */
+
+/*------------------------------------------------------------------------------
+ * Module Typedefs
+ ------------------------------------------------------------------------------*/
+/** State of the latency measurement */
+typedef struct
+{
+  uint32_t impulses; /**< impulses to detect */
+  uint8_t waiting; /**< 1 while an impulse is travelling */
+  uint64_t impulse_frame; /**< captured frame replaced by the impulse */
+  uint64_t next_impulse; /**< captured frame for the next impulse */
+  uint64_t sum_frames; /**< sum of the round trips */
+  duplex_latency *result; /**< results */
+} latency_probe;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t start_streams (duplex_engine*)
+ *
+ * @brief Prepare both streams, fill the playback buffer with silence and
+ *        start them
+ *
+ * @param[in] *engine  duplex engine
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+static int8_t start_streams (duplex_engine *engine)
+{
+  snd_pcm_sframes_t written;
+
+  snd_pcm_drop (engine->capture_handle);
+  snd_pcm_drop (engine->playback_handle);
+  if ( (S_SUCCESS>snd_pcm_prepare (engine->capture_handle))||
+       ((0u==engine->linked)&&
+        (S_SUCCESS>snd_pcm_prepare (engine->playback_handle))) )
+  {
+    return S_ERROR;
+  }
+
+  memset (engine->playback_buffer, 0, engine->pool.block_bytes);
+  for (uint32_t n = 0; n<engine->prefill_periods; n++)
+  {
+    written = snd_pcm_writei (engine->playback_handle, engine->playback_buffer,
+                              engine->period_size);
+    if ( 0>written )
+    {
+      return S_ERROR;
+    }
+  }
+
+  /* with a small start threshold the writes could have started the
+   * playback, and with it the linked capture, already */
+  if ( (SND_PCM_STATE_PREPARED==snd_pcm_state (engine->capture_handle))&&
+       (S_SUCCESS>snd_pcm_start (engine->capture_handle)) )
+  {
+    return S_ERROR;
+  }
+  if ( (0u==engine->linked)&&
+       (SND_PCM_STATE_PREPARED==snd_pcm_state (engine->playback_handle))&&
+       (S_SUCCESS>snd_pcm_start (engine->playback_handle)) )
+  {
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void probe_period (duplex_engine*, latency_probe*, uint64_t)
+ *
+ * @brief Look for the impulse in the captured period and put the next one in
+ *        the period to play
+ *
+ * The streams start together, so a frame captured at position @a n was
+ * recorded while the playback frame @a n was being played. The impulse is
+ * timed from the position of the captured period that carries it, so the
+ * round trip is the latency from the input to the output of the chain
+ * (prefill of the playback buffer plus both converters)
+ *
+ * @param[in]     *engine   duplex engine
+ * @param[in,out] *probe    state of the measurement
+ * @param          position frames captured (and played) before this period
+ *
+ ******************************************************************************/
+static void probe_period (duplex_engine *engine, latency_probe *probe,
+                          uint64_t position)
+{
+  duplex_latency *result = probe->result;
+  uint32_t frames;
+  float value;
+
+  for (uint32_t n = 0; (0u!=probe->waiting)&&(n<engine->period_size); n++)
+  {
+    for (uint32_t ch = 0; ch<engine->num_channels; ch++)
+    {
+      value = engine->channels[ch][n];
+      if ( ((IMPULSE_THRESHOLD<value)||(-IMPULSE_THRESHOLD>value))&&
+           (position+n>=probe->impulse_frame) )
+      {
+        frames = (uint32_t)(position+n-probe->impulse_frame);
+        if ( (0u==result->measurements)||(frames<result->min_frames) )
+        {
+          result->min_frames = frames;
+        }
+        if ( frames>result->max_frames )
+        {
+          result->max_frames = frames;
+        }
+        result->measurements++;
+        probe->sum_frames += frames;
+        probe->waiting = 0u;
+        break;
+      }
+    }
+  }
+
+  /* after a second the impulse is considered lost */
+  if ( (0u!=probe->waiting)&&
+       (position>probe->impulse_frame+engine->sample_rate) )
+  {
+    result->missed++;
+    probe->waiting = 0u;
+  }
+
+  /* the stages are not run, the output is silence with the impulses */
+  for (uint32_t ch = 0; ch<engine->num_channels; ch++)
+  {
+    memset (engine->channels[ch], 0, sizeof(float)*engine->period_size);
+  }
+
+  if ( (0u==probe->waiting)&&(position>=probe->next_impulse)&&
+       (result->measurements+result->missed<probe->impulses) )
+  {
+    for (uint32_t ch = 0; ch<engine->num_channels; ch++)
+    {
+      engine->channels[ch][0] = IMPULSE_LEVEL;
+    }
+    probe->impulse_frame = position;
+    probe->next_impulse = position+engine->sample_rate/IMPULSE_INTERVAL_DIV;
+    probe->waiting = 1u;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t run_loop (duplex_engine*, uint64_t, latency_probe*)
+ *
+ * @brief Capture, process and play periods until stopped
+ *
+ * @param[in] *engine        duplex engine
+ * @param      total_frames  frames to process, 0 to run until stopped
+ * @param[in] *probe         latency measurement, NULL to run the stages
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+static int8_t run_loop (duplex_engine *engine, uint64_t total_frames,
+                        latency_probe *probe)
+{
+  snd_pcm_uframes_t period = engine->period_size;
+  uint64_t position = 0;
+  snd_pcm_sframes_t frames;
+  snd_pcm_uframes_t done;
+  uint8_t restart;
+
+  atomic_store (&engine->running, 1u);
+  if ( S_SUCCESS!=start_streams (engine) )
+  {
+    printf ("duplex_engine Error: starting the streams\n");
+    return S_ERROR;
+  }
+
+  while ( atomic_load_explicit (&engine->running, memory_order_relaxed) )
+  {
+    if ( (0u!=total_frames)&&(position>=total_frames) )
+    {
+      break;
+    }
+    if ( (NULL!=probe)&&
+         (probe->result->measurements+probe->result->missed>=probe->impulses) )
+    {
+      break;
+    }
+
+    /* readi only returns less than a period on errors or signals */
+    restart = 0u;
+    for (done = 0; (0u==restart)&&(done<period); )
+    {
+      frames = snd_pcm_readi (engine->capture_handle,
+                              (uint8_t*)engine->capture_buffer+
+                              snd_pcm_frames_to_bytes (engine->capture_handle,
+                                                       (snd_pcm_sframes_t)done),
+                              period-done);
+      if ( 0>frames )
+      {
+        restart = 1u;
+      }
+      else
+      {
+        done += (snd_pcm_uframes_t)frames;
+      }
+    }
+
+    if ( 0u==restart )
+    {
+      convert_format_to_float (engine->capture_buffer, engine->channels,
+                               (uint32_t)period, engine->num_channels,
+                               engine->format);
+      if ( NULL!=probe )
+      {
+        probe_period (engine, probe, position);
+      }
+      else
+      {
+        for (uint32_t s = 0; s<engine->num_stages; s++)
+        {
+          dsp_stage *stage = &engine->stages[s];
+
+          if ( S_SUCCESS!=stage->process (engine->channels,
+                                          engine->num_channels,
+                                          (uint32_t)period, stage->user_data) )
+          {
+            snd_pcm_drop (engine->capture_handle);
+            snd_pcm_drop (engine->playback_handle);
+            atomic_store (&engine->running, 0u);
+            return S_ERROR;
+          }
+        }
+      }
+
+      for (uint32_t n = 0; n<period; n++)
+      {
+        for (uint32_t ch = 0; ch<engine->num_channels; ch++)
+        {
+          engine->interleaved[n*engine->num_channels+ch] =
+              engine->channels[ch][n];
+        }
+      }
+      convert_float_to_format (engine->interleaved, engine->playback_buffer,
+                               (uint32_t)period*engine->num_channels,
+                               engine->format);
+
+      frames = snd_pcm_writei (engine->playback_handle,
+                               engine->playback_buffer, period);
+      restart = (0>frames) ? 1u : 0u;
+      position += period;
+      engine->periods++;
+    }
+
+    if ( 0u!=restart )
+    {
+      /* the alignment of the streams is lost, start both again */
+      engine->xruns++;
+      if ( NULL!=probe )
+      {
+        probe->waiting = 0u;
+        probe->next_impulse = 0u;
+      }
+      position = 0u;
+      if ( S_SUCCESS!=start_streams (engine) )
+      {
+        printf ("duplex_engine Error: restarting the streams\n");
+        atomic_store (&engine->running, 0u);
+        return S_ERROR;
+      }
+    }
+  }
+
+  snd_pcm_drop (engine->capture_handle);
+  snd_pcm_drop (engine->playback_handle);
+  atomic_store (&engine->running, 0u);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t duplex_engine_init (duplex_engine*, snd_pcm_t*, snd_pcm_t*,
+ *                                const hw_configuration*)
+ *
+ * @brief Create a duplex engine for two configured streams and link them
+ *
+ * If the streams can't be linked (e.g. different sound cards) they're
+ * started one after the other and the latency measured can change between
+ * runs
+ *
+ * @param[out] *engine           pointer to the engine
+ * @param[in]  *capture_handle   capture stream configured with
+ *                               @ref configure_hw
+ * @param[in]  *playback_handle  playback stream configured with
+ *                               @ref configure_hw
+ * @param[in]  *hw_config        configuration of both streams
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t duplex_engine_init (duplex_engine *engine, snd_pcm_t *capture_handle,
+                           snd_pcm_t *playback_handle,
+                           const hw_configuration *hw_config)
+{
+  size_t block_bytes;
+  float *storage;
+
+  if ( (NULL==engine)||(NULL==capture_handle)||(NULL==playback_handle)||
+       (NULL==hw_config)||(0u==hw_config->period_size)||
+       (MAX_CHANNELS<hw_config->num_channels)||
+       (NULL==sample_convert_get_kernel (hw_config->format)) )
+  {
+    return S_ERROR;
+  }
+
+  if ( SND_PCM_ACCESS_RW_INTERLEAVED!=hw_config->access_type )
+  {
+    printf ("duplex_engine_init Error: the access must be RW interleaved\n");
+    return S_ERROR;
+  }
+
+  memset (engine, 0, sizeof(*engine));
+  engine->capture_handle = capture_handle;
+  engine->playback_handle = playback_handle;
+  engine->period_size = hw_config->period_size;
+  engine->num_channels = hw_config->num_channels;
+  engine->sample_rate = hw_config->sample_rate;
+  engine->format = hw_config->format;
+  engine->prefill_periods = (1u<hw_config->periods) ?
+      hw_config->periods-1u : 1u;
+
+  /** @b buffer_pool a float sample is the biggest sample supported, so all
+   * the buffers of a period fit in blocks of the same size */
+  block_bytes = sizeof(float)*engine->period_size*engine->num_channels;
+  if ( S_SUCCESS!=buffer_pool_init (&engine->pool, block_bytes, 4u,
+                                    BUFFER_POOL_LOCK) )
+  {
+    return S_ERROR;
+  }
+  engine->capture_buffer = buffer_pool_acquire (&engine->pool);
+  engine->playback_buffer = buffer_pool_acquire (&engine->pool);
+  engine->interleaved = (float*)buffer_pool_acquire (&engine->pool);
+  engine->float_storage = buffer_pool_acquire (&engine->pool);
+  storage = (float*)engine->float_storage;
+  for (uint32_t ch = 0; ch<engine->num_channels; ch++)
+  {
+    engine->channels[ch] = &storage[ch*engine->period_size];
+  }
+
+  if ( 0==snd_pcm_link (capture_handle, playback_handle) )
+  {
+    engine->linked = 1u;
+  }
+  else
+  {
+    printf ("duplex_engine_init Warning: the streams can't be linked\n");
+  }
+  atomic_init (&engine->running, 0u);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t duplex_engine_add_stage (duplex_engine*, dsp_stage_callback,
+ *                                     void*)
+ *
+ * @brief Add a stage at the end of the processing chain
+ *
+ * @param[in] *engine     pointer to the engine
+ * @param      process    processing function of the stage
+ * @param[in] *user_data  pointer given to @a process
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the chain is
+ *         full
+ *
+ ******************************************************************************/
+int8_t duplex_engine_add_stage (duplex_engine *engine,
+                                dsp_stage_callback process, void *user_data)
+{
+  if ( (NULL==engine)||(NULL==process)||
+       (DUPLEX_MAX_STAGES<=engine->num_stages) )
+  {
+    return S_ERROR;
+  }
+
+  engine->stages[engine->num_stages].process = process;
+  engine->stages[engine->num_stages].user_data = user_data;
+  engine->num_stages++;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t duplex_engine_run (duplex_engine*, uint64_t)
+ *
+ * @brief Process the audio in the calling thread
+ *
+ * @param[in] *engine        pointer to the engine
+ * @param      total_frames  frames to process, 0 to run until
+ *                           @ref duplex_engine_stop is called
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t duplex_engine_run (duplex_engine *engine, uint64_t total_frames)
+{
+  if ( NULL==engine )
+  {
+    return S_ERROR;
+  }
+
+  return run_loop (engine, total_frames, NULL);
+}
+
+/******************************************************************************
+ *
+ * @fn void duplex_engine_stop (duplex_engine*)
+ *
+ * @brief Stop @ref duplex_engine_run, it can be called from other threads or
+ *        from signal handlers
+ *
+ * @param[in] *engine  pointer to the engine
+ *
+ ******************************************************************************/
+void duplex_engine_stop (duplex_engine *engine)
+{
+  if ( NULL!=engine )
+  {
+    atomic_store (&engine->running, 0u);
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t duplex_engine_measure_latency (duplex_engine*, uint32_t,
+ *                                           duplex_latency*)
+ *
+ * @brief Measure the round trip latency with impulses
+ *
+ * The stages are not run, the playback gets silence with an impulse every
+ * 250ms and the capture is scanned for it
+ *
+ * @param[in]  *engine    pointer to the engine
+ * @param       impulses  number of impulses to send
+ * @param[out] *result    latencies measured
+ *
+ * @return int8_t @a S_SUCCESS if at least one impulse was detected,
+ *         @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t duplex_engine_measure_latency (duplex_engine *engine,
+                                      uint32_t impulses,
+                                      duplex_latency *result)
+{
+  latency_probe probe = { .impulses = impulses, .result = result };
+  float ms_per_frame;
+
+  if ( (NULL==engine)||(NULL==result)||(0u==impulses) )
+  {
+    return S_ERROR;
+  }
+
+  memset (result, 0, sizeof(*result));
+  if ( S_SUCCESS!=run_loop (engine, 0u, &probe) )
+  {
+    return S_ERROR;
+  }
+
+  if ( 0u==result->measurements )
+  {
+    printf ("duplex_engine_measure_latency Error: no impulse detected\n");
+    return S_ERROR;
+  }
+
+  ms_per_frame = 1000.0f/(float)engine->sample_rate;
+  result->min_ms = (float)result->min_frames*ms_per_frame;
+  result->max_ms = (float)result->max_frames*ms_per_frame;
+  result->avg_ms = (float)probe.sum_frames*ms_per_frame/
+      (float)result->measurements;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void duplex_engine_destroy (duplex_engine*)
+ *
+ * @brief Unlink the streams and free the buffers, the streams are not closed
+ *
+ * @param[in] *engine  pointer to the engine
+ *
+ ******************************************************************************/
+void duplex_engine_destroy (duplex_engine *engine)
+{
+  if ( NULL!=engine )
+  {
+    if ( 0u!=engine->linked )
+    {
+      snd_pcm_unlink (engine->capture_handle);
+      engine->linked = 0u;
+    }
+    buffer_pool_destroy (&engine->pool);
+  }
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,132 @@
+/*******************************************************************************
+ * @file      duplex_engine.h
+ *
+ * @brief      Full duplex capture, processing and playback
+ *
+ * Reads a period from a capture stream, runs it through a chain of
+ * @ref dsp_stage and writes it to a playback stream, all in the same thread
+ * and in the same period, so the only latency added is the one of the
+ * buffers of the sound cards:
+ *      @li the two streams are linked with @a snd_pcm_link so they start at
+ *          the same time and their frame counters keep aligned
+ *      @li the stages see the audio as float buffers, one for each channel,
+ *          and process it in place
+ *      @li @ref duplex_engine_measure_latency sends impulses to the playback
+ *          stream and looks for them in the capture stream, the output must
+ *          be connected to the input (cable or loopback device)
+ *
+ * Both streams must be configured with the same @ref hw_configuration using
+ * the RW interleaved access.
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include <stdatomic.h>
+#include "alsa_utils.h"
+#include "buffer_pool.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _DUPLEX_ENGINE_
+#define _DUPLEX_ENGINE_
+
+#define DUPLEX_MAX_STAGES       (8u) /**< maximum stages in the chain */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Stage of the processing chain */
+typedef struct
+{
+  dsp_stage_callback process; /**< processing function */
+  void *user_data; /**< pointer given to the function */
+} dsp_stage;
+
+/** Result of @ref duplex_engine_measure_latency, the latency is the one a
+ * captured frame needs to reach the output: the periods buffered in the
+ * playback stream and the converters and cables in between */
+typedef struct
+{
+  uint32_t measurements; /**< impulses detected */
+  uint32_t missed; /**< impulses not detected in a second */
+  uint32_t min_frames; /**< shortest round trip */
+  uint32_t max_frames; /**< longest round trip */
+  float min_ms; /**< shortest round trip in ms */
+  float avg_ms; /**< average round trip in ms */
+  float max_ms; /**< longest round trip in ms */
+} duplex_latency;
+
+/** Full duplex engine */
+typedef struct
+{
+  snd_pcm_t *capture_handle; /**< configured capture stream */
+  snd_pcm_t *playback_handle; /**< configured playback stream */
+  snd_pcm_uframes_t period_size; /**< frames processed at once */
+  uint32_t num_channels; /**< channels of both streams */
+  uint32_t sample_rate; /**< rate of both streams */
+  snd_pcm_format_t format; /**< format of both streams */
+  uint32_t prefill_periods; /**< periods of silence written before starting,
+   by default one less than the periods of the buffer */
+  uint8_t linked; /**< 1 if the streams are linked */
+
+  dsp_stage stages[DUPLEX_MAX_STAGES]; /**< processing chain */
+  uint32_t num_stages; /**< stages in the chain */
+
+  buffer_pool pool; /**< memory of the buffers below */
+  void *capture_buffer; /**< period read from the capture stream */
+  void *playback_buffer; /**< period written to the playback stream */
+  float *interleaved; /**< processed period before the conversion */
+  float *channels[MAX_CHANNELS]; /**< period given to the stages */
+  void *float_storage; /**< memory of @a channels */
+
+  atomic_uint running; /**< cleared to stop @ref duplex_engine_run */
+  uint64_t periods; /**< periods processed */
+  uint64_t xruns; /**< restarts of the streams */
+} duplex_engine;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t duplex_engine_init (duplex_engine *engine, snd_pcm_t *capture_handle,
+                           snd_pcm_t *playback_handle,
+                           const hw_configuration *hw_config);
+int8_t duplex_engine_add_stage (duplex_engine *engine,
+                                dsp_stage_callback process, void *user_data);
+int8_t duplex_engine_run (duplex_engine *engine, uint64_t total_frames);
+void duplex_engine_stop (duplex_engine *engine);
+int8_t duplex_engine_measure_latency (duplex_engine *engine,
+                                      uint32_t impulses,
+                                      duplex_latency *result);
+void duplex_engine_destroy (duplex_engine *engine);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
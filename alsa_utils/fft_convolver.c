@@ -0,0 +1,488 @@
+/*******************************************************************************
+ * @file      fft_convolver.c
+ *
+ * @brief      Partitioned FFT convolution for long FIR filters
+ *
+ * For each block of B frames and each pair of channels:
+ *      @li the last 2B inputs are transformed (2B points) and the spectrum is
+ *          stored in the delay line
+ *      @li the spectra of the last P blocks are multiplied with the P
+ *          partitions of the impulse response and added
+ *      @li the last B points of the inverse transform are the output, the
+ *          first B have the circular aliasing and are discarded
+ *
+ * The transform is an iterative radix-2 FFT with precomputed twiddles, the
+ * complex products work on separated real and imaginary arrays so the
+ * compiler can vectorize them.
+ *
+ * @note Link using -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fft_convolver.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define FFT_ALIGNMENT           (64u) /**< alignment of the buffers */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn void* alloc_zeroed (size_t)
+ *
+ * @brief Allocate an aligned buffer set to 0
+ *
+ ******************************************************************************/
+static void* alloc_zeroed (size_t bytes)
+{
+  void *buffer;
+
+  if ( 0!=posix_memalign (&buffer, FFT_ALIGNMENT, bytes) )
+  {
+    return NULL;
+  }
+  memset (buffer, 0, bytes);
+
+  return buffer;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t fft_plan_init (fft_plan*, uint32_t)
+ *
+ * @brief Compute the tables of a transform of @a size points
+ *
+ ******************************************************************************/
+static int8_t fft_plan_init (fft_plan *plan, uint32_t size)
+{
+  uint32_t bits = 0;
+
+  plan->size = size;
+  plan->bit_reverse = (uint32_t*)alloc_zeroed (sizeof(uint32_t)*size);
+  plan->cos_table = (float*)alloc_zeroed (sizeof(float)*size/2u);
+  plan->sin_table = (float*)alloc_zeroed (sizeof(float)*size/2u);
+  if ( (NULL==plan->bit_reverse)||(NULL==plan->cos_table)||
+       (NULL==plan->sin_table) )
+  {
+    return S_ERROR;
+  }
+
+  while ( (1u<<bits)<size )
+  {
+    bits++;
+  }
+  for (uint32_t n = 0; n<size; n++)
+  {
+    uint32_t reversed = 0;
+
+    for (uint32_t b = 0; b<bits; b++)
+    {
+      reversed |= ((n>>b)&1u)<<(bits-1u-b);
+    }
+    plan->bit_reverse[n] = reversed;
+  }
+
+  for (uint32_t k = 0; k<size/2u; k++)
+  {
+    plan->cos_table[k] = (float)cos (2.0*M_PI*(double)k/(double)size);
+    plan->sin_table[k] = (float)sin (2.0*M_PI*(double)k/(double)size);
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void fft_plan_destroy (fft_plan*)
+ *
+ * @brief Free the tables of a transform
+ *
+ ******************************************************************************/
+static void fft_plan_destroy (fft_plan *plan)
+{
+  free (plan->bit_reverse);
+  free (plan->cos_table);
+  free (plan->sin_table);
+  plan->bit_reverse = NULL;
+  plan->cos_table = NULL;
+  plan->sin_table = NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn void fft_forward (const fft_plan*, float*, float*)
+ *
+ * @brief Forward transform in place, without scaling
+ *
+ * The inverse transform is done with the same function swapping the real
+ * and imaginary parts before and after it
+ *
+ ******************************************************************************/
+static void fft_forward (const fft_plan *plan, float *re, float *im)
+{
+  uint32_t size = plan->size;
+  uint32_t half;
+  uint32_t step;
+  uint32_t j;
+  float tmp;
+  float wr;
+  float wi;
+  float tr;
+  float ti;
+
+  for (uint32_t n = 0; n<size; n++)
+  {
+    j = plan->bit_reverse[n];
+    if ( j>n )
+    {
+      tmp = re[n];
+      re[n] = re[j];
+      re[j] = tmp;
+      tmp = im[n];
+      im[n] = im[j];
+      im[j] = tmp;
+    }
+  }
+
+  for (uint32_t length = 2u; length<=size; length <<= 1)
+  {
+    half = length/2u;
+    step = size/length;
+    for (uint32_t start = 0; start<size; start += length)
+    {
+      for (uint32_t k = 0; k<half; k++)
+      {
+        float *re_low = &re[start+k];
+        float *im_low = &im[start+k];
+
+        /* e^{-j2pi k/length} */
+        wr = plan->cos_table[k*step];
+        wi = -plan->sin_table[k*step];
+        tr = wr*re_low[half]-wi*im_low[half];
+        ti = wr*im_low[half]+wi*re_low[half];
+        re_low[half] = re_low[0]-tr;
+        im_low[half] = im_low[0]-ti;
+        re_low[0] += tr;
+        im_low[0] += ti;
+      }
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void process_block (fft_convolver*, float**, uint32_t)
+ *
+ * @brief Convolve one block of all the channels
+ *
+ ******************************************************************************/
+static void process_block (fft_convolver *convolver, float **channels,
+                           uint32_t offset)
+{
+  uint32_t block = convolver->block_size;
+  uint32_t size = convolver->fft_size;
+  uint32_t partitions = convolver->num_partitions;
+  float scale = 1.0f/(float)size;
+  float *re = convolver->work_re;
+  float *im = convolver->work_im;
+  float *input[2];
+  float *delay_re;
+  float *delay_im;
+  uint32_t slot;
+
+  convolver->delay_position = (0u==convolver->delay_position) ?
+      partitions-1u : convolver->delay_position-1u;
+
+  for (uint32_t p = 0; p<convolver->num_pairs; p++)
+  {
+    /* the previous block and the new one, the second channel of the last
+     * pair can be missing */
+    for (uint32_t c = 0; c<2u; c++)
+    {
+      uint32_t ch = 2u*p+c;
+
+      input[c] = &convolver->inputs[(size_t)ch*size];
+      memmove (input[c], &input[c][block], sizeof(float)*block);
+      if ( ch<convolver->num_channels )
+      {
+        memcpy (&input[c][block], &channels[ch][offset], sizeof(float)*block);
+      }
+    }
+
+    delay_re = &convolver->delay_re[(size_t)p*partitions*size];
+    delay_im = &convolver->delay_im[(size_t)p*partitions*size];
+    memcpy (&delay_re[(size_t)convolver->delay_position*size], input[0],
+            sizeof(float)*size);
+    memcpy (&delay_im[(size_t)convolver->delay_position*size], input[1],
+            sizeof(float)*size);
+    fft_forward (&convolver->plan,
+                 &delay_re[(size_t)convolver->delay_position*size],
+                 &delay_im[(size_t)convolver->delay_position*size]);
+
+    /* the accumulation is done with real and imaginary swapped, so the
+     * forward transform gives the inverse one */
+    memset (re, 0, sizeof(float)*size);
+    memset (im, 0, sizeof(float)*size);
+    slot = convolver->delay_position;
+    for (uint32_t k = 0; k<partitions; k++)
+    {
+      const float *xr = &delay_re[(size_t)slot*size];
+      const float *xi = &delay_im[(size_t)slot*size];
+      const float *hr = &convolver->kernel_re[(size_t)k*size];
+      const float *hi = &convolver->kernel_im[(size_t)k*size];
+
+      for (uint32_t n = 0; n<size; n++)
+      {
+        im[n] += xr[n]*hr[n]-xi[n]*hi[n];
+        re[n] += xr[n]*hi[n]+xi[n]*hr[n];
+      }
+      slot = (slot+1u==partitions) ? 0u : slot+1u;
+    }
+    fft_forward (&convolver->plan, re, im);
+
+    /* the first half has the circular aliasing */
+    for (uint32_t c = 0; c<2u; c++)
+    {
+      uint32_t ch = 2u*p+c;
+      const float *result = (0u==c) ? &im[block] : &re[block];
+
+      if ( ch<convolver->num_channels )
+      {
+        for (uint32_t n = 0; n<block; n++)
+        {
+          channels[ch][offset+n] = result[n]*scale;
+        }
+      }
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t fft_convolver_init (fft_convolver*, uint32_t, const float*,
+ *                                uint32_t, uint32_t)
+ *
+ * @brief Create a convolver and transform the partitions of the impulse
+ *        response
+ *
+ * @param[out] *convolver     pointer to the convolver
+ * @param       num_channels  number of channels
+ * @param[in]  *taps          impulse response, the same for all channels
+ * @param       num_taps      length of the impulse response
+ * @param       block_size    frames of each partition, power of 2, the
+ *                            blocks given to @ref fft_convolver_process
+ *                            must be a multiple of it
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t fft_convolver_init (fft_convolver *convolver, uint32_t num_channels,
+                           const float *taps, uint32_t num_taps,
+                           uint32_t block_size)
+{
+  size_t spectrum;
+  uint32_t length;
+
+  if ( (NULL==convolver)||(NULL==taps)||(0u==num_channels)||
+       (MAX_CHANNELS<num_channels)||(0u==num_taps)||(0u==block_size)||
+       (0u!=(block_size&(block_size-1u)))||(FFT_MAX_SIZE<2u*block_size) )
+  {
+    return S_ERROR;
+  }
+
+  memset (convolver, 0, sizeof(*convolver));
+  convolver->num_channels = num_channels;
+  convolver->num_pairs = (num_channels+1u)/2u;
+  convolver->block_size = block_size;
+  convolver->fft_size = 2u*block_size;
+  convolver->num_partitions = (num_taps+block_size-1u)/block_size;
+  spectrum = sizeof(float)*convolver->fft_size;
+
+  convolver->kernel_re = (float*)alloc_zeroed (spectrum*
+                                              convolver->num_partitions);
+  convolver->kernel_im = (float*)alloc_zeroed (spectrum*
+                                              convolver->num_partitions);
+  convolver->delay_re = (float*)alloc_zeroed (spectrum*convolver->num_pairs*
+                                             convolver->num_partitions);
+  convolver->delay_im = (float*)alloc_zeroed (spectrum*convolver->num_pairs*
+                                             convolver->num_partitions);
+  convolver->inputs = (float*)alloc_zeroed (spectrum*2u*convolver->num_pairs);
+  convolver->work_re = (float*)alloc_zeroed (spectrum);
+  convolver->work_im = (float*)alloc_zeroed (spectrum);
+  if ( (NULL==convolver->kernel_re)||(NULL==convolver->kernel_im)||
+       (NULL==convolver->delay_re)||(NULL==convolver->delay_im)||
+       (NULL==convolver->inputs)||(NULL==convolver->work_re)||
+       (NULL==convolver->work_im)||
+       (S_SUCCESS!=fft_plan_init (&convolver->plan, convolver->fft_size)) )
+  {
+    fft_convolver_destroy (convolver);
+    return S_ERROR;
+  }
+
+  /* each partition is padded with zeros to the size of the transform */
+  for (uint32_t k = 0; k<convolver->num_partitions; k++)
+  {
+    float *re = &convolver->kernel_re[(size_t)k*convolver->fft_size];
+    float *im = &convolver->kernel_im[(size_t)k*convolver->fft_size];
+
+    length = num_taps-k*block_size;
+    if ( length>block_size )
+    {
+      length = block_size;
+    }
+    memcpy (re, &taps[k*block_size], sizeof(float)*length);
+    fft_forward (&convolver->plan, re, im);
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t fft_convolver_process (fft_convolver*, float**, uint32_t)
+ *
+ * @brief Filter a block of all the channels in place
+ *
+ * @param[in]     *convolver  pointer to the convolver
+ * @param[in,out] **channels  one buffer for each channel of the convolver
+ * @param          frames     frames of each buffer, multiple of the block
+ *                            size, the partial blocks are not buffered
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise, e.g.
+ *         if @a frames is not a multiple of the block size
+ *
+ ******************************************************************************/
+int8_t fft_convolver_process (fft_convolver *convolver, float **channels,
+                              uint32_t frames)
+{
+  if ( (NULL==convolver)||(NULL==channels)||
+       (0u!=frames%convolver->block_size) )
+  {
+    return S_ERROR;
+  }
+
+  for (uint32_t offset = 0; offset<frames; offset += convolver->block_size)
+  {
+    process_block (convolver, channels, offset);
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t fft_convolver_stage (float**, uint32_t, uint32_t, void*)
+ *
+ * @brief @ref dsp_stage_callback running a convolver
+ *
+ * @param[in,out] **channels     audio of the period
+ * @param           num_channels channels of the period, at least the ones
+ *                               of the convolver
+ * @param           frames       frames of each channel, multiple of the
+ *                               block size of the convolver
+ * @param[in]      *user_data    pointer to the @ref fft_convolver
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t fft_convolver_stage (float **channels, uint32_t num_channels,
+                            uint32_t frames, void *user_data)
+{
+  fft_convolver *convolver = (fft_convolver*)user_data;
+
+  if ( (NULL==convolver)||(num_channels<convolver->num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  return fft_convolver_process (convolver, channels, frames);
+}
+
+/******************************************************************************
+ *
+ * @fn void fft_convolver_reset (fft_convolver*)
+ *
+ * @brief Clear the past inputs of the convolver
+ *
+ * @param[in] *convolver  pointer to the convolver
+ *
+ ******************************************************************************/
+void fft_convolver_reset (fft_convolver *convolver)
+{
+  size_t spectrum;
+
+  if ( (NULL!=convolver)&&(NULL!=convolver->inputs) )
+  {
+    spectrum = sizeof(float)*convolver->fft_size;
+    memset (convolver->delay_re, 0, spectrum*convolver->num_pairs*
+            convolver->num_partitions);
+    memset (convolver->delay_im, 0, spectrum*convolver->num_pairs*
+            convolver->num_partitions);
+    memset (convolver->inputs, 0, spectrum*2u*convolver->num_pairs);
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void fft_convolver_destroy (fft_convolver*)
+ *
+ * @brief Free the memory of a convolver
+ *
+ * @param[in] *convolver  pointer to the convolver
+ *
+ ******************************************************************************/
+void fft_convolver_destroy (fft_convolver *convolver)
+{
+  if ( NULL!=convolver )
+  {
+    free (convolver->kernel_re);
+    free (convolver->kernel_im);
+    free (convolver->delay_re);
+    free (convolver->delay_im);
+    free (convolver->inputs);
+    free (convolver->work_re);
+    free (convolver->work_im);
+    convolver->kernel_re = NULL;
+    convolver->kernel_im = NULL;
+    convolver->delay_re = NULL;
+    convolver->delay_im = NULL;
+    convolver->inputs = NULL;
+    convolver->work_re = NULL;
+    convolver->work_im = NULL;
+    fft_plan_destroy (&convolver->plan);
+  }
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,110 @@
+/*******************************************************************************
+ * @file      fft_convolver.h
+ *
+ * @brief      Partitioned FFT convolution for long FIR filters
+ *
+ * Uniformly partitioned overlap-save convolution: the impulse response is
+ * split in partitions of @a block_size taps, each block of input is
+ * transformed once and multiplied with all the partitions through a
+ * frequency domain delay line. The cost per sample grows with the number of
+ * partitions instead of the number of taps, and there is no latency when the
+ * period is a multiple of the block size.
+ *
+ * Two channels are filtered with each complex FFT, one as the real part and
+ * the other as the imaginary part, the impulse response is real so both
+ * results come out separated.
+ *
+ * @note The partial blocks are not buffered, @ref fft_convolver_process only
+ *       takes a multiple of @a block_size frames and fails without touching
+ *       the audio otherwise. Buffering them would add a block of latency,
+ *       the block size should be a power of 2 that divides the period
+ *       instead, e.g. the period itself when it's a power of 2
+ *
+ * @note Link using -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _FFT_CONVOLVER_
+#define _FFT_CONVOLVER_
+
+#define FFT_MAX_SIZE            (65536u) /**< biggest transform supported */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Precomputed tables of a radix-2 complex FFT */
+typedef struct
+{
+  uint32_t size; /**< points of the transform (power of 2) */
+  uint32_t *bit_reverse; /**< position of each input after the reorder */
+  float *cos_table; /**< @f$ \cos(2\pi k/size) @f$ for k < size/2 */
+  float *sin_table; /**< @f$ \sin(2\pi k/size) @f$ for k < size/2 */
+} fft_plan;
+
+/** Partitioned convolver for several channels with the same impulse
+ * response, the spectra are stored as separated real and imaginary parts */
+typedef struct
+{
+  uint32_t num_channels; /**< channels filtered */
+  uint32_t num_pairs; /**< channels filtered with each transform */
+  uint32_t block_size; /**< frames of each partition */
+  uint32_t fft_size; /**< 2*block_size */
+  uint32_t num_partitions; /**< partitions of the impulse response */
+  fft_plan plan; /**< tables of the transform */
+  float *kernel_re; /**< spectrum of each partition (real part) */
+  float *kernel_im; /**< spectrum of each partition (imaginary part) */
+  float *delay_re; /**< spectra of the last inputs of each pair */
+  float *delay_im; /**< spectra of the last inputs of each pair */
+  uint32_t delay_position; /**< slot of the newest spectrum */
+  float *inputs; /**< the last 2 blocks of each channel */
+  float *work_re; /**< transform in progress (real part) */
+  float *work_im; /**< transform in progress (imaginary part) */
+} fft_convolver;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t fft_convolver_init (fft_convolver *convolver, uint32_t num_channels,
+                           const float *taps, uint32_t num_taps,
+                           uint32_t block_size);
+int8_t fft_convolver_process (fft_convolver *convolver, float **channels,
+                              uint32_t frames);
+int8_t fft_convolver_stage (float **channels, uint32_t num_channels,
+                            uint32_t frames, void *user_data);
+void fft_convolver_reset (fft_convolver *convolver);
+void fft_convolver_destroy (fft_convolver *convolver);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,679 @@
+/*******************************************************************************
+ * @file      file_source.c
+ *
+ * @brief      Memory mapped WAV/raw file source with read-ahead
+ *
+ * The player only reads the mapping and publishes its position, all the
+ * system calls that can block (readahead, mlock, munlock, posix_fadvise)
+ * are made by the prefetch thread.
+ *
+ * @note Link using -lasound and -lpthread
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "file_source.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define WAV_FORMAT_PCM          (0x0001u) /**< integer samples */
+#define WAV_FORMAT_FLOAT        (0x0003u) /**< IEEE float samples */
+#define WAV_FORMAT_EXTENSIBLE   (0xFFFEu) /**< the format is in the GUID */
+#define WAV_FMT_MIN_SIZE        (16u) /**< bytes of a basic fmt chunk */
+#define WAV_FMT_MAX_SIZE        (40u) /**< bytes of an extensible fmt chunk */
+#define WAV_NOT_RIFF            (2) /**< returned by parse_wav when the file
+                                         has no RIFF/WAVE header (raw PCM) */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn uint32_t read_le (const uint8_t*, uint32_t)
+ *
+ * @brief Read a little endian integer of 2 or 4 bytes
+ *
+ ******************************************************************************/
+static uint32_t read_le (const uint8_t *bytes, uint32_t size)
+{
+  uint32_t value = 0u;
+
+  for (uint32_t n = 0; n<size; n++)
+  {
+    value |= (uint32_t)bytes[n]<<(8u*n);
+  }
+
+  return value;
+}
+
+/******************************************************************************
+ *
+ * @fn snd_pcm_format_t wav_format (uint32_t, uint32_t, uint32_t)
+ *
+ * @brief Get the ALSA format of a WAV file
+ *
+ * @param tag          format tag (after resolving the extensible format)
+ * @param bits         bits per sample
+ * @param sample_size  bytes per sample (block align / channels)
+ *
+ * @return snd_pcm_format_t format, @a SND_PCM_FORMAT_UNKNOWN if it's not
+ *         supported
+ *
+ ******************************************************************************/
+static snd_pcm_format_t wav_format (uint32_t tag, uint32_t bits,
+                                    uint32_t sample_size)
+{
+  if ( (WAV_FORMAT_FLOAT==tag)&&(32u==bits)&&(4u==sample_size) )
+  {
+    return SND_PCM_FORMAT_FLOAT_LE;
+  }
+  if ( WAV_FORMAT_PCM!=tag )
+  {
+    return SND_PCM_FORMAT_UNKNOWN;
+  }
+
+  switch (sample_size)
+  {
+    case 1u:
+      return SND_PCM_FORMAT_U8;
+    case 2u:
+      return SND_PCM_FORMAT_S16_LE;
+    case 3u:
+      return SND_PCM_FORMAT_S24_3LE;
+    case 4u:
+      /* 24 bits in 4 bytes are aligned to the MSB in WAV */
+      return SND_PCM_FORMAT_S32_LE;
+    default:
+      return SND_PCM_FORMAT_UNKNOWN;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t parse_wav (file_source*, uint64_t)
+ *
+ * @brief Read the format and the position of the audio of a WAV file
+ *
+ * @param[in,out] *source     source with the file open
+ * @param          file_size  size of the file
+ *
+ * @return int8_t @a S_SUCCESS if it's a supported WAV file,
+ *         @ref WAV_NOT_RIFF if it isn't a WAV file, @a S_ERROR if it's a WAV
+ *         file that can't be played (format not supported, no data)
+ *
+ ******************************************************************************/
+static int8_t parse_wav (file_source *source, uint64_t file_size)
+{
+  uint8_t header[12];
+  uint8_t chunk[8];
+  uint8_t fmt[WAV_FMT_MAX_SIZE];
+  uint64_t position = sizeof(header);
+  uint32_t chunk_size;
+  uint32_t tag;
+  uint32_t block_align;
+  uint8_t have_fmt = 0u;
+
+  if ( (sizeof(header)!=pread (source->fd, header, sizeof(header), 0))||
+       (0!=memcmp (header, "RIFF", 4))||(0!=memcmp (&header[8], "WAVE", 4)) )
+  {
+    return WAV_NOT_RIFF;
+  }
+
+  while ( position+sizeof(chunk)<=file_size )
+  {
+    if ( sizeof(chunk)!=pread (source->fd, chunk, sizeof(chunk),
+                               (off_t)position) )
+    {
+      return S_ERROR;
+    }
+    chunk_size = read_le (&chunk[4], 4u);
+    position += sizeof(chunk);
+
+    if ( 0==memcmp (chunk, "fmt ", 4) )
+    {
+      memset (fmt, 0, sizeof(fmt));
+      if ( (WAV_FMT_MIN_SIZE>chunk_size)||
+           (0>pread (source->fd, fmt,
+                     (WAV_FMT_MAX_SIZE<chunk_size) ?
+                         WAV_FMT_MAX_SIZE : chunk_size, (off_t)position)) )
+      {
+        return S_ERROR;
+      }
+
+      tag = read_le (&fmt[0], 2u);
+      if ( (WAV_FORMAT_EXTENSIBLE==tag)&&(WAV_FMT_MAX_SIZE<=chunk_size) )
+      {
+        /* the first 2 bytes of the sub format GUID are the real tag */
+        tag = read_le (&fmt[24], 2u);
+      }
+      source->num_channels = read_le (&fmt[2], 2u);
+      source->sample_rate = read_le (&fmt[4], 4u);
+      block_align = read_le (&fmt[12], 2u);
+      if ( (0u==source->num_channels)||(MAX_CHANNELS<source->num_channels)||
+           (0u!=block_align%source->num_channels) )
+      {
+        return S_ERROR;
+      }
+      source->format = wav_format (tag, read_le (&fmt[14], 2u),
+                                   block_align/source->num_channels);
+      source->frame_bytes = block_align;
+      have_fmt = 1u;
+    }
+    else if ( 0==memcmp (chunk, "data", 4) )
+    {
+      if ( (0u==have_fmt)||(SND_PCM_FORMAT_UNKNOWN==source->format) )
+      {
+        printf ("file_source_open Error: WAV format not supported\n");
+        return S_ERROR;
+      }
+
+      source->data_offset = position;
+      source->data_size = file_size-position;
+      if ( chunk_size<source->data_size )
+      {
+        source->data_size = chunk_size;
+      }
+      return S_SUCCESS;
+    }
+
+    /* the chunks are aligned to 2 bytes */
+    position += chunk_size+(chunk_size&1u);
+  }
+
+  return S_ERROR;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t file_source_open (file_source*, const char*, hw_configuration*)
+ *
+ * @brief Open and map a WAV or raw PCM file
+ *
+ * @param[out]    *source     source to initialize
+ * @param[in]     *path       path of the file
+ * @param[in,out] *hw_config  for raw files the rate, channels and format of
+ *                            the samples, for WAV files they are updated
+ *                            with the values of the header
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t file_source_open (file_source *source, const char *path,
+                         hw_configuration *hw_config)
+{
+  struct stat file_stat;
+  ssize_t frame_bytes;
+  int8_t err;
+
+  if ( (NULL==source)||(NULL==path)||(NULL==hw_config) )
+  {
+    return S_ERROR;
+  }
+
+  memset (source, 0, sizeof(*source));
+  source->fd = open (path, O_RDONLY|O_CLOEXEC);
+  if ( 0>source->fd )
+  {
+    printf ("file_source_open Error: opening %s\n", path);
+    return S_ERROR;
+  }
+
+  if ( (0!=fstat (source->fd, &file_stat))||(0>=file_stat.st_size) )
+  {
+    printf ("file_source_open Error: reading the size of %s\n", path);
+    close (source->fd);
+    return S_ERROR;
+  }
+
+  /* a WAV file that can't be played is an error, playing it as raw PCM
+   * would play the header and the samples as noise */
+  err = parse_wav (source, (uint64_t)file_stat.st_size);
+  if ( S_ERROR==err )
+  {
+    printf ("file_source_open Error: can't play the WAV file %s\n", path);
+    close (source->fd);
+    return S_ERROR;
+  }
+
+  if ( S_SUCCESS==err )
+  {
+    hw_config->sample_rate = source->sample_rate;
+    hw_config->num_channels = source->num_channels;
+    hw_config->format = source->format;
+  }
+  else
+  {
+    /* raw PCM in the format of the configuration */
+    frame_bytes = snd_pcm_format_size (hw_config->format,
+                                       hw_config->num_channels);
+    if ( 0>=frame_bytes )
+    {
+      printf ("file_source_open Error: invalid raw format\n");
+      close (source->fd);
+      return S_ERROR;
+    }
+    source->sample_rate = hw_config->sample_rate;
+    source->num_channels = hw_config->num_channels;
+    source->format = hw_config->format;
+    source->frame_bytes = (uint32_t)frame_bytes;
+    source->data_offset = 0u;
+    source->data_size = (uint64_t)file_stat.st_size;
+  }
+
+  source->total_frames = source->data_size/source->frame_bytes;
+  source->map_size = (size_t)(source->data_offset+source->data_size);
+  source->map = (const uint8_t*)mmap (NULL, source->map_size, PROT_READ,
+                                      MAP_SHARED, source->fd, 0);
+  if ( MAP_FAILED==source->map )
+  {
+    printf ("file_source_open Error: mapping %s\n", path);
+    close (source->fd);
+    return S_ERROR;
+  }
+  source->data = source->map+source->data_offset;
+
+  /* the file is read once from the beginning to the end */
+  madvise ((void*)source->map, source->map_size, MADV_SEQUENTIAL);
+  posix_fadvise (source->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  atomic_init (&source->running, 0u);
+  atomic_init (&source->started, 0u);
+  atomic_init (&source->read_offset, 0u);
+  atomic_init (&source->prefetched_end, 0u);
+  atomic_init (&source->late_periods, 0u);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn uint64_t page_down (uint64_t)
+ *
+ * @brief Round an offset of the mapping down to a page
+ *
+ ******************************************************************************/
+static uint64_t page_down (uint64_t offset)
+{
+  uint64_t page = (uint64_t)sysconf (_SC_PAGESIZE);
+
+  return offset-(offset%page);
+}
+
+/******************************************************************************
+ *
+ * @fn void prefetch_range (file_source*, uint64_t, uint64_t)
+ *
+ * @brief Load a range of the audio in memory
+ *
+ * @a readahead starts the I/O of the whole range, then the pages are
+ * locked, or touched if they can't be locked, so they are mapped when the
+ * player reads them
+ *
+ * @param[in,out] *source  source being played
+ * @param          start   first byte of the audio to load
+ * @param          end     end of the range
+ *
+ ******************************************************************************/
+static void prefetch_range (file_source *source, uint64_t start, uint64_t end)
+{
+  uint64_t page = (uint64_t)sysconf (_SC_PAGESIZE);
+  uint64_t first = page_down (source->data_offset+start);
+  uint64_t last = source->data_offset+end;
+  volatile uint8_t touch;
+
+  readahead (source->fd, (off_t)first, (size_t)(last-first));
+
+  if ( (0u!=source->lock_pages)&&
+       (0!=mlock (source->map+first, (size_t)(last-first))) )
+  {
+    /* mlock can fail after locking part of the range */
+    printf ("file_source Warning: mlock failed, touching the pages\n");
+    munlock (source->map+first, (size_t)(last-first));
+    source->lock_pages = 0u;
+  }
+
+  if ( 0u==source->lock_pages )
+  {
+    for (uint64_t offset = first; offset<last; offset += page)
+    {
+      touch = source->map[offset];
+    }
+    (void)touch;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void release_range (file_source*, uint64_t, uint64_t)
+ *
+ * @brief Free the memory of a range already played
+ *
+ ******************************************************************************/
+static void release_range (file_source *source, uint64_t start, uint64_t end)
+{
+  uint64_t first = page_down (source->data_offset+start);
+  uint64_t last = page_down (source->data_offset+end);
+
+  if ( last<=first )
+  {
+    return;
+  }
+
+  /* also after mlock stopped working, the windows locked before are still
+   * locked */
+  munlock (source->map+first, (size_t)(last-first));
+  posix_fadvise (source->fd, (off_t)first, (off_t)(last-first),
+                 POSIX_FADV_DONTNEED);
+}
+
+/******************************************************************************
+ *
+ * @fn void* prefetch_thread (void*)
+ *
+ * @brief Keep the window ahead of the player in memory
+ *
+ * The thread sleeps until the player has played a step, then loads the
+ * next part of the file and releases what was played
+ *
+ * @param[in] *arg  pointer to the @ref file_source
+ *
+ ******************************************************************************/
+static void* prefetch_thread (void *arg)
+{
+  file_source *source = (file_source*)arg;
+  uint64_t prefetched = atomic_load (&source->prefetched_end);
+  uint64_t released = 0u;
+  uint64_t position;
+  uint64_t target;
+
+  while ( 0u!=atomic_load (&source->running) )
+  {
+    position = atomic_load (&source->read_offset);
+    target = position+source->window_bytes;
+    if ( target>source->data_size )
+    {
+      target = source->data_size;
+    }
+
+    if ( target>prefetched )
+    {
+      prefetch_range (source, prefetched, target);
+      prefetched = target;
+      atomic_store (&source->prefetched_end, prefetched);
+    }
+
+    if ( position>released+source->step_bytes )
+    {
+      release_range (source, released, position);
+      released = position;
+    }
+
+    sem_wait (&source->wakeup);
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t file_source_start (file_source*, uint32_t)
+ *
+ * @brief Load the first window and start the prefetch thread
+ *
+ * The first window is loaded before returning, so the playback can start
+ * right away
+ *
+ * @param[in,out] *source     source to start
+ * @param          window_ms  audio to keep in memory, 0 to use
+ *                            @ref FILE_SOURCE_WINDOW_MS
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t file_source_start (file_source *source, uint32_t window_ms)
+{
+  uint64_t window;
+
+  if ( 0u==window_ms )
+  {
+    window_ms = FILE_SOURCE_WINDOW_MS;
+  }
+
+  window = ((uint64_t)window_ms*source->sample_rate/1000u)*source->frame_bytes;
+  if ( window>source->data_size )
+  {
+    window = source->data_size;
+  }
+  source->window_bytes = (size_t)window;
+  source->step_bytes = source->window_bytes/FILE_SOURCE_STEPS;
+  source->lock_pages = 1u;
+
+  prefetch_range (source, 0u, source->window_bytes);
+  atomic_store (&source->prefetched_end, source->window_bytes);
+
+  if ( 0!=sem_init (&source->wakeup, 0, 0u) )
+  {
+    printf ("file_source_start Error: creating the semaphore\n");
+    return S_ERROR;
+  }
+
+  atomic_store (&source->running, 1u);
+  if ( 0!=pthread_create (&source->prefetch_thread, NULL, prefetch_thread,
+                          source) )
+  {
+    printf ("file_source_start Error: creating the prefetch thread\n");
+    atomic_store (&source->running, 0u);
+    sem_destroy (&source->wakeup);
+    return S_ERROR;
+  }
+  atomic_store (&source->started, 1u);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn snd_pcm_uframes_t file_source_peek (file_source*, snd_pcm_uframes_t,
+ *                                         const void**)
+ *
+ * @brief Get the next frames of the file without copying them
+ *
+ * The pointer can be given directly to @a snd_pcm_writei, then call
+ * @ref file_source_advance with the frames written
+ *
+ * @param[in]  *source      source being played
+ * @param       max_frames  frames wanted, usually a period
+ * @param[out] **data       first frame in the mapping
+ *
+ * @return snd_pcm_uframes_t frames available, less than @a max_frames at
+ *         the end of the file and 0 when all the file was played
+ *
+ ******************************************************************************/
+snd_pcm_uframes_t file_source_peek (file_source *source,
+                                    snd_pcm_uframes_t max_frames,
+                                    const void **data)
+{
+  uint64_t left = source->total_frames-source->position;
+  uint64_t end;
+
+  if ( max_frames>left )
+  {
+    max_frames = (snd_pcm_uframes_t)left;
+  }
+
+  end = (source->position+max_frames)*source->frame_bytes;
+  if ( (0u!=atomic_load (&source->started))&&
+       (end>atomic_load (&source->prefetched_end)) )
+  {
+    atomic_fetch_add (&source->late_periods, 1u);
+  }
+
+  *data = source->data+source->position*source->frame_bytes;
+
+  return max_frames;
+}
+
+/******************************************************************************
+ *
+ * @fn void file_source_advance (file_source*, snd_pcm_uframes_t)
+ *
+ * @brief Move the playback position after the frames were written
+ *
+ * It never blocks, the prefetch thread is woken up each time a step of the
+ * window has been played
+ *
+ * @param[in,out] *source  source being played
+ * @param          frames  frames played
+ *
+ ******************************************************************************/
+void file_source_advance (file_source *source, snd_pcm_uframes_t frames)
+{
+  uint64_t before = source->position*source->frame_bytes;
+  uint64_t after;
+
+  source->position += frames;
+  if ( source->position>source->total_frames )
+  {
+    source->position = source->total_frames;
+  }
+
+  after = source->position*source->frame_bytes;
+  atomic_store (&source->read_offset, after);
+  if ( (0u!=atomic_load (&source->started))&&(0u!=source->step_bytes)&&
+       (before/source->step_bytes!=after/source->step_bytes) )
+  {
+    sem_post (&source->wakeup);
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t file_source_render_mmap (const snd_pcm_channel_area_t*,
+ *                                     snd_pcm_uframes_t, snd_pcm_uframes_t,
+ *                                     void*)
+ *
+ * @brief Copy the next frames of the file to the ring buffer of the sound
+ *        card, used as @ref mmap_render_callback
+ *
+ * The frames are copied from the mapping to the ring buffer in one step,
+ * after the end of the file silence is written
+ *
+ * @param[in] *areas      channel areas of the ring buffer
+ * @param      offset     first frame to write
+ * @param      frames     number of frames to write
+ * @param[in] *user_data  pointer to the @ref file_source
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t file_source_render_mmap (const snd_pcm_channel_area_t *areas,
+                                snd_pcm_uframes_t offset,
+                                snd_pcm_uframes_t frames, void *user_data)
+{
+  file_source *source = (file_source*)user_data;
+  snd_pcm_channel_area_t file_areas[MAX_CHANNELS];
+  uint32_t sample_bits = (uint32_t)snd_pcm_format_physical_width (
+      source->format);
+  const void *data;
+  snd_pcm_uframes_t available;
+
+  available = file_source_peek (source, frames, &data);
+  if ( 0u<available )
+  {
+    /* the file is interleaved, describe it as areas to let ALSA copy it to
+     * any layout of the ring buffer */
+    for (uint32_t ch = 0; ch<source->num_channels; ch++)
+    {
+      file_areas[ch].addr = (void*)data;
+      file_areas[ch].first = ch*sample_bits;
+      file_areas[ch].step = source->frame_bytes*8u;
+    }
+
+    if ( S_SUCCESS>snd_pcm_areas_copy (areas, offset, file_areas, 0,
+                                       source->num_channels, available,
+                                       source->format) )
+    {
+      return S_ERROR;
+    }
+    file_source_advance (source, available);
+  }
+
+  if ( available<frames )
+  {
+    snd_pcm_areas_silence (areas, offset+available, source->num_channels,
+                           frames-available, source->format);
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn uint8_t file_source_eof (const file_source*)
+ *
+ * @brief Check if the whole file was played
+ *
+ * @return uint8_t 1 at the end of the file, 0 otherwise
+ *
+ ******************************************************************************/
+uint8_t file_source_eof (const file_source *source)
+{
+  return (source->position>=source->total_frames) ? 1u : 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn void file_source_close (file_source*)
+ *
+ * @brief Stop the prefetch thread and close the file
+ *
+ ******************************************************************************/
+void file_source_close (file_source *source)
+{
+  if ( 0u!=atomic_load (&source->started) )
+  {
+    atomic_store (&source->running, 0u);
+    sem_post (&source->wakeup);
+    pthread_join (source->prefetch_thread, NULL);
+    sem_destroy (&source->wakeup);
+    atomic_store (&source->started, 0u);
+  }
+
+  munmap ((void*)source->map, source->map_size);
+  close (source->fd);
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,124 @@
+/*******************************************************************************
+ * @file      file_source.h
+ *
+ * @brief      Memory mapped WAV/raw file source with read-ahead
+ *
+ * Plays PCM files without intermediate buffers:
+ *      @li the file is memory mapped and its periods are given directly to
+ *          @a snd_pcm_writei (@ref file_source_peek) or copied once into the
+ *          ring buffer in MMAP mode (@ref file_source_render_mmap)
+ *      @li a prefetch thread keeps a window ahead of the playback position
+ *          in memory with @a readahead and @a mlock (or touching the pages if
+ *          the pages can't be locked), so the audio thread never waits for
+ *          the storage
+ *      @li the part already played is unlocked and dropped from the page
+ *          cache with @a posix_fadvise, so files of hours don't fill the
+ *          memory
+ *
+ * WAV files (PCM, IEEE float and extensible) are recognized by their
+ * header, any other file is played as raw interleaved PCM in the format
+ * given by the caller.
+ *
+ * @note Don't lock all the memory (@ref rt_configuration.lock_memory) while
+ *       a file is mapped, @a MCL_FUTURE would load and lock the whole file
+ *
+ * @note Link using -lasound and -lpthread
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _FILE_SOURCE_
+#define _FILE_SOURCE_
+
+#define FILE_SOURCE_WINDOW_MS   (2000u) /**< default audio kept in memory
+                                             ahead of the playback position */
+#define FILE_SOURCE_STEPS       (4u) /**< the window is refilled each time a
+                                          1/FILE_SOURCE_STEPS is played */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** File being played */
+typedef struct
+{
+  int fd; /**< descriptor of the file */
+  const uint8_t *map; /**< mapping of the whole file */
+  size_t map_size; /**< size of the mapping */
+  const uint8_t *data; /**< first frame in the mapping */
+  uint64_t data_offset; /**< offset of the first frame in the file */
+  uint64_t data_size; /**< bytes of audio */
+
+  uint32_t sample_rate; /**< rate of the file */
+  uint32_t num_channels; /**< channels of the file */
+  snd_pcm_format_t format; /**< format of the samples */
+  uint32_t frame_bytes; /**< bytes of each frame */
+  uint64_t total_frames; /**< frames in the file */
+  uint64_t position; /**< next frame to play, only used by the player */
+
+  size_t window_bytes; /**< bytes kept ahead of the position */
+  size_t step_bytes; /**< bytes played between refills of the window */
+  uint8_t lock_pages; /**< 1 while mlock works */
+  pthread_t prefetch_thread; /**< keeps the window in memory */
+  sem_t wakeup; /**< posted by the player every step */
+  atomic_uint running; /**< cleared to stop the prefetch thread */
+  atomic_uint started; /**< 1 if the prefetch thread was created */
+  atomic_uint_fast64_t read_offset; /**< bytes played, written by the
+   player */
+  atomic_uint_fast64_t prefetched_end; /**< bytes loaded in memory, written
+   by the prefetch thread */
+  atomic_uint_fast64_t late_periods; /**< periods played beyond the
+   prefetched window, they could wait for the storage */
+} file_source;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t file_source_open (file_source *source, const char *path,
+                         hw_configuration *hw_config);
+int8_t file_source_start (file_source *source, uint32_t window_ms);
+snd_pcm_uframes_t file_source_peek (file_source *source,
+                                    snd_pcm_uframes_t max_frames,
+                                    const void **data);
+void file_source_advance (file_source *source, snd_pcm_uframes_t frames);
+int8_t file_source_render_mmap (const snd_pcm_channel_area_t *areas,
+                                snd_pcm_uframes_t offset,
+                                snd_pcm_uframes_t frames, void *user_data);
+uint8_t file_source_eof (const file_source *source);
+void file_source_close (file_source *source);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
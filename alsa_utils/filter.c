@@ -0,0 +1,957 @@
+/*******************************************************************************
+ * @file      filter.c
+ *
+ * @brief      Biquad and FIR filters for multichannel float buffers
+ *
+ * Each group of @ref FILTER_LANES channels is transposed to a block where
+ * the frame @a n of all the lanes is consecutive, the kernels run over the
+ * block with one channel in each lane and the result is transposed back.
+ * The sections of a cascade run one after the other over the whole block, so
+ * the coefficients and the state stay in registers.
+ *
+ * All the kernels do the same operations in the same order and the module
+ * is built with @a -ffp-contract=off (see CMakeLists.txt), so every
+ * instruction set gives the same result as the scalar code.
+ *
+ * @note Link using -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filter.h"
+
+#if defined(__x86_64__)||defined(__i386__)
+#include <immintrin.h>
+#define FILTER_HAVE_X86         (1u) /**< SSE2/AVX2 kernels available */
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FILTER_HAVE_NEON        (1u) /**< NEON kernels available */
+#endif
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define FILTER_ALIGNMENT        (64u) /**< alignment of the filter buffers */
+#define BIQUAD_STATES           (2u) /**< state values of each section */
+#define BIQUAD_DENORMAL_LIMIT   (1e-15f) /**< smaller states are set to 0 */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn float* alloc_floats (size_t)
+ *
+ * @brief Allocate an aligned buffer of floats set to 0
+ *
+ ******************************************************************************/
+static float* alloc_floats (size_t count)
+{
+  void *buffer;
+
+  if ( 0!=posix_memalign (&buffer, FILTER_ALIGNMENT, sizeof(float)*count) )
+  {
+    return NULL;
+  }
+  memset (buffer, 0, sizeof(float)*count);
+
+  return (float*)buffer;
+}
+
+/******************************************************************************
+ *
+ * @fn void transpose_in (float**, uint32_t, uint32_t, uint32_t, float*)
+ *
+ * @brief Copy up to @ref FILTER_LANES channels to a transposed block, the
+ *        missing lanes are set to 0
+ *
+ ******************************************************************************/
+static void transpose_in (float **channels, uint32_t first, uint32_t count,
+                          uint32_t frames, float *block)
+{
+  for (uint32_t n = 0; n<frames; n++)
+  {
+    for (uint32_t l = 0; l<FILTER_LANES; l++)
+    {
+      block[n*FILTER_LANES+l] = (l<count) ? channels[first+l][n] : 0.0f;
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void transpose_out (const float*, uint32_t, uint32_t, uint32_t,
+ *                         float**)
+ *
+ * @brief Copy a transposed block back to the channels
+ *
+ ******************************************************************************/
+static void transpose_out (const float *block, uint32_t first, uint32_t count,
+                           uint32_t frames, float **channels)
+{
+  for (uint32_t l = 0; l<count; l++)
+  {
+    float *channel = channels[first+l];
+
+    for (uint32_t n = 0; n<frames; n++)
+    {
+      channel[n] = block[n*FILTER_LANES+l];
+    }
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * Scalar kernels
+ ------------------------------------------------------------------------------*/
+static void scalar_biquad (float *block, uint32_t frames,
+                           const float *coefficients, float *state)
+{
+  for (uint32_t l = 0; l<FILTER_LANES; l++)
+  {
+    float b0 = coefficients[0u*FILTER_LANES+l];
+    float b1 = coefficients[1u*FILTER_LANES+l];
+    float b2 = coefficients[2u*FILTER_LANES+l];
+    float a1 = coefficients[3u*FILTER_LANES+l];
+    float a2 = coefficients[4u*FILTER_LANES+l];
+    float z1 = state[l];
+    float z2 = state[FILTER_LANES+l];
+    float x;
+    float y;
+
+    for (uint32_t n = 0; n<frames; n++)
+    {
+      x = block[n*FILTER_LANES+l];
+      y = b0*x+z1;
+      z1 = b1*x-a1*y+z2;
+      z2 = b2*x-a2*y;
+      block[n*FILTER_LANES+l] = y;
+    }
+
+    /* after the input goes silent the state decays into denormals, which
+     * are very slow on x86, it's flushed to 0 before it gets there */
+    state[l] = (fabsf (z1)<BIQUAD_DENORMAL_LIMIT) ? 0.0f : z1;
+    state[FILTER_LANES+l] = (fabsf (z2)<BIQUAD_DENORMAL_LIMIT) ? 0.0f : z2;
+  }
+}
+
+static void scalar_fir (const float *line, float *out, uint32_t frames,
+                        const float *taps, uint32_t num_taps)
+{
+  float acc[FILTER_LANES];
+
+  for (uint32_t n = 0; n<frames; n++)
+  {
+    for (uint32_t l = 0; l<FILTER_LANES; l++)
+    {
+      acc[l] = 0.0f;
+    }
+    for (uint32_t k = 0; k<num_taps; k++)
+    {
+      const float *x = &line[(n+k)*FILTER_LANES];
+
+      for (uint32_t l = 0; l<FILTER_LANES; l++)
+      {
+        acc[l] = acc[l]+taps[k]*x[l];
+      }
+    }
+    for (uint32_t l = 0; l<FILTER_LANES; l++)
+    {
+      out[n*FILTER_LANES+l] = acc[l];
+    }
+  }
+}
+
+#ifdef FILTER_HAVE_X86
+/*------------------------------------------------------------------------------
+ * SSE2 kernels, each group is processed as two vectors of 4 lanes
+ ------------------------------------------------------------------------------*/
+static void sse2_biquad (float *block, uint32_t frames,
+                         const float *coefficients, float *state)
+{
+  for (uint32_t h = 0; h<FILTER_LANES; h += 4u)
+  {
+    __m128 b0 = _mm_load_ps (&coefficients[0u*FILTER_LANES+h]);
+    __m128 b1 = _mm_load_ps (&coefficients[1u*FILTER_LANES+h]);
+    __m128 b2 = _mm_load_ps (&coefficients[2u*FILTER_LANES+h]);
+    __m128 a1 = _mm_load_ps (&coefficients[3u*FILTER_LANES+h]);
+    __m128 a2 = _mm_load_ps (&coefficients[4u*FILTER_LANES+h]);
+    __m128 z1 = _mm_load_ps (&state[h]);
+    __m128 z2 = _mm_load_ps (&state[FILTER_LANES+h]);
+    __m128 abs_mask = _mm_castsi128_ps (_mm_set1_epi32 (0x7FFFFFFF));
+    __m128 limit = _mm_set1_ps (BIQUAD_DENORMAL_LIMIT);
+    __m128 x;
+    __m128 y;
+
+    for (uint32_t n = 0; n<frames; n++)
+    {
+      x = _mm_load_ps (&block[n*FILTER_LANES+h]);
+      y = _mm_add_ps (_mm_mul_ps (b0, x), z1);
+      z1 = _mm_add_ps (_mm_sub_ps (_mm_mul_ps (b1, x), _mm_mul_ps (a1, y)),
+                       z2);
+      z2 = _mm_sub_ps (_mm_mul_ps (b2, x), _mm_mul_ps (a2, y));
+      _mm_store_ps (&block[n*FILTER_LANES+h], y);
+    }
+
+    /* the state is flushed to 0 like in the scalar kernel */
+    z1 = _mm_andnot_ps (_mm_cmplt_ps (_mm_and_ps (z1, abs_mask), limit), z1);
+    z2 = _mm_andnot_ps (_mm_cmplt_ps (_mm_and_ps (z2, abs_mask), limit), z2);
+    _mm_store_ps (&state[h], z1);
+    _mm_store_ps (&state[FILTER_LANES+h], z2);
+  }
+}
+
+static void sse2_fir (const float *line, float *out, uint32_t frames,
+                      const float *taps, uint32_t num_taps)
+{
+  for (uint32_t n = 0; n<frames; n++)
+  {
+    __m128 low = _mm_setzero_ps ();
+    __m128 high = _mm_setzero_ps ();
+
+    for (uint32_t k = 0; k<num_taps; k++)
+    {
+      const float *x = &line[(n+k)*FILTER_LANES];
+      __m128 tap = _mm_set1_ps (taps[k]);
+
+      low = _mm_add_ps (low, _mm_mul_ps (tap, _mm_load_ps (&x[0])));
+      high = _mm_add_ps (high, _mm_mul_ps (tap, _mm_load_ps (&x[4])));
+    }
+    _mm_store_ps (&out[n*FILTER_LANES], low);
+    _mm_store_ps (&out[n*FILTER_LANES+4u], high);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * AVX2 kernels, a group fits in one vector
+ ------------------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static void avx2_biquad (float *block, uint32_t frames,
+                         const float *coefficients, float *state)
+{
+  __m256 b0 = _mm256_load_ps (&coefficients[0u*FILTER_LANES]);
+  __m256 b1 = _mm256_load_ps (&coefficients[1u*FILTER_LANES]);
+  __m256 b2 = _mm256_load_ps (&coefficients[2u*FILTER_LANES]);
+  __m256 a1 = _mm256_load_ps (&coefficients[3u*FILTER_LANES]);
+  __m256 a2 = _mm256_load_ps (&coefficients[4u*FILTER_LANES]);
+  __m256 z1 = _mm256_load_ps (&state[0]);
+  __m256 z2 = _mm256_load_ps (&state[FILTER_LANES]);
+  __m256 abs_mask = _mm256_castsi256_ps (_mm256_set1_epi32 (0x7FFFFFFF));
+  __m256 limit = _mm256_set1_ps (BIQUAD_DENORMAL_LIMIT);
+  __m256 x;
+  __m256 y;
+
+  for (uint32_t n = 0; n<frames; n++)
+  {
+    x = _mm256_load_ps (&block[n*FILTER_LANES]);
+    y = _mm256_add_ps (_mm256_mul_ps (b0, x), z1);
+    z1 = _mm256_add_ps (_mm256_sub_ps (_mm256_mul_ps (b1, x),
+                                       _mm256_mul_ps (a1, y)), z2);
+    z2 = _mm256_sub_ps (_mm256_mul_ps (b2, x), _mm256_mul_ps (a2, y));
+    _mm256_store_ps (&block[n*FILTER_LANES], y);
+  }
+
+  /* the state is flushed to 0 like in the scalar kernel */
+  z1 = _mm256_andnot_ps (_mm256_cmp_ps (_mm256_and_ps (z1, abs_mask), limit,
+                                        _CMP_LT_OQ), z1);
+  z2 = _mm256_andnot_ps (_mm256_cmp_ps (_mm256_and_ps (z2, abs_mask), limit,
+                                        _CMP_LT_OQ), z2);
+  _mm256_store_ps (&state[0], z1);
+  _mm256_store_ps (&state[FILTER_LANES], z2);
+}
+
+__attribute__((target("avx2")))
+static void avx2_fir (const float *line, float *out, uint32_t frames,
+                      const float *taps, uint32_t num_taps)
+{
+  for (uint32_t n = 0; n<frames; n++)
+  {
+    __m256 acc = _mm256_setzero_ps ();
+
+    for (uint32_t k = 0; k<num_taps; k++)
+    {
+      acc = _mm256_add_ps (acc, _mm256_mul_ps (
+          _mm256_set1_ps (taps[k]),
+          _mm256_load_ps (&line[(n+k)*FILTER_LANES])));
+    }
+    _mm256_store_ps (&out[n*FILTER_LANES], acc);
+  }
+}
+#endif
+
+#ifdef FILTER_HAVE_NEON
+/*------------------------------------------------------------------------------
+ * NEON kernels, each group is processed as two vectors of 4 lanes
+ ------------------------------------------------------------------------------*/
+static void neon_biquad (float *block, uint32_t frames,
+                         const float *coefficients, float *state)
+{
+  for (uint32_t h = 0; h<FILTER_LANES; h += 4u)
+  {
+    float32x4_t b0 = vld1q_f32 (&coefficients[0u*FILTER_LANES+h]);
+    float32x4_t b1 = vld1q_f32 (&coefficients[1u*FILTER_LANES+h]);
+    float32x4_t b2 = vld1q_f32 (&coefficients[2u*FILTER_LANES+h]);
+    float32x4_t a1 = vld1q_f32 (&coefficients[3u*FILTER_LANES+h]);
+    float32x4_t a2 = vld1q_f32 (&coefficients[4u*FILTER_LANES+h]);
+    float32x4_t z1 = vld1q_f32 (&state[h]);
+    float32x4_t z2 = vld1q_f32 (&state[FILTER_LANES+h]);
+    float32x4_t limit = vdupq_n_f32 (BIQUAD_DENORMAL_LIMIT);
+    float32x4_t x;
+    float32x4_t y;
+
+    /* vmlaq could be fused, the products are kept separated to match the
+     * scalar kernel */
+    for (uint32_t n = 0; n<frames; n++)
+    {
+      x = vld1q_f32 (&block[n*FILTER_LANES+h]);
+      y = vaddq_f32 (vmulq_f32 (b0, x), z1);
+      z1 = vaddq_f32 (vsubq_f32 (vmulq_f32 (b1, x), vmulq_f32 (a1, y)), z2);
+      z2 = vsubq_f32 (vmulq_f32 (b2, x), vmulq_f32 (a2, y));
+      vst1q_f32 (&block[n*FILTER_LANES+h], y);
+    }
+
+    /* the state is flushed to 0 like in the scalar kernel */
+    z1 = vreinterpretq_f32_u32 (vbicq_u32 (vreinterpretq_u32_f32 (z1),
+                                           vcltq_f32 (vabsq_f32 (z1), limit)));
+    z2 = vreinterpretq_f32_u32 (vbicq_u32 (vreinterpretq_u32_f32 (z2),
+                                           vcltq_f32 (vabsq_f32 (z2), limit)));
+    vst1q_f32 (&state[h], z1);
+    vst1q_f32 (&state[FILTER_LANES+h], z2);
+  }
+}
+
+static void neon_fir (const float *line, float *out, uint32_t frames,
+                      const float *taps, uint32_t num_taps)
+{
+  for (uint32_t n = 0; n<frames; n++)
+  {
+    float32x4_t low = vdupq_n_f32 (0.0f);
+    float32x4_t high = vdupq_n_f32 (0.0f);
+
+    for (uint32_t k = 0; k<num_taps; k++)
+    {
+      const float *x = &line[(n+k)*FILTER_LANES];
+      float32x4_t tap = vdupq_n_f32 (taps[k]);
+
+      low = vaddq_f32 (low, vmulq_f32 (tap, vld1q_f32 (&x[0])));
+      high = vaddq_f32 (high, vmulq_f32 (tap, vld1q_f32 (&x[4])));
+    }
+    vst1q_f32 (&out[n*FILTER_LANES], low);
+    vst1q_f32 (&out[n*FILTER_LANES+4u], high);
+  }
+}
+#endif
+
+/******************************************************************************
+ *
+ * @fn void select_kernels (biquad_kernel*, fir_kernel*)
+ *
+ * @brief Get the kernels of the instruction set selected in
+ *        @ref sample_convert_set_isa
+ *
+ ******************************************************************************/
+static void select_kernels (biquad_kernel *biquad, fir_kernel *fir)
+{
+  *biquad = scalar_biquad;
+  *fir = scalar_fir;
+
+  switch (sample_convert_get_isa ())
+  {
+#ifdef FILTER_HAVE_X86
+    case E_ISA_SSE2:
+      *biquad = sse2_biquad;
+      *fir = sse2_fir;
+      break;
+    case E_ISA_AVX2:
+      *biquad = avx2_biquad;
+      *fir = avx2_fir;
+      break;
+#endif
+#ifdef FILTER_HAVE_NEON
+    case E_ISA_NEON:
+      *biquad = neon_biquad;
+      *fir = neon_fir;
+      break;
+#endif
+    default:
+      break;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t biquad_design (biquad_coefficients*, biquad_type, float,
+ *                           uint32_t, float, float)
+ *
+ * @brief Compute the coefficients of a section with the formulas of the
+ *        Audio EQ Cookbook (R. Bristow-Johnson)
+ *
+ * @param[out] *coefficients  coefficients normalized by a0
+ * @param       type          type of section
+ * @param       f0            center or cutoff frequency in Hz
+ * @param       fs            sample rate in Hz
+ * @param       q             quality factor (0.7071 for Butterworth)
+ * @param       gain_db       gain of the peaking and shelf sections
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t biquad_design (biquad_coefficients *coefficients, biquad_type type,
+                      float f0, uint32_t fs, float q, float gain_db)
+{
+  double w0;
+  double cos_w0;
+  double alpha;
+  double a;
+  double sqrt_a;
+  double b[3];
+  double den[3];
+
+  if ( (NULL==coefficients)||(0.0f>=f0)||((float)fs<=2.0f*f0)||(0.0f>=q) )
+  {
+    return S_ERROR;
+  }
+
+  w0 = 2.0*M_PI*(double)f0/(double)fs;
+  cos_w0 = cos (w0);
+  alpha = sin (w0)/(2.0*(double)q);
+  a = pow (10.0, (double)gain_db/40.0);
+  sqrt_a = 2.0*sqrt (a)*alpha;
+
+  switch (type)
+  {
+    case E_BIQUAD_LOWPASS:
+      b[0] = (1.0-cos_w0)/2.0;
+      b[1] = 1.0-cos_w0;
+      b[2] = (1.0-cos_w0)/2.0;
+      den[0] = 1.0+alpha;
+      den[1] = -2.0*cos_w0;
+      den[2] = 1.0-alpha;
+      break;
+    case E_BIQUAD_HIGHPASS:
+      b[0] = (1.0+cos_w0)/2.0;
+      b[1] = -(1.0+cos_w0);
+      b[2] = (1.0+cos_w0)/2.0;
+      den[0] = 1.0+alpha;
+      den[1] = -2.0*cos_w0;
+      den[2] = 1.0-alpha;
+      break;
+    case E_BIQUAD_BANDPASS:
+      b[0] = alpha;
+      b[1] = 0.0;
+      b[2] = -alpha;
+      den[0] = 1.0+alpha;
+      den[1] = -2.0*cos_w0;
+      den[2] = 1.0-alpha;
+      break;
+    case E_BIQUAD_NOTCH:
+      b[0] = 1.0;
+      b[1] = -2.0*cos_w0;
+      b[2] = 1.0;
+      den[0] = 1.0+alpha;
+      den[1] = -2.0*cos_w0;
+      den[2] = 1.0-alpha;
+      break;
+    case E_BIQUAD_PEAKING:
+      b[0] = 1.0+alpha*a;
+      b[1] = -2.0*cos_w0;
+      b[2] = 1.0-alpha*a;
+      den[0] = 1.0+alpha/a;
+      den[1] = -2.0*cos_w0;
+      den[2] = 1.0-alpha/a;
+      break;
+    case E_BIQUAD_LOWSHELF:
+      b[0] = a*((a+1.0)-(a-1.0)*cos_w0+sqrt_a);
+      b[1] = 2.0*a*((a-1.0)-(a+1.0)*cos_w0);
+      b[2] = a*((a+1.0)-(a-1.0)*cos_w0-sqrt_a);
+      den[0] = (a+1.0)+(a-1.0)*cos_w0+sqrt_a;
+      den[1] = -2.0*((a-1.0)+(a+1.0)*cos_w0);
+      den[2] = (a+1.0)+(a-1.0)*cos_w0-sqrt_a;
+      break;
+    case E_BIQUAD_HIGHSHELF:
+      b[0] = a*((a+1.0)+(a-1.0)*cos_w0+sqrt_a);
+      b[1] = -2.0*a*((a-1.0)+(a+1.0)*cos_w0);
+      b[2] = a*((a+1.0)+(a-1.0)*cos_w0-sqrt_a);
+      den[0] = (a+1.0)-(a-1.0)*cos_w0+sqrt_a;
+      den[1] = 2.0*((a-1.0)-(a+1.0)*cos_w0);
+      den[2] = (a+1.0)-(a-1.0)*cos_w0-sqrt_a;
+      break;
+    default:
+      return S_ERROR;
+  }
+
+  coefficients->b0 = (float)(b[0]/den[0]);
+  coefficients->b1 = (float)(b[1]/den[0]);
+  coefficients->b2 = (float)(b[2]/den[0]);
+  coefficients->a1 = (float)(den[1]/den[0]);
+  coefficients->a2 = (float)(den[2]/den[0]);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t biquad_cascade_init (biquad_cascade*, uint32_t, uint32_t,
+ *                                 uint32_t)
+ *
+ * @brief Create a cascade, all the sections start as pass-through
+ *
+ * The kernels of the instruction set selected in @ref sample_convert_set_isa
+ * are used, so @ref sample_convert_init should be called before
+ *
+ * @param[out] *cascade       pointer to the cascade
+ * @param       num_channels  number of channels
+ * @param       num_sections  sections of each channel
+ * @param       max_frames    biggest block processed at once, bigger blocks
+ *                            are split
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t biquad_cascade_init (biquad_cascade *cascade, uint32_t num_channels,
+                            uint32_t num_sections, uint32_t max_frames)
+{
+  fir_kernel unused;
+  size_t sections;
+  const biquad_coefficients identity = { .b0 = 1.0f };
+
+  if ( (NULL==cascade)||(0u==num_channels)||(MAX_CHANNELS<num_channels)||
+       (0u==num_sections)||(0u==max_frames) )
+  {
+    return S_ERROR;
+  }
+
+  cascade->num_channels = num_channels;
+  cascade->num_sections = num_sections;
+  cascade->num_groups = (num_channels+FILTER_LANES-1u)/FILTER_LANES;
+  cascade->max_frames = max_frames;
+  sections = (size_t)cascade->num_groups*num_sections;
+
+  cascade->coefficients = alloc_floats (sections*BIQUAD_COEFFICIENTS*
+                                        FILTER_LANES);
+  cascade->state = alloc_floats (sections*BIQUAD_STATES*FILTER_LANES);
+  cascade->block = alloc_floats ((size_t)max_frames*FILTER_LANES);
+  if ( (NULL==cascade->coefficients)||(NULL==cascade->state)||
+       (NULL==cascade->block) )
+  {
+    biquad_cascade_destroy (cascade);
+    return S_ERROR;
+  }
+
+  select_kernels (&cascade->kernel, &unused);
+  for (uint32_t s = 0; s<num_sections; s++)
+  {
+    biquad_cascade_set_section (cascade, FILTER_ALL_CHANNELS, s, &identity);
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t biquad_cascade_set_section (biquad_cascade*, uint32_t,
+ *                                        uint32_t,
+ *                                        const biquad_coefficients*)
+ *
+ * @brief Set the coefficients of a section of one or all the channels
+ *
+ * The state is kept, so the coefficients can be changed while streaming
+ * from the thread that processes the audio
+ *
+ * @param[in] *cascade       pointer to the cascade
+ * @param      channel       channel to change or @ref FILTER_ALL_CHANNELS
+ * @param      section       section to change
+ * @param[in] *coefficients  new coefficients
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t biquad_cascade_set_section (biquad_cascade *cascade, uint32_t channel,
+                                   uint32_t section,
+                                   const biquad_coefficients *coefficients)
+{
+  float values[BIQUAD_COEFFICIENTS];
+  uint32_t first = channel;
+  uint32_t last = channel;
+  float *lane;
+
+  if ( (NULL==cascade)||(NULL==coefficients)||
+       (section>=cascade->num_sections)||
+       ((FILTER_ALL_CHANNELS!=channel)&&(channel>=cascade->num_channels)) )
+  {
+    return S_ERROR;
+  }
+
+  values[0] = coefficients->b0;
+  values[1] = coefficients->b1;
+  values[2] = coefficients->b2;
+  values[3] = coefficients->a1;
+  values[4] = coefficients->a2;
+
+  /* the padding lanes get the coefficients too, so they stay at 0 */
+  if ( FILTER_ALL_CHANNELS==channel )
+  {
+    first = 0u;
+    last = cascade->num_groups*FILTER_LANES-1u;
+  }
+
+  for (uint32_t ch = first; ch<=last; ch++)
+  {
+    lane = &cascade->coefficients[((ch/FILTER_LANES)*cascade->num_sections+
+        section)*BIQUAD_COEFFICIENTS*FILTER_LANES+ch%FILTER_LANES];
+    for (uint32_t k = 0; k<BIQUAD_COEFFICIENTS; k++)
+    {
+      lane[k*FILTER_LANES] = values[k];
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t biquad_cascade_process (biquad_cascade*, float**, uint32_t)
+ *
+ * @brief Filter a block of all the channels in place
+ *
+ * @param[in]     *cascade   pointer to the cascade
+ * @param[in,out] **channels one buffer for each channel of the cascade
+ * @param          frames    frames of each buffer
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t biquad_cascade_process (biquad_cascade *cascade, float **channels,
+                               uint32_t frames)
+{
+  float *chunk[MAX_CHANNELS];
+  uint32_t frames_done;
+  uint32_t length;
+  uint32_t count;
+  size_t section;
+
+  if ( (NULL==cascade)||(NULL==channels) )
+  {
+    return S_ERROR;
+  }
+
+  for (frames_done = 0; frames_done<frames; frames_done += length)
+  {
+    length = frames-frames_done;
+    if ( length>cascade->max_frames )
+    {
+      length = cascade->max_frames;
+    }
+    for (uint32_t ch = 0; ch<cascade->num_channels; ch++)
+    {
+      chunk[ch] = &channels[ch][frames_done];
+    }
+
+    for (uint32_t g = 0; g<cascade->num_groups; g++)
+    {
+      count = cascade->num_channels-g*FILTER_LANES;
+      if ( FILTER_LANES<count )
+      {
+        count = FILTER_LANES;
+      }
+
+      transpose_in (chunk, g*FILTER_LANES, count, length, cascade->block);
+      for (uint32_t s = 0; s<cascade->num_sections; s++)
+      {
+        section = (size_t)g*cascade->num_sections+s;
+        cascade->kernel (cascade->block, length,
+                         &cascade->coefficients[section*BIQUAD_COEFFICIENTS*
+                             FILTER_LANES],
+                         &cascade->state[section*BIQUAD_STATES*FILTER_LANES]);
+      }
+      transpose_out (cascade->block, g*FILTER_LANES, count, length, chunk);
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t biquad_cascade_stage (float**, uint32_t, uint32_t, void*)
+ *
+ * @brief @ref dsp_stage_callback running a cascade
+ *
+ * @param[in,out] **channels     audio of the period
+ * @param           num_channels channels of the period, at least the ones
+ *                               of the cascade
+ * @param           frames       frames of each channel
+ * @param[in]      *user_data    pointer to the @ref biquad_cascade
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t biquad_cascade_stage (float **channels, uint32_t num_channels,
+                             uint32_t frames, void *user_data)
+{
+  biquad_cascade *cascade = (biquad_cascade*)user_data;
+
+  if ( (NULL==cascade)||(num_channels<cascade->num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  return biquad_cascade_process (cascade, channels, frames);
+}
+
+/******************************************************************************
+ *
+ * @fn void biquad_cascade_reset (biquad_cascade*)
+ *
+ * @brief Clear the state of all the sections, e.g. after a restart of the
+ *        stream
+ *
+ * @param[in] *cascade  pointer to the cascade
+ *
+ ******************************************************************************/
+void biquad_cascade_reset (biquad_cascade *cascade)
+{
+  if ( (NULL!=cascade)&&(NULL!=cascade->state) )
+  {
+    memset (cascade->state, 0, sizeof(float)*cascade->num_groups*
+            cascade->num_sections*BIQUAD_STATES*FILTER_LANES);
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void biquad_cascade_destroy (biquad_cascade*)
+ *
+ * @brief Free the memory of a cascade
+ *
+ * @param[in] *cascade  pointer to the cascade
+ *
+ ******************************************************************************/
+void biquad_cascade_destroy (biquad_cascade *cascade)
+{
+  if ( NULL!=cascade )
+  {
+    free (cascade->coefficients);
+    free (cascade->state);
+    free (cascade->block);
+    cascade->coefficients = NULL;
+    cascade->state = NULL;
+    cascade->block = NULL;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t fir_filter_init (fir_filter*, uint32_t, const float*, uint32_t,
+ *                             uint32_t)
+ *
+ * @brief Create a FIR filter
+ *
+ * The kernels of the instruction set selected in @ref sample_convert_set_isa
+ * are used, so @ref sample_convert_init should be called before
+ *
+ * @param[out] *fir           pointer to the filter
+ * @param       num_channels  number of channels
+ * @param[in]  *taps          impulse response, the same for all channels
+ * @param       num_taps      length of the impulse response
+ * @param       max_frames    biggest block processed at once, bigger blocks
+ *                            are split
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t fir_filter_init (fir_filter *fir, uint32_t num_channels,
+                        const float *taps, uint32_t num_taps,
+                        uint32_t max_frames)
+{
+  biquad_kernel unused;
+
+  if ( (NULL==fir)||(NULL==taps)||(0u==num_channels)||
+       (MAX_CHANNELS<num_channels)||(0u==num_taps)||(0u==max_frames) )
+  {
+    return S_ERROR;
+  }
+
+  fir->num_channels = num_channels;
+  fir->num_taps = num_taps;
+  fir->num_groups = (num_channels+FILTER_LANES-1u)/FILTER_LANES;
+  fir->max_frames = max_frames;
+
+  fir->taps = alloc_floats (num_taps);
+  fir->lines = alloc_floats ((size_t)fir->num_groups*(num_taps-1u+max_frames)*
+                             FILTER_LANES);
+  fir->out = alloc_floats ((size_t)max_frames*FILTER_LANES);
+  if ( (NULL==fir->taps)||(NULL==fir->lines)||(NULL==fir->out) )
+  {
+    fir_filter_destroy (fir);
+    return S_ERROR;
+  }
+
+  /* reversed, so the kernels walk the taps and the inputs forward */
+  for (uint32_t k = 0; k<num_taps; k++)
+  {
+    fir->taps[k] = taps[num_taps-1u-k];
+  }
+  select_kernels (&unused, &fir->kernel);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t fir_filter_process (fir_filter*, float**, uint32_t)
+ *
+ * @brief Filter a block of all the channels in place
+ *
+ * @param[in]     *fir       pointer to the filter
+ * @param[in,out] **channels one buffer for each channel of the filter
+ * @param          frames    frames of each buffer
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t fir_filter_process (fir_filter *fir, float **channels, uint32_t frames)
+{
+  float *chunk[MAX_CHANNELS];
+  size_t history = (NULL!=fir) ? fir->num_taps-1u : 0u;
+  uint32_t frames_done;
+  uint32_t length;
+  uint32_t count;
+  float *line;
+
+  if ( (NULL==fir)||(NULL==channels) )
+  {
+    return S_ERROR;
+  }
+
+  for (frames_done = 0; frames_done<frames; frames_done += length)
+  {
+    length = frames-frames_done;
+    if ( length>fir->max_frames )
+    {
+      length = fir->max_frames;
+    }
+    for (uint32_t ch = 0; ch<fir->num_channels; ch++)
+    {
+      chunk[ch] = &channels[ch][frames_done];
+    }
+
+    for (uint32_t g = 0; g<fir->num_groups; g++)
+    {
+      count = fir->num_channels-g*FILTER_LANES;
+      if ( FILTER_LANES<count )
+      {
+        count = FILTER_LANES;
+      }
+
+      line = &fir->lines[(size_t)g*(history+fir->max_frames)*FILTER_LANES];
+      transpose_in (chunk, g*FILTER_LANES, count, length,
+                    &line[history*FILTER_LANES]);
+      fir->kernel (line, fir->out, length, fir->taps, fir->num_taps);
+      transpose_out (fir->out, g*FILTER_LANES, count, length, chunk);
+
+      /* keep the last inputs for the next block */
+      memmove (line, &line[(size_t)length*FILTER_LANES],
+               sizeof(float)*history*FILTER_LANES);
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t fir_filter_stage (float**, uint32_t, uint32_t, void*)
+ *
+ * @brief @ref dsp_stage_callback running a FIR filter
+ *
+ * @param[in,out] **channels     audio of the period
+ * @param           num_channels channels of the period, at least the ones
+ *                               of the filter
+ * @param           frames       frames of each channel
+ * @param[in]      *user_data    pointer to the @ref fir_filter
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t fir_filter_stage (float **channels, uint32_t num_channels,
+                         uint32_t frames, void *user_data)
+{
+  fir_filter *fir = (fir_filter*)user_data;
+
+  if ( (NULL==fir)||(num_channels<fir->num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  return fir_filter_process (fir, channels, frames);
+}
+
+/******************************************************************************
+ *
+ * @fn void fir_filter_reset (fir_filter*)
+ *
+ * @brief Clear the past inputs of the filter
+ *
+ * @param[in] *fir  pointer to the filter
+ *
+ ******************************************************************************/
+void fir_filter_reset (fir_filter *fir)
+{
+  if ( (NULL!=fir)&&(NULL!=fir->lines) )
+  {
+    memset (fir->lines, 0, sizeof(float)*fir->num_groups*
+            (fir->num_taps-1u+fir->max_frames)*FILTER_LANES);
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void fir_filter_destroy (fir_filter*)
+ *
+ * @brief Free the memory of a FIR filter
+ *
+ * @param[in] *fir  pointer to the filter
+ *
+ ******************************************************************************/
+void fir_filter_destroy (fir_filter *fir)
+{
+  if ( NULL!=fir )
+  {
+    free (fir->taps);
+    free (fir->lines);
+    free (fir->out);
+    fir->taps = NULL;
+    fir->lines = NULL;
+    fir->out = NULL;
+  }
+}
+/*-------------- END OF FILE -------------------------------------------------*/
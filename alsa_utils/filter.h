@@ -0,0 +1,157 @@
+/*******************************************************************************
+ * @file      filter.h
+ *
+ * @brief      Biquad and FIR filters for multichannel float buffers
+ *
+ * Block filters working on one float buffer per channel (planar), in
+ * place, so they can be used as @ref dsp_stage_callback:
+ *      @li @ref biquad_cascade cascade of second order sections (SOS), each
+ *          channel can have its own coefficients (e.g. one EQ per channel)
+ *      @li @ref fir_filter FIR with the same taps for all the channels, for
+ *          short kernels, the partitioned FFT in @ref fft_convolver is
+ *          faster for long ones
+ *
+ * The channels are filtered in groups of @ref FILTER_LANES in lockstep, each
+ * channel is a lane of the vector registers (SSE2, AVX2 or NEON), so the
+ * recursion of the biquads is vectorized too. The instruction set is the one
+ * selected in @ref sample_convert_set_isa when the filter is created.
+ *
+ * @note Link using -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "alsa_utils.h"
+#include "sample_convert.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _FILTER_
+#define _FILTER_
+
+#define FILTER_LANES            (8u) /**< channels filtered in lockstep */
+#define FILTER_ALL_CHANNELS     (0xFFFFFFFFu) /**< apply to all channels */
+#define BIQUAD_COEFFICIENTS     (5u) /**< b0, b1, b2, a1, a2 */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Coefficients of a second order section normalized by a0:
+ * @f$ H(z) = \frac{b_0+b_1z^{-1}+b_2z^{-2}}{1+a_1z^{-1}+a_2z^{-2}} @f$ */
+typedef struct
+{
+  float b0; /**< feedforward coefficient of x[n] */
+  float b1; /**< feedforward coefficient of x[n-1] */
+  float b2; /**< feedforward coefficient of x[n-2] */
+  float a1; /**< feedback coefficient of y[n-1] */
+  float a2; /**< feedback coefficient of y[n-2] */
+} biquad_coefficients;
+
+/** Types of sections designed by @ref biquad_design (Audio EQ Cookbook) */
+typedef enum
+{
+  E_BIQUAD_LOWPASS = 0, /**< 2nd order low pass */
+  E_BIQUAD_HIGHPASS, /**< 2nd order high pass */
+  E_BIQUAD_BANDPASS, /**< band pass, 0dB peak gain */
+  E_BIQUAD_NOTCH, /**< notch */
+  E_BIQUAD_PEAKING, /**< peaking EQ */
+  E_BIQUAD_LOWSHELF, /**< low shelf */
+  E_BIQUAD_HIGHSHELF /**< high shelf */
+} biquad_type;
+
+/** Kernel running one section over a transposed block of
+ * @ref FILTER_LANES channels */
+typedef void (*biquad_kernel) (float *block, uint32_t frames,
+                               const float *coefficients, float *state);
+
+/** Kernel running a FIR over a transposed block of @ref FILTER_LANES
+ * channels */
+typedef void (*fir_kernel) (const float *line, float *out, uint32_t frames,
+                            const float *taps, uint32_t num_taps);
+
+/** Cascade of biquads for several channels, the coefficients and the state
+ * are stored by group of channels, section and lane: the value of the lane
+ * @a l of the group @a g and section @a s is at
+ * @f$ ((g \cdot sections+s) \cdot N+k) \cdot LANES+l @f$. At the end of
+ * each block the states below 1e-15 are set to 0, so the decay after the
+ * input goes silent doesn't reach the (slow) denormals */
+typedef struct
+{
+  uint32_t num_channels; /**< channels filtered */
+  uint32_t num_sections; /**< sections of each channel */
+  uint32_t num_groups; /**< groups of @ref FILTER_LANES channels */
+  uint32_t max_frames; /**< biggest block that can be processed */
+  float *coefficients; /**< @ref BIQUAD_COEFFICIENTS per section and lane */
+  float *state; /**< 2 values per section and lane (transposed DF II) */
+  float *block; /**< transposed block of a group */
+  biquad_kernel kernel; /**< kernel of the instruction set in use */
+} biquad_cascade;
+
+/** FIR filter for several channels with the same taps */
+typedef struct
+{
+  uint32_t num_channels; /**< channels filtered */
+  uint32_t num_taps; /**< length of the filter */
+  uint32_t num_groups; /**< groups of @ref FILTER_LANES channels */
+  uint32_t max_frames; /**< biggest block that can be processed */
+  float *taps; /**< taps in reverse order */
+  float *lines; /**< for each group the last num_taps-1 inputs followed by
+   the block, transposed */
+  float *out; /**< transposed output of a group */
+  fir_kernel kernel; /**< kernel of the instruction set in use */
+} fir_filter;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t biquad_design (biquad_coefficients *coefficients, biquad_type type,
+                      float f0, uint32_t fs, float q, float gain_db);
+int8_t biquad_cascade_init (biquad_cascade *cascade, uint32_t num_channels,
+                            uint32_t num_sections, uint32_t max_frames);
+int8_t biquad_cascade_set_section (biquad_cascade *cascade, uint32_t channel,
+                                   uint32_t section,
+                                   const biquad_coefficients *coefficients);
+int8_t biquad_cascade_process (biquad_cascade *cascade, float **channels,
+                               uint32_t frames);
+int8_t biquad_cascade_stage (float **channels, uint32_t num_channels,
+                             uint32_t frames, void *user_data);
+void biquad_cascade_reset (biquad_cascade *cascade);
+void biquad_cascade_destroy (biquad_cascade *cascade);
+int8_t fir_filter_init (fir_filter *fir, uint32_t num_channels,
+                        const float *taps, uint32_t num_taps,
+                        uint32_t max_frames);
+int8_t fir_filter_process (fir_filter *fir, float **channels, uint32_t frames);
+int8_t fir_filter_stage (float **channels, uint32_t num_channels,
+                         uint32_t frames, void *user_data);
+void fir_filter_reset (fir_filter *fir);
+void fir_filter_destroy (fir_filter *fir);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
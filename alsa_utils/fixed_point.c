@@ -0,0 +1,607 @@
+/*******************************************************************************
+ * @file      fixed_point.c
+ *
+ * @brief      Q15/Q31 fixed point arithmetic for targets without a fast FPU
+ *
+ * The NEON kernels use the saturating rounding doubling multiply
+ * (@a vqrdmulh), that computes @f$ sat(\lfloor (2ab+2^{N-1})/2^N \rfloor) @f$,
+ * the same value as @ref q15_mul and @ref q31_mul, and the saturating add and
+ * shift, so they give the same bits as the scalar loops. There are no x86
+ * kernels: @a pmulhrsw doesn't saturate -1*-1 and the scalar loops are simple
+ * enough for the compiler to vectorize them, the conversions from float use
+ * the kernels of @ref convert_float_to_format in every instruction set.
+ *
+ * @note
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <stddef.h>
+#include "fixed_point.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FIXED_POINT_HAVE_NEON   (1u) /**< NEON kernels available */
+#endif
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define Q15_TO_FLOAT            (1.0f/32768.0f) /**< scale of Q15 to float */
+#define Q31_TO_FLOAT            (1.0f/2147483648.0f) /**< scale of Q31 to
+                                                          float */
+#define Q15_MAX_SHIFT           (15u) /**< biggest shift of @ref q15_gain */
+#define Q31_MAX_SHIFT           (31u) /**< biggest shift of @ref q31_gain */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/*------------------------------------------------------------------------------
+ * Scalar kernels
+ ------------------------------------------------------------------------------*/
+static void scalar_q15_to_float (const q15_t *in, float *out, uint32_t samples)
+{
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    out[n] = (float)in[n]*Q15_TO_FLOAT;
+  }
+}
+
+static void scalar_q15_gain (q15_t *data, uint32_t samples, q15_t gain,
+                             uint32_t shift)
+{
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    data[n] = q15_shift (q15_mul (data[n], gain), shift);
+  }
+}
+
+static void scalar_q15_mix (q15_t *out, const q15_t *in, uint32_t samples,
+                            q15_t gain)
+{
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    out[n] = q15_add (out[n], q15_mul (in[n], gain));
+  }
+}
+
+static int64_t scalar_q15_dot (const q15_t *a, const q15_t *b,
+                               uint32_t samples)
+{
+  int64_t sum = 0;
+
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    sum += q15_mul (a[n], b[n]);
+  }
+
+  return sum;
+}
+
+static void scalar_q31_to_float (const q31_t *in, float *out, uint32_t samples)
+{
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    out[n] = (float)in[n]*Q31_TO_FLOAT;
+  }
+}
+
+static void scalar_q31_gain (q31_t *data, uint32_t samples, q31_t gain,
+                             uint32_t shift)
+{
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    data[n] = q31_shift (q31_mul (data[n], gain), shift);
+  }
+}
+
+static void scalar_q31_mix (q31_t *out, const q31_t *in, uint32_t samples,
+                            q31_t gain)
+{
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    out[n] = q31_add (out[n], q31_mul (in[n], gain));
+  }
+}
+
+static int64_t scalar_q31_dot (const q31_t *a, const q31_t *b,
+                               uint32_t samples)
+{
+  int64_t sum = 0;
+
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    sum += q31_mul (a[n], b[n]);
+  }
+
+  return sum;
+}
+
+#ifdef FIXED_POINT_HAVE_NEON
+/*------------------------------------------------------------------------------
+ * NEON kernels, only with the intrinsics of ARMv7 so they build on both
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int64_t neon_sum_s64 (int64x2_t)
+ *
+ * @brief Add the two lanes, ARMv7 has no @a vaddvq
+ *
+ ******************************************************************************/
+static inline int64_t neon_sum_s64 (int64x2_t sum)
+{
+  return vgetq_lane_s64 (sum, 0)+vgetq_lane_s64 (sum, 1);
+}
+
+static void neon_q15_to_float (const q15_t *in, float *out, uint32_t samples)
+{
+  float32x4_t scale = vdupq_n_f32 (Q15_TO_FLOAT);
+  int16x8_t value;
+  uint32_t n = 0;
+
+  for (; n+8u<=samples; n += 8u)
+  {
+    value = vld1q_s16 (&in[n]);
+    vst1q_f32 (&out[n], vmulq_f32 (vcvtq_f32_s32 (vmovl_s16 (
+        vget_low_s16 (value))), scale));
+    vst1q_f32 (&out[n+4u], vmulq_f32 (vcvtq_f32_s32 (vmovl_s16 (
+        vget_high_s16 (value))), scale));
+  }
+  scalar_q15_to_float (&in[n], &out[n], samples-n);
+}
+
+static void neon_q15_gain (q15_t *data, uint32_t samples, q15_t gain,
+                           uint32_t shift)
+{
+  int16x8_t shifts = vdupq_n_s16 ((int16_t)shift);
+  uint32_t n = 0;
+
+  for (; n+8u<=samples; n += 8u)
+  {
+    vst1q_s16 (&data[n], vqshlq_s16 (vqrdmulhq_n_s16 (vld1q_s16 (&data[n]),
+                                                      gain), shifts));
+  }
+  scalar_q15_gain (&data[n], samples-n, gain, shift);
+}
+
+static void neon_q15_mix (q15_t *out, const q15_t *in, uint32_t samples,
+                          q15_t gain)
+{
+  uint32_t n = 0;
+
+  for (; n+8u<=samples; n += 8u)
+  {
+    vst1q_s16 (&out[n], vqaddq_s16 (vld1q_s16 (&out[n]),
+                                    vqrdmulhq_n_s16 (vld1q_s16 (&in[n]),
+                                                     gain)));
+  }
+  scalar_q15_mix (&out[n], &in[n], samples-n, gain);
+}
+
+static int64_t neon_q15_dot (const q15_t *a, const q15_t *b, uint32_t samples)
+{
+  int64x2_t sum = vdupq_n_s64 (0);
+  uint32_t n = 0;
+
+  /* the pairs of Q15 products are widened to 32 bits before the sum */
+  for (; n+8u<=samples; n += 8u)
+  {
+    sum = vpadalq_s32 (sum, vpaddlq_s16 (vqrdmulhq_s16 (vld1q_s16 (&a[n]),
+                                                        vld1q_s16 (&b[n]))));
+  }
+
+  return neon_sum_s64 (sum)+scalar_q15_dot (&a[n], &b[n], samples-n);
+}
+
+static void neon_q31_to_float (const q31_t *in, float *out, uint32_t samples)
+{
+  float32x4_t scale = vdupq_n_f32 (Q31_TO_FLOAT);
+  uint32_t n = 0;
+
+  for (; n+4u<=samples; n += 4u)
+  {
+    vst1q_f32 (&out[n], vmulq_f32 (vcvtq_f32_s32 (vld1q_s32 (&in[n])),
+                                   scale));
+  }
+  scalar_q31_to_float (&in[n], &out[n], samples-n);
+}
+
+static void neon_q31_gain (q31_t *data, uint32_t samples, q31_t gain,
+                           uint32_t shift)
+{
+  int32x4_t shifts = vdupq_n_s32 ((int32_t)shift);
+  uint32_t n = 0;
+
+  for (; n+4u<=samples; n += 4u)
+  {
+    vst1q_s32 (&data[n], vqshlq_s32 (vqrdmulhq_n_s32 (vld1q_s32 (&data[n]),
+                                                      gain), shifts));
+  }
+  scalar_q31_gain (&data[n], samples-n, gain, shift);
+}
+
+static void neon_q31_mix (q31_t *out, const q31_t *in, uint32_t samples,
+                          q31_t gain)
+{
+  uint32_t n = 0;
+
+  for (; n+4u<=samples; n += 4u)
+  {
+    vst1q_s32 (&out[n], vqaddq_s32 (vld1q_s32 (&out[n]),
+                                    vqrdmulhq_n_s32 (vld1q_s32 (&in[n]),
+                                                     gain)));
+  }
+  scalar_q31_mix (&out[n], &in[n], samples-n, gain);
+}
+
+static int64_t neon_q31_dot (const q31_t *a, const q31_t *b, uint32_t samples)
+{
+  int64x2_t sum = vdupq_n_s64 (0);
+  uint32_t n = 0;
+
+  for (; n+4u<=samples; n += 4u)
+  {
+    sum = vpadalq_s32 (sum, vqrdmulhq_s32 (vld1q_s32 (&a[n]),
+                                           vld1q_s32 (&b[n])));
+  }
+
+  return neon_sum_s64 (sum)+scalar_q31_dot (&a[n], &b[n], samples-n);
+}
+#endif
+
+/******************************************************************************
+ *
+ * @fn uint8_t use_neon (void)
+ *
+ * @brief Check if the NEON kernels were selected in
+ *        @ref sample_convert_set_isa
+ *
+ ******************************************************************************/
+static inline uint8_t use_neon (void)
+{
+  return (E_ISA_NEON==sample_convert_get_isa ()) ? 1u : 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t q15_from_float (const float*, q15_t*, uint32_t)
+ *
+ * @brief Convert float samples to Q15, rounding to the nearest and
+ *        saturating
+ *
+ * It's the conversion to @a SND_PCM_FORMAT_S16_LE, so the fixed point path
+ * starts with the same samples that the float path sends to the card
+ *
+ * @param[in]  *in       float samples
+ * @param[out] *out      Q15 samples
+ * @param       samples  number of samples to convert
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t q15_from_float (const float *in, q15_t *out, uint32_t samples)
+{
+  return convert_float_to_format (in, out, samples, SND_PCM_FORMAT_S16_LE);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t q15_to_float (const q15_t*, float*, uint32_t)
+ *
+ * @brief Convert Q15 samples to float, the conversion is exact
+ *
+ * @param[in]  *in       Q15 samples
+ * @param[out] *out      float samples
+ * @param       samples  number of samples to convert
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t q15_to_float (const q15_t *in, float *out, uint32_t samples)
+{
+  if ( (NULL==in)||(NULL==out) )
+  {
+    return S_ERROR;
+  }
+
+#ifdef FIXED_POINT_HAVE_NEON
+  if ( use_neon () )
+  {
+    neon_q15_to_float (in, out, samples);
+    return S_SUCCESS;
+  }
+#endif
+  scalar_q15_to_float (in, out, samples);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t q15_gain (q15_t*, uint32_t, q15_t, uint32_t)
+ *
+ * @brief Apply a gain in place, @f$ x = sat(sat(x \cdot gain) \cdot
+ *        2^{shift}) @f$
+ *
+ * A gain bigger than one is given as a Q15 mantissa and a shift, e.g. 1.5 is
+ * 0.75 (24576) with a shift of 1, the product is rounded before the shift
+ *
+ * @param[in,out] *data     samples to scale
+ * @param          samples  number of samples
+ * @param          gain     Q15 gain
+ * @param          shift    left shift applied after the gain, up to 15
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t q15_gain (q15_t *data, uint32_t samples, q15_t gain, uint32_t shift)
+{
+  if ( (NULL==data)||(Q15_MAX_SHIFT<shift) )
+  {
+    return S_ERROR;
+  }
+
+#ifdef FIXED_POINT_HAVE_NEON
+  if ( use_neon () )
+  {
+    neon_q15_gain (data, samples, gain, shift);
+    return S_SUCCESS;
+  }
+#endif
+  scalar_q15_gain (data, samples, gain, shift);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t q15_mix (q15_t*, const q15_t*, uint32_t, q15_t)
+ *
+ * @brief Add a scaled signal to a buffer, @f$ out = sat(out+sat(in \cdot
+ *        gain)) @f$
+ *
+ * @param[in,out] *out      mix
+ * @param[in]     *in       signal to add
+ * @param          samples  number of samples
+ * @param          gain     Q15 gain of @a in
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t q15_mix (q15_t *out, const q15_t *in, uint32_t samples, q15_t gain)
+{
+  if ( (NULL==out)||(NULL==in) )
+  {
+    return S_ERROR;
+  }
+
+#ifdef FIXED_POINT_HAVE_NEON
+  if ( use_neon () )
+  {
+    neon_q15_mix (out, in, samples, gain);
+    return S_SUCCESS;
+  }
+#endif
+  scalar_q15_mix (out, in, samples, gain);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int64_t q15_dot (const q15_t*, const q15_t*, uint32_t)
+ *
+ * @brief Multiply and accumulate two blocks, e.g. a FIR tap set and its delay
+ *        line
+ *
+ * Each product is rounded to Q15 (@ref q15_mul) before the sum, the same
+ * rule as @ref q31_dot, so the result is Q15 and can't overflow
+ *
+ * @param[in] *a        first block
+ * @param[in] *b        second block
+ * @param      samples  number of samples of each block
+ *
+ * @return int64_t the Q15 sum of the products, 0 if a block is NULL
+ *
+ ******************************************************************************/
+int64_t q15_dot (const q15_t *a, const q15_t *b, uint32_t samples)
+{
+  if ( (NULL==a)||(NULL==b) )
+  {
+    return 0;
+  }
+
+#ifdef FIXED_POINT_HAVE_NEON
+  if ( use_neon () )
+  {
+    return neon_q15_dot (a, b, samples);
+  }
+#endif
+
+  return scalar_q15_dot (a, b, samples);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t q31_from_float (const float*, q31_t*, uint32_t)
+ *
+ * @brief Convert float samples to Q31, rounding to the nearest and
+ *        saturating
+ *
+ * It's the conversion to @a SND_PCM_FORMAT_S32_LE, so the fixed point path
+ * starts with the same samples that the float path sends to the card
+ *
+ * @param[in]  *in       float samples
+ * @param[out] *out      Q31 samples
+ * @param       samples  number of samples to convert
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t q31_from_float (const float *in, q31_t *out, uint32_t samples)
+{
+  return convert_float_to_format (in, out, samples, SND_PCM_FORMAT_S32_LE);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t q31_to_float (const q31_t*, float*, uint32_t)
+ *
+ * @brief Convert Q31 samples to float, rounding to the 24 bits of the
+ *        mantissa
+ *
+ * @param[in]  *in       Q31 samples
+ * @param[out] *out      float samples
+ * @param       samples  number of samples to convert
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t q31_to_float (const q31_t *in, float *out, uint32_t samples)
+{
+  if ( (NULL==in)||(NULL==out) )
+  {
+    return S_ERROR;
+  }
+
+#ifdef FIXED_POINT_HAVE_NEON
+  if ( use_neon () )
+  {
+    neon_q31_to_float (in, out, samples);
+    return S_SUCCESS;
+  }
+#endif
+  scalar_q31_to_float (in, out, samples);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t q31_gain (q31_t*, uint32_t, q31_t, uint32_t)
+ *
+ * @brief Apply a gain in place, @f$ x = sat(sat(x \cdot gain) \cdot
+ *        2^{shift}) @f$
+ *
+ * Like @ref q15_gain, a gain bigger than one is a mantissa and a shift
+ *
+ * @param[in,out] *data     samples to scale
+ * @param          samples  number of samples
+ * @param          gain     Q31 gain
+ * @param          shift    left shift applied after the gain, up to 31
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t q31_gain (q31_t *data, uint32_t samples, q31_t gain, uint32_t shift)
+{
+  if ( (NULL==data)||(Q31_MAX_SHIFT<shift) )
+  {
+    return S_ERROR;
+  }
+
+#ifdef FIXED_POINT_HAVE_NEON
+  if ( use_neon () )
+  {
+    neon_q31_gain (data, samples, gain, shift);
+    return S_SUCCESS;
+  }
+#endif
+  scalar_q31_gain (data, samples, gain, shift);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t q31_mix (q31_t*, const q31_t*, uint32_t, q31_t)
+ *
+ * @brief Add a scaled signal to a buffer, @f$ out = sat(out+sat(in \cdot
+ *        gain)) @f$
+ *
+ * @param[in,out] *out      mix
+ * @param[in]     *in       signal to add
+ * @param          samples  number of samples
+ * @param          gain     Q31 gain of @a in
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t q31_mix (q31_t *out, const q31_t *in, uint32_t samples, q31_t gain)
+{
+  if ( (NULL==out)||(NULL==in) )
+  {
+    return S_ERROR;
+  }
+
+#ifdef FIXED_POINT_HAVE_NEON
+  if ( use_neon () )
+  {
+    neon_q31_mix (out, in, samples, gain);
+    return S_SUCCESS;
+  }
+#endif
+  scalar_q31_mix (out, in, samples, gain);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int64_t q31_dot (const q31_t*, const q31_t*, uint32_t)
+ *
+ * @brief Multiply and accumulate two blocks
+ *
+ * Each product is rounded to Q31 (@ref q31_mul) before the sum, so the
+ * result is Q31 and can't overflow for less than @f$ 2^{32} @f$ samples
+ *
+ * @param[in] *a        first block
+ * @param[in] *b        second block
+ * @param      samples  number of samples of each block
+ *
+ * @return int64_t the Q31 sum of the products, 0 if a block is NULL
+ *
+ ******************************************************************************/
+int64_t q31_dot (const q31_t *a, const q31_t *b, uint32_t samples)
+{
+  if ( (NULL==a)||(NULL==b) )
+  {
+    return 0;
+  }
+
+#ifdef FIXED_POINT_HAVE_NEON
+  if ( use_neon () )
+  {
+    return neon_q31_dot (a, b, samples);
+  }
+#endif
+
+  return scalar_q31_dot (a, b, samples);
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,191 @@
+/*******************************************************************************
+ * @file      fixed_point.h
+ *
+ * @brief      Q15/Q31 fixed point arithmetic for targets without a fast FPU
+ *
+ * Generalizes the @ref Q_14 convention of @ref generate_sin to Q15 (16 bits,
+ * @f$ [-1, 1) @f$ scaled by @f$ 2^{15} @f$) and Q31 (32 bits scaled by
+ * @f$ 2^{31} @f$), so a whole period can be processed in the format of the
+ * sound card without going through float:
+ *      @li multiplications round to the nearest (half up) and saturate, like
+ *          the NEON @a vqrdmulh instructions
+ *      @li additions saturate instead of wrapping
+ *      @li gain, mixing and dot products (multiply-accumulate) over blocks,
+ *          with NEON kernels (aarch64 and ARMv7) when
+ *          @ref sample_convert_set_isa selects them
+ *      @li the dot products round each product like a multiplication before
+ *          the sum, so the result is in the format of the operands
+ *
+ * Every kernel gives the same bits as the scalar inline functions of this
+ * header, and those are exactly the float operation rounded and saturated:
+ * @f$ y = sat(\lfloor x \cdot g+0.5 \rfloor) @f$, which the benchmark cross
+ * checks. The conversions from float are the ones of
+ * @ref convert_float_to_format, so both paths agree.
+ *
+ * @note
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "alsa_utils.h"
+#include "sample_convert.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _FIXED_POINT_
+#define _FIXED_POINT_
+
+#define Q_15                    (1<<15) /**< one in Q15 (saturates to
+                                             @ref Q15_MAX) */
+#define Q_31                    (1LL<<31) /**< one in Q31 (saturates to
+                                               @ref Q31_MAX) */
+#define Q15_MAX                 (INT16_MAX) /**< biggest Q15 value */
+#define Q15_MIN                 (INT16_MIN) /**< -1 in Q15 */
+#define Q31_MAX                 (INT32_MAX) /**< biggest Q31 value */
+#define Q31_MIN                 (INT32_MIN) /**< -1 in Q31 */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+typedef int16_t q15_t; /**< Q15 sample or coefficient */
+typedef int32_t q31_t; /**< Q31 sample or coefficient */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t q15_from_float (const float *in, q15_t *out, uint32_t samples);
+int8_t q15_to_float (const q15_t *in, float *out, uint32_t samples);
+int8_t q15_gain (q15_t *data, uint32_t samples, q15_t gain, uint32_t shift);
+int8_t q15_mix (q15_t *out, const q15_t *in, uint32_t samples, q15_t gain);
+int64_t q15_dot (const q15_t *a, const q15_t *b, uint32_t samples);
+int8_t q31_from_float (const float *in, q31_t *out, uint32_t samples);
+int8_t q31_to_float (const q31_t *in, float *out, uint32_t samples);
+int8_t q31_gain (q31_t *data, uint32_t samples, q31_t gain, uint32_t shift);
+int8_t q31_mix (q31_t *out, const q31_t *in, uint32_t samples, q31_t gain);
+int64_t q31_dot (const q31_t *a, const q31_t *b, uint32_t samples);
+
+/******************************************************************************
+ *
+ * @fn q15_t q15_saturate (int32_t)
+ *
+ * @brief Limit a value to the Q15 range
+ *
+ ******************************************************************************/
+static inline q15_t q15_saturate (int32_t x)
+{
+  return (q15_t)((Q15_MAX<x) ? Q15_MAX : (Q15_MIN>x) ? Q15_MIN : x);
+}
+
+/******************************************************************************
+ *
+ * @fn q31_t q31_saturate (int64_t)
+ *
+ * @brief Limit a value to the Q31 range
+ *
+ ******************************************************************************/
+static inline q31_t q31_saturate (int64_t x)
+{
+  return (q31_t)((Q31_MAX<x) ? Q31_MAX : (Q31_MIN>x) ? Q31_MIN : x);
+}
+
+/******************************************************************************
+ *
+ * @fn q15_t q15_add (q15_t, q15_t)
+ *
+ * @brief Saturated addition
+ *
+ ******************************************************************************/
+static inline q15_t q15_add (q15_t a, q15_t b)
+{
+  return q15_saturate ((int32_t)a+b);
+}
+
+/******************************************************************************
+ *
+ * @fn q15_t q15_mul (q15_t, q15_t)
+ *
+ * @brief Rounded and saturated product, only -1*-1 saturates
+ *
+ ******************************************************************************/
+static inline q15_t q15_mul (q15_t a, q15_t b)
+{
+  return q15_saturate (((int32_t)a*b+(1<<14))>>15);
+}
+
+/******************************************************************************
+ *
+ * @fn q15_t q15_shift (q15_t, uint32_t)
+ *
+ * @brief Saturated left shift, a gain of @f$ 2^{shift} @f$
+ *
+ ******************************************************************************/
+static inline q15_t q15_shift (q15_t a, uint32_t shift)
+{
+  return q15_saturate ((int32_t)((uint32_t)(int32_t)a<<shift));
+}
+
+/******************************************************************************
+ *
+ * @fn q31_t q31_add (q31_t, q31_t)
+ *
+ * @brief Saturated addition
+ *
+ ******************************************************************************/
+static inline q31_t q31_add (q31_t a, q31_t b)
+{
+  return q31_saturate ((int64_t)a+b);
+}
+
+/******************************************************************************
+ *
+ * @fn q31_t q31_mul (q31_t, q31_t)
+ *
+ * @brief Rounded and saturated product, only -1*-1 saturates
+ *
+ ******************************************************************************/
+static inline q31_t q31_mul (q31_t a, q31_t b)
+{
+  return q31_saturate (((int64_t)a*b+(1LL<<30))>>31);
+}
+
+/******************************************************************************
+ *
+ * @fn q31_t q31_shift (q31_t, uint32_t)
+ *
+ * @brief Saturated left shift, a gain of @f$ 2^{shift} @f$
+ *
+ ******************************************************************************/
+static inline q31_t q31_shift (q31_t a, uint32_t shift)
+{
+  return q31_saturate ((int64_t)((uint64_t)(int64_t)a<<shift));
+}
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
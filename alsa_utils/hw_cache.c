@@ -0,0 +1,362 @@
+/*******************************************************************************
+ * @file      hw_cache.c
+ *
+ * @brief      Cache of negotiated HW parameters and warm restarts
+ *
+ * The parameters are cached after @a snd_pcm_hw_params, at that point ALSA
+ * has reduced every parameter to a single value, so applying them again
+ * doesn't need any negotiation.
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "hw_cache.h"
+#include "rt_log.h"
+#include "sample_convert.h"
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t hw_cache_init (hw_cache*)
+ *
+ * @brief Initialize an empty cache
+ *
+ * @param[out] *cache  cache to initialize
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t hw_cache_init (hw_cache *cache)
+{
+  if ( NULL==cache )
+  {
+    return S_ERROR;
+  }
+
+  memset (cache, 0, sizeof(*cache));
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void hw_cache_destroy (hw_cache*)
+ *
+ * @brief Free all the entries of the cache
+ *
+ ******************************************************************************/
+void hw_cache_destroy (hw_cache *cache)
+{
+  for (uint32_t n = 0; n<cache->num_entries; n++)
+  {
+    snd_pcm_hw_params_free (cache->entries[n].hw_params);
+  }
+  memset (cache, 0, sizeof(*cache));
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t same_request (const hw_configuration*, const hw_configuration*)
+ *
+ * @brief Compare two requested configurations field by field (the padding
+ *        of the structures can be different)
+ *
+ ******************************************************************************/
+static int8_t same_request (const hw_configuration *a,
+                            const hw_configuration *b)
+{
+  if ( (a->sample_rate==b->sample_rate)&&
+       (a->sample_rate_direction==b->sample_rate_direction)&&
+       (a->frame_size_direction==b->frame_size_direction)&&
+       (a->period_size==b->period_size)&&(a->periods==b->periods)&&
+       (a->access_type==b->access_type)&&(a->num_channels==b->num_channels)&&
+       (a->format==b->format) )
+  {
+    return S_SUCCESS;
+  }
+
+  return S_ERROR;
+}
+
+/******************************************************************************
+ *
+ * @fn hw_cache_entry* find_entry (hw_cache*, const char*,
+ *                                 const hw_configuration*)
+ *
+ * @brief Look for the entry of a device and configuration
+ *
+ * @return hw_cache_entry* entry found, NULL if it isn't in the cache
+ *
+ ******************************************************************************/
+static hw_cache_entry* find_entry (hw_cache *cache, const char *device_name,
+                                   const hw_configuration *hw_config)
+{
+  for (uint32_t n = 0; n<cache->num_entries; n++)
+  {
+    if ( (0==strcmp (cache->entries[n].device_name, device_name))&&
+         (S_SUCCESS==same_request (&cache->entries[n].requested, hw_config)) )
+    {
+      return &cache->entries[n];
+    }
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn void store_entry (hw_cache*, const char*, const hw_configuration*,
+ *                       const hw_configuration*, snd_pcm_hw_params_t*)
+ *
+ * @brief Add a configuration to the cache, replacing the oldest entry when
+ *        the cache is full. If the memory can't be allocated the
+ *        configuration is just not cached
+ *
+ ******************************************************************************/
+static void store_entry (hw_cache *cache, const char *device_name,
+                         const hw_configuration *requested,
+                         const hw_configuration *negotiated,
+                         snd_pcm_hw_params_t *hw_params)
+{
+  hw_cache_entry *entry;
+
+  if ( HW_CACHE_MAX_ENTRIES>cache->num_entries )
+  {
+    entry = &cache->entries[cache->num_entries];
+    if ( S_SUCCESS>snd_pcm_hw_params_malloc (&entry->hw_params) )
+    {
+      return;
+    }
+    cache->num_entries++;
+  }
+  else
+  {
+    entry = &cache->entries[cache->next_victim];
+    cache->next_victim = (cache->next_victim+1u)%HW_CACHE_MAX_ENTRIES;
+  }
+
+  snprintf (entry->device_name, sizeof(entry->device_name), "%s",
+            device_name);
+  entry->requested = *requested;
+  entry->negotiated = *negotiated;
+  snd_pcm_hw_params_copy (entry->hw_params, hw_params);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t hw_cache_configure (hw_cache*, snd_pcm_t*, const char*,
+ *                                hw_configuration*)
+ *
+ * @brief Configure the HW of the sound card, using the cached parameters
+ *        if the configuration was already negotiated for the device
+ *
+ * Works like @ref configure_hw, but nothing is printed when the
+ * configuration comes from the cache. If the cached parameters can't be
+ * applied anymore (e.g. the device changed) the entry is negotiated again.
+ *
+ * @param[in,out] *cache              cache of parameters
+ * @param[in]     *sound_card_handle  handle of the sound card, in the open,
+ *                                    setup or prepared state
+ * @param[in]     *device_name        name used to open the handle
+ * @param[in,out] *hw_config          pointer to desired hw configuration,
+ *                                    updated like @ref configure_hw does
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t hw_cache_configure (hw_cache *cache, snd_pcm_t *sound_card_handle,
+                           const char *device_name,
+                           hw_configuration *hw_config)
+{
+  snd_pcm_hw_params_t *hw_params;
+  hw_configuration requested;
+  hw_cache_entry *entry;
+  int err;
+
+  if ( (NULL==cache)||(NULL==device_name)||(NULL==hw_config) )
+  {
+    return S_ERROR;
+  }
+
+  snd_pcm_hw_params_alloca(&hw_params);
+  requested = *hw_config;
+  entry = find_entry (cache, device_name, hw_config);
+  if ( NULL!=entry )
+  {
+    /* snd_pcm_hw_params can modify the parameters, so apply a copy */
+    snd_pcm_hw_params_copy (hw_params, entry->hw_params);
+    if ( S_SUCCESS<=snd_pcm_hw_params (sound_card_handle, hw_params) )
+    {
+      *hw_config = entry->negotiated;
+      cache->hits++;
+      return S_SUCCESS;
+    }
+
+    rt_log_printf ("hw_cache_configure Warning: cached parameters of %s "
+                   "rejected\n", device_name);
+  }
+
+  cache->misses++;
+  if ( S_SUCCESS!=negotiate_hw (sound_card_handle, hw_config, hw_params) )
+  {
+    return S_ERROR;
+  }
+
+  err = snd_pcm_hw_params (sound_card_handle, hw_params);
+  if ( S_SUCCESS>err )
+  {
+    rt_log_printf ("hw_cache_configure Error: setting HW params, Err = %d\n",
+                   err);
+    return S_ERROR;
+  }
+  hw_config->render = sample_convert_get_render_kernel (
+      hw_config->format, hw_config->num_channels,
+      get_channel_layout (hw_config->access_type));
+
+  if ( NULL!=entry )
+  {
+    entry->negotiated = *hw_config;
+    snd_pcm_hw_params_copy (entry->hw_params, hw_params);
+  }
+  else
+  {
+    store_entry (cache, device_name, &requested, hw_config, hw_params);
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void hw_cache_invalidate (hw_cache*, const char*)
+ *
+ * @brief Remove all the configurations of a device, e.g. after it was
+ *        unplugged
+ *
+ * @param[in,out] *cache        cache of parameters
+ * @param[in]     *device_name  device to remove, NULL to remove all of them
+ *
+ ******************************************************************************/
+void hw_cache_invalidate (hw_cache *cache, const char *device_name)
+{
+  uint32_t n = 0;
+  snd_pcm_hw_params_t *hw_params;
+
+  while ( n<cache->num_entries )
+  {
+    if ( (NULL!=device_name)&&
+         (0!=strcmp (cache->entries[n].device_name, device_name)) )
+    {
+      n++;
+      continue;
+    }
+
+    /* move the last entry here, its params are freed with the removed one */
+    hw_params = cache->entries[n].hw_params;
+    cache->num_entries--;
+    cache->entries[n] = cache->entries[cache->num_entries];
+    snd_pcm_hw_params_free (hw_params);
+  }
+
+  cache->next_victim = 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t pcm_warm_stop (snd_pcm_t*)
+ *
+ * @brief Stop a stream and leave it ready to be restarted
+ *
+ * The pending frames are dropped and the stream is prepared again, so
+ * the device stays open and configured and the next write (or
+ * @a snd_pcm_start) restarts it without any setup
+ *
+ * @param[in] *sound_card_handle  handle of the sound card
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t pcm_warm_stop (snd_pcm_t *sound_card_handle)
+{
+  int err;
+
+  err = snd_pcm_drop (sound_card_handle);
+  if ( S_SUCCESS>err )
+  {
+    rt_log_printf ("pcm_warm_stop Error: stopping the stream, Err = %d\n",
+                   err);
+    return S_ERROR;
+  }
+
+  err = snd_pcm_prepare (sound_card_handle);
+  if ( S_SUCCESS>err )
+  {
+    rt_log_printf ("pcm_warm_stop Error: preparing the stream, Err = %d\n",
+                   err);
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t pcm_warm_restart (snd_pcm_t*)
+ *
+ * @brief Make sure a configured stream is prepared, whatever its state
+ *
+ * A stream stopped with @ref pcm_warm_stop is already prepared and nothing
+ * is done, a stream in xrun or running is dropped and prepared again
+ *
+ * @param[in] *sound_card_handle  handle of the sound card
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the stream
+ *         is not configured or can't be prepared
+ *
+ ******************************************************************************/
+int8_t pcm_warm_restart (snd_pcm_t *sound_card_handle)
+{
+  switch (snd_pcm_state (sound_card_handle))
+  {
+    case SND_PCM_STATE_PREPARED:
+      return S_SUCCESS;
+    case SND_PCM_STATE_OPEN:
+    case SND_PCM_STATE_DISCONNECTED:
+      return S_ERROR;
+    default:
+      return pcm_warm_stop (sound_card_handle);
+  }
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,96 @@
+/*******************************************************************************
+ * @file      hw_cache.h
+ *
+ * @brief      Cache of negotiated HW parameters and warm restarts
+ *
+ * Restarting a stream with @ref configure_hw reads the whole configuration
+ * space of the device and negotiates each parameter again. The cache keeps
+ * the @a snd_pcm_hw_params_t negotiated for each device and configuration,
+ * so the next time the same configuration is requested it's applied directly
+ * with @a snd_pcm_hw_params_copy / @a snd_pcm_hw_params.
+ *
+ * @ref pcm_warm_stop and @ref pcm_warm_restart keep a stopped stream
+ * prepared, so it can be restarted without closing and opening the device.
+ *
+ * @note The cache is not thread safe, use one cache per thread or protect it
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _HW_CACHE_
+#define _HW_CACHE_
+
+#define HW_CACHE_MAX_ENTRIES    (16u) /**< configurations kept, the oldest
+                                           one is replaced when it's full */
+#define HW_CACHE_NAME_SIZE      (64u) /**< maximum length of a device name */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Configuration negotiated for a device */
+typedef struct
+{
+  char device_name[HW_CACHE_NAME_SIZE]; /**< PCM, e.g. hw:0,0 */
+  hw_configuration requested; /**< configuration asked in
+   @ref hw_cache_configure, it's the key of the entry */
+  hw_configuration negotiated; /**< configuration supported by the device */
+  snd_pcm_hw_params_t *hw_params; /**< parameters applied */
+} hw_cache_entry;
+
+/** Cache of HW parameters */
+typedef struct
+{
+  hw_cache_entry entries[HW_CACHE_MAX_ENTRIES]; /**< cached configurations */
+  uint32_t num_entries; /**< entries used */
+  uint32_t next_victim; /**< entry replaced when the cache is full */
+  uint64_t hits; /**< configurations applied from the cache */
+  uint64_t misses; /**< configurations negotiated */
+} hw_cache;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t hw_cache_init (hw_cache *cache);
+void hw_cache_destroy (hw_cache *cache);
+int8_t hw_cache_configure (hw_cache *cache, snd_pcm_t *sound_card_handle,
+                           const char *device_name,
+                           hw_configuration *hw_config);
+void hw_cache_invalidate (hw_cache *cache, const char *device_name);
+int8_t pcm_warm_stop (snd_pcm_t *sound_card_handle);
+int8_t pcm_warm_restart (snd_pcm_t *sound_card_handle);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
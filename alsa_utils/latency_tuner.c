@@ -0,0 +1,616 @@
+/*******************************************************************************
+ * @file      latency_tuner.c
+ *
+ * @brief      Search of the smallest period/buffer configuration without xruns
+ *
+ * Calibration of @a period_size and @a periods for a device, see
+ * @ref tune_latency.
+ *
+ * The results are stored in a text file, one line per device and stream
+ * configuration:
+ *      @li device rate channels format period_size periods
+ * so a service can read the calibrated values at startup instead of
+ * repeating the search.
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "latency_tuner.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define TUNER_LINE_SIZE         (256u) /**< maximum line of the result file */
+#define TUNER_MAX_LINES         (256u) /**< maximum lines of the result file */
+
+/*------------------------------------------------------------------------------
+ * Module Typedefs
+ ------------------------------------------------------------------------------*/
+/** Period configuration to evaluate */
+typedef struct
+{
+  snd_pcm_uframes_t period_size; /**< frames of each period */
+  uint32_t periods; /**< number of periods */
+} tuner_candidate;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int compare_candidates (const void*, const void*)
+ *
+ * @brief Sort the candidates by buffer size (latency) and then by period
+ *        size, used with qsort
+ *
+ ******************************************************************************/
+static int compare_candidates (const void *a, const void *b)
+{
+  const tuner_candidate *x = (const tuner_candidate*)a;
+  const tuner_candidate *y = (const tuner_candidate*)b;
+  snd_pcm_uframes_t buffer_x = x->period_size*x->periods;
+  snd_pcm_uframes_t buffer_y = y->period_size*y->periods;
+
+  if ( buffer_x!=buffer_y )
+  {
+    return (buffer_x<buffer_y) ? -1 : 1;
+  }
+  if ( x->period_size!=y->period_size )
+  {
+    return (x->period_size<y->period_size) ? -1 : 1;
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * @fn snd_pcm_access_t trial_access (snd_pcm_access_t)
+ *
+ * @brief RW access with the layout of @a access, the trials are written with
+ *        snd_pcm_writei / snd_pcm_writen even if the stream uses MMAP
+ *
+ ******************************************************************************/
+static snd_pcm_access_t trial_access (snd_pcm_access_t access)
+{
+  if ( SND_PCM_ACCESS_MMAP_INTERLEAVED==access )
+  {
+    return SND_PCM_ACCESS_RW_INTERLEAVED;
+  }
+  if ( SND_PCM_ACCESS_MMAP_NONINTERLEAVED==access )
+  {
+    return SND_PCM_ACCESS_RW_NONINTERLEAVED;
+  }
+
+  return access;
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t find_candidates (const tuner_configuration*,
+ *                               tuner_candidate*)
+ *
+ * @brief Get the period configurations supported by the device
+ *
+ * The device is restricted to the access of the trials, format, channels
+ * and rate wanted before reading the limits, so only valid combinations are
+ * returned.
+ * Period sizes are powers of 2 between the limits.
+ *
+ * @param[in]  *tuner_config  configuration of the search
+ * @param[out] *candidates    candidates found
+ *
+ * @return uint32_t number of candidates found
+ *
+ ******************************************************************************/
+static uint32_t find_candidates (const tuner_configuration *tuner_config,
+                                 tuner_candidate *candidates)
+{
+  snd_pcm_t *handle;
+  snd_pcm_hw_params_t *hw_params;
+  snd_pcm_uframes_t min_size;
+  snd_pcm_uframes_t max_size;
+  unsigned int min_periods;
+  unsigned int max_periods;
+  unsigned int rate = tuner_config->hw_config.sample_rate;
+  int dir = 0;
+  uint32_t count = 0;
+
+  if ( S_SUCCESS>snd_pcm_open (&handle, tuner_config->device_name,
+                               SND_PCM_STREAM_PLAYBACK,
+                               PCM_OPEN_STANDARD_MODE) )
+  {
+    printf ("tune_latency Error: opening %s\n", tuner_config->device_name);
+    return 0u;
+  }
+
+  snd_pcm_hw_params_alloca(&hw_params);
+  if ( (S_SUCCESS>snd_pcm_hw_params_any (handle, hw_params))||
+       (S_SUCCESS>snd_pcm_hw_params_set_access (
+           handle, hw_params,
+           trial_access (tuner_config->hw_config.access_type)))||
+       (S_SUCCESS>snd_pcm_hw_params_set_format (
+           handle, hw_params, tuner_config->hw_config.format))||
+       (S_SUCCESS>snd_pcm_hw_params_set_channels (
+           handle, hw_params, tuner_config->hw_config.num_channels))||
+       (S_SUCCESS>snd_pcm_hw_params_set_rate_near (handle, hw_params, &rate,
+                                                   &dir))||
+       (S_SUCCESS>snd_pcm_hw_params_get_period_size_min (hw_params, &min_size,
+                                                         &dir))||
+       (S_SUCCESS>snd_pcm_hw_params_get_period_size_max (hw_params, &max_size,
+                                                         &dir))||
+       (S_SUCCESS>snd_pcm_hw_params_get_periods_min (hw_params, &min_periods,
+                                                     &dir))||
+       (S_SUCCESS>snd_pcm_hw_params_get_periods_max (hw_params, &max_periods,
+                                                     &dir)) )
+  {
+    printf ("tune_latency Error: reading limits of %s\n",
+            tuner_config->device_name);
+    snd_pcm_close (handle);
+    return 0u;
+  }
+
+  if ( 2u>min_periods )
+  {
+    min_periods = 2u;
+  }
+  if ( max_periods>tuner_config->max_periods )
+  {
+    max_periods = tuner_config->max_periods;
+  }
+
+  for (snd_pcm_uframes_t size = TUNER_MIN_PERIOD_SIZE;
+      size<=TUNER_MAX_PERIOD_SIZE; size *= 2u)
+  {
+    if ( (size<min_size)||(size>max_size)||
+         (S_SUCCESS!=snd_pcm_hw_params_test_period_size (handle, hw_params,
+                                                         size, 0)) )
+    {
+      continue;
+    }
+
+    for (unsigned int periods = min_periods; periods<=max_periods; periods++)
+    {
+      if ( (TUNER_MAX_CANDIDATES>count)&&
+           (S_SUCCESS==snd_pcm_hw_params_test_periods (handle, hw_params,
+                                                       periods, 0))&&
+           (S_SUCCESS==snd_pcm_hw_params_test_buffer_size (handle, hw_params,
+                                                           size*periods)) )
+      {
+        candidates[count].period_size = size;
+        candidates[count].periods = periods;
+        count++;
+      }
+    }
+  }
+
+  snd_pcm_close (handle);
+  qsort (candidates, count, sizeof(*candidates), compare_candidates);
+
+  return count;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t run_trial (const tuner_configuration*, const tuner_candidate*,
+ *                       uint64_t*, unsigned int*)
+ *
+ * @brief Play a trial stream with a candidate and count the xruns
+ *
+ * The length of the trial is computed with the rate negotiated, which can be
+ * different from the one requested
+ *
+ * @param[in]  *tuner_config  configuration of the search
+ * @param[in]  *candidate     period configuration to try
+ * @param[out] *xruns         xruns during the trial
+ * @param[out] *rate          rate negotiated with the device
+ *
+ * @return int8_t @a S_SUCCESS if the trial could run, @a S_ERROR if the
+ *         device couldn't be configured with the candidate
+ *
+ ******************************************************************************/
+static int8_t run_trial (const tuner_configuration *tuner_config,
+                         const tuner_candidate *candidate, uint64_t *xruns,
+                         unsigned int *rate)
+{
+  snd_pcm_t *handle;
+  hw_configuration hw_config = tuner_config->hw_config;
+  snd_pcm_hw_params_t *hw_params;
+  sw_configuration sw_config;
+  snd_pcm_channel_area_t areas[MAX_CHANNELS];
+  snd_pcm_uframes_t buffer_size;
+  snd_pcm_uframes_t period_size;
+  snd_pcm_sframes_t written;
+  void *buffer;
+  void *channels[MAX_CHANNELS];
+  uint64_t periods_to_play;
+  channel_layout layout = get_channel_layout (hw_config.access_type);
+  ssize_t buffer_bytes;
+  int8_t status = S_ERROR;
+
+  *xruns = 0u;
+  *rate = 0u;
+  hw_config.access_type = trial_access (hw_config.access_type);
+  hw_config.period_size = candidate->period_size;
+  hw_config.periods = candidate->periods;
+
+  if ( S_SUCCESS>snd_pcm_open (&handle, tuner_config->device_name,
+                               SND_PCM_STREAM_PLAYBACK,
+                               PCM_OPEN_STANDARD_MODE) )
+  {
+    return S_ERROR;
+  }
+
+  if ( S_SUCCESS!=configure_hw (handle, &hw_config) )
+  {
+    snd_pcm_close (handle);
+    return S_ERROR;
+  }
+
+  /* configure_hw uses the _near functions so check what we really got */
+  snd_pcm_hw_params_alloca(&hw_params);
+  if ( (S_SUCCESS>snd_pcm_hw_params_current (handle, hw_params))||
+       (S_SUCCESS>snd_pcm_hw_params_get_rate (hw_params, rate, NULL))||
+       (0u==*rate)||
+       (S_SUCCESS>snd_pcm_get_params (handle, &buffer_size, &period_size))||
+       (period_size!=candidate->period_size)||
+       (buffer_size!=candidate->period_size*candidate->periods) )
+  {
+    snd_pcm_close (handle);
+    return S_ERROR;
+  }
+
+  sw_config = (sw_configuration){ .avail_min = period_size,
+          .start_threshold = buffer_size, .stop_threshold = SW_KEEP_DEFAULT,
+          .silence_threshold = 0u, .silence_size = 0u, .period_event = 0u };
+  /* a period of the channels and format that setup_channel_areas lays out,
+   * it has to be the frame size of the device too */
+  buffer_bytes = snd_pcm_format_size (hw_config.format,
+                                      period_size*hw_config.num_channels);
+  if ( (0>=buffer_bytes)||
+       (buffer_bytes!=snd_pcm_frames_to_bytes (handle,
+                                               (snd_pcm_sframes_t)period_size)) )
+  {
+    snd_pcm_close (handle);
+    return S_ERROR;
+  }
+  buffer = malloc ((size_t)buffer_bytes);
+  if ( (NULL==buffer)||(S_SUCCESS!=configure_sw (handle, &sw_config))||
+       (S_SUCCESS!=setup_channel_areas (areas, buffer, period_size,
+                                        hw_config.num_channels, layout,
+                                        hw_config.format)) )
+  {
+    free (buffer);
+    snd_pcm_close (handle);
+    return S_ERROR;
+  }
+
+  for (uint32_t ch = 0; ch<hw_config.num_channels; ch++)
+  {
+    channels[ch] = areas[ch].addr;
+  }
+
+  periods_to_play = ((uint64_t)tuner_config->trial_ms*(*rate))/
+      (1000u*period_size);
+  status = S_SUCCESS;
+  for (uint64_t n = 0; n<periods_to_play; n++)
+  {
+    if ( S_SUCCESS!=tuner_config->workload (areas, 0u, period_size,
+                                            tuner_config->user_data) )
+    {
+      status = S_ERROR;
+      break;
+    }
+
+    if ( E_LAYOUT_PLANAR==layout )
+    {
+      written = snd_pcm_writen (handle, channels, period_size);
+    }
+    else
+    {
+      written = snd_pcm_writei (handle, buffer, period_size);
+    }
+
+    if ( 0>written )
+    {
+      (*xruns)++;
+      if ( S_SUCCESS>snd_pcm_recover (handle, (int)written, 1) )
+      {
+        status = S_ERROR;
+        break;
+      }
+    }
+  }
+
+  snd_pcm_drop (handle);
+  snd_pcm_close (handle);
+  free (buffer);
+
+  return status;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t tune_latency (const tuner_configuration*, tuner_result*)
+ *
+ * @brief Find the smallest period configuration that plays the workload
+ *        without xruns
+ *
+ * @param[in]  *tuner_config  configuration of the search
+ * @param[out] *result        configuration found
+ *
+ * @return int8_t @a S_SUCCESS if a configuration was found, @a S_ERROR
+ *         otherwise
+ *
+ ******************************************************************************/
+int8_t tune_latency (const tuner_configuration *tuner_config,
+                     tuner_result *result)
+{
+  tuner_candidate candidates[TUNER_MAX_CANDIDATES];
+  uint32_t count;
+  uint64_t xruns;
+  unsigned int rate;
+
+  if ( (NULL==tuner_config)||(NULL==result)||(NULL==tuner_config->workload)||
+       (NULL==tuner_config->device_name)||
+       (MAX_CHANNELS<tuner_config->hw_config.num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  memset (result, 0, sizeof(*result));
+  count = find_candidates (tuner_config, candidates);
+  printf ("tune_latency: %u candidates for %s\n", count,
+          tuner_config->device_name);
+
+  for (uint32_t n = 0; n<count; n++)
+  {
+    result->candidates_tried++;
+    if ( S_SUCCESS!=run_trial (tuner_config, &candidates[n], &xruns, &rate) )
+    {
+      continue;
+    }
+
+    printf ("tune_latency: period_size = %lu, periods = %u, xruns = %llu\n",
+            (unsigned long)candidates[n].period_size, candidates[n].periods,
+            (unsigned long long)xruns);
+    if ( 0u==xruns )
+    {
+      result->period_size = candidates[n].period_size;
+      result->periods = candidates[n].periods;
+      result->latency_ms = 1000.0*(double)(candidates[n].period_size*
+          candidates[n].periods)/rate;
+
+      return S_SUCCESS;
+    }
+  }
+
+  return S_ERROR;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t line_matches (const char*, const char*, const hw_configuration*)
+ *
+ * @brief Check if a line of the result file belongs to a device and stream
+ *        configuration
+ *
+ ******************************************************************************/
+static int8_t line_matches (const char *line, const char *device_name,
+                            const hw_configuration *hw_config)
+{
+  char name[TUNER_LINE_SIZE];
+  unsigned int rate;
+  unsigned int channels;
+  int format;
+
+  if ( 4!=sscanf (line, "%255s %u %u %d", name, &rate, &channels, &format) )
+  {
+    return S_ERROR;
+  }
+
+  if ( (0==strcmp (name, device_name))&&(rate==hw_config->sample_rate)&&
+       (channels==hw_config->num_channels)&&(format==(int)hw_config->format) )
+  {
+    return S_SUCCESS;
+  }
+
+  return S_ERROR;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t tuner_save_result (const char*, const char*,
+ *                               const hw_configuration*, const tuner_result*)
+ *
+ * @brief Store a result in the result file, replacing the previous result
+ *        of the same device and stream configuration
+ *
+ * The file is written to a temporary file and renamed, so a reader never
+ * sees a partial file. It's left untouched if it has lines or results that
+ * don't fit in the buffers, rewriting it would lose them
+ *
+ * @param[in] *path         path of the result file
+ * @param[in] *device_name  device calibrated
+ * @param[in] *hw_config    rate, channels and format of the calibration
+ * @param[in] *result       result of @ref tune_latency
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t tuner_save_result (const char *path, const char *device_name,
+                          const hw_configuration *hw_config,
+                          const tuner_result *result)
+{
+  static char lines[TUNER_MAX_LINES][TUNER_LINE_SIZE];
+  char tmp_path[TUNER_LINE_SIZE];
+  uint32_t num_lines = 0;
+  size_t length;
+  FILE *file;
+
+  if ( (NULL==path)||(NULL==device_name)||(NULL==hw_config)||(NULL==result)||
+       (NULL!=strpbrk (device_name, " \t\n")) )
+  {
+    return S_ERROR;
+  }
+
+  /* keep the results of the other devices, the file isn't rewritten if any
+   * of them doesn't fit in the buffers, it would be lost */
+  file = fopen (path, "r");
+  if ( NULL!=file )
+  {
+    while ( NULL!=fgets (lines[num_lines], TUNER_LINE_SIZE, file) )
+    {
+      length = strlen (lines[num_lines]);
+      if ( (0u<length)&&('\n'!=lines[num_lines][length-1u]) )
+      {
+        if ( (0==feof (file))||(TUNER_LINE_SIZE-1u<=length) )
+        {
+          printf ("tuner_save_result Error: %s has a line longer than %u "
+                  "characters\n", path, TUNER_LINE_SIZE-2u);
+          fclose (file);
+          return S_ERROR;
+        }
+        /* last line without end of line */
+        lines[num_lines][length] = '\n';
+        lines[num_lines][length+1u] = '\0';
+      }
+      if ( S_SUCCESS!=line_matches (lines[num_lines], device_name, hw_config) )
+      {
+        num_lines++;
+      }
+      if ( TUNER_MAX_LINES<=num_lines )
+      {
+        printf ("tuner_save_result Error: %s has more than %u results\n",
+                path, TUNER_MAX_LINES-1u);
+        fclose (file);
+        return S_ERROR;
+      }
+    }
+    fclose (file);
+  }
+
+  if ( sizeof(tmp_path)<=(size_t)snprintf (tmp_path, sizeof(tmp_path),
+                                           "%s.tmp", path) )
+  {
+    printf ("tuner_save_result Error: the path %s is too long\n", path);
+    return S_ERROR;
+  }
+  if ( TUNER_LINE_SIZE<=(size_t)snprintf (lines[num_lines], TUNER_LINE_SIZE,
+                                          "%s %u %u %d %lu %u\n", device_name,
+                                          hw_config->sample_rate,
+                                          hw_config->num_channels,
+                                          (int)hw_config->format,
+                                          (unsigned long)result->period_size,
+                                          result->periods) )
+  {
+    printf ("tuner_save_result Error: the result of %s is too long\n",
+            device_name);
+    return S_ERROR;
+  }
+  num_lines++;
+
+  file = fopen (tmp_path, "w");
+  if ( NULL==file )
+  {
+    printf ("tuner_save_result Error: opening %s\n", tmp_path);
+    return S_ERROR;
+  }
+  for (uint32_t n = 0; n<num_lines; n++)
+  {
+    fputs (lines[n], file);
+  }
+  if ( 0!=fclose (file) )
+  {
+    return S_ERROR;
+  }
+
+  return (0==rename (tmp_path, path)) ? S_SUCCESS : S_ERROR;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t tuner_load_result (const char*, const char*, hw_configuration*)
+ *
+ * @brief Load a calibrated period configuration
+ *
+ * @param[in]     *path         path of the result file
+ * @param[in]     *device_name  device to look for
+ * @param[in,out] *hw_config    rate, channels and format to look for, on
+ *                              success period_size and periods are updated
+ *
+ * @return int8_t @a S_SUCCESS if a result was found, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t tuner_load_result (const char *path, const char *device_name,
+                          hw_configuration *hw_config)
+{
+  char line[TUNER_LINE_SIZE];
+  char name[TUNER_LINE_SIZE];
+  unsigned int rate;
+  unsigned int channels;
+  int format;
+  unsigned long period_size;
+  unsigned int periods;
+  int8_t status = S_ERROR;
+  FILE *file;
+
+  if ( (NULL==path)||(NULL==device_name)||(NULL==hw_config) )
+  {
+    return S_ERROR;
+  }
+
+  file = fopen (path, "r");
+  if ( NULL==file )
+  {
+    return S_ERROR;
+  }
+
+  while ( NULL!=fgets (line, sizeof(line), file) )
+  {
+    if ( (S_SUCCESS==line_matches (line, device_name, hw_config))&&
+         (6==sscanf (line, "%255s %u %u %d %lu %u", name, &rate, &channels,
+                     &format, &period_size, &periods)) )
+    {
+      hw_config->period_size = period_size;
+      hw_config->periods = periods;
+      status = S_SUCCESS;
+    }
+  }
+  fclose (file);
+
+  return status;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
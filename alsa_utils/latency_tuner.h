@@ -0,0 +1,97 @@
+/*******************************************************************************
+ * @file      latency_tuner.h
+ *
+ * @brief      Search of the smallest period/buffer configuration without xruns
+ *
+ * Calibration of @a period_size and @a periods for a device:
+ *      @li the period/buffer space supported by the device (for the rate,
+ *          format and channels wanted) is read and each candidate is checked
+ *          with @a snd_pcm_hw_params_test_period_size /
+ *          @a snd_pcm_hw_params_test_periods
+ *      @li the candidates are sorted by latency and a short trial stream is
+ *          played with each one, running the workload callback every period
+ *      @li the first candidate without xruns is the result, it can be saved
+ *          to a file and loaded at startup with @ref tuner_load_result
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _LATENCY_TUNER_
+#define _LATENCY_TUNER_
+
+#define TUNER_MIN_PERIOD_SIZE   (16u) /**< smallest period tried */
+#define TUNER_MAX_PERIOD_SIZE   (8192u) /**< biggest period tried */
+#define TUNER_MAX_CANDIDATES    (128u) /**< candidates evaluated */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Configuration of the search */
+typedef struct
+{
+  const char *device_name; /**< device to calibrate, e.g. hw:0,0 */
+  hw_configuration hw_config; /**< rate, format, channels and access to use,
+   period_size and periods are ignored. The trials always use the RW access
+   with the same layout, so the MMAP access types can be calibrated too */
+  uint32_t trial_ms; /**< duration of each trial stream */
+  uint32_t max_periods; /**< maximum number of periods tried (minimum 2) */
+  mmap_render_callback workload; /**< called for each period of the trials,
+   it should render the audio and do the work expected in production */
+  void *user_data; /**< pointer given to the workload */
+} tuner_configuration;
+
+/** Result of the search */
+typedef struct
+{
+  snd_pcm_uframes_t period_size; /**< period size found */
+  uint32_t periods; /**< number of periods found */
+  double latency_ms; /**< latency of the buffer */
+  uint32_t candidates_tried; /**< trial streams played */
+} tuner_result;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t tune_latency (const tuner_configuration *tuner_config,
+                     tuner_result *result);
+int8_t tuner_save_result (const char *path, const char *device_name,
+                          const hw_configuration *hw_config,
+                          const tuner_result *result);
+int8_t tuner_load_result (const char *path, const char *device_name,
+                          hw_configuration *hw_config);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
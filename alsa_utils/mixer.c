@@ -0,0 +1,724 @@
+/*******************************************************************************
+ * @file      mixer.c
+ *
+ * @brief      Lock-free software mixer of many sources in one stream
+ *
+ * The voices are kept in slots that are only touched by the real time
+ * thread: @a active lists the slots being mixed (a removal moves the last one
+ * to its place) and @a free_slots the ones available, so adding and removing
+ * is O(1) apart from the search of the id.
+ *
+ * The ramp kernels compute the gain of the frame @a n as
+ * @f$ start+step \cdot n @f$ in every instruction set, the module is
+ * built without contraction like filter.c (see CMakeLists.txt).
+ *
+ * @note Link using -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mixer.h"
+
+#if defined(__x86_64__)||defined(__i386__)
+#include <immintrin.h>
+#define MIXER_HAVE_X86          (1u) /**< SSE2/AVX2 kernels available */
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MIXER_HAVE_NEON         (1u) /**< NEON kernels available */
+#endif
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define MIXER_ALIGNMENT         (64u) /**< alignment of the buffers */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/*------------------------------------------------------------------------------
+ * Scalar kernel
+ ------------------------------------------------------------------------------*/
+static void scalar_kernel (float *out, const float *in, uint32_t frames,
+                           float start_gain, float end_gain)
+{
+  float step = (end_gain-start_gain)/(float)frames;
+
+  for (uint32_t n = 0; n<frames; n++)
+  {
+    out[n] = out[n]+(start_gain+step*(float)n)*in[n];
+  }
+}
+
+#ifdef MIXER_HAVE_X86
+/*------------------------------------------------------------------------------
+ * SSE2 kernel, the buffers don't need to be aligned
+ ------------------------------------------------------------------------------*/
+static void sse2_kernel (float *out, const float *in, uint32_t frames,
+                         float start_gain, float end_gain)
+{
+  float step = (end_gain-start_gain)/(float)frames;
+  __m128 start = _mm_set1_ps (start_gain);
+  __m128 steps = _mm_set1_ps (step);
+  __m128 index = _mm_setr_ps (0.0f, 1.0f, 2.0f, 3.0f);
+  __m128 four = _mm_set1_ps (4.0f);
+  __m128 gain;
+  uint32_t n = 0;
+
+  for (; n+4u<=frames; n += 4u)
+  {
+    gain = _mm_add_ps (start, _mm_mul_ps (steps, index));
+    _mm_storeu_ps (&out[n], _mm_add_ps (_mm_loadu_ps (&out[n]),
+                                        _mm_mul_ps (gain,
+                                                    _mm_loadu_ps (&in[n]))));
+    index = _mm_add_ps (index, four);
+  }
+  for (; n<frames; n++)
+  {
+    out[n] = out[n]+(start_gain+step*(float)n)*in[n];
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * AVX2 kernel
+ ------------------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static void avx2_kernel (float *out, const float *in, uint32_t frames,
+                         float start_gain, float end_gain)
+{
+  float step = (end_gain-start_gain)/(float)frames;
+  __m256 start = _mm256_set1_ps (start_gain);
+  __m256 steps = _mm256_set1_ps (step);
+  __m256 index = _mm256_setr_ps (0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f,
+                                 7.0f);
+  __m256 eight = _mm256_set1_ps (8.0f);
+  __m256 gain;
+  uint32_t n = 0;
+
+  for (; n+8u<=frames; n += 8u)
+  {
+    gain = _mm256_add_ps (start, _mm256_mul_ps (steps, index));
+    _mm256_storeu_ps (&out[n],
+                      _mm256_add_ps (_mm256_loadu_ps (&out[n]),
+                                     _mm256_mul_ps (gain,
+                                                    _mm256_loadu_ps (&in[n]))));
+    index = _mm256_add_ps (index, eight);
+  }
+  for (; n<frames; n++)
+  {
+    out[n] = out[n]+(start_gain+step*(float)n)*in[n];
+  }
+}
+#endif
+
+#ifdef MIXER_HAVE_NEON
+/*------------------------------------------------------------------------------
+ * NEON kernel
+ ------------------------------------------------------------------------------*/
+static void neon_kernel (float *out, const float *in, uint32_t frames,
+                         float start_gain, float end_gain)
+{
+  float step = (end_gain-start_gain)/(float)frames;
+  const float first[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+  float32x4_t start = vdupq_n_f32 (start_gain);
+  float32x4_t steps = vdupq_n_f32 (step);
+  float32x4_t index = vld1q_f32 (first);
+  float32x4_t four = vdupq_n_f32 (4.0f);
+  float32x4_t gain;
+  uint32_t n = 0;
+
+  for (; n+4u<=frames; n += 4u)
+  {
+    gain = vaddq_f32 (start, vmulq_f32 (steps, index));
+    vst1q_f32 (&out[n], vaddq_f32 (vld1q_f32 (&out[n]),
+                                   vmulq_f32 (gain, vld1q_f32 (&in[n]))));
+    index = vaddq_f32 (index, four);
+  }
+  for (; n<frames; n++)
+  {
+    out[n] = out[n]+(start_gain+step*(float)n)*in[n];
+  }
+}
+#endif
+
+/******************************************************************************
+ *
+ * @fn mixer_kernel select_kernel (void)
+ *
+ * @brief Get the kernel of the instruction set selected in
+ *        @ref sample_convert_set_isa
+ *
+ ******************************************************************************/
+static mixer_kernel select_kernel (void)
+{
+  switch (sample_convert_get_isa ())
+  {
+#ifdef MIXER_HAVE_X86
+    case E_ISA_SSE2:
+      return sse2_kernel;
+    case E_ISA_AVX2:
+      return avx2_kernel;
+#endif
+#ifdef MIXER_HAVE_NEON
+    case E_ISA_NEON:
+      return neon_kernel;
+#endif
+    default:
+      return scalar_kernel;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void update_targets (const mixer*, mixer_voice*)
+ *
+ * @brief Compute the gain of each channel from the gain and pan of a voice
+ *
+ ******************************************************************************/
+static void update_targets (const mixer *mix, mixer_voice *voice)
+{
+  float angle = (voice->pan+1.0f)*(float)(M_PI/4.0);
+  float left = voice->gain*cosf (angle);
+  float right = voice->gain*sinf (angle);
+
+  for (uint32_t ch = 0; ch<mix->num_channels; ch++)
+  {
+    if ( 0u!=voice->removing )
+    {
+      voice->target[ch] = 0.0f;
+    }
+    else if ( ch+1u==mix->num_channels )
+    {
+      /* mono stream or a last channel without pair */
+      voice->target[ch] = (0u==ch%2u) ? voice->gain : right;
+    }
+    else
+    {
+      voice->target[ch] = (0u==ch%2u) ? left : right;
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn mixer_voice* find_voice (mixer*, uint32_t)
+ *
+ * @brief Get the voice of an id, NULL if it's not in the mix
+ *
+ ******************************************************************************/
+static mixer_voice* find_voice (mixer *mix, uint32_t id)
+{
+  for (uint32_t n = 0; n<mix->num_active; n++)
+  {
+    if ( id==mix->voices[mix->active[n]].id )
+    {
+      return &mix->voices[mix->active[n]];
+    }
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn void release_voice (mixer*, uint32_t)
+ *
+ * @brief Take out of the mix the voice at a position of @a active
+ *
+ ******************************************************************************/
+static void release_voice (mixer *mix, uint32_t position)
+{
+  uint32_t slot = mix->active[position];
+
+  if ( NULL!=mix->voices[slot].finished )
+  {
+    atomic_store_explicit (mix->voices[slot].finished, 1u,
+                           memory_order_release);
+  }
+  mix->active[position] = mix->active[--mix->num_active];
+  mix->free_slots[mix->num_free++] = slot;
+}
+
+/******************************************************************************
+ *
+ * @fn void apply_command (mixer*, const mixer_command*)
+ *
+ * @brief Apply a command in the real time thread
+ *
+ ******************************************************************************/
+static void apply_command (mixer *mix, const mixer_command *command)
+{
+  mixer_voice *voice;
+
+  if ( E_MIXER_ADD==command->type )
+  {
+    if ( 0u==mix->num_free )
+    {
+      atomic_fetch_add_explicit (&mix->rejected_commands, 1u,
+                                 memory_order_relaxed);
+      if ( NULL!=command->finished )
+      {
+        atomic_store_explicit (command->finished, 1u, memory_order_release);
+      }
+      return;
+    }
+
+    mix->active[mix->num_active] = mix->free_slots[--mix->num_free];
+    voice = &mix->voices[mix->active[mix->num_active++]];
+    voice->id = command->id;
+    voice->removing = 0u;
+    voice->gain = command->gain;
+    voice->pan = command->pan;
+    voice->source = command->source;
+    voice->finished = command->finished;
+    /* the voice fades in from silence */
+    memset (voice->current, 0, sizeof(voice->current));
+    update_targets (mix, voice);
+    return;
+  }
+
+  voice = find_voice (mix, command->id);
+  if ( NULL==voice )
+  {
+    return;
+  }
+
+  switch (command->type)
+  {
+    case E_MIXER_REMOVE:
+      voice->removing = 1u;
+      break;
+    case E_MIXER_GAIN:
+      voice->gain = command->gain;
+      break;
+    case E_MIXER_PAN:
+      voice->pan = (-1.0f>command->pan) ? -1.0f :
+                   (1.0f<command->pan) ? 1.0f : command->pan;
+      break;
+    default:
+      break;
+  }
+  update_targets (mix, voice);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t send_command (mixer*, const mixer_command*)
+ *
+ * @brief Queue a command for the next period
+ *
+ ******************************************************************************/
+static int8_t send_command (mixer *mix, const mixer_command *command)
+{
+  if ( S_SUCCESS!=mpsc_queue_push (&mix->commands, command) )
+  {
+    atomic_fetch_add_explicit (&mix->rejected_commands, 1u,
+                               memory_order_relaxed);
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t mixer_init (mixer*, uint32_t, uint32_t)
+ *
+ * @brief Create a mixer without voices
+ *
+ * The kernel of the instruction set selected in @ref sample_convert_set_isa
+ * is used, so @ref sample_convert_init should be called before
+ *
+ * @param[out] *mix           pointer to the mixer
+ * @param       num_channels  channels of the stream
+ * @param       max_frames    biggest period mixed
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t mixer_init (mixer *mix, uint32_t num_channels, uint32_t max_frames)
+{
+  void *buffer;
+
+  if ( (NULL==mix)||(0u==num_channels)||(MAX_CHANNELS<num_channels)||
+       (0u==max_frames) )
+  {
+    return S_ERROR;
+  }
+
+  memset (mix, 0, sizeof(*mix));
+  mix->num_channels = num_channels;
+  mix->max_frames = max_frames;
+  mix->kernel = select_kernel ();
+  atomic_init (&mix->next_id, 1u);
+  atomic_init (&mix->active_voices, 0u);
+  atomic_init (&mix->rejected_commands, 0u);
+
+  if ( S_SUCCESS!=mpsc_queue_init (&mix->commands, MIXER_QUEUE_SIZE,
+                                   sizeof(mixer_command)) )
+  {
+    return S_ERROR;
+  }
+
+  mix->voices = (mixer_voice*)calloc (MIXER_MAX_VOICES, sizeof(mixer_voice));
+  mix->active = (uint32_t*)calloc (MIXER_MAX_VOICES, sizeof(uint32_t));
+  mix->free_slots = (uint32_t*)calloc (MIXER_MAX_VOICES, sizeof(uint32_t));
+  if ( 0==posix_memalign (&buffer, MIXER_ALIGNMENT,
+                          sizeof(float)*max_frames*(num_channels+1u)) )
+  {
+    mix->scratch = (float*)buffer;
+  }
+  if ( (NULL==mix->voices)||(NULL==mix->active)||(NULL==mix->free_slots)||
+       (NULL==mix->scratch) )
+  {
+    mixer_destroy (mix);
+    return S_ERROR;
+  }
+
+  mix->bus = mix->scratch+max_frames;
+  for (uint32_t ch = 0; ch<num_channels; ch++)
+  {
+    mix->bus_channels[ch] = &mix->bus[ch*max_frames];
+  }
+  /* the lowest slots are taken first */
+  for (uint32_t n = 0; n<MIXER_MAX_VOICES; n++)
+  {
+    mix->free_slots[n] = MIXER_MAX_VOICES-1u-n;
+  }
+  mix->num_free = MIXER_MAX_VOICES;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void mixer_destroy (mixer*)
+ *
+ * @brief Free the mixer, no thread can be using it. The voices still in the
+ *        mix are not marked as finished
+ *
+ * @param[in] *mix  pointer to the mixer
+ *
+ ******************************************************************************/
+void mixer_destroy (mixer *mix)
+{
+  if ( NULL==mix )
+  {
+    return;
+  }
+
+  mpsc_queue_destroy (&mix->commands);
+  free (mix->voices);
+  free (mix->active);
+  free (mix->free_slots);
+  free (mix->scratch);
+  mix->voices = NULL;
+  mix->active = NULL;
+  mix->free_slots = NULL;
+  mix->scratch = NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t mixer_add_voice (mixer*, const signal_source*, float, float,
+ *                               atomic_uint*)
+ *
+ * @brief Start mixing a source, can be called from any thread
+ *
+ * The source is rendered in mono by the real time thread from the next
+ * period, it must stay valid until @a finished is set. The voice leaves the
+ * mix when it's removed or when its fill returns @a S_ERROR (e.g. at the
+ * end of a file)
+ *
+ * @param[in] *mix       pointer to the mixer
+ * @param[in] *source    source of the voice, it's copied
+ * @param      gain      linear gain
+ * @param      pan       -1 left to 1 right, 0 is the center
+ * @param[in] *finished  set to 1 when the real time thread stops using the
+ *                       source, NULL if not needed
+ *
+ * @return uint32_t id of the voice, @ref MIXER_INVALID_VOICE if the queue
+ *         is full
+ *
+ ******************************************************************************/
+uint32_t mixer_add_voice (mixer *mix, const signal_source *source, float gain,
+                          float pan, atomic_uint *finished)
+{
+  mixer_command command = { .type = E_MIXER_ADD, .gain = gain, .pan = pan,
+      .finished = finished };
+
+  if ( (NULL==mix)||(NULL==source)||(NULL==source->fill) )
+  {
+    return MIXER_INVALID_VOICE;
+  }
+
+  do
+  {
+    command.id = atomic_fetch_add_explicit (&mix->next_id, 1u,
+                                            memory_order_relaxed);
+  }
+  while ( MIXER_INVALID_VOICE==command.id );
+  command.source = *source;
+  command.pan = (-1.0f>pan) ? -1.0f : (1.0f<pan) ? 1.0f : pan;
+  if ( NULL!=finished )
+  {
+    atomic_store_explicit (finished, 0u, memory_order_relaxed);
+  }
+
+  if ( S_SUCCESS!=send_command (mix, &command) )
+  {
+    return MIXER_INVALID_VOICE;
+  }
+
+  return command.id;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t mixer_remove_voice (mixer*, uint32_t)
+ *
+ * @brief Fade out a voice in the next period and remove it, can be called
+ *        from any thread
+ *
+ * @param[in] *mix  pointer to the mixer
+ * @param      id   voice returned by @ref mixer_add_voice
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the queue
+ *         is full
+ *
+ ******************************************************************************/
+int8_t mixer_remove_voice (mixer *mix, uint32_t id)
+{
+  mixer_command command = { .type = E_MIXER_REMOVE, .id = id };
+
+  if ( (NULL==mix)||(MIXER_INVALID_VOICE==id) )
+  {
+    return S_ERROR;
+  }
+
+  return send_command (mix, &command);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t mixer_set_gain (mixer*, uint32_t, float)
+ *
+ * @brief Change the gain of a voice, it's ramped over the next period, can
+ *        be called from any thread
+ *
+ * @param[in] *mix   pointer to the mixer
+ * @param      id    voice returned by @ref mixer_add_voice
+ * @param      gain  linear gain
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the queue
+ *         is full
+ *
+ ******************************************************************************/
+int8_t mixer_set_gain (mixer *mix, uint32_t id, float gain)
+{
+  mixer_command command = { .type = E_MIXER_GAIN, .id = id, .gain = gain };
+
+  if ( (NULL==mix)||(MIXER_INVALID_VOICE==id) )
+  {
+    return S_ERROR;
+  }
+
+  return send_command (mix, &command);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t mixer_set_pan (mixer*, uint32_t, float)
+ *
+ * @brief Change the pan of a voice, it's ramped over the next period, can
+ *        be called from any thread
+ *
+ * @param[in] *mix  pointer to the mixer
+ * @param      id   voice returned by @ref mixer_add_voice
+ * @param      pan  -1 left to 1 right, 0 is the center
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the queue
+ *         is full
+ *
+ ******************************************************************************/
+int8_t mixer_set_pan (mixer *mix, uint32_t id, float pan)
+{
+  mixer_command command = { .type = E_MIXER_PAN, .id = id, .pan = pan };
+
+  if ( (NULL==mix)||(MIXER_INVALID_VOICE==id) )
+  {
+    return S_ERROR;
+  }
+
+  return send_command (mix, &command);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t mixer_process (mixer*, float**, uint32_t)
+ *
+ * @brief Mix a period of all the voices, only called by the real time
+ *        thread
+ *
+ * The commands queued are applied first, then each voice is rendered in
+ * mono and added to the channels with the gains ramped from the last
+ * period
+ *
+ * @param[in]   *mix       pointer to the mixer
+ * @param[out] **channels  one buffer for each channel, they are overwritten
+ * @param        frames    frames of the period, up to @a max_frames
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t mixer_process (mixer *mix, float **channels, uint32_t frames)
+{
+  mixer_command command;
+  mixer_voice *voice;
+  float *scratch[1];
+  uint32_t n = 0;
+
+  if ( (NULL==mix)||(NULL==channels)||(mix->max_frames<frames) )
+  {
+    return S_ERROR;
+  }
+
+  /* bounded, a producer pushing all the time can't keep this thread here */
+  for (uint32_t c = 0; (c<MIXER_QUEUE_SIZE)&&
+       (S_SUCCESS==mpsc_queue_pop (&mix->commands, &command)); c++)
+  {
+    apply_command (mix, &command);
+  }
+
+  for (uint32_t ch = 0; ch<mix->num_channels; ch++)
+  {
+    memset (channels[ch], 0, sizeof(float)*frames);
+  }
+  if ( 0u==frames )
+  {
+    atomic_store_explicit (&mix->active_voices, mix->num_active,
+                           memory_order_relaxed);
+    return S_SUCCESS;
+  }
+
+  scratch[0] = mix->scratch;
+  while ( n<mix->num_active )
+  {
+    voice = &mix->voices[mix->active[n]];
+    if ( S_SUCCESS!=signal_source_fill (&voice->source, scratch, frames, 1u,
+                                        E_LAYOUT_PLANAR, E_FILL_REPLACE) )
+    {
+      /* the source ended, the next voice takes its place in the list */
+      release_voice (mix, n);
+      continue;
+    }
+
+    for (uint32_t ch = 0; ch<mix->num_channels; ch++)
+    {
+      if ( (0.0f!=voice->current[ch])||(0.0f!=voice->target[ch]) )
+      {
+        mix->kernel (channels[ch], mix->scratch, frames, voice->current[ch],
+                     voice->target[ch]);
+        voice->current[ch] = voice->target[ch];
+      }
+    }
+
+    if ( 0u!=voice->removing )
+    {
+      release_voice (mix, n);
+      continue;
+    }
+    n++;
+  }
+  atomic_store_explicit (&mix->active_voices, mix->num_active,
+                         memory_order_relaxed);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t mixer_fill (void*, float**, uint32_t, uint32_t, channel_layout,
+ *                        fill_mode, float)
+ *
+ * @brief @ref signal_fill_callback of a mixer, so the mix can be used as
+ *        the source of a stream or of another mixer
+ *
+ * A planar period written with unity gain is mixed in place, otherwise the
+ * mix is done in the bus of the mixer and copied
+ *
+ * @param[in,out] *context       pointer to the @ref mixer
+ * @param[in,out] **data         buffers of the period
+ * @param           frames       frames to render
+ * @param           num_channels channels of the period, the ones of the
+ *                               mixer
+ * @param           layout       organization of @a data
+ * @param           mode         write or add the samples
+ * @param           gain         gain applied to the mix
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t mixer_fill (void *context, float **data, uint32_t frames,
+                   uint32_t num_channels, channel_layout layout,
+                   fill_mode mode, float gain)
+{
+  mixer *mix = (mixer*)context;
+  float *out;
+
+  if ( (NULL==mix)||(NULL==data)||(mix->num_channels!=num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  if ( (E_LAYOUT_PLANAR==layout)&&(E_FILL_REPLACE==mode)&&(1.0f==gain) )
+  {
+    return mixer_process (mix, data, frames);
+  }
+
+  if ( S_SUCCESS!=mixer_process (mix, mix->bus_channels, frames) )
+  {
+    return S_ERROR;
+  }
+  for (uint32_t ch = 0; ch<num_channels; ch++)
+  {
+    for (uint32_t n = 0; n<frames; n++)
+    {
+      out = (E_LAYOUT_PLANAR==layout) ? &data[ch][n] :
+          &data[0][n*num_channels+ch];
+      *out = (E_FILL_ADD==mode) ? *out+gain*mix->bus_channels[ch][n] :
+          gain*mix->bus_channels[ch][n];
+    }
+  }
+
+  return S_SUCCESS;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,148 @@
+/*******************************************************************************
+ * @file      mixer.h
+ *
+ * @brief      Lock-free software mixer of many sources in one stream
+ *
+ * Mixes hundreds of voices in the periods of one PCM, each voice is a
+ * @ref signal_source with its own gain and pan:
+ *      @li the voices are added, removed and changed from any thread with
+ *          commands sent through a @ref mpsc_queue, the real time thread
+ *          applies them at the start of each period, so it never takes a lock
+ *      @li gain and pan changes are ramped over a period, new voices fade in
+ *          and removed voices fade out, so the changes don't click
+ *      @li the voices are rendered in mono and added to each channel with
+ *          the SIMD kernel of @ref sample_convert_set_isa
+ *      @li the mixer is also a @ref signal_source (@ref mixer_fill), so it can
+ *          feed any of the playback paths
+ *
+ * The pan is constant power over each pair of channels (left/right), a last
+ * channel without pair gets the voice with its gain.
+ *
+ * @note Link using -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdatomic.h>
+#include <stdint.h>
+#include "alsa_utils.h"
+#include "mpsc_queue.h"
+#include "sample_convert.h"
+#include "signal_source.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _MIXER_
+#define _MIXER_
+
+#define MIXER_MAX_VOICES        (512u) /**< voices mixed at the same time */
+#define MIXER_QUEUE_SIZE        (1024u) /**< commands waiting for a period */
+#define MIXER_INVALID_VOICE     (0u) /**< id returned when a voice can't be
+                                          added */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Commands sent to the real time thread */
+typedef enum
+{
+  E_MIXER_ADD = 0, /**< start mixing a voice */
+  E_MIXER_REMOVE, /**< fade out and remove a voice */
+  E_MIXER_GAIN, /**< change the gain of a voice */
+  E_MIXER_PAN /**< change the pan of a voice */
+} mixer_command_type;
+
+/** Message of the command queue */
+typedef struct
+{
+  mixer_command_type type; /**< what to do */
+  uint32_t id; /**< voice affected */
+  float gain; /**< linear gain (add and gain) */
+  float pan; /**< -1 left to 1 right (add and pan) */
+  signal_source source; /**< source of the voice (add) */
+  atomic_uint *finished; /**< set to 1 when the voice leaves the mix (add) */
+} mixer_command;
+
+/** Kernel adding a mono block to a channel with a gain ramp from
+ * @a start_gain to @a end_gain */
+typedef void (*mixer_kernel) (float *out, const float *in, uint32_t frames,
+                              float start_gain, float end_gain);
+
+/** Voice being mixed, only used by the real time thread */
+typedef struct
+{
+  uint32_t id; /**< id returned by @ref mixer_add_voice */
+  uint8_t removing; /**< 1 while fading out before the removal */
+  float gain; /**< linear gain */
+  float pan; /**< -1 left to 1 right */
+  signal_source source; /**< renders the voice */
+  atomic_uint *finished; /**< set when the voice is removed, can be NULL */
+  float target[MAX_CHANNELS]; /**< gain of each channel after the ramp */
+  float current[MAX_CHANNELS]; /**< gain of each channel at the last
+   period */
+} mixer_voice;
+
+/** Mixer of a stream */
+typedef struct
+{
+  uint32_t num_channels; /**< channels of the stream */
+  uint32_t max_frames; /**< biggest period mixed */
+  mpsc_queue commands; /**< commands from the other threads */
+  atomic_uint next_id; /**< next voice id */
+  atomic_uint active_voices; /**< voices in the mix after the last period */
+  atomic_uint_fast64_t rejected_commands; /**< commands lost because the
+   queue or the voices were full */
+  mixer_voice *voices; /**< @ref MIXER_MAX_VOICES slots */
+  uint32_t *active; /**< slots being mixed, the first @a num_active */
+  uint32_t num_active; /**< voices being mixed */
+  uint32_t *free_slots; /**< slots available, the first @a num_free */
+  uint32_t num_free; /**< slots available */
+  float *scratch; /**< mono render of a voice */
+  float *bus; /**< planar mix used by @ref mixer_fill */
+  float *bus_channels[MAX_CHANNELS]; /**< channels of @a bus */
+  mixer_kernel kernel; /**< kernel of the instruction set in use */
+} mixer;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t mixer_init (mixer *mix, uint32_t num_channels, uint32_t max_frames);
+void mixer_destroy (mixer *mix);
+uint32_t mixer_add_voice (mixer *mix, const signal_source *source, float gain,
+                          float pan, atomic_uint *finished);
+int8_t mixer_remove_voice (mixer *mix, uint32_t id);
+int8_t mixer_set_gain (mixer *mix, uint32_t id, float gain);
+int8_t mixer_set_pan (mixer *mix, uint32_t id, float pan);
+int8_t mixer_process (mixer *mix, float **channels, uint32_t frames);
+int8_t mixer_fill (void *context, float **data, uint32_t frames,
+                   uint32_t num_channels, channel_layout layout,
+                   fill_mode mode, float gain);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
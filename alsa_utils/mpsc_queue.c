@@ -0,0 +1,204 @@
+/*******************************************************************************
+ * @file      mpsc_queue.c
+ *
+ * @brief      Lock-free bounded queue with many producers and one consumer
+ *
+ * A cell at position @a pos is free for the producer when its sequence is
+ * @a pos, a producer that claimed it copies the message and stores
+ * @a pos+1 (release), so the consumer sees the message when it reads that
+ * sequence. After the copy the consumer stores @a pos+num_cells, which frees
+ * the cell for the next round.
+ *
+ * @note
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include "alsa_utils.h"
+#include "mpsc_queue.h"
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t mpsc_queue_init (mpsc_queue*, size_t, size_t)
+ *
+ * @brief Create an empty queue
+ *
+ * @param[out] *queue          pointer to the queue
+ * @param       num_cells      messages the queue can hold, power of 2
+ * @param       message_bytes  size of each message
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t mpsc_queue_init (mpsc_queue *queue, size_t num_cells,
+                        size_t message_bytes)
+{
+  if ( (NULL==queue)||(2u>num_cells)||(0u!=(num_cells&(num_cells-1u)))||
+       (0u==message_bytes) )
+  {
+    return S_ERROR;
+  }
+
+  queue->sequences = (atomic_size_t*)malloc (sizeof(atomic_size_t)*
+                                             num_cells);
+  queue->storage = (uint8_t*)malloc (message_bytes*num_cells);
+  if ( (NULL==queue->sequences)||(NULL==queue->storage) )
+  {
+    mpsc_queue_destroy (queue);
+    return S_ERROR;
+  }
+
+  queue->message_bytes = message_bytes;
+  queue->num_cells = num_cells;
+  queue->mask = num_cells-1u;
+  for (size_t n = 0; n<num_cells; n++)
+  {
+    atomic_init (&queue->sequences[n], n);
+  }
+  atomic_init (&queue->enqueue_pos, 0u);
+  queue->dequeue_pos = 0u;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void mpsc_queue_destroy (mpsc_queue*)
+ *
+ * @brief Free the memory of the queue, no thread can be using it
+ *
+ * @param[in] *queue  pointer to the queue
+ *
+ ******************************************************************************/
+void mpsc_queue_destroy (mpsc_queue *queue)
+{
+  if ( NULL==queue )
+  {
+    return;
+  }
+
+  free (queue->sequences);
+  free (queue->storage);
+  queue->sequences = NULL;
+  queue->storage = NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t mpsc_queue_push (mpsc_queue*, const void*)
+ *
+ * @brief Copy a message to the queue, can be called from any thread
+ *
+ * @param[in] *queue    pointer to the queue
+ * @param[in] *message  @a message_bytes to copy
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the queue
+ *         is full
+ *
+ ******************************************************************************/
+int8_t mpsc_queue_push (mpsc_queue *queue, const void *message)
+{
+  size_t pos = atomic_load_explicit (&queue->enqueue_pos,
+                                     memory_order_relaxed);
+  size_t sequence;
+  intptr_t diff;
+
+  for (;;)
+  {
+    sequence = atomic_load_explicit (&queue->sequences[pos&queue->mask],
+                                     memory_order_acquire);
+    diff = (intptr_t)sequence-(intptr_t)pos;
+    if ( 0==diff )
+    {
+      /* the cell is free, claim the position */
+      if ( atomic_compare_exchange_weak_explicit (&queue->enqueue_pos, &pos,
+                                                  pos+1u,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed) )
+      {
+        break;
+      }
+    }
+    else if ( 0>diff )
+    {
+      /* the consumer hasn't freed the cell of the previous round */
+      return S_ERROR;
+    }
+    else
+    {
+      pos = atomic_load_explicit (&queue->enqueue_pos, memory_order_relaxed);
+    }
+  }
+
+  memcpy (&queue->storage[(pos&queue->mask)*queue->message_bytes], message,
+          queue->message_bytes);
+  atomic_store_explicit (&queue->sequences[pos&queue->mask], pos+1u,
+                         memory_order_release);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t mpsc_queue_pop (mpsc_queue*, void*)
+ *
+ * @brief Copy the oldest message out of the queue, only one thread can call
+ *        this function
+ *
+ * @param[in]  *queue    pointer to the queue
+ * @param[out] *message  buffer of @a message_bytes
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the queue
+ *         is empty (or the oldest message is still being written)
+ *
+ ******************************************************************************/
+int8_t mpsc_queue_pop (mpsc_queue *queue, void *message)
+{
+  size_t pos = queue->dequeue_pos;
+
+  if ( pos+1u!=atomic_load_explicit (&queue->sequences[pos&queue->mask],
+                                     memory_order_acquire) )
+  {
+    return S_ERROR;
+  }
+
+  memcpy (message, &queue->storage[(pos&queue->mask)*queue->message_bytes],
+          queue->message_bytes);
+  atomic_store_explicit (&queue->sequences[pos&queue->mask],
+                         pos+queue->num_cells, memory_order_release);
+  queue->dequeue_pos = pos+1u;
+
+  return S_SUCCESS;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
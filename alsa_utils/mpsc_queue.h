@@ -0,0 +1,86 @@
+/*******************************************************************************
+ * @file      mpsc_queue.h
+ *
+ * @brief      Lock-free bounded queue with many producers and one consumer
+ *
+ * Queue of fixed size messages (e.g. commands to the real time thread)
+ * where any number of threads can push and only one thread pops. Neither side
+ * takes a lock or makes a system call, a push fails if the queue is full
+ * instead of waiting, so the real time thread can also be a producer.
+ *
+ * Each cell has a sequence number (D. Vyukov's bounded queue): the producers
+ * claim a position with a compare and swap of @a enqueue_pos and publish the
+ * message by storing the sequence, the consumer owns @a dequeue_pos.
+ *
+ * @note
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "spsc_ring.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _MPSC_QUEUE_
+#define _MPSC_QUEUE_
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Queue of messages, the positions are free running counters */
+typedef struct
+{
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t enqueue_pos; /**< next position
+   claimed by a producer */
+
+  _Alignas(CACHE_LINE_SIZE) size_t dequeue_pos; /**< next position read,
+   only used by the consumer */
+
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t *sequences; /**< state of each
+   cell: @a pos when free, @a pos+1 when written */
+  uint8_t *storage; /**< messages of all the cells */
+  size_t message_bytes; /**< size of each message */
+  size_t num_cells; /**< number of cells, power of 2 */
+  size_t mask; /**< num_cells-1, used to wrap the positions */
+} mpsc_queue;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t mpsc_queue_init (mpsc_queue *queue, size_t num_cells,
+                        size_t message_bytes);
+void mpsc_queue_destroy (mpsc_queue *queue);
+int8_t mpsc_queue_push (mpsc_queue *queue, const void *message);
+int8_t mpsc_queue_pop (mpsc_queue *queue, void *message);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,233 @@
+/*******************************************************************************
+ * @file      oscillator.c
+ *
+ * @brief      Phase accumulator oscillators for the tone generators
+ *
+ * Oscillators based on a phase accumulator reading a precomputed wavetable
+ * with linear interpolation, the phase is kept inside the oscillator so
+ * successive periods join without discontinuities.
+ *
+ * With 1024 points and linear interpolation the error of the table is around
+ * -100dB, which is more than we need for 16 bits audio, and we avoid calling
+ * @a sin() for every sample.
+ *
+ * @note Link using -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include "oscillator.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define PHASE_FULL_CYCLE        (4294967296.0) /**< @f$ 2^{32} @f$ */
+
+/*------------------------------------------------------------------------------
+ * Module Variable Definitions
+ ------------------------------------------------------------------------------*/
+float oscillator_wavetable[OSCILLATOR_TABLE_SIZE+1];
+
+/** set once the wavetable was filled */
+static uint8_t wavetable_ready = 0u;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn void init_wavetable (void)
+ *
+ * @brief Fill the sine table, this is done only once
+ *
+ * @note This is not thread safe, the first oscillator should be initialized
+ *       before starting the audio threads
+ *
+ ******************************************************************************/
+static void init_wavetable (void)
+{
+  if ( 0u==wavetable_ready )
+  {
+    for (uint32_t n = 0; n<=OSCILLATOR_TABLE_SIZE; n++)
+    {
+      oscillator_wavetable[n] = (float)sin (2*M_PI*n/OSCILLATOR_TABLE_SIZE);
+    }
+    wavetable_ready = 1u;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t oscillator_init (oscillator*, float, uint32_t, float)
+ *
+ * @brief Initialize a sine oscillator
+ *
+ * The oscillator starts with phase 0, so the first sample is always 0
+ *
+ * @param[out] *osc         pointer to the oscillator
+ * @param       f           frequency of the sine wave
+ * @param       fs          sampling frequency
+ * @param       amplitude   peak value of the sine wave
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t oscillator_init (oscillator *osc, float f, uint32_t fs,
+                        float amplitude)
+{
+  if ( NULL==osc )
+  {
+    return S_ERROR;
+  }
+
+  init_wavetable ();
+  osc->phase = 0u;
+  osc->amplitude = amplitude;
+
+  return oscillator_set_frequency (osc, f, fs);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t oscillator_set_frequency (oscillator*, float, uint32_t)
+ *
+ * @brief Change the frequency of the oscillator
+ *
+ * The phase is not modified, so the frequency can be changed between periods
+ * without generating clicks
+ *
+ * @param[in,out] *osc  pointer to the oscillator
+ * @param          f    frequency of the sine wave, it must be below fs/2
+ * @param          fs   sampling frequency
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t oscillator_set_frequency (oscillator *osc, float f, uint32_t fs)
+{
+  if ( (NULL==osc)||(0u==fs)||(0.0f>f)||((float)fs<=2.0f*f) )
+  {
+    return S_ERROR;
+  }
+
+  osc->phase_increment = (uint32_t)llround (PHASE_FULL_CYCLE*f/fs);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t oscillator_render (oscillator*, float*, uint32_t)
+ *
+ * @brief Render a block of samples of the oscillator
+ *
+ * @param[in,out] *osc      pointer to the oscillator
+ * @param[out]    *data     buffer to store the samples (mono)
+ * @param          frames   number of samples to render
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t oscillator_render (oscillator *osc, float *data, uint32_t frames)
+{
+  if ( (NULL==osc)||(NULL==data) )
+  {
+    return S_ERROR;
+  }
+
+  for (uint32_t n = 0; n<frames; n++)
+  {
+    data[n] = oscillator_tick (osc);
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t oscillator_fill (oscillator*, float**, uint32_t, uint32_t,
+ *                             channel_layout)
+ *
+ * @brief Render a block of the oscillator in all the channels of a buffer
+ *
+ * All the channels get the same samples, see @ref channel_layout for the
+ * organization of the buffers
+ *
+ * @param[in,out] *osc          pointer to the oscillator
+ * @param[out]    *data         buffers to store the samples
+ * @param          frames       number of frames to render
+ * @param          num_channels number of channels of the buffers
+ * @param          layout       organization of the buffers
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t oscillator_fill (oscillator *osc, float **data, uint32_t frames,
+                        uint32_t num_channels, channel_layout layout)
+{
+  float sample;
+  float *buffer;
+
+  if ( (NULL==osc)||(NULL==data)||(NULL==data[0])||(0u==num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  if ( E_LAYOUT_INTERLEAVED==layout )
+  {
+    buffer = data[0];
+    for (uint32_t n = 0; n<frames; n++)
+    {
+      sample = oscillator_tick (osc);
+      for (uint32_t ch = 0; ch<num_channels; ch++)
+      {
+        buffer[n*num_channels+ch] = sample;
+      }
+    }
+
+    return S_SUCCESS;
+  }
+
+  /* planar: render the first channel and copy it to the rest */
+  oscillator_render (osc, data[0], frames);
+  for (uint32_t ch = 1; ch<num_channels; ch++)
+  {
+    if ( NULL==data[ch] )
+    {
+      return S_ERROR;
+    }
+    memcpy (data[ch], data[0], frames*sizeof(float));
+  }
+
+  return S_SUCCESS;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,116 @@
+/*******************************************************************************
+ * @file      oscillator.h
+ *
+ * @brief      Phase accumulator oscillators for the tone generators
+ *
+ * Oscillators based on a phase accumulator reading a precomputed wavetable
+ * with linear interpolation, the phase is kept inside the oscillator so
+ * successive periods join without discontinuities.
+ *
+ * @note
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _OSCILLATOR_
+#define _OSCILLATOR_
+
+#define OSCILLATOR_TABLE_BITS   (10u) /**< log2 of the wavetable size */
+#define OSCILLATOR_TABLE_SIZE   (1u<<OSCILLATOR_TABLE_BITS) /**< number of
+                                       points of a full cycle of the table */
+#define OSCILLATOR_FRAC_BITS    (32u-OSCILLATOR_TABLE_BITS) /**< bits of the
+                                       phase used to interpolate */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Sine oscillator, the phase is a 32 bits fixed point number where
+ * @f$ 2^{32} @f$ is a full cycle so the wrap around is done for free by the
+ * unsigned overflow:
+ * @li the upper @ref OSCILLATOR_TABLE_BITS bits are the index of the table
+ * @li the lower @ref OSCILLATOR_FRAC_BITS bits are used to interpolate between
+ *     two points of the table */
+typedef struct
+{
+  uint32_t phase; /**< current phase of the oscillator */
+  uint32_t phase_increment; /**< @f$ 2^{32}\frac{f}{fs} @f$ */
+  float amplitude; /**< peak value of the generated wave */
+} oscillator;
+
+/*------------------------------------------------------------------------------
+ * Global Variables
+ -----------------------------------------------------------------------------*/
+/** Sine table with one extra point to interpolate the last segment without
+ * wrapping the index, filled by @ref oscillator_init */
+extern float oscillator_wavetable[OSCILLATOR_TABLE_SIZE+1];
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t oscillator_init (oscillator *osc, float f, uint32_t fs,
+                        float amplitude);
+int8_t oscillator_set_frequency (oscillator *osc, float f, uint32_t fs);
+int8_t oscillator_render (oscillator *osc, float *data, uint32_t frames);
+int8_t oscillator_fill (oscillator *osc, float **data, uint32_t frames,
+                        uint32_t num_channels, channel_layout layout);
+
+/******************************************************************************
+ *
+ * @fn float oscillator_tick (oscillator*)
+ *
+ * @brief Get the next sample of the oscillator
+ *
+ * Kept inline since this is called once per sample by the generators
+ *
+ * @param[in,out] *osc  pointer to the oscillator
+ *
+ * @return float next sample of the oscillator
+ *
+ ******************************************************************************/
+static inline float oscillator_tick (oscillator *osc)
+{
+  uint32_t index = osc->phase>>OSCILLATOR_FRAC_BITS;
+  float frac = (float)(osc->phase&((1u<<OSCILLATOR_FRAC_BITS)-1u))*
+      (1.0f/(float)(1u<<OSCILLATOR_FRAC_BITS));
+  float a = oscillator_wavetable[index];
+  float b = oscillator_wavetable[index+1u];
+
+  osc->phase += osc->phase_increment;
+
+  return osc->amplitude*(a+frac*(b-a));
+}
+
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
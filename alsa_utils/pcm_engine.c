@@ -0,0 +1,954 @@
+/*******************************************************************************
+ * @file      pcm_engine.c
+ *
+ * @brief      Engine driving several PCM devices from one thread
+ *
+ * Engine that opens several devices, links them and services all of them
+ * from a single @ref pcm_event_loop, see @ref pcm_engine.
+ *
+ * To start all the devices with their buffers full:
+ *      @li the automatic start is disabled (start threshold = boundary)
+ *      @li all the buffers are filled and then the master is started, this
+ *          starts all the linked devices at the same time
+ *
+ * If a device doesn't support linking (e.g. some plugins) it's started on its
+ * own after the master.
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <math.h>
+#include <string.h>
+#include "device_probe.h"
+#include "pcm_engine.h"
+#include "pcm_stats.h"
+#include "sample_convert.h"
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t render_resampled (const snd_pcm_channel_area_t*,
+ *                              snd_pcm_uframes_t, snd_pcm_uframes_t, void*)
+ *
+ * @brief Render a slave through its resampler, used as
+ *        @ref mmap_render_callback when the drift is compensated
+ *
+ * For each period the content needed is rendered by the callback of the
+ * user at the rate of the master, converted to float, resampled to the
+ * clock of the slave and converted to the format of the device
+ *
+ * @param[in] *areas      channel areas to fill
+ * @param      offset     first frame to write
+ * @param      frames     number of frames to write
+ * @param[in] *user_data  pointer to the @ref engine_device
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+static int8_t render_resampled (const snd_pcm_channel_area_t *areas,
+                                snd_pcm_uframes_t offset,
+                                snd_pcm_uframes_t frames, void *user_data)
+{
+  engine_device *device = (engine_device*)user_data;
+  uint32_t num_channels = device->hw_config.num_channels;
+  void *out[MAX_CHANNELS];
+  snd_pcm_uframes_t done = 0;
+  uint32_t chunk;
+  uint32_t needed;
+  uint32_t produced;
+
+  while ( done<frames )
+  {
+    chunk = (uint32_t)(frames-done);
+    if ( chunk>device->hw_config.period_size )
+    {
+      chunk = (uint32_t)device->hw_config.period_size;
+    }
+
+    needed = resampler_input_frames (&device->src, chunk);
+    if ( (0u<needed)&&
+         ((S_SUCCESS!=device->src_render (device->content_areas, 0u, needed,
+                                          device->src_user_data))||
+          (S_SUCCESS!=convert_format_to_float (device->content_buffer,
+                                               device->src_in, needed,
+                                               num_channels,
+                                               device->hw_config.format))) )
+    {
+      return S_ERROR;
+    }
+
+    if ( (S_SUCCESS!=resampler_process (&device->src, device->src_in, needed,
+                                        device->src_out, chunk, &produced))||
+         ((0u==needed)&&(0u==produced)) )
+    {
+      return S_ERROR;
+    }
+    device->content_frames += needed;
+
+    for (uint32_t ch = 0; ch<num_channels; ch++)
+    {
+      out[ch] = mmap_area_address (&areas[ch], offset+done);
+    }
+    if ( NULL!=device->hw_config.render )
+    {
+      device->hw_config.render (device->src_out, out, produced, num_channels);
+    }
+    else if ( S_SUCCESS!=convert_float_channels (device->src_out, out,
+                                                 produced, num_channels,
+                                                 device->layout,
+                                                 device->hw_config.format) )
+    {
+      return S_ERROR;
+    }
+    done += produced;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void update_drift (engine_device*)
+ *
+ * @brief Estimate the clock of a device and adjust the resampler of a slave
+ *
+ * The frames played (written minus the delay) are sampled at the time of the
+ * last pointer update. For a slave the content at its output at that time
+ * is compared with the content at the output of the master:
+ * @f$ content - pending - (written - played) \cdot ratio @f$ where
+ * @a content are the frames given to the resampler, @a pending the ones not
+ * converted yet and the rest the frames in the buffer of the device
+ *
+ * @param[in,out] *device  device serviced
+ *
+ ******************************************************************************/
+static void update_drift (engine_device *device)
+{
+  pcm_engine *engine = device->engine;
+  drift_estimator *master = &engine->devices[0].drift;
+  snd_htimestamp_t tstamp;
+  uint64_t time_ns;
+  double played;
+  double content;
+  double ratio;
+
+  if ( (S_SUCCESS>snd_pcm_status (device->sound_card_handle, engine->status))||
+       (SND_PCM_STATE_RUNNING!=snd_pcm_status_get_state (engine->status)) )
+  {
+    return;
+  }
+
+  snd_pcm_status_get_htstamp (engine->status, &tstamp);
+  time_ns = (uint64_t)tstamp.tv_sec*1000000000u+(uint64_t)tstamp.tv_nsec;
+  if ( 0u==time_ns )
+  {
+    return;
+  }
+
+  played = (double)device->stats.frames_written-
+      (double)snd_pcm_status_get_delay (engine->status);
+  drift_estimator_update (&device->drift, time_ns, played);
+  device->stats.drift_ppm = drift_estimator_ppm (&device->drift);
+  if ( (0u==device->resampled)||(0u==master->updates) )
+  {
+    return;
+  }
+
+  content = (double)device->content_frames-
+      resampler_pending_input (&device->src)-
+      ((double)device->stats.frames_written-
+          drift_estimator_position (&device->drift, time_ns))*
+          resampler_get_ratio (&device->src);
+  device->stats.align_error = content-drift_estimator_position (master,
+                                                                time_ns);
+
+  ratio = drift_sync_ratio (master, &device->drift, device->stats.align_error);
+  resampler_set_ratio (&device->src, ratio);
+  device->stats.src_ratio = ratio;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t setup_resampler (pcm_engine*, engine_device*)
+ *
+ * @brief Put the resampler between a slave and the callback of the user
+ *
+ * @param[in]     *engine  pointer to the engine
+ * @param[in,out] *device  slave to resample
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+static int8_t setup_resampler (pcm_engine *engine, engine_device *device)
+{
+  uint32_t num_channels = device->hw_config.num_channels;
+  uint32_t in_rate = engine->devices[0].hw_config.sample_rate;
+  uint32_t period = (uint32_t)device->hw_config.period_size;
+  uint32_t max_in;
+  ssize_t content_bytes;
+
+  /* a period at the fastest ratio plus the history of the filter */
+  max_in = (uint32_t)((double)period*in_rate*(1.0+RESAMPLER_MAX_ADJUST)/
+      device->hw_config.sample_rate)+2u*RESAMPLER_MAX_TAPS+1u;
+  if ( S_SUCCESS!=resampler_init (&device->src, num_channels, in_rate,
+                                  device->hw_config.sample_rate,
+                                  engine->src_quality, max_in) )
+  {
+    return S_ERROR;
+  }
+  device->resampled = 1u;
+
+  content_bytes = snd_pcm_format_size (device->hw_config.format,
+                                       (size_t)max_in*num_channels);
+  device->content_buffer = (0<content_bytes) ?
+      malloc ((size_t)content_bytes) : NULL;
+  device->src_in[0] = malloc (sizeof(float)*max_in*num_channels);
+  device->src_out[0] = malloc (sizeof(float)*period*num_channels);
+  if ( (NULL==device->content_buffer)||(NULL==device->src_in[0])||
+       (NULL==device->src_out[0])||
+       (S_SUCCESS!=setup_channel_areas (device->content_areas,
+                                        device->content_buffer, max_in,
+                                        num_channels, E_LAYOUT_INTERLEAVED,
+                                        device->hw_config.format)) )
+  {
+    return S_ERROR;
+  }
+  for (uint32_t ch = 1; ch<num_channels; ch++)
+  {
+    device->src_in[ch] = device->src_in[0]+(size_t)ch*max_in;
+    device->src_out[ch] = device->src_out[0]+(size_t)ch*period;
+  }
+
+  /* the engine renders the slave, the user renders the content */
+  device->src_render = device->render;
+  device->src_user_data = device->user_data;
+  device->render = render_resampled;
+  device->user_data = device;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn snd_pcm_sframes_t rw_write_available (engine_device*)
+ *
+ * @brief Render and write the free frames of a device with RW access
+ *
+ * Only the frames reported by @a snd_pcm_avail_update are written so the
+ * non blocking writes never return -EAGAIN
+ *
+ * @param[in] *device  device to write
+ *
+ * @return snd_pcm_sframes_t frames written, negative error code on failure
+ *
+ ******************************************************************************/
+static snd_pcm_sframes_t rw_write_available (engine_device *device)
+{
+  void *channels[MAX_CHANNELS];
+  snd_pcm_sframes_t avail;
+  snd_pcm_sframes_t written;
+  snd_pcm_uframes_t frames;
+  snd_pcm_uframes_t total = 0;
+  int err;
+
+  avail = snd_pcm_avail_update (device->sound_card_handle);
+  if ( 0>avail )
+  {
+    err = snd_pcm_recover (device->sound_card_handle, (int)avail, 1);
+    return (S_SUCCESS>err) ? err : 0;
+  }
+
+  while ( total<(snd_pcm_uframes_t)avail )
+  {
+    frames = (snd_pcm_uframes_t)avail-total;
+    if ( frames>device->hw_config.period_size )
+    {
+      frames = device->hw_config.period_size;
+    }
+
+    if ( S_SUCCESS!=device->render (device->areas, 0u, frames,
+                                    device->user_data) )
+    {
+      return -EIO;
+    }
+
+    if ( E_LAYOUT_PLANAR==device->layout )
+    {
+      for (uint32_t ch = 0; ch<device->hw_config.num_channels; ch++)
+      {
+        channels[ch] = device->areas[ch].addr;
+      }
+      written = snd_pcm_writen (device->sound_card_handle, channels, frames);
+    }
+    else
+    {
+      written = snd_pcm_writei (device->sound_card_handle, device->buffer,
+                                frames);
+    }
+
+    if ( 0>written )
+    {
+      err = snd_pcm_recover (device->sound_card_handle, (int)written, 1);
+      return (S_SUCCESS>err) ? err : (snd_pcm_sframes_t)total;
+    }
+    total += (snd_pcm_uframes_t)written;
+  }
+
+  return (snd_pcm_sframes_t)total;
+}
+
+/******************************************************************************
+ *
+ * @fn snd_pcm_sframes_t write_available (engine_device*)
+ *
+ * @brief Fill the free part of the buffer of a device
+ *
+ * @param[in] *device  device to write
+ *
+ * @return snd_pcm_sframes_t frames written, negative error code on failure
+ *
+ ******************************************************************************/
+static snd_pcm_sframes_t write_available (engine_device *device)
+{
+  if ( 0u!=device->use_mmap )
+  {
+    return mmap_write_available (device->sound_card_handle,
+                                 device->buffer_size, device->render,
+                                 device->user_data);
+  }
+
+  return rw_write_available (device);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t service_device (snd_pcm_t*, unsigned short, void*)
+ *
+ * @brief Callback of the event loop for each device
+ *
+ * @param[in] *sound_card_handle  handle of the device
+ * @param      revents            events of the device
+ * @param[in] *user_data          pointer to the @ref engine_device
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+static int8_t service_device (snd_pcm_t *sound_card_handle,
+                              unsigned short revents, void *user_data)
+{
+  engine_device *device = (engine_device*)user_data;
+  engine_device_stats *stats = &device->stats;
+  uint64_t start = pcm_stats_now_ns ();
+  uint64_t elapsed;
+  snd_pcm_sframes_t avail;
+  snd_pcm_sframes_t written;
+  snd_pcm_state_t state;
+
+  if ( 0u!=stats->last_wakeup_ns )
+  {
+    elapsed = start-stats->last_wakeup_ns;
+    if ( elapsed>stats->max_wakeup_interval_ns )
+    {
+      stats->max_wakeup_interval_ns = elapsed;
+    }
+  }
+  stats->last_wakeup_ns = start;
+  stats->wakeups++;
+
+  if ( 0u!=(revents&POLLERR) )
+  {
+    state = snd_pcm_state (sound_card_handle);
+    if ( (SND_PCM_STATE_XRUN==state)||(SND_PCM_STATE_SUSPENDED==state) )
+    {
+      stats->xruns++;
+      if ( 0u!=device->engine->linked )
+      {
+        /* the whole group stopped, pcm_engine_run restarts it */
+        device->engine->restart_pending = 1u;
+        return S_SUCCESS;
+      }
+
+      if ( S_SUCCESS>snd_pcm_recover (sound_card_handle,
+                                      (SND_PCM_STATE_XRUN==state) ?
+                                          -EPIPE : -ESTRPIPE, 1) )
+      {
+        printf ("pcm_engine Error: %s can't recover\n", device->name);
+        return S_ERROR;
+      }
+    }
+  }
+
+  avail = snd_pcm_avail_update (sound_card_handle);
+  if ( (0<avail)&&((snd_pcm_uframes_t)avail>stats->max_avail) )
+  {
+    stats->max_avail = (snd_pcm_uframes_t)avail;
+  }
+
+  written = write_available (device);
+  if ( 0>written )
+  {
+    if ( -EPIPE==written )
+    {
+      stats->xruns++;
+    }
+    printf ("pcm_engine Error: %s write failed, Err = %ld\n", device->name,
+            (long)written);
+    return S_ERROR;
+  }
+  stats->frames_written += (uint64_t)written;
+
+  if ( 0u!=device->engine->drift_compensation )
+  {
+    update_drift (device);
+  }
+
+  /* the automatic start is disabled, an unlinked device that recovered is
+   * started again once its buffer is full */
+  if ( (SND_PCM_STATE_PREPARED==snd_pcm_state (sound_card_handle))&&
+       (0==snd_pcm_avail_update (sound_card_handle)) )
+  {
+    if ( S_SUCCESS>snd_pcm_start (sound_card_handle) )
+    {
+      printf ("pcm_engine Error: %s can't be started\n", device->name);
+      return S_ERROR;
+    }
+  }
+
+  elapsed = pcm_stats_now_ns ()-start;
+  stats->total_service_ns += elapsed;
+  if ( elapsed>stats->max_service_ns )
+  {
+    stats->max_service_ns = elapsed;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t fill_and_start (pcm_engine*)
+ *
+ * @brief Fill the buffers of all the devices and start them
+ *
+ * All the buffers are filled before starting, then the master is started
+ * (this starts all the linked devices) and also the devices that couldn't be
+ * linked
+ *
+ * @param[in] *engine  pointer to the engine
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+static int8_t fill_and_start (pcm_engine *engine)
+{
+  engine_device *device;
+  snd_pcm_sframes_t written;
+  int err;
+
+  for (uint32_t n = 0; n<engine->num_devices; n++)
+  {
+    device = &engine->devices[n];
+    written = write_available (device);
+    if ( 0>written )
+    {
+      printf ("pcm_engine Error: filling %s, Err = %ld\n", device->name,
+              (long)written);
+      return S_ERROR;
+    }
+    device->stats.frames_written += (uint64_t)written;
+  }
+
+  for (uint32_t n = 0; n<engine->num_devices; n++)
+  {
+    device = &engine->devices[n];
+    if ( ((0u==n)||(0u==device->linked))&&
+         (SND_PCM_STATE_PREPARED==snd_pcm_state (device->sound_card_handle)) )
+    {
+      err = snd_pcm_start (device->sound_card_handle);
+      if ( S_SUCCESS>err )
+      {
+        printf ("pcm_engine Error: starting %s, Err = %d\n", device->name,
+                err);
+        return S_ERROR;
+      }
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t restart_group (pcm_engine*)
+ *
+ * @brief Recover all the devices of a linked group after an xrun
+ *
+ * @param[in] *engine  pointer to the engine
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+static int8_t restart_group (pcm_engine *engine)
+{
+  snd_pcm_state_t state;
+  int err = S_SUCCESS;
+
+  engine->restart_pending = 0u;
+  for (uint32_t n = 0; n<engine->num_devices; n++)
+  {
+    /* the positions jump, the clocks are estimated again */
+    drift_estimator_reset (&engine->devices[n].drift);
+
+    state = snd_pcm_state (engine->devices[n].sound_card_handle);
+    if ( SND_PCM_STATE_SUSPENDED==state )
+    {
+      err = snd_pcm_recover (engine->devices[n].sound_card_handle, -ESTRPIPE,
+                             1);
+    }
+    else if ( SND_PCM_STATE_PREPARED!=state )
+    {
+      err = snd_pcm_prepare (engine->devices[n].sound_card_handle);
+    }
+
+    if ( S_SUCCESS>err )
+    {
+      printf ("pcm_engine Error: %s can't recover, Err = %d\n",
+              engine->devices[n].name, err);
+      return S_ERROR;
+    }
+  }
+
+  return fill_and_start (engine);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t pcm_engine_init (pcm_engine*)
+ *
+ * @brief Initialize an engine without devices
+ *
+ * @param[out] *engine  pointer to the engine
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t pcm_engine_init (pcm_engine *engine)
+{
+  if ( NULL==engine )
+  {
+    return S_ERROR;
+  }
+
+  memset (engine, 0, sizeof(*engine));
+
+  return event_loop_init (&engine->loop);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t pcm_engine_add_device (pcm_engine*, const char*,
+ *                                   hw_configuration*, mmap_render_callback,
+ *                                   void*)
+ *
+ * @brief Open and configure a device of the engine
+ *
+ * The first device added is the master of the linked group
+ *
+ * @param[in]     *engine     pointer to the engine
+ * @param[in]     *name       name of the PCM, e.g. hw:1,0
+ * @param[in,out] *hw_config  desired configuration, on return it has the
+ *                            negotiated values
+ * @param          render     callback to render the audio of the device
+ * @param[in]     *user_data  pointer given to the callback
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t pcm_engine_add_device (pcm_engine *engine, const char *name,
+                              hw_configuration *hw_config,
+                              mmap_render_callback render, void *user_data)
+{
+  engine_device *device;
+  snd_pcm_uframes_t period_size;
+  sw_configuration sw_config;
+  ssize_t buffer_bytes;
+  int err;
+
+  if ( (NULL==engine)||(NULL==name)||(NULL==hw_config)||(NULL==render)||
+       (ENGINE_MAX_DEVICES<=engine->num_devices)||
+       (MAX_CHANNELS<hw_config->num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  device = &engine->devices[engine->num_devices];
+  memset (device, 0, sizeof(*device));
+  strncpy (device->name, name, sizeof(device->name)-1u);
+  device->render = render;
+  device->user_data = user_data;
+  device->engine = engine;
+
+  /* don't open a device that the cache knows can't play the configuration */
+  if ( S_SUCCESS!=device_cache_fit (name, SND_PCM_STREAM_PLAYBACK, hw_config) )
+  {
+    return S_ERROR;
+  }
+
+  err = snd_pcm_open (&device->sound_card_handle, name,
+                      SND_PCM_STREAM_PLAYBACK, PCM_OPEN_NONBLOCK_MODE);
+  if ( S_SUCCESS>err )
+  {
+    printf ("pcm_engine_add_device Error: opening %s, Err = %d\n", name, err);
+    return S_ERROR;
+  }
+
+  if ( S_SUCCESS!=configure_hw (device->sound_card_handle, hw_config) )
+  {
+    snd_pcm_close (device->sound_card_handle);
+    return S_ERROR;
+  }
+  device->hw_config = *hw_config;
+
+  /* the engine decides when the devices start, see pcm_engine_start */
+  snd_pcm_get_params (device->sound_card_handle, &device->buffer_size,
+                      &period_size);
+  device->hw_config.period_size = period_size;
+  sw_config = (sw_configuration){ .avail_min = period_size,
+          .start_threshold = SW_BOUNDARY, .stop_threshold = SW_KEEP_DEFAULT,
+          .silence_threshold = 0u, .silence_size = 0u, .period_event = 0u,
+          .timestamps = 1u };
+  if ( S_SUCCESS!=configure_sw (device->sound_card_handle, &sw_config) )
+  {
+    snd_pcm_close (device->sound_card_handle);
+    return S_ERROR;
+  }
+  device->monotonic = (S_SUCCESS==set_monotonic_timestamps (
+      device->sound_card_handle)) ? 1u : 0u;
+
+  device->layout = get_channel_layout (hw_config->access_type);
+  device->use_mmap = ((SND_PCM_ACCESS_MMAP_INTERLEAVED==hw_config->access_type)
+      ||(SND_PCM_ACCESS_MMAP_NONINTERLEAVED==hw_config->access_type)) ? 1u : 0u;
+
+  if ( 0u==device->use_mmap )
+  {
+    buffer_bytes = snd_pcm_frames_to_bytes (device->sound_card_handle,
+                                            (snd_pcm_sframes_t)period_size);
+    device->buffer = (0<buffer_bytes) ? malloc ((size_t)buffer_bytes) : NULL;
+    if ( (NULL==device->buffer)||
+         (S_SUCCESS!=setup_channel_areas (device->areas, device->buffer,
+                                          period_size, hw_config->num_channels,
+                                          device->layout, hw_config->format)) )
+    {
+      printf ("pcm_engine_add_device Error: allocating buffer of %s\n", name);
+      free (device->buffer);
+      snd_pcm_close (device->sound_card_handle);
+      return S_ERROR;
+    }
+  }
+
+  engine->num_devices++;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t pcm_engine_enable_drift_compensation (pcm_engine*,
+ *                                                  resampler_quality)
+ *
+ * @brief Resample the slaves to follow the clock of the master
+ *
+ * Call it before @ref pcm_engine_start. The callbacks of the slaves render
+ * their content at the rate of the master, the engine resamples it to the
+ * rate of each slave adjusting the ratio to its clock, so the content of
+ * all the devices stays aligned without dropping or inserting frames. The
+ * formats must be supported by @ref convert_format_to_float
+ *
+ * @param[in] *engine   pointer to the engine
+ * @param      quality  quality of the resamplers
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t pcm_engine_enable_drift_compensation (pcm_engine *engine,
+                                             resampler_quality quality)
+{
+  if ( (NULL==engine)||(E_SRC_BEST<quality) )
+  {
+    return S_ERROR;
+  }
+
+  if ( (NULL==engine->status)&&
+       (S_SUCCESS>snd_pcm_status_malloc (&engine->status)) )
+  {
+    printf ("pcm_engine_enable_drift_compensation Error: allocating the "
+            "status\n");
+    return S_ERROR;
+  }
+  engine->src_quality = quality;
+  engine->drift_compensation = 1u;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t pcm_engine_start (pcm_engine*)
+ *
+ * @brief Link the devices, fill their buffers and start all of them
+ *
+ * @param[in] *engine  pointer to the engine
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t pcm_engine_start (pcm_engine *engine)
+{
+  snd_pcm_t *master;
+  int err;
+
+  if ( (NULL==engine)||(0u==engine->num_devices) )
+  {
+    return S_ERROR;
+  }
+
+  /** @b snd_pcm_link link the slaves to the master, starting/stopping the
+   * master starts/stops all of them at the same time */
+  master = engine->devices[0].sound_card_handle;
+  engine->linked = 1u;
+  engine->devices[0].linked = 1u;
+  for (uint32_t n = 1; n<engine->num_devices; n++)
+  {
+    err = snd_pcm_link (master, engine->devices[n].sound_card_handle);
+    engine->devices[n].linked = (S_SUCCESS==err) ? 1u : 0u;
+    if ( S_SUCCESS>err )
+    {
+      printf ("pcm_engine_start Warning: %s can't be linked, Err = %d\n",
+              engine->devices[n].name, err);
+      engine->linked = 0u;
+    }
+  }
+
+  /* the clocks can only be compared if all the timestamps are monotonic */
+  for (uint32_t n = 0; (0u!=engine->drift_compensation)&&
+                       (n<engine->num_devices); n++)
+  {
+    if ( 0u==engine->devices[n].monotonic )
+    {
+      printf ("pcm_engine_start Warning: %s has no monotonic timestamps, the "
+              "drift is not compensated\n", engine->devices[n].name);
+      engine->drift_compensation = 0u;
+    }
+  }
+
+  for (uint32_t n = 1; (0u!=engine->drift_compensation)&&
+                       (n<engine->num_devices); n++)
+  {
+    if ( S_SUCCESS!=setup_resampler (engine, &engine->devices[n]) )
+    {
+      printf ("pcm_engine_start Error: resampler of %s\n",
+              engine->devices[n].name);
+      return S_ERROR;
+    }
+  }
+
+  for (uint32_t n = 0; (0u!=engine->drift_compensation)&&
+                       (n<engine->num_devices); n++)
+  {
+    drift_estimator_init (&engine->devices[n].drift,
+                          engine->devices[n].hw_config.sample_rate,
+                          DRIFT_DEFAULT_BANDWIDTH);
+  }
+
+  if ( S_SUCCESS!=fill_and_start (engine) )
+  {
+    return S_ERROR;
+  }
+
+  for (uint32_t n = 0; n<engine->num_devices; n++)
+  {
+    if ( S_SUCCESS!=event_loop_add_pcm (&engine->loop,
+                                        engine->devices[n].sound_card_handle,
+                                        service_device, &engine->devices[n]) )
+    {
+      return S_ERROR;
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t pcm_engine_run (pcm_engine*, uint32_t)
+ *
+ * @brief Service all the devices for some time
+ *
+ * @param[in] *engine       pointer to the engine
+ * @param      duration_ms  time to run, 0 to run until a device fails or the
+ *                          loop is stopped with @ref event_loop_stop
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t pcm_engine_run (pcm_engine *engine, uint32_t duration_ms)
+{
+  uint64_t end;
+
+  if ( NULL==engine )
+  {
+    return S_ERROR;
+  }
+
+  end = pcm_stats_now_ns ()+(uint64_t)duration_ms*1000000u;
+  atomic_store (&engine->loop.running, 1u);
+  while ( atomic_load_explicit (&engine->loop.running, memory_order_relaxed) )
+  {
+    if ( (0u!=duration_ms)&&(pcm_stats_now_ns ()>=end) )
+    {
+      break;
+    }
+
+    if ( S_SUCCESS!=event_loop_run_once (&engine->loop,
+                                         ENGINE_POLL_TIMEOUT_MS) )
+    {
+      return S_ERROR;
+    }
+
+    if ( (0u!=engine->restart_pending)&&(S_SUCCESS!=restart_group (engine)) )
+    {
+      return S_ERROR;
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_engine_print_stats (pcm_engine*)
+ *
+ * @brief Print the timing statistics of each device
+ *
+ * @param[in] *engine  pointer to the engine
+ *
+ ******************************************************************************/
+void pcm_engine_print_stats (pcm_engine *engine)
+{
+  engine_device *device;
+
+  if ( NULL==engine )
+  {
+    return;
+  }
+
+  printf ("device, frames, wakeups, xruns, avg_service_us, max_service_us, "
+          "max_interval_us, max_avail\n");
+  for (uint32_t n = 0; n<engine->num_devices; n++)
+  {
+    device = &engine->devices[n];
+    printf ("%s, %llu, %llu, %llu, %.1f, %.1f, %.1f, %lu/%lu\n", device->name,
+            (unsigned long long)device->stats.frames_written,
+            (unsigned long long)device->stats.wakeups,
+            (unsigned long long)device->stats.xruns,
+            (0u!=device->stats.wakeups) ?
+                device->stats.total_service_ns/1000.0/device->stats.wakeups :
+                0.0,
+            device->stats.max_service_ns/1000.0,
+            device->stats.max_wakeup_interval_ns/1000.0,
+            (unsigned long)device->stats.max_avail,
+            (unsigned long)device->buffer_size);
+  }
+
+  if ( 0u==engine->drift_compensation )
+  {
+    return;
+  }
+
+  printf ("device, drift_ppm, src_ratio, align_error_frames\n");
+  for (uint32_t n = 0; n<engine->num_devices; n++)
+  {
+    device = &engine->devices[n];
+    printf ("%s, %.2f, %.6f, %.2f\n", device->name, device->stats.drift_ppm,
+            (0u!=device->resampled) ? device->stats.src_ratio : 1.0,
+            device->stats.align_error);
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_engine_close (pcm_engine*)
+ *
+ * @brief Stop and close all the devices of the engine
+ *
+ * @param[in] *engine  pointer to the engine
+ *
+ ******************************************************************************/
+void pcm_engine_close (pcm_engine *engine)
+{
+  if ( NULL==engine )
+  {
+    return;
+  }
+
+  for (uint32_t n = 0; n<engine->num_devices; n++)
+  {
+    snd_pcm_drop (engine->devices[n].sound_card_handle);
+    if ( 0u<n )
+    {
+      snd_pcm_unlink (engine->devices[n].sound_card_handle);
+    }
+    snd_pcm_close (engine->devices[n].sound_card_handle);
+    free (engine->devices[n].buffer);
+    engine->devices[n].buffer = NULL;
+    if ( 0u!=engine->devices[n].resampled )
+    {
+      resampler_destroy (&engine->devices[n].src);
+      engine->devices[n].resampled = 0u;
+    }
+    free (engine->devices[n].content_buffer);
+    free (engine->devices[n].src_in[0]);
+    free (engine->devices[n].src_out[0]);
+    engine->devices[n].content_buffer = NULL;
+    engine->devices[n].src_in[0] = NULL;
+    engine->devices[n].src_out[0] = NULL;
+  }
+  engine->num_devices = 0u;
+
+  if ( NULL!=engine->status )
+  {
+    snd_pcm_status_free (engine->status);
+    engine->status = NULL;
+  }
+}
+/*-------------- END OF FILE -------------------------------------------------*/
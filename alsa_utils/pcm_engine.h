@@ -0,0 +1,157 @@
+/*******************************************************************************
+ * @file      pcm_engine.h
+ *
+ * @brief      Engine driving several PCM devices from one thread
+ *
+ * Engine that opens a list of devices, each one with its own
+ * @ref hw_configuration, links them with @a snd_pcm_link so they start at the
+ * same time and services all of them from a single @ref pcm_event_loop.
+ *
+ * For each device the engine keeps timing statistics (wakeups, service time,
+ * fill level, xruns) so the devices that are close to underrun can be found.
+ *
+ * The devices are rendered with a @ref mmap_render_callback:
+ *      @li MMAP access: the callback renders directly in the ring buffer
+ *      @li RW access: the callback renders in a buffer of the engine which is
+ *          written with @a snd_pcm_writei / @a snd_pcm_writen
+ *
+ * Linked devices start together but each one runs with its own crystal, the
+ * content drifts apart some ppm per second. With
+ * @ref pcm_engine_enable_drift_compensation the clock of each device is
+ * estimated from the timestamps of @a snd_pcm_status and the content of the
+ * slaves is resampled to follow the master, see @ref clock_drift.h
+ *
+ * @note Link using -lasound and -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include "alsa_utils.h"
+#include "clock_drift.h"
+#include "pcm_event_loop.h"
+#include "resampler.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _PCM_ENGINE_
+#define _PCM_ENGINE_
+
+#define ENGINE_MAX_DEVICES      (EVENT_LOOP_MAX_PCMS) /**< devices handled by
+                                                           one engine */
+#define ENGINE_POLL_TIMEOUT_MS  (100) /**< maximum wait without events */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Timing statistics of a device, the times are in nanoseconds */
+typedef struct
+{
+  uint64_t frames_written; /**< frames given to the device */
+  uint64_t wakeups; /**< times the device was serviced */
+  uint64_t xruns; /**< recoveries of the device */
+  uint64_t total_service_ns; /**< time spent rendering and writing */
+  uint64_t max_service_ns; /**< longest service */
+  uint64_t max_wakeup_interval_ns; /**< longest time between services */
+  uint64_t last_wakeup_ns; /**< time of the last service */
+  snd_pcm_uframes_t max_avail; /**< most free frames seen at a wakeup, close
+   to the buffer size means close to underrun */
+  double drift_ppm; /**< deviation of the clock from its nominal rate */
+  double src_ratio; /**< last adjust of the resampler of a slave */
+  double align_error; /**< last content frames a slave was ahead of the
+   master (negative if behind) */
+} engine_device_stats;
+
+struct pcm_engine;
+
+/** Device of the engine */
+typedef struct
+{
+  struct pcm_engine *engine; /**< engine that owns the device */
+  char name[64]; /**< name of the PCM, e.g. hw:1,0 */
+  snd_pcm_t *sound_card_handle; /**< handle of the PCM */
+  hw_configuration hw_config; /**< negotiated configuration */
+  snd_pcm_uframes_t buffer_size; /**< negotiated buffer size */
+  uint8_t use_mmap; /**< 1 if the access type is MMAP */
+  uint8_t linked; /**< 1 if the device is in the group of the master */
+  channel_layout layout; /**< layout of the buffers */
+  void *buffer; /**< render buffer for the RW access (one period) */
+  snd_pcm_channel_area_t areas[MAX_CHANNELS]; /**< areas of @a buffer */
+  mmap_render_callback render; /**< renders the audio of the device */
+  void *user_data; /**< pointer given to the callback */
+  uint8_t monotonic; /**< 1 if the timestamps are taken from
+   CLOCK_MONOTONIC */
+  drift_estimator drift; /**< estimation of the clock of the device */
+  uint8_t resampled; /**< 1 if the content goes through @a src */
+  resampler src; /**< follows the clock of the master, see
+   @ref pcm_engine_enable_drift_compensation */
+  mmap_render_callback src_render; /**< callback of the user, renders the
+   content at the rate of the master */
+  void *src_user_data; /**< pointer given to @a src_render */
+  void *content_buffer; /**< content rendered by @a src_render */
+  snd_pcm_channel_area_t content_areas[MAX_CHANNELS]; /**< areas of
+   @a content_buffer */
+  float *src_in[MAX_CHANNELS]; /**< content converted to float */
+  float *src_out[MAX_CHANNELS]; /**< output of the resampler */
+  uint64_t content_frames; /**< content frames given to @a src */
+  engine_device_stats stats; /**< timing statistics */
+} engine_device;
+
+/** Engine with all its devices */
+typedef struct pcm_engine
+{
+  engine_device devices[ENGINE_MAX_DEVICES]; /**< devices, the first one is
+   the master of the linked group */
+  uint32_t num_devices; /**< number of devices */
+  uint8_t linked; /**< 1 if all the devices were linked to the master */
+  uint8_t restart_pending; /**< set when a linked device stopped, an xrun
+   stops the whole group so all of them are restarted together */
+  uint8_t drift_compensation; /**< 1 to resample the slaves to the clock
+   of the master */
+  resampler_quality src_quality; /**< quality of the resamplers */
+  snd_pcm_status_t *status; /**< status read on each service */
+  pcm_event_loop loop; /**< loop servicing all the devices */
+} pcm_engine;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t pcm_engine_init (pcm_engine *engine);
+int8_t pcm_engine_add_device (pcm_engine *engine, const char *name,
+                              hw_configuration *hw_config,
+                              mmap_render_callback render, void *user_data);
+int8_t pcm_engine_enable_drift_compensation (pcm_engine *engine,
+                                             resampler_quality quality);
+int8_t pcm_engine_start (pcm_engine *engine);
+int8_t pcm_engine_run (pcm_engine *engine, uint32_t duration_ms);
+void pcm_engine_print_stats (pcm_engine *engine);
+void pcm_engine_close (pcm_engine *engine);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,303 @@
+/*******************************************************************************
+ * @file      pcm_event_loop.c
+ *
+ * @brief      Poll based event loop for PCM handles and file descriptors
+ *
+ * Event loop to service many non blocking PCM handles and other file
+ * descriptors from a single thread, see @ref pcm_event_loop.
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <errno.h>
+#include <string.h>
+#include "pcm_event_loop.h"
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t event_loop_init (pcm_event_loop*)
+ *
+ * @brief Initialize an empty event loop
+ *
+ * @param[out] *loop  pointer to the event loop
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t event_loop_init (pcm_event_loop *loop)
+{
+  if ( NULL==loop )
+  {
+    return S_ERROR;
+  }
+
+  memset (loop, 0, sizeof(*loop));
+  atomic_init (&loop->running, 0u);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t event_loop_add_pcm (pcm_event_loop*, snd_pcm_t*,
+ *                                pcm_ready_callback, void*)
+ *
+ * @brief Register a PCM in the event loop
+ *
+ * The PCM should be opened with @ref PCM_OPEN_NONBLOCK_MODE (or set with
+ * @a snd_pcm_nonblock), otherwise the callbacks could block the whole loop
+ *
+ * @param[in] *loop               pointer to the event loop
+ * @param[in] *sound_card_handle  handle of the PCM
+ * @param      callback           called when the PCM is ready
+ * @param[in] *user_data          pointer given to the callback
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t event_loop_add_pcm (pcm_event_loop *loop, snd_pcm_t *sound_card_handle,
+                           pcm_ready_callback callback, void *user_data)
+{
+  int count;
+  event_loop_pcm *pcm;
+
+  if ( (NULL==loop)||(NULL==sound_card_handle)||(NULL==callback)||
+       (EVENT_LOOP_MAX_PCMS<=loop->num_pcms) )
+  {
+    return S_ERROR;
+  }
+
+  /** @b snd_pcm_poll_descriptors_count number of fds used by the PCM */
+  count = snd_pcm_poll_descriptors_count (sound_card_handle);
+  if ( (0>=count)||(EVENT_LOOP_MAX_FDS<loop->num_fds+(uint32_t)count) )
+  {
+    printf ("event_loop_add_pcm Error: invalid number of fds = %d\n", count);
+    return S_ERROR;
+  }
+
+  count = snd_pcm_poll_descriptors (sound_card_handle,
+                                    &loop->fds[loop->num_fds],
+                                    (unsigned int)count);
+  if ( 0>=count )
+  {
+    printf ("event_loop_add_pcm Error: getting poll descriptors, Err = %d\n",
+            count);
+    return S_ERROR;
+  }
+
+  pcm = &loop->pcms[loop->num_pcms];
+  pcm->sound_card_handle = sound_card_handle;
+  pcm->callback = callback;
+  pcm->user_data = user_data;
+  pcm->first_fd = loop->num_fds;
+  pcm->num_fds = (uint32_t)count;
+
+  loop->num_fds += (uint32_t)count;
+  loop->num_pcms++;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t event_loop_add_fd (pcm_event_loop*, int, short,
+ *                               fd_ready_callback, void*)
+ *
+ * @brief Register a file descriptor (e.g. a socket) in the event loop
+ *
+ * @param[in] *loop       pointer to the event loop
+ * @param      fd         file descriptor
+ * @param      events     poll events to wait for (POLLIN, POLLOUT, ...)
+ * @param      callback   called when the fd is ready
+ * @param[in] *user_data  pointer given to the callback
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t event_loop_add_fd (pcm_event_loop *loop, int fd, short events,
+                          fd_ready_callback callback, void *user_data)
+{
+  event_loop_other *other;
+
+  if ( (NULL==loop)||(0>fd)||(NULL==callback)||
+       (EVENT_LOOP_MAX_OTHERS<=loop->num_others)||
+       (EVENT_LOOP_MAX_FDS<=loop->num_fds) )
+  {
+    return S_ERROR;
+  }
+
+  loop->fds[loop->num_fds].fd = fd;
+  loop->fds[loop->num_fds].events = events;
+  loop->fds[loop->num_fds].revents = 0;
+
+  other = &loop->others[loop->num_others];
+  other->callback = callback;
+  other->user_data = user_data;
+  other->fd_index = loop->num_fds;
+
+  loop->num_fds++;
+  loop->num_others++;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t event_loop_run_once (pcm_event_loop*, int)
+ *
+ * @brief Wait for events and call the callbacks of the ready PCMs and fds
+ *
+ * @param[in] *loop        pointer to the event loop
+ * @param      timeout_ms  maximum time to wait, -1 to wait forever
+ *
+ * @return int8_t @a S_SUCCESS in case of success (or timeout), @a S_ERROR
+ *         if poll or any of the callbacks failed
+ *
+ ******************************************************************************/
+int8_t event_loop_run_once (pcm_event_loop *loop, int timeout_ms)
+{
+  int err;
+  unsigned short revents;
+  event_loop_pcm *pcm;
+  event_loop_other *other;
+
+  if ( NULL==loop )
+  {
+    return S_ERROR;
+  }
+
+  err = poll (loop->fds, loop->num_fds, timeout_ms);
+  if ( 0>err )
+  {
+    return (EINTR==errno) ? S_SUCCESS : S_ERROR;
+  }
+  if ( 0==err )
+  {
+    return S_SUCCESS;
+  }
+
+  for (uint32_t n = 0; n<loop->num_pcms; n++)
+  {
+    pcm = &loop->pcms[n];
+
+    /** @b snd_pcm_poll_descriptors_revents translate the events of the fds
+     * of the PCM to POLLOUT/POLLIN/POLLERR */
+    err = snd_pcm_poll_descriptors_revents (pcm->sound_card_handle,
+                                            &loop->fds[pcm->first_fd],
+                                            pcm->num_fds, &revents);
+    if ( S_SUCCESS>err )
+    {
+      printf ("event_loop_run_once Error: getting revents, Err = %d\n", err);
+      return S_ERROR;
+    }
+
+    if ( 0u!=(revents&(POLLOUT|POLLIN|POLLERR)) )
+    {
+      if ( S_SUCCESS!=pcm->callback (pcm->sound_card_handle, revents,
+                                     pcm->user_data) )
+      {
+        return S_ERROR;
+      }
+    }
+  }
+
+  for (uint32_t n = 0; n<loop->num_others; n++)
+  {
+    other = &loop->others[n];
+    if ( 0!=loop->fds[other->fd_index].revents )
+    {
+      if ( S_SUCCESS!=other->callback (loop->fds[other->fd_index].fd,
+                                       loop->fds[other->fd_index].revents,
+                                       other->user_data) )
+      {
+        return S_ERROR;
+      }
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t event_loop_run (pcm_event_loop*, int)
+ *
+ * @brief Run the event loop until @ref event_loop_stop is called or a
+ *        callback fails
+ *
+ * @param[in] *loop        pointer to the event loop
+ * @param      timeout_ms  maximum time of each wait, this is how often the
+ *                         stop request is checked when there are no events
+ *
+ * @return int8_t @a S_SUCCESS when stopped, @a S_ERROR on failure
+ *
+ ******************************************************************************/
+int8_t event_loop_run (pcm_event_loop *loop, int timeout_ms)
+{
+  if ( NULL==loop )
+  {
+    return S_ERROR;
+  }
+
+  atomic_store (&loop->running, 1u);
+  while ( atomic_load_explicit (&loop->running, memory_order_relaxed) )
+  {
+    if ( S_SUCCESS!=event_loop_run_once (loop, timeout_ms) )
+    {
+      atomic_store (&loop->running, 0u);
+      return S_ERROR;
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void event_loop_stop (pcm_event_loop*)
+ *
+ * @brief Request the loop to stop, it can be called from a callback or from
+ *        another thread
+ *
+ * @param[in] *loop  pointer to the event loop
+ *
+ ******************************************************************************/
+void event_loop_stop (pcm_event_loop *loop)
+{
+  if ( NULL!=loop )
+  {
+    atomic_store (&loop->running, 0u);
+  }
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,129 @@
+/*******************************************************************************
+ * @file      pcm_event_loop.h
+ *
+ * @brief      Poll based event loop for PCM handles and file descriptors
+ *
+ * Event loop to service many PCM handles opened in non blocking mode
+ * (@ref PCM_OPEN_NONBLOCK_MODE) together with other file descriptors (e.g.
+ * control sockets) from a single thread:
+ *      @li the poll descriptors of each PCM are taken with
+ *          @a snd_pcm_poll_descriptors and the events are translated with
+ *          @a snd_pcm_poll_descriptors_revents (a PCM can use several fds, or
+ *          fds that don't map directly to POLLOUT/POLLIN, e.g. plugins)
+ *      @li the callback of a PCM is called when it can be written (playback)
+ *          or read (capture), or when there is an error to recover
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _PCM_EVENT_LOOP_
+#define _PCM_EVENT_LOOP_
+
+#define EVENT_LOOP_MAX_FDS      (256u) /**< poll descriptors of all the PCMs
+                                            and file descriptors */
+#define EVENT_LOOP_MAX_PCMS     (64u) /**< PCM handles in one loop */
+#define EVENT_LOOP_MAX_OTHERS   (64u) /**< other file descriptors in one loop */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Callback called when a PCM is ready
+ *
+ * @param[in] *sound_card_handle  handle of the PCM
+ * @param      revents            events returned by
+ *                                @a snd_pcm_poll_descriptors_revents
+ * @param[in] *user_data          pointer given to @ref event_loop_add_pcm
+ *
+ * @return int8_t @a S_SUCCESS to continue, @a S_ERROR to stop the loop */
+typedef int8_t (*pcm_ready_callback) (snd_pcm_t *sound_card_handle,
+                                      unsigned short revents,
+                                      void *user_data);
+
+/** Callback called when a file descriptor is ready
+ *
+ * @param      fd         file descriptor
+ * @param      revents    events returned by poll
+ * @param[in] *user_data  pointer given to @ref event_loop_add_fd
+ *
+ * @return int8_t @a S_SUCCESS to continue, @a S_ERROR to stop the loop */
+typedef int8_t (*fd_ready_callback) (int fd, short revents, void *user_data);
+
+/** PCM registered in the loop */
+typedef struct
+{
+  snd_pcm_t *sound_card_handle; /**< handle of the PCM */
+  pcm_ready_callback callback; /**< called when the PCM is ready */
+  void *user_data; /**< pointer given to the callback */
+  uint32_t first_fd; /**< first poll descriptor of the PCM */
+  uint32_t num_fds; /**< number of poll descriptors of the PCM */
+} event_loop_pcm;
+
+/** File descriptor registered in the loop */
+typedef struct
+{
+  fd_ready_callback callback; /**< called when the fd is ready */
+  void *user_data; /**< pointer given to the callback */
+  uint32_t fd_index; /**< index of the descriptor in the poll array */
+} event_loop_other;
+
+/** Event loop, all the memory is inside the structure */
+typedef struct
+{
+  struct pollfd fds[EVENT_LOOP_MAX_FDS]; /**< array given to poll */
+  uint32_t num_fds; /**< used entries of fds */
+  event_loop_pcm pcms[EVENT_LOOP_MAX_PCMS]; /**< registered PCMs */
+  uint32_t num_pcms; /**< number of registered PCMs */
+  event_loop_other others[EVENT_LOOP_MAX_OTHERS]; /**< registered fds */
+  uint32_t num_others; /**< number of registered fds */
+  atomic_uint running; /**< cleared by @ref event_loop_stop */
+} pcm_event_loop;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t event_loop_init (pcm_event_loop *loop);
+int8_t event_loop_add_pcm (pcm_event_loop *loop, snd_pcm_t *sound_card_handle,
+                           pcm_ready_callback callback, void *user_data);
+int8_t event_loop_add_fd (pcm_event_loop *loop, int fd, short events,
+                          fd_ready_callback callback, void *user_data);
+int8_t event_loop_run_once (pcm_event_loop *loop, int timeout_ms);
+int8_t event_loop_run (pcm_event_loop *loop, int timeout_ms);
+void event_loop_stop (pcm_event_loop *loop);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,350 @@
+/*******************************************************************************
+ * @file      pcm_recovery.c
+ *
+ * @brief      Recovery of a playback stream after xruns and suspends
+ *
+ * Recovery of a playback stream after an xrun or a suspend, see
+ * @ref pcm_recovery.
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pcm_recovery.h"
+#include "rt_log.h"
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t render_silence (const snd_pcm_channel_area_t*,
+ *                            snd_pcm_uframes_t, snd_pcm_uframes_t, void*)
+ *
+ * @brief @ref mmap_render_callback filling the areas with silence
+ *
+ ******************************************************************************/
+static int8_t render_silence (const snd_pcm_channel_area_t *areas,
+                              snd_pcm_uframes_t offset,
+                              snd_pcm_uframes_t frames, void *user_data)
+{
+  pcm_recovery *recovery = (pcm_recovery*)user_data;
+
+  return (S_SUCCESS>snd_pcm_areas_silence (areas, offset,
+                                           recovery->num_channels, frames,
+                                           recovery->format)) ?
+      S_ERROR : S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t pcm_recovery_refill (pcm_recovery*)
+ *
+ * @brief Write the refill in the prepared stream
+ *
+ ******************************************************************************/
+static int8_t pcm_recovery_refill (pcm_recovery *recovery)
+{
+  snd_pcm_sframes_t written;
+
+  if ( 0u==recovery->refill_frames )
+  {
+    return S_SUCCESS;
+  }
+
+  if ( 0u!=recovery->mmap )
+  {
+    written = mmap_write_available (
+        recovery->sound_card_handle, recovery->refill_frames,
+        (NULL!=recovery->render) ? recovery->render : render_silence,
+        (NULL!=recovery->render) ? recovery->user_data : recovery);
+  }
+  else
+  {
+    /* refill_buffer keeps the silence written in init when there is no
+     * render callback */
+    if ( (NULL!=recovery->render)&&
+         (S_SUCCESS!=recovery->render (recovery->areas, 0u,
+                                       recovery->refill_frames,
+                                       recovery->user_data)) )
+    {
+      return S_ERROR;
+    }
+    if ( E_LAYOUT_PLANAR==recovery->layout )
+    {
+      written = snd_pcm_writen (recovery->sound_card_handle,
+                                recovery->channels, recovery->refill_frames);
+    }
+    else
+    {
+      written = snd_pcm_writei (recovery->sound_card_handle,
+                                recovery->refill_buffer,
+                                recovery->refill_frames);
+    }
+  }
+
+  if ( 0>written )
+  {
+    rt_log_printf ("pcm_recovery Error: writing the refill, Err = %ld\n",
+                   (long)written);
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t pcm_recovery_init (pcm_recovery*, snd_pcm_t*,
+ *                               const hw_configuration*, snd_pcm_uframes_t,
+ *                               mmap_render_callback, void*)
+ *
+ * @brief Prepare the recovery of a configured playback stream
+ *
+ * The refill is limited to the buffer minus one period, so the period
+ * retried by the caller after the recovery always fits. With the start
+ * threshold at the buffer size (like @a basic_pcm_playback) a refill of
+ * buffer - period restarts the stream with the whole buffer queued.
+ *
+ * @param[out] *recovery           pointer to the recovery state
+ * @param[in]  *sound_card_handle  handle of the configured sound card
+ * @param[in]  *hw_config          configuration of the sound card
+ * @param       refill_frames      frames written after preparing the stream,
+ *                                 0 to restart with just the caller's data
+ * @param       render             renders the refill (in the areas of the
+ *                                 ring buffer or of an internal buffer for
+ *                                 the RW access types), NULL to use silence
+ * @param[in]  *user_data          pointer given to the render callback
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t pcm_recovery_init (pcm_recovery *recovery,
+                          snd_pcm_t *sound_card_handle,
+                          const hw_configuration *hw_config,
+                          snd_pcm_uframes_t refill_frames,
+                          mmap_render_callback render, void *user_data)
+{
+  snd_pcm_uframes_t buffer_size;
+  snd_pcm_uframes_t period_size;
+  ssize_t frame_bytes;
+
+  if ( (NULL==recovery)||(NULL==sound_card_handle)||(NULL==hw_config)||
+       (MAX_CHANNELS<hw_config->num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  memset (recovery, 0, sizeof(*recovery));
+  recovery->sound_card_handle = sound_card_handle;
+  recovery->format = hw_config->format;
+  recovery->num_channels = hw_config->num_channels;
+  recovery->layout = get_channel_layout (hw_config->access_type);
+  recovery->mmap = ( (SND_PCM_ACCESS_MMAP_INTERLEAVED==hw_config->access_type)||
+      (SND_PCM_ACCESS_MMAP_NONINTERLEAVED==hw_config->access_type) ) ? 1u : 0u;
+  recovery->render = render;
+  recovery->user_data = user_data;
+  recovery->recovery_ns.min = UINT64_MAX;
+
+  if ( S_SUCCESS>snd_pcm_get_params (sound_card_handle, &buffer_size,
+                                     &period_size) )
+  {
+    return S_ERROR;
+  }
+  if ( refill_frames>buffer_size-period_size )
+  {
+    refill_frames = buffer_size-period_size;
+  }
+  recovery->refill_frames = refill_frames;
+
+  /* the MMAP refill is rendered directly in the ring buffer */
+  if ( (0u!=recovery->mmap)||(0u==refill_frames) )
+  {
+    return S_SUCCESS;
+  }
+
+  frame_bytes = snd_pcm_format_size (hw_config->format,
+                                     hw_config->num_channels);
+  if ( 0>=frame_bytes )
+  {
+    return S_ERROR;
+  }
+
+  recovery->refill_buffer = malloc ((size_t)frame_bytes*refill_frames);
+  if ( (NULL==recovery->refill_buffer)||
+       (S_SUCCESS!=setup_channel_areas (recovery->areas,
+                                        recovery->refill_buffer,
+                                        refill_frames,
+                                        hw_config->num_channels,
+                                        recovery->layout, hw_config->format)) )
+  {
+    free (recovery->refill_buffer);
+    recovery->refill_buffer = NULL;
+    return S_ERROR;
+  }
+  for (uint32_t ch = 0u; ch<hw_config->num_channels; ch++)
+  {
+    recovery->channels[ch] = mmap_area_address (&recovery->areas[ch], 0u);
+  }
+  snd_pcm_areas_silence (recovery->areas, 0u, hw_config->num_channels,
+                         refill_frames, hw_config->format);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t pcm_recovery_recover (pcm_recovery*, int)
+ *
+ * @brief Recover the stream after a failed write
+ *
+ * After a successful recovery the caller should write again the period that
+ * failed, it wasn't played
+ *
+ * @param[in,out] *recovery  pointer to the recovery state
+ * @param          err       negative error returned by the write
+ *
+ * @return int8_t @a S_SUCCESS when the stream can be written again,
+ *         @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t pcm_recovery_recover (pcm_recovery *recovery, int err)
+{
+  int result;
+  uint64_t elapsed_ns;
+  uint64_t start_ns = pcm_stats_now_ns ();
+  struct timespec wait = { .tv_sec = 0, .tv_nsec =
+      (long)RECOVERY_RESUME_WAIT_US*1000 };
+
+  if ( -EPIPE==err )
+  {
+    recovery->xruns++;
+    result = snd_pcm_prepare (recovery->sound_card_handle);
+  }
+  else if ( -ESTRPIPE==err )
+  {
+    recovery->suspends++;
+
+    /** @b snd_pcm_resume returns -EAGAIN until the system is awake, if the
+     * device can't resume the stream is restarted with a refill */
+    result = snd_pcm_resume (recovery->sound_card_handle);
+    for (uint32_t tries = 1u; (-EAGAIN==result)&&(RECOVERY_RESUME_TRIES>tries);
+        tries++)
+    {
+      nanosleep (&wait, NULL);
+      result = snd_pcm_resume (recovery->sound_card_handle);
+    }
+    if ( S_SUCCESS<=result )
+    {
+      recovery->resumes++;
+      elapsed_ns = pcm_stats_now_ns ()-start_ns;
+      pcm_stats_histogram_add (&recovery->recovery_ns, elapsed_ns);
+      rt_log_printf ("pcm_recovery Warning: resumed in %llu us\n",
+                     (unsigned long long)(elapsed_ns/1000u));
+      return S_SUCCESS;
+    }
+    result = snd_pcm_prepare (recovery->sound_card_handle);
+  }
+  else
+  {
+    recovery->failed_recoveries++;
+    rt_log_printf ("pcm_recovery Error: can't recover from %s\n",
+                   snd_strerror (err));
+    return S_ERROR;
+  }
+
+  if ( (S_SUCCESS>result)||(S_SUCCESS!=pcm_recovery_refill (recovery)) )
+  {
+    recovery->failed_recoveries++;
+    rt_log_printf ("pcm_recovery Error: preparing the stream, Err = %d\n",
+                   result);
+    return S_ERROR;
+  }
+
+  elapsed_ns = pcm_stats_now_ns ()-start_ns;
+  pcm_stats_histogram_add (&recovery->recovery_ns, elapsed_ns);
+  rt_log_printf ("pcm_recovery Warning: %s recovered in %llu us\n",
+                 (-EPIPE==err) ? "underrun" : "suspend",
+                 (unsigned long long)(elapsed_ns/1000u));
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_recovery_print (const pcm_recovery*)
+ *
+ * @brief Print the counters and the recovery times
+ *
+ * @param[in] *recovery  pointer to the recovery state
+ *
+ ******************************************************************************/
+void pcm_recovery_print (const pcm_recovery *recovery)
+{
+  const stats_histogram *times = &recovery->recovery_ns;
+
+  printf ("Recoveries: xruns = %llu, suspends = %llu (resumed %llu), "
+          "failed = %llu\n", (unsigned long long)recovery->xruns,
+          (unsigned long long)recovery->suspends,
+          (unsigned long long)recovery->resumes,
+          (unsigned long long)recovery->failed_recoveries);
+  if ( 0u!=times->count )
+  {
+    printf ("Recovery time: min = %llu us, avg = %llu us, max = %llu us\n",
+            (unsigned long long)(times->min/1000u),
+            (unsigned long long)(times->sum/times->count/1000u),
+            (unsigned long long)(times->max/1000u));
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_recovery_destroy (pcm_recovery*)
+ *
+ * @brief Release the refill buffer, the sound card is not closed
+ *
+ * @param[in,out] *recovery  pointer to the recovery state
+ *
+ ******************************************************************************/
+void pcm_recovery_destroy (pcm_recovery *recovery)
+{
+  if ( NULL==recovery )
+  {
+    return;
+  }
+
+  free (recovery->refill_buffer);
+  recovery->refill_buffer = NULL;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
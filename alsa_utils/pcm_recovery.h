@@ -0,0 +1,101 @@
+/*******************************************************************************
+ * @file      pcm_recovery.h
+ *
+ * @brief      Recovery of a playback stream after xruns and suspends
+ *
+ * Recovery of a playback stream after an xrun or a suspend, replacement of
+ * @a snd_pcm_recover for the audio loops:
+ *      @li -EPIPE (underrun) the stream is prepared again and a refill of
+ *          silence, or fresh audio from a render callback, is written before
+ *          the caller retries its period, so the stream restarts with margin
+ *          instead of running out again right after the first period
+ *      @li -ESTRPIPE (suspend) @a snd_pcm_resume is tried while the system
+ *          wakes up, the buffer is kept when it works, otherwise the stream is
+ *          prepared and refilled like after an underrun
+ *      @li the time spent in each recovery is recorded in a histogram and the
+ *          messages go through @ref rt_log_printf, so nothing in the recovery
+ *          path does I/O when a @ref rt_log is active
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include "alsa_utils.h"
+#include "pcm_stats.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _PCM_RECOVERY_
+#define _PCM_RECOVERY_
+
+#define RECOVERY_RESUME_TRIES   (100u) /**< calls to snd_pcm_resume while it
+                                            returns -EAGAIN */
+#define RECOVERY_RESUME_WAIT_US (10000u) /**< wait between the calls */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Recovery state of a playback stream */
+typedef struct
+{
+  snd_pcm_t *sound_card_handle; /**< handle of the sound card */
+  snd_pcm_format_t format; /**< format of the samples */
+  uint32_t num_channels; /**< channels of the stream */
+  channel_layout layout; /**< layout of the buffers */
+  uint8_t mmap; /**< 1 with the MMAP access types */
+  snd_pcm_uframes_t refill_frames; /**< frames written after preparing */
+  mmap_render_callback render; /**< renders the refill, NULL for silence */
+  void *user_data; /**< pointer given to the render callback */
+  void *refill_buffer; /**< refill of the RW access types */
+  snd_pcm_channel_area_t areas[MAX_CHANNELS]; /**< areas of refill_buffer */
+  void *channels[MAX_CHANNELS]; /**< channels of refill_buffer, for
+   snd_pcm_writen */
+  uint64_t xruns; /**< underruns recovered */
+  uint64_t suspends; /**< suspends recovered */
+  uint64_t resumes; /**< suspends that kept the buffer */
+  uint64_t failed_recoveries; /**< errors that couldn't be recovered */
+  stats_histogram recovery_ns; /**< time spent in each recovery */
+} pcm_recovery;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t pcm_recovery_init (pcm_recovery *recovery,
+                          snd_pcm_t *sound_card_handle,
+                          const hw_configuration *hw_config,
+                          snd_pcm_uframes_t refill_frames,
+                          mmap_render_callback render, void *user_data);
+int8_t pcm_recovery_recover (pcm_recovery *recovery, int err);
+void pcm_recovery_print (const pcm_recovery *recovery);
+void pcm_recovery_destroy (pcm_recovery *recovery);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,392 @@
+/*******************************************************************************
+ * @file      pcm_stats.c
+ *
+ * @brief      Xrun and latency instrumentation of a playback stream
+ *
+ * Counters and histograms of a playback stream published with a sequence
+ * lock, see @ref pcm_stats_snapshot.
+ *
+ * The usual sequence in the thread writing to the sound card is:
+ *      @li render the period, then @ref pcm_stats_render_done
+ *      @li start = @ref pcm_stats_now_ns, write the period, then
+ *          @ref pcm_stats_write_done
+ *      @li @ref pcm_stats_recovery if the write failed
+ *      @li @ref pcm_stats_publish
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "pcm_stats.h"
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t pcm_stats_init (pcm_stats*, uint32_t)
+ *
+ * @brief Initialize the statistics of a stream
+ *
+ * @param[out] *stats        statistics to initialize
+ * @param       sample_rate  rate of the stream
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t pcm_stats_init (pcm_stats *stats, uint32_t sample_rate)
+{
+  if ( (NULL==stats)||(0u==sample_rate) )
+  {
+    return S_ERROR;
+  }
+
+  memset (stats, 0, sizeof(*stats));
+  atomic_init (&stats->sequence, 0u);
+  stats->sample_rate = sample_rate;
+  stats->working.write_ns.min = UINT64_MAX;
+  stats->working.delay_frames.min = UINT64_MAX;
+  stats->working.avail_frames.min = UINT64_MAX;
+  stats->working.wakeup_interval_ns.min = UINT64_MAX;
+  stats->working.headroom_ns.min = UINT64_MAX;
+  stats->published = stats->working;
+
+  if ( S_SUCCESS>snd_pcm_status_malloc (&stats->status) )
+  {
+    printf ("pcm_stats_init Error: allocating the status\n");
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_stats_destroy (pcm_stats*)
+ *
+ * @brief Free the resources of the statistics
+ *
+ ******************************************************************************/
+void pcm_stats_destroy (pcm_stats *stats)
+{
+  if ( (NULL!=stats)&&(NULL!=stats->status) )
+  {
+    snd_pcm_status_free (stats->status);
+    stats->status = NULL;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn uint64_t pcm_stats_now_ns (void)
+ *
+ * @brief Get the monotonic time in nanoseconds
+ *
+ ******************************************************************************/
+uint64_t pcm_stats_now_ns (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec*1000000000u+(uint64_t)now.tv_nsec;
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_stats_histogram_add (stats_histogram*, uint64_t)
+ *
+ * @brief Record a value in a histogram
+ *
+ * @param[in,out] *histogram  histogram to update
+ * @param          value      value to record
+ *
+ ******************************************************************************/
+void pcm_stats_histogram_add (stats_histogram *histogram, uint64_t value)
+{
+  uint32_t bucket = 0u;
+
+  if ( 0u!=value )
+  {
+    bucket = 63u-(uint32_t)__builtin_clzll (value);
+  }
+  if ( STATS_HISTOGRAM_BUCKETS<=bucket )
+  {
+    bucket = STATS_HISTOGRAM_BUCKETS-1u;
+  }
+
+  histogram->buckets[bucket]++;
+  histogram->count++;
+  histogram->sum += value;
+  if ( value<histogram->min )
+  {
+    histogram->min = value;
+  }
+  if ( value>histogram->max )
+  {
+    histogram->max = value;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_stats_render_done (pcm_stats*, snd_pcm_t*)
+ *
+ * @brief Record the headroom left when a period has been rendered
+ *
+ * The headroom is the time the device can keep playing with the frames
+ * already queued, if it reaches 0 before the write there is an underrun.
+ * Nothing is recorded while the stream is not running.
+ *
+ * @param[in,out] *stats   statistics of the stream
+ * @param[in]     *handle  handle of the PCM
+ *
+ ******************************************************************************/
+void pcm_stats_render_done (pcm_stats *stats, snd_pcm_t *handle)
+{
+  snd_pcm_sframes_t delay;
+
+  if ( (SND_PCM_STATE_RUNNING!=snd_pcm_state (handle))||
+       (S_SUCCESS>snd_pcm_delay (handle, &delay)) )
+  {
+    return;
+  }
+
+  if ( 0>delay )
+  {
+    delay = 0;
+  }
+  pcm_stats_histogram_add (&stats->working.headroom_ns,
+                           ((uint64_t)delay*1000000000u)/stats->sample_rate);
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_stats_write_done (pcm_stats*, snd_pcm_t*, uint64_t,
+ *                                snd_pcm_sframes_t)
+ *
+ * @brief Record a write to the sound card
+ *
+ * Records the wall time of the write and reads the status of the stream to
+ * get the delay, the free frames and the time of the last update of the
+ * hardware pointer (one per period wakeup)
+ *
+ * @param[in,out] *stats     statistics of the stream
+ * @param[in]     *handle    handle of the PCM
+ * @param          start_ns  @ref pcm_stats_now_ns before the write
+ * @param          written   value returned by the write
+ *
+ ******************************************************************************/
+void pcm_stats_write_done (pcm_stats *stats, snd_pcm_t *handle,
+                           uint64_t start_ns, snd_pcm_sframes_t written)
+{
+  pcm_stats_data *data = &stats->working;
+  stats_trajectory_point *point;
+  snd_htimestamp_t tstamp;
+  uint64_t now = pcm_stats_now_ns ();
+  uint64_t tstamp_ns;
+  snd_pcm_sframes_t delay;
+  snd_pcm_sframes_t avail;
+
+  data->writes++;
+  pcm_stats_histogram_add (&data->write_ns, now-start_ns);
+  if ( -EPIPE==written )
+  {
+    data->xruns++;
+  }
+  else if ( -ESTRPIPE==written )
+  {
+    data->suspends++;
+  }
+
+  if ( S_SUCCESS>snd_pcm_status (handle, stats->status) )
+  {
+    return;
+  }
+
+  delay = snd_pcm_status_get_delay (stats->status);
+  avail = (snd_pcm_sframes_t)snd_pcm_status_get_avail (stats->status);
+  pcm_stats_histogram_add (&data->delay_frames,
+                           (0<delay) ? (uint64_t)delay : 0u);
+  pcm_stats_histogram_add (&data->avail_frames, (uint64_t)avail);
+
+  point = &data->trajectory[data->trajectory_count&
+                            (STATS_TRAJECTORY_SIZE-1u)];
+  point->timestamp_ns = now;
+  point->delay = delay;
+  point->avail = avail;
+  data->trajectory_count++;
+
+  /* the timestamp changes only when the driver updates the pointer */
+  snd_pcm_status_get_htstamp (stats->status, &tstamp);
+  tstamp_ns = (uint64_t)tstamp.tv_sec*1000000000u+(uint64_t)tstamp.tv_nsec;
+  if ( (SND_PCM_STATE_RUNNING==snd_pcm_status_get_state (stats->status))&&
+       (tstamp_ns!=stats->last_hw_tstamp_ns) )
+  {
+    if ( (0u!=stats->last_hw_tstamp_ns)&&(tstamp_ns>stats->last_hw_tstamp_ns) )
+    {
+      pcm_stats_histogram_add (&data->wakeup_interval_ns,
+                               tstamp_ns-stats->last_hw_tstamp_ns);
+    }
+    stats->last_hw_tstamp_ns = tstamp_ns;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_stats_recovery (pcm_stats*, int)
+ *
+ * @brief Record the result of snd_pcm_recover
+ *
+ * @param[in,out] *stats           statistics of the stream
+ * @param          recover_result  value returned by snd_pcm_recover
+ *
+ ******************************************************************************/
+void pcm_stats_recovery (pcm_stats *stats, int recover_result)
+{
+  if ( S_SUCCESS>recover_result )
+  {
+    stats->working.failed_recoveries++;
+  }
+  else
+  {
+    stats->working.recoveries++;
+  }
+
+  /* the timestamps restart with the stream */
+  stats->last_hw_tstamp_ns = 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_stats_publish (pcm_stats*)
+ *
+ * @brief Make the current statistics visible to @ref pcm_stats_snapshot
+ *
+ * Only the writer calls this function, the sequence is odd while the copy
+ * is being made
+ *
+ * @param[in,out] *stats  statistics of the stream
+ *
+ ******************************************************************************/
+void pcm_stats_publish (pcm_stats *stats)
+{
+  unsigned int sequence = atomic_load_explicit (&stats->sequence,
+                                                memory_order_relaxed);
+
+  atomic_store_explicit (&stats->sequence, sequence+1u, memory_order_relaxed);
+  atomic_thread_fence (memory_order_release);
+  memcpy (&stats->published, &stats->working, sizeof(stats->published));
+  atomic_store_explicit (&stats->sequence, sequence+2u, memory_order_release);
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_stats_snapshot (pcm_stats*, pcm_stats_data*)
+ *
+ * @brief Get a consistent copy of the last published statistics
+ *
+ * Can be called from any thread, the copy is repeated if the writer
+ * published in the meantime
+ *
+ * @param[in]  *stats     statistics of the stream
+ * @param[out] *snapshot  copy of the statistics
+ *
+ ******************************************************************************/
+void pcm_stats_snapshot (pcm_stats *stats, pcm_stats_data *snapshot)
+{
+  unsigned int before;
+  unsigned int after;
+
+  do
+  {
+    before = atomic_load_explicit (&stats->sequence, memory_order_acquire);
+    memcpy (snapshot, &stats->published, sizeof(*snapshot));
+    atomic_thread_fence (memory_order_acquire);
+    after = atomic_load_explicit (&stats->sequence, memory_order_relaxed);
+  }
+  while ( (0u!=(before&1u))||(before!=after) );
+}
+
+/******************************************************************************
+ *
+ * @fn void print_histogram (const char*, const stats_histogram*)
+ *
+ * @brief Print the summary and the non empty buckets of a histogram
+ *
+ ******************************************************************************/
+static void print_histogram (const char *name, const stats_histogram *histogram)
+{
+  if ( 0u==histogram->count )
+  {
+    printf ("%s: no samples\n", name);
+    return;
+  }
+
+  printf ("%s: count = %llu, min = %llu, avg = %llu, max = %llu\n", name,
+          (unsigned long long)histogram->count,
+          (unsigned long long)histogram->min,
+          (unsigned long long)(histogram->sum/histogram->count),
+          (unsigned long long)histogram->max);
+  for (uint32_t n = 0; n<STATS_HISTOGRAM_BUCKETS; n++)
+  {
+    if ( 0u!=histogram->buckets[n] )
+    {
+      printf ("  [2^%u, 2^%u): %llu\n", n, n+1u,
+              (unsigned long long)histogram->buckets[n]);
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void pcm_stats_print (const pcm_stats_data*)
+ *
+ * @brief Print a snapshot of the statistics
+ *
+ ******************************************************************************/
+void pcm_stats_print (const pcm_stats_data *snapshot)
+{
+  printf ("writes = %llu, xruns = %llu, suspends = %llu, recoveries = %llu, "
+          "failed recoveries = %llu\n", (unsigned long long)snapshot->writes,
+          (unsigned long long)snapshot->xruns,
+          (unsigned long long)snapshot->suspends,
+          (unsigned long long)snapshot->recoveries,
+          (unsigned long long)snapshot->failed_recoveries);
+  print_histogram ("write time (ns)", &snapshot->write_ns);
+  print_histogram ("delay (frames)", &snapshot->delay_frames);
+  print_histogram ("avail (frames)", &snapshot->avail_frames);
+  print_histogram ("wakeup interval (ns)", &snapshot->wakeup_interval_ns);
+  print_histogram ("headroom (ns)", &snapshot->headroom_ns);
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,135 @@
+/*******************************************************************************
+ * @file      pcm_stats.h
+ *
+ * @brief      Xrun and latency instrumentation of a playback stream
+ *
+ * Counters and histograms of a playback stream:
+ *      @li xruns, suspends and recoveries
+ *      @li wall time of each write to the sound card
+ *      @li @a snd_pcm_delay and @a snd_pcm_avail trajectory
+ *      @li interval between period wakeups, from the @a snd_pcm_status
+ *          timestamps
+ *      @li headroom between the end of the render and the time the device
+ *          would run out of samples
+ *
+ * The statistics are updated only by the thread writing to the sound card,
+ * other threads read them with @ref pcm_stats_snapshot. The writer publishes
+ * a copy with a sequence lock, so it never waits for the readers and the
+ * readers retry if they read while the writer was publishing.
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdatomic.h>
+#include <alsa/asoundlib.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _PCM_STATS_
+#define _PCM_STATS_
+
+#define STATS_HISTOGRAM_BUCKETS (32u) /**< bucket n counts the values in
+                                           [2^n, 2^(n+1)), bucket 0 also
+                                           counts 0 */
+#define STATS_TRAJECTORY_SIZE   (256u) /**< last delay/avail samples kept,
+                                           power of 2 */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Histogram with power of 2 buckets */
+typedef struct
+{
+  uint64_t count; /**< values recorded */
+  uint64_t sum; /**< sum of the values, to get the average */
+  uint64_t min; /**< smallest value */
+  uint64_t max; /**< biggest value */
+  uint64_t buckets[STATS_HISTOGRAM_BUCKETS]; /**< distribution */
+} stats_histogram;
+
+/** Sample of the delay/avail trajectory */
+typedef struct
+{
+  uint64_t timestamp_ns; /**< monotonic time of the sample */
+  snd_pcm_sframes_t delay; /**< frames until a new sample is played */
+  snd_pcm_sframes_t avail; /**< free frames in the buffer */
+} stats_trajectory_point;
+
+/** Statistics of the stream, times in nanoseconds */
+typedef struct
+{
+  uint64_t writes; /**< writes to the sound card */
+  uint64_t xruns; /**< underruns (-EPIPE) */
+  uint64_t suspends; /**< suspends (-ESTRPIPE) */
+  uint64_t recoveries; /**< successful calls to snd_pcm_recover */
+  uint64_t failed_recoveries; /**< the stream couldn't be recovered */
+  stats_histogram write_ns; /**< wall time of each write */
+  stats_histogram delay_frames; /**< snd_pcm_delay after each write */
+  stats_histogram avail_frames; /**< snd_pcm_avail after each write */
+  stats_histogram wakeup_interval_ns; /**< time between the updates of the
+   hardware pointer reported by snd_pcm_status */
+  stats_histogram headroom_ns; /**< time left at the end of the render
+   before the device runs out of samples */
+  uint64_t trajectory_count; /**< samples written in @a trajectory, the
+   oldest one is trajectory_count&(STATS_TRAJECTORY_SIZE-1) when full */
+  stats_trajectory_point trajectory[STATS_TRAJECTORY_SIZE]; /**< last
+   delay/avail samples */
+} pcm_stats_data;
+
+/** Instrumentation of a stream */
+typedef struct
+{
+  atomic_uint sequence; /**< odd while the writer publishes */
+  pcm_stats_data published; /**< copy read by @ref pcm_stats_snapshot */
+  pcm_stats_data working; /**< updated by the writer */
+  uint32_t sample_rate; /**< used to convert frames to time */
+  snd_pcm_status_t *status; /**< status of the stream */
+  uint64_t last_hw_tstamp_ns; /**< last hardware pointer update */
+} pcm_stats;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t pcm_stats_init (pcm_stats *stats, uint32_t sample_rate);
+void pcm_stats_destroy (pcm_stats *stats);
+uint64_t pcm_stats_now_ns (void);
+void pcm_stats_histogram_add (stats_histogram *histogram, uint64_t value);
+void pcm_stats_render_done (pcm_stats *stats, snd_pcm_t *handle);
+void pcm_stats_write_done (pcm_stats *stats, snd_pcm_t *handle,
+                           uint64_t start_ns, snd_pcm_sframes_t written);
+void pcm_stats_recovery (pcm_stats *stats, int recover_result);
+void pcm_stats_publish (pcm_stats *stats);
+void pcm_stats_snapshot (pcm_stats *stats, pcm_stats_data *snapshot);
+void pcm_stats_print (const pcm_stats_data *snapshot);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,495 @@
+/*******************************************************************************
+ * @file      playback_pipeline.c
+ *
+ * @brief      Producer/consumer playback pipeline
+ *
+ * Playback split in a producer thread and an I/O thread connected by a
+ * @ref spsc_ring, see @ref playback_pipeline.
+ *
+ * The ring itself is lock-free, the only blocking points are:
+ *      @li the I/O thread blocks in @a snd_pcm_writei, paced by the sound card
+ *      @li with the ring empty, the I/O thread sleeps a quarter of a period
+ *          between the checks, until the sound card gets down to one period
+ *      @li the producer sleeps in a semaphore when the ring is full, the I/O
+ *          thread posts it after releasing each block (sem_post never blocks)
+ *
+ * @note Link using -lasound -lpthread
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <errno.h>
+#include <time.h>
+#include "playback_pipeline.h"
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t write_block (playback_pipeline*, void*)
+ *
+ * @brief Write a full block to the sound card, recovering from xruns
+ *
+ * @param[in] *pipeline  pointer to the pipeline
+ * @param[in] *block     block to write
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+static int8_t write_block (playback_pipeline *pipeline, void *block)
+{
+  void *channels[MAX_CHANNELS];
+  snd_pcm_uframes_t offset = 0;
+  snd_pcm_sframes_t written;
+  size_t channel_bytes = pipeline->period_size*pipeline->sample_bytes;
+
+  while ( offset<pipeline->period_size )
+  {
+    if ( E_LAYOUT_PLANAR==pipeline->layout )
+    {
+      for (uint32_t ch = 0; ch<pipeline->num_channels; ch++)
+      {
+        channels[ch] = (uint8_t*)block+ch*channel_bytes+
+            offset*pipeline->sample_bytes;
+      }
+      written = snd_pcm_writen (pipeline->sound_card_handle, channels,
+                                pipeline->period_size-offset);
+    }
+    else
+    {
+      written = snd_pcm_writei (
+          pipeline->sound_card_handle,
+          (uint8_t*)block+offset*pipeline->sample_bytes*pipeline->num_channels,
+          pipeline->period_size-offset);
+    }
+
+    if ( 0>written )
+    {
+      atomic_fetch_add_explicit (&pipeline->xruns, 1u, memory_order_relaxed);
+      if ( 0>snd_pcm_recover (pipeline->sound_card_handle, (int)written, 1) )
+      {
+        return S_ERROR;
+      }
+      continue;
+    }
+    offset += (snd_pcm_uframes_t)written;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn uint8_t wait_producer (playback_pipeline*)
+ *
+ * @brief With the ring empty, wait for the producer while the sound card has
+ *        more than a period queued
+ *
+ * @param[in] *pipeline  pointer to the pipeline
+ *
+ * @return uint8_t 1 to look at the ring again, 0 if the silence has to be
+ *         written now
+ *
+ ******************************************************************************/
+static uint8_t wait_producer (playback_pipeline *pipeline)
+{
+  struct timespec wait = { .tv_sec = 0, .tv_nsec = pipeline->empty_wait_ns };
+  snd_pcm_sframes_t avail;
+
+  /** @b snd_pcm_avail syncs the hardware pointer, the frames queued are the
+   * buffer minus the free ones. An xrun is recovered by the write of the
+   * silence */
+  avail = snd_pcm_avail (pipeline->sound_card_handle);
+  if ( (0>avail)||
+       ((snd_pcm_uframes_t)avail+pipeline->period_size>=pipeline->buffer_size) )
+  {
+    return 0u;
+  }
+
+  nanosleep (&wait, NULL);
+
+  return 1u;
+}
+
+/******************************************************************************
+ *
+ * @fn void* io_thread (void*)
+ *
+ * @brief Thread feeding the sound card with the blocks of the ring
+ *
+ * @param[in] *arg  pointer to the pipeline
+ *
+ * @return void* NULL
+ *
+ ******************************************************************************/
+static void* io_thread (void *arg)
+{
+  playback_pipeline *pipeline = (playback_pipeline*)arg;
+  void *block;
+  uint64_t played = 0;
+
+  if ( NULL!=pipeline->io_rt_config )
+  {
+    configure_rt_thread (pipeline->io_rt_config);
+  }
+
+  while ( atomic_load_explicit (&pipeline->running, memory_order_acquire) )
+  {
+    if ( (0u!=pipeline->total_periods)&&(played>=pipeline->total_periods) )
+    {
+      break;
+    }
+
+    block = spsc_ring_read_block (&pipeline->ring);
+    if ( (NULL==block)&&(0u!=wait_producer (pipeline)) )
+    {
+      continue;
+    }
+    if ( NULL==block )
+    {
+      /* the producer is late, keep the sound card running with silence */
+      atomic_fetch_add_explicit (&pipeline->pipeline_underruns, 1u,
+                                 memory_order_relaxed);
+      if ( S_SUCCESS!=write_block (pipeline, pipeline->silence) )
+      {
+        atomic_store (&pipeline->error, S_ERROR);
+        break;
+      }
+      continue;
+    }
+
+    if ( S_SUCCESS!=write_block (pipeline, block) )
+    {
+      atomic_store (&pipeline->error, S_ERROR);
+      break;
+    }
+    spsc_ring_release_read (&pipeline->ring);
+    sem_post (&pipeline->free_blocks);
+
+    played++;
+    atomic_store_explicit (&pipeline->periods_played, played,
+                           memory_order_relaxed);
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn void* producer_thread (void*)
+ *
+ * @brief Thread rendering the audio in the free blocks of the ring
+ *
+ * @param[in] *arg  pointer to the pipeline
+ *
+ * @return void* NULL
+ *
+ ******************************************************************************/
+static void* producer_thread (void *arg)
+{
+  playback_pipeline *pipeline = (playback_pipeline*)arg;
+  void *block;
+  uint64_t rendered = pipeline->ring.num_blocks; /* prefilled in start */
+
+  if ( NULL!=pipeline->producer_rt_config )
+  {
+    configure_rt_thread (pipeline->producer_rt_config);
+  }
+
+  while ( atomic_load_explicit (&pipeline->running, memory_order_acquire) )
+  {
+    if ( (0u!=pipeline->total_periods)&&(rendered>=pipeline->total_periods) )
+    {
+      break;
+    }
+
+    if ( 0!=sem_wait (&pipeline->free_blocks) )
+    {
+      /* interrupted by a signal */
+      continue;
+    }
+
+    block = spsc_ring_write_block (&pipeline->ring);
+    if ( NULL==block )
+    {
+      /* woken up by playback_pipeline_stop */
+      continue;
+    }
+
+    if ( S_SUCCESS!=pipeline->render (block, pipeline->period_size,
+                                      pipeline->user_data) )
+    {
+      atomic_store (&pipeline->error, S_ERROR);
+      atomic_store (&pipeline->running, 0u);
+      break;
+    }
+    spsc_ring_commit_write (&pipeline->ring);
+    rendered++;
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t playback_pipeline_init (playback_pipeline*, snd_pcm_t*,
+ *                                    hw_configuration*, uint32_t,
+ *                                    pipeline_render_callback, void*)
+ *
+ * @brief Create a pipeline for a configured sound card
+ *
+ * All the memory is allocated here, nothing is allocated while streaming
+ *
+ * @param[out] *pipeline            pointer to the pipeline
+ * @param[in]  *sound_card_handle   sound card configured with
+ *                                  @ref configure_hw (RW access)
+ * @param[in]  *hw_config           configuration returned by
+ *                                  @ref configure_hw
+ * @param       num_blocks          number of periods in the ring (power of 2)
+ * @param       render              callback used to render each period
+ * @param[in]  *user_data           pointer given to the callback
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t playback_pipeline_init (playback_pipeline *pipeline,
+                               snd_pcm_t *sound_card_handle,
+                               hw_configuration *hw_config,
+                               uint32_t num_blocks,
+                               pipeline_render_callback render,
+                               void *user_data)
+{
+  int width;
+  size_t block_bytes;
+  snd_pcm_uframes_t buffer_size;
+  snd_pcm_uframes_t period_size;
+
+  if ( (NULL==pipeline)||(NULL==sound_card_handle)||(NULL==hw_config)||
+       (NULL==render)||(MAX_CHANNELS<hw_config->num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  width = snd_pcm_format_physical_width (hw_config->format);
+  if ( 0>=width )
+  {
+    printf ("playback_pipeline_init Error: unsupported format\n");
+    return S_ERROR;
+  }
+  if ( (0u==hw_config->sample_rate)||
+       (S_SUCCESS>snd_pcm_get_params (sound_card_handle, &buffer_size,
+                                      &period_size)) )
+  {
+    printf ("playback_pipeline_init Error: reading the buffer size\n");
+    return S_ERROR;
+  }
+
+  pipeline->sound_card_handle = sound_card_handle;
+  pipeline->period_size = hw_config->period_size;
+  pipeline->buffer_size = buffer_size;
+  pipeline->empty_wait_ns = (long)((uint64_t)pipeline->period_size*
+      1000000000u/(4u*hw_config->sample_rate));
+  pipeline->num_channels = hw_config->num_channels;
+  pipeline->sample_bytes = (size_t)width/8u;
+  pipeline->layout = get_channel_layout (hw_config->access_type);
+  pipeline->render = render;
+  pipeline->user_data = user_data;
+  pipeline->total_periods = 0u;
+  pipeline->io_rt_config = NULL;
+  pipeline->producer_rt_config = NULL;
+
+  block_bytes = pipeline->period_size*pipeline->num_channels*
+      pipeline->sample_bytes;
+  if ( S_SUCCESS!=spsc_ring_init (&pipeline->ring, num_blocks, block_bytes) )
+  {
+    printf ("playback_pipeline_init Error: creating the ring\n");
+    return S_ERROR;
+  }
+
+  pipeline->silence = malloc (block_bytes);
+  if ( NULL==pipeline->silence )
+  {
+    spsc_ring_destroy (&pipeline->ring);
+    return S_ERROR;
+  }
+  snd_pcm_format_set_silence (
+      hw_config->format, pipeline->silence,
+      (unsigned int)(pipeline->period_size*pipeline->num_channels));
+
+  if ( 0!=sem_init (&pipeline->free_blocks, 0, 0u) )
+  {
+    free (pipeline->silence);
+    spsc_ring_destroy (&pipeline->ring);
+    return S_ERROR;
+  }
+
+  atomic_init (&pipeline->running, 0u);
+  atomic_init (&pipeline->periods_played, 0u);
+  atomic_init (&pipeline->pipeline_underruns, 0u);
+  atomic_init (&pipeline->xruns, 0u);
+  atomic_init (&pipeline->error, S_SUCCESS);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t playback_pipeline_start (playback_pipeline*, uint64_t)
+ *
+ * @brief Fill the ring and start the producer and I/O threads
+ *
+ * The whole ring is rendered before starting, so the I/O thread starts with
+ * the maximum headroom
+ *
+ * @param[in] *pipeline       pointer to the pipeline
+ * @param      total_periods  number of periods to play, 0 to play until
+ *                            @ref playback_pipeline_stop is called
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t playback_pipeline_start (playback_pipeline *pipeline,
+                                uint64_t total_periods)
+{
+  void *block;
+
+  if ( NULL==pipeline )
+  {
+    return S_ERROR;
+  }
+
+  pipeline->total_periods = total_periods;
+  for (uint32_t n = 0; n<pipeline->ring.num_blocks; n++)
+  {
+    block = spsc_ring_write_block (&pipeline->ring);
+    if ( (NULL==block)||
+         (S_SUCCESS!=pipeline->render (block, pipeline->period_size,
+                                       pipeline->user_data)) )
+    {
+      printf ("playback_pipeline_start Error: rendering first periods\n");
+      return S_ERROR;
+    }
+    spsc_ring_commit_write (&pipeline->ring);
+  }
+
+  atomic_store (&pipeline->running, 1u);
+  if ( 0!=pthread_create (&pipeline->io_thread, NULL, io_thread, pipeline) )
+  {
+    atomic_store (&pipeline->running, 0u);
+    printf ("playback_pipeline_start Error: creating I/O thread\n");
+    return S_ERROR;
+  }
+
+  if ( 0!=pthread_create (&pipeline->producer_thread, NULL, producer_thread,
+                          pipeline) )
+  {
+    atomic_store (&pipeline->running, 0u);
+    pthread_join (pipeline->io_thread, NULL);
+    printf ("playback_pipeline_start Error: creating producer thread\n");
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t playback_pipeline_wait (playback_pipeline*)
+ *
+ * @brief Wait until all the periods were played, see
+ *        @ref playback_pipeline_start
+ *
+ * @param[in] *pipeline  pointer to the pipeline
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if any of the
+ *         threads failed
+ *
+ ******************************************************************************/
+int8_t playback_pipeline_wait (playback_pipeline *pipeline)
+{
+  if ( NULL==pipeline )
+  {
+    return S_ERROR;
+  }
+
+  pthread_join (pipeline->io_thread, NULL);
+
+  /* the producer could be sleeping in the semaphore */
+  atomic_store (&pipeline->running, 0u);
+  sem_post (&pipeline->free_blocks);
+  pthread_join (pipeline->producer_thread, NULL);
+
+  return (int8_t)atomic_load (&pipeline->error);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t playback_pipeline_stop (playback_pipeline*)
+ *
+ * @brief Stop both threads without waiting for the pending periods
+ *
+ * @param[in] *pipeline  pointer to the pipeline
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if any of the
+ *         threads failed
+ *
+ ******************************************************************************/
+int8_t playback_pipeline_stop (playback_pipeline *pipeline)
+{
+  if ( NULL==pipeline )
+  {
+    return S_ERROR;
+  }
+
+  atomic_store (&pipeline->running, 0u);
+
+  return playback_pipeline_wait (pipeline);
+}
+
+/******************************************************************************
+ *
+ * @fn void playback_pipeline_destroy (playback_pipeline*)
+ *
+ * @brief Free the memory of the pipeline, the threads must be stopped
+ *
+ * @param[in] *pipeline  pointer to the pipeline
+ *
+ ******************************************************************************/
+void playback_pipeline_destroy (playback_pipeline *pipeline)
+{
+  if ( NULL!=pipeline )
+  {
+    sem_destroy (&pipeline->free_blocks);
+    free (pipeline->silence);
+    pipeline->silence = NULL;
+    spsc_ring_destroy (&pipeline->ring);
+  }
+}
+/*-------------- END OF FILE -------------------------------------------------*/
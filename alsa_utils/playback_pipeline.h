@@ -0,0 +1,131 @@
+/*******************************************************************************
+ * @file      playback_pipeline.h
+ *
+ * @brief      Producer/consumer playback pipeline
+ *
+ * Playback split in two threads connected by a @ref spsc_ring of period
+ * sized blocks:
+ *      @li producer thread: renders the audio with a callback in the free
+ *          blocks of the ring, the time used to render doesn't affect the
+ *          sound card as long as the ring doesn't get empty
+ *      @li I/O thread: takes the blocks from the ring and gives them to the
+ *          sound card with @a snd_pcm_writei / @a snd_pcm_writen
+ *
+ * If the ring is empty the I/O thread waits while the sound card still has
+ * more than a period queued, the producer can still make it. When only a
+ * period is left it sends a period of silence instead of letting the sound
+ * card underrun (counted as a pipeline underrun).
+ *
+ * @note Link using -lasound -lpthread
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "alsa_utils.h"
+#include "spsc_ring.h"
+#include "rt_setup.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _PLAYBACK_PIPELINE_
+#define _PLAYBACK_PIPELINE_
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Callback used by the producer thread to render a period
+ *
+ * @param[out] *block      block to fill, in the layout and format configured
+ *                         in the sound card (in planar mode the channels are
+ *                         consecutive: ch0 frames, ch1 frames, ...)
+ * @param       frames     number of frames to render
+ * @param[in]  *user_data  pointer given to @ref playback_pipeline_init
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR to stop */
+typedef int8_t (*pipeline_render_callback) (void *block,
+                                            snd_pcm_uframes_t frames,
+                                            void *user_data);
+
+/** Playback pipeline */
+typedef struct
+{
+  snd_pcm_t *sound_card_handle; /**< sound card fed by the I/O thread */
+  snd_pcm_uframes_t period_size; /**< frames of each block */
+  snd_pcm_uframes_t buffer_size; /**< frames of the buffer of the sound card */
+  long empty_wait_ns; /**< sleep between the checks of an empty ring, a
+   quarter of a period */
+  uint32_t num_channels; /**< number of channels of the stream */
+  size_t sample_bytes; /**< bytes of each sample */
+  channel_layout layout; /**< layout of the blocks (writei or writen) */
+  spsc_ring ring; /**< blocks shared between the threads */
+  void *silence; /**< block of silence used when the ring is empty */
+
+  pipeline_render_callback render; /**< callback of the producer */
+  void *user_data; /**< pointer given to the callback */
+
+  const rt_configuration *io_rt_config; /**< real time setup of the I/O
+   thread, NULL by default, it can be set before starting the pipeline */
+  const rt_configuration *producer_rt_config; /**< real time setup of the
+   producer thread, NULL by default */
+
+  pthread_t producer_thread; /**< renders the blocks */
+  pthread_t io_thread; /**< writes the blocks to the sound card */
+  sem_t free_blocks; /**< posted by the I/O thread for each released block,
+   the producer sleeps here when the ring is full */
+  atomic_uint running; /**< cleared to stop both threads */
+  uint64_t total_periods; /**< periods to play, 0 to play until stopped */
+
+  atomic_uint_fast64_t periods_played; /**< blocks given to the sound card */
+  atomic_uint_fast64_t pipeline_underruns; /**< silence periods sent
+   because the producer was late */
+  atomic_uint_fast64_t xruns; /**< recoveries of the sound card */
+  atomic_int error; /**< @a S_ERROR if any of the threads failed */
+} playback_pipeline;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t playback_pipeline_init (playback_pipeline *pipeline,
+                               snd_pcm_t *sound_card_handle,
+                               hw_configuration *hw_config,
+                               uint32_t num_blocks,
+                               pipeline_render_callback render,
+                               void *user_data);
+int8_t playback_pipeline_start (playback_pipeline *pipeline,
+                                uint64_t total_periods);
+int8_t playback_pipeline_wait (playback_pipeline *pipeline);
+int8_t playback_pipeline_stop (playback_pipeline *pipeline);
+void playback_pipeline_destroy (playback_pipeline *pipeline);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
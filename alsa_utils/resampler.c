@@ -0,0 +1,673 @@
+/*******************************************************************************
+ * @file      resampler.c
+ *
+ * @brief      Polyphase sample rate converter for planar float buffers
+ *
+ * The output @a n is at the input position @f$ n \cdot in/out @f$, the
+ * integer part selects the first of the inputs used and the fraction the two
+ * nearest phases of the table. The phase @a p is the filter delayed by
+ * @f$ p/phases @f$ of a sample, the table has one phase more than the
+ * fractions so the last interpolation doesn't wrap.
+ *
+ * The lines keep the inputs not consumed, they start with half the filter of
+ * zeros so the first output is aligned with the first input.
+ *
+ * @note Link using -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "resampler.h"
+
+#if defined(__x86_64__)||defined(__i386__)
+#include <immintrin.h>
+#define RESAMPLER_HAVE_X86      (1u) /**< SSE2/AVX2 kernels available */
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RESAMPLER_HAVE_NEON     (1u) /**< NEON kernels available */
+#endif
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define RESAMPLER_ALIGNMENT     (64u) /**< alignment of the phases */
+#define FRACTION_BITS           (32u) /**< fractional bits of the position */
+
+/*------------------------------------------------------------------------------
+ * Module Typedefs
+ ------------------------------------------------------------------------------*/
+/** Design of a quality preset */
+typedef struct
+{
+  uint32_t num_taps; /**< taps of each phase */
+  uint32_t phase_bits; /**< log2 of the phases */
+  double beta; /**< Kaiser window parameter */
+  double passband; /**< cutoff relative to the lowest Nyquist frequency */
+} resampler_preset;
+
+/*------------------------------------------------------------------------------
+ * Module Variable Definitions
+ ------------------------------------------------------------------------------*/
+static const resampler_preset presets[] = {
+  [E_SRC_FAST] = { .num_taps = 16u, .phase_bits = 5u, .beta = 5.0,
+      .passband = 0.80 },
+  [E_SRC_MEDIUM] = { .num_taps = 32u, .phase_bits = 7u, .beta = 7.5,
+      .passband = 0.88 },
+  [E_SRC_BEST] = { .num_taps = RESAMPLER_MAX_TAPS, .phase_bits = 8u,
+      .beta = 9.5, .passband = 0.92 } };
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn double bessel_i0 (double)
+ *
+ * @brief Modified Bessel function of order 0, used by the Kaiser window
+ *
+ ******************************************************************************/
+static double bessel_i0 (double x)
+{
+  double sum = 1.0;
+  double term = 1.0;
+
+  for (uint32_t k = 1; k<64u; k++)
+  {
+    term *= (x/(2.0*k))*(x/(2.0*k));
+    sum += term;
+    if ( term<sum*1e-12 )
+    {
+      break;
+    }
+  }
+
+  return sum;
+}
+
+/*------------------------------------------------------------------------------
+ * Scalar kernel
+ ------------------------------------------------------------------------------*/
+static float scalar_kernel (const float *in, const float *phase0,
+                            const float *phase1, float frac, uint32_t taps)
+{
+  float d0 = 0.0f;
+  float d1 = 0.0f;
+
+  for (uint32_t k = 0; k<taps; k++)
+  {
+    d0 = d0+in[k]*phase0[k];
+    d1 = d1+in[k]*phase1[k];
+  }
+
+  return d0+frac*(d1-d0);
+}
+
+#ifdef RESAMPLER_HAVE_X86
+/*------------------------------------------------------------------------------
+ * SSE2 kernel, the inputs are not aligned, the phases are
+ ------------------------------------------------------------------------------*/
+static float sse2_kernel (const float *in, const float *phase0,
+                          const float *phase1, float frac, uint32_t taps)
+{
+  __m128 d0 = _mm_setzero_ps ();
+  __m128 d1 = _mm_setzero_ps ();
+  __m128 x;
+  float sums[4];
+
+  for (uint32_t k = 0; k<taps; k += 4u)
+  {
+    x = _mm_loadu_ps (&in[k]);
+    d0 = _mm_add_ps (d0, _mm_mul_ps (x, _mm_load_ps (&phase0[k])));
+    d1 = _mm_add_ps (d1, _mm_mul_ps (x, _mm_load_ps (&phase1[k])));
+  }
+  d0 = _mm_add_ps (d0, _mm_mul_ps (_mm_set1_ps (frac), _mm_sub_ps (d1, d0)));
+  _mm_storeu_ps (sums, d0);
+
+  return (sums[0]+sums[1])+(sums[2]+sums[3]);
+}
+
+/*------------------------------------------------------------------------------
+ * AVX2 kernel
+ ------------------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static float avx2_kernel (const float *in, const float *phase0,
+                          const float *phase1, float frac, uint32_t taps)
+{
+  __m256 d0 = _mm256_setzero_ps ();
+  __m256 d1 = _mm256_setzero_ps ();
+  __m256 x;
+  __m128 sum;
+
+  for (uint32_t k = 0; k<taps; k += 8u)
+  {
+    x = _mm256_loadu_ps (&in[k]);
+    d0 = _mm256_add_ps (d0, _mm256_mul_ps (x, _mm256_load_ps (&phase0[k])));
+    d1 = _mm256_add_ps (d1, _mm256_mul_ps (x, _mm256_load_ps (&phase1[k])));
+  }
+  d0 = _mm256_add_ps (d0, _mm256_mul_ps (_mm256_set1_ps (frac),
+                                         _mm256_sub_ps (d1, d0)));
+  sum = _mm_add_ps (_mm256_castps256_ps128 (d0),
+                    _mm256_extractf128_ps (d0, 1));
+  sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+  sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, 1));
+
+  return _mm_cvtss_f32 (sum);
+}
+#endif
+
+#ifdef RESAMPLER_HAVE_NEON
+/*------------------------------------------------------------------------------
+ * NEON kernel
+ ------------------------------------------------------------------------------*/
+static float neon_kernel (const float *in, const float *phase0,
+                          const float *phase1, float frac, uint32_t taps)
+{
+  float32x4_t d0 = vdupq_n_f32 (0.0f);
+  float32x4_t d1 = vdupq_n_f32 (0.0f);
+  float32x4_t x;
+  float32x2_t sum;
+
+  for (uint32_t k = 0; k<taps; k += 4u)
+  {
+    x = vld1q_f32 (&in[k]);
+    d0 = vaddq_f32 (d0, vmulq_f32 (x, vld1q_f32 (&phase0[k])));
+    d1 = vaddq_f32 (d1, vmulq_f32 (x, vld1q_f32 (&phase1[k])));
+  }
+  d0 = vaddq_f32 (d0, vmulq_f32 (vdupq_n_f32 (frac), vsubq_f32 (d1, d0)));
+
+  /* pairwise like vaddvq, which ARMv7 doesn't have */
+  sum = vpadd_f32 (vget_low_f32 (d0), vget_high_f32 (d0));
+
+  return vget_lane_f32 (vpadd_f32 (sum, sum), 0);
+}
+#endif
+
+/******************************************************************************
+ *
+ * @fn resampler_kernel select_kernel (void)
+ *
+ * @brief Get the kernel of the instruction set selected in
+ *        @ref sample_convert_set_isa
+ *
+ ******************************************************************************/
+static resampler_kernel select_kernel (void)
+{
+  switch (sample_convert_get_isa ())
+  {
+#ifdef RESAMPLER_HAVE_X86
+    case E_ISA_SSE2:
+      return sse2_kernel;
+    case E_ISA_AVX2:
+      return avx2_kernel;
+#endif
+#ifdef RESAMPLER_HAVE_NEON
+    case E_ISA_NEON:
+      return neon_kernel;
+#endif
+    default:
+      return scalar_kernel;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void design_phases (resampler*, const resampler_preset*)
+ *
+ * @brief Fill the table of phases, each one is normalized to unity gain at
+ *        DC so the interpolation between phases doesn't modulate the level
+ *
+ ******************************************************************************/
+static void design_phases (resampler *rs, const resampler_preset *preset)
+{
+  uint32_t num_phases = 1u<<rs->phase_bits;
+  double ratio = (double)rs->out_rate/(double)rs->in_rate;
+  double cutoff = preset->passband*0.5*((1.0>ratio) ? ratio : 1.0);
+  double half = (double)rs->num_taps/2.0;
+  double window_gain = bessel_i0 (preset->beta);
+  double x;
+  double w;
+  double sum;
+  float *phase;
+
+  for (uint32_t p = 0; p<=num_phases; p++)
+  {
+    phase = &rs->phases[(size_t)p*rs->num_taps];
+    sum = 0.0;
+    for (uint32_t k = 0; k<rs->num_taps; k++)
+    {
+      /* distance in inputs from the tap to the output */
+      x = (double)k-(half-1.0)-(double)p/(double)num_phases;
+      w = 1.0-(x/half)*(x/half);
+      w = (0.0<w) ? bessel_i0 (preset->beta*sqrt (w))/window_gain : 0.0;
+      if ( 0.0!=x )
+      {
+        w *= sin (2.0*M_PI*cutoff*x)/(M_PI*x);
+      }
+      else
+      {
+        w *= 2.0*cutoff;
+      }
+      phase[k] = (float)w;
+      sum += w;
+    }
+    for (uint32_t k = 0; k<rs->num_taps; k++)
+    {
+      phase[k] = (float)(phase[k]/sum);
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t resampler_init (resampler*, uint32_t, uint32_t, uint32_t,
+ *                            resampler_quality, uint32_t)
+ *
+ * @brief Create a converter between two rates
+ *
+ * The kernels of the instruction set selected in @ref sample_convert_set_isa
+ * are used, so @ref sample_convert_init should be called before
+ *
+ * @param[out] *rs             pointer to the converter
+ * @param       num_channels   number of channels
+ * @param       in_rate        rate of the input in Hz (e.g. of the file)
+ * @param       out_rate       rate of the output in Hz (e.g. the rate
+ *                             negotiated by @ref configure_hw)
+ * @param       quality        preset of the filter
+ * @param       max_in_frames  biggest input given to
+ *                             @ref resampler_process
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t resampler_init (resampler *rs, uint32_t num_channels, uint32_t in_rate,
+                       uint32_t out_rate, resampler_quality quality,
+                       uint32_t max_in_frames)
+{
+  const resampler_preset *preset;
+  void *buffer;
+  size_t phases_size;
+  size_t lines_size;
+
+  if ( (NULL==rs)||(0u==num_channels)||(MAX_CHANNELS<num_channels)||
+       (0u==in_rate)||(0u==out_rate)||(0u==max_in_frames)||
+       (E_SRC_BEST<quality) )
+  {
+    return S_ERROR;
+  }
+
+  preset = &presets[quality];
+  rs->num_channels = num_channels;
+  rs->in_rate = in_rate;
+  rs->out_rate = out_rate;
+  rs->num_taps = preset->num_taps;
+  rs->phase_bits = preset->phase_bits;
+  rs->max_in_frames = max_in_frames;
+  rs->step = (((uint64_t)in_rate<<FRACTION_BITS)+out_rate/2u)/out_rate;
+  rs->nominal_step = rs->step;
+  rs->line_size = max_in_frames+2u*rs->num_taps;
+  rs->phases = NULL;
+  rs->lines = NULL;
+  rs->kernel = select_kernel ();
+
+  phases_size = sizeof(float)*(((size_t)1u<<rs->phase_bits)+1u)*rs->num_taps;
+  lines_size = sizeof(float)*(size_t)rs->line_size*num_channels;
+  if ( 0!=posix_memalign (&buffer, RESAMPLER_ALIGNMENT, phases_size) )
+  {
+    return S_ERROR;
+  }
+  rs->phases = (float*)buffer;
+  if ( 0!=posix_memalign (&buffer, RESAMPLER_ALIGNMENT, lines_size) )
+  {
+    resampler_destroy (rs);
+    return S_ERROR;
+  }
+  rs->lines = (float*)buffer;
+
+  design_phases (rs, preset);
+  resampler_reset (rs);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t resampler_input_frames (const resampler*, uint32_t)
+ *
+ * @brief Get the input frames needed to produce some output frames, used to
+ *        pull from a source exactly what a period needs
+ *
+ * Giving these frames to @ref resampler_process with @a max_out_frames set
+ * to @a out_frames produces exactly @a out_frames
+ *
+ * @param[in] *rs          pointer to the converter
+ * @param      out_frames  output frames wanted
+ *
+ * @return uint32_t frames to give to @ref resampler_process
+ *
+ ******************************************************************************/
+uint32_t resampler_input_frames (const resampler *rs, uint32_t out_frames)
+{
+  uint64_t last;
+  uint64_t needed;
+
+  if ( (NULL==rs)||(0u==out_frames) )
+  {
+    return 0u;
+  }
+
+  last = rs->position+(uint64_t)(out_frames-1u)*rs->step;
+  needed = (last>>FRACTION_BITS)+rs->num_taps;
+
+  return (needed>rs->buffered) ? (uint32_t)(needed-rs->buffered) : 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t resampler_output_frames (const resampler*, uint32_t)
+ *
+ * @brief Get the output frames produced by some input frames, used to size
+ *        the output of a push source
+ *
+ * @param[in] *rs         pointer to the converter
+ * @param      in_frames  input frames given
+ *
+ * @return uint32_t frames that @ref resampler_process would produce
+ *
+ ******************************************************************************/
+uint32_t resampler_output_frames (const resampler *rs, uint32_t in_frames)
+{
+  uint64_t available;
+  uint64_t end;
+
+  if ( NULL==rs )
+  {
+    return 0u;
+  }
+
+  available = (uint64_t)rs->buffered+in_frames;
+  if ( available<rs->num_taps )
+  {
+    return 0u;
+  }
+
+  /* first position that needs inputs not available */
+  end = (available-rs->num_taps+1u)<<FRACTION_BITS;
+  if ( end<=rs->position )
+  {
+    return 0u;
+  }
+
+  return (uint32_t)((end-rs->position+rs->step-1u)/rs->step);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t resampler_process (resampler*, float**, uint32_t, float**,
+ *                               uint32_t, uint32_t*)
+ *
+ * @brief Convert a block of frames
+ *
+ * The inputs are appended to the ones kept from the previous call, and as
+ * many outputs as possible are produced, up to @a max_out_frames. The
+ * inputs not consumed are kept for the next call
+ *
+ * @param[in,out] *rs              pointer to the converter
+ * @param[in]    **in              one buffer for each channel
+ * @param          in_frames       frames of each input buffer, up to
+ *                                 @a max_in_frames
+ * @param[out]   **out             one buffer for each channel
+ * @param          max_out_frames  frames available in each output buffer,
+ *                                 see @ref resampler_output_frames
+ * @param[out]    *out_frames      frames written in each output buffer
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the inputs
+ *         don't fit with the ones kept, the outputs must be consumed first
+ *
+ ******************************************************************************/
+int8_t resampler_process (resampler *rs, float **in, uint32_t in_frames,
+                          float **out, uint32_t max_out_frames,
+                          uint32_t *out_frames)
+{
+  const uint64_t fraction_mask = ((uint64_t)1u<<FRACTION_BITS)-1u;
+  const uint32_t phase_shift = FRACTION_BITS-rs->phase_bits;
+  const float fraction_scale = 1.0f/(float)((uint64_t)1u<<phase_shift);
+  uint32_t produced;
+  uint32_t consumed;
+  uint64_t position;
+  uint32_t fraction;
+  float *line;
+
+  if ( (NULL==rs)||(NULL==out_frames)||((0u<in_frames)&&(NULL==in))||
+       ((0u<max_out_frames)&&(NULL==out))||(rs->max_in_frames<in_frames)||
+       (rs->line_size<rs->buffered+in_frames) )
+  {
+    return S_ERROR;
+  }
+
+  for (uint32_t ch = 0; ch<rs->num_channels; ch++)
+  {
+    memcpy (&rs->lines[(size_t)ch*rs->line_size+rs->buffered], in[ch],
+            sizeof(float)*in_frames);
+  }
+  rs->buffered += in_frames;
+
+  produced = resampler_output_frames (rs, 0u);
+  if ( produced>max_out_frames )
+  {
+    produced = max_out_frames;
+  }
+
+  for (uint32_t ch = 0; ch<rs->num_channels; ch++)
+  {
+    line = &rs->lines[(size_t)ch*rs->line_size];
+    position = rs->position;
+    for (uint32_t n = 0; n<produced; n++)
+    {
+      fraction = (uint32_t)(position&fraction_mask);
+      out[ch][n] = rs->kernel (
+          &line[position>>FRACTION_BITS],
+          &rs->phases[(size_t)(fraction>>phase_shift)*rs->num_taps],
+          &rs->phases[(size_t)((fraction>>phase_shift)+1u)*rs->num_taps],
+          (float)(fraction&((1u<<phase_shift)-1u))*fraction_scale,
+          rs->num_taps);
+      position += rs->step;
+    }
+  }
+
+  /* the consumed inputs are removed, the rest is moved to the start */
+  position = rs->position+(uint64_t)produced*rs->step;
+  consumed = (uint32_t)(position>>FRACTION_BITS);
+  if ( consumed>rs->buffered )
+  {
+    consumed = rs->buffered;
+  }
+  for (uint32_t ch = 0; (0u<consumed)&&(ch<rs->num_channels); ch++)
+  {
+    line = &rs->lines[(size_t)ch*rs->line_size];
+    memmove (line, &line[consumed], sizeof(float)*(rs->buffered-consumed));
+  }
+  rs->buffered -= consumed;
+  rs->position = position-((uint64_t)consumed<<FRACTION_BITS);
+  *out_frames = produced;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t resampler_latency (const resampler*)
+ *
+ * @brief Get the input frames the filter needs after each output, they are
+ *        buffered before the output is produced
+ *
+ * @param[in] *rs  pointer to the converter
+ *
+ * @return uint32_t look ahead of the filter in input frames
+ *
+ ******************************************************************************/
+uint32_t resampler_latency (const resampler *rs)
+{
+  return (NULL!=rs) ? rs->num_taps/2u+1u : 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t resampler_set_ratio (resampler*, double)
+ *
+ * @brief Adjust the ratio of the conversion around the nominal one
+ *
+ * The step becomes @f$ step_{nominal} \cdot adjust @f$, a value over 1.0
+ * consumes the input faster. The filter is designed for the nominal ratio,
+ * the small deviations used to follow a clock don't change the cutoff
+ * noticeably. The change is applied from the next output, without
+ * discontinuities in the position
+ *
+ * @param[in,out] *rs      pointer to the converter
+ * @param          adjust  factor applied to the nominal ratio, limited to
+ *                         1.0 +/- @ref RESAMPLER_MAX_ADJUST
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t resampler_set_ratio (resampler *rs, double adjust)
+{
+  if ( (NULL==rs)||(0.0>=adjust) )
+  {
+    return S_ERROR;
+  }
+
+  if ( adjust>1.0+RESAMPLER_MAX_ADJUST )
+  {
+    adjust = 1.0+RESAMPLER_MAX_ADJUST;
+  }
+  else if ( adjust<1.0-RESAMPLER_MAX_ADJUST )
+  {
+    adjust = 1.0-RESAMPLER_MAX_ADJUST;
+  }
+  rs->step = (uint64_t)((double)rs->nominal_step*adjust+0.5);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn double resampler_get_ratio (const resampler*)
+ *
+ * @brief Get the input frames consumed for each output frame
+ *
+ * @param[in] *rs  pointer to the converter
+ *
+ * @return double current ratio, including the adjust of
+ *         @ref resampler_set_ratio
+ *
+ ******************************************************************************/
+double resampler_get_ratio (const resampler *rs)
+{
+  if ( NULL==rs )
+  {
+    return 0.0;
+  }
+
+  return (double)rs->step/(double)((uint64_t)1u<<FRACTION_BITS);
+}
+
+/******************************************************************************
+ *
+ * @fn double resampler_pending_input (const resampler*)
+ *
+ * @brief Get the input frames given and not converted yet
+ *
+ * The frames are counted from the center of the filter for the next output,
+ * so the inputs given since the reset minus this value is the index of the
+ * input at the time of the next output. The lines start with
+ * @a num_taps/2-1 frames of silence, so the first output is at the time of
+ * the first input
+ *
+ * @param[in] *rs  pointer to the converter
+ *
+ * @return double input frames, with the fraction of the position
+ *
+ ******************************************************************************/
+double resampler_pending_input (const resampler *rs)
+{
+  if ( NULL==rs )
+  {
+    return 0.0;
+  }
+
+  return (double)rs->buffered-(double)(rs->num_taps/2u-1u)-
+      (double)rs->position/(double)((uint64_t)1u<<FRACTION_BITS);
+}
+
+/******************************************************************************
+ *
+ * @fn void resampler_reset (resampler*)
+ *
+ * @brief Clear the inputs kept, e.g. after a seek
+ *
+ * @param[in] *rs  pointer to the converter
+ *
+ ******************************************************************************/
+void resampler_reset (resampler *rs)
+{
+  if ( (NULL==rs)||(NULL==rs->lines) )
+  {
+    return;
+  }
+
+  memset (rs->lines, 0, sizeof(float)*(size_t)rs->line_size*rs->num_channels);
+  rs->buffered = rs->num_taps/2u-1u;
+  rs->position = 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn void resampler_destroy (resampler*)
+ *
+ * @brief Free the buffers of a converter
+ *
+ * @param[in] *rs  pointer to the converter
+ *
+ ******************************************************************************/
+void resampler_destroy (resampler *rs)
+{
+  if ( NULL==rs )
+  {
+    return;
+  }
+
+  free (rs->phases);
+  free (rs->lines);
+  rs->phases = NULL;
+  rs->lines = NULL;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
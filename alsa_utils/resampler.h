@@ -0,0 +1,126 @@
+/*******************************************************************************
+ * @file      resampler.h
+ *
+ * @brief      Polyphase sample rate converter for planar float buffers
+ *
+ * Converts the rate of a multichannel stream, so the sound card can be
+ * opened at its native rate (e.g. @a hw:0,0 at 48KHz) and still play content
+ * at any rate, without the resampler of the @a plug layer:
+ *      @li windowed sinc (Kaiser) filter with the cutoff under the lowest of
+ *          the two Nyquist frequencies
+ *      @li the filter is stored as a table of phases, the phases are linearly
+ *          interpolated so any ratio can be used, not only small fractions
+ *      @li the position is kept in 32.32 fixed point, so the ratio doesn't
+ *          drift with the time
+ *      @li the quality presets trade taps (CPU) for stop band attenuation
+ *      @li the ratio can be adjusted while running with
+ *          @ref resampler_set_ratio, e.g. to follow the drift between the
+ *          clocks of two devices
+ *
+ * The kernels of the instruction set selected in @ref sample_convert_set_isa
+ * are used, the SIMD kernels sum in another order than the scalar one, so
+ * the results can differ in the last bits.
+ *
+ * @note Link using -lm
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "alsa_utils.h"
+#include "sample_convert.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _RESAMPLER_
+#define _RESAMPLER_
+
+#define RESAMPLER_MAX_TAPS      (64u) /**< taps of the best preset */
+#define RESAMPLER_MAX_ADJUST    (0.01) /**< biggest deviation from the
+                                            nominal ratio, see
+                                            @ref resampler_set_ratio */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Quality presets, the CPU cost is proportional to the taps */
+typedef enum
+{
+  E_SRC_FAST = 0, /**< 16 taps, ~50dB of attenuation, for monitoring */
+  E_SRC_MEDIUM, /**< 32 taps, ~80dB of attenuation */
+  E_SRC_BEST /**< 64 taps, ~100dB of attenuation */
+} resampler_quality;
+
+/** Kernel computing an output sample from @a taps inputs and the two phases
+ * around it: @f$ y = d_0+frac \cdot (d_1-d_0) @f$ where @a d are the dot
+ * products of the inputs with each phase */
+typedef float (*resampler_kernel) (const float *in, const float *phase0,
+                                   const float *phase1, float frac,
+                                   uint32_t taps);
+
+/** Sample rate converter of several channels */
+typedef struct
+{
+  uint32_t num_channels; /**< channels converted */
+  uint32_t in_rate; /**< rate of the input */
+  uint32_t out_rate; /**< rate of the output */
+  uint32_t num_taps; /**< length of each phase, multiple of 8 */
+  uint32_t phase_bits; /**< log2 of the phases of the table */
+  uint32_t max_in_frames; /**< biggest input of @ref resampler_process */
+  uint64_t step; /**< input frames for each output frame in 32.32 */
+  uint64_t nominal_step; /**< @a step of in_rate/out_rate */
+  uint64_t position; /**< position of the next output in the lines, in
+   32.32 */
+  uint32_t buffered; /**< frames in the lines */
+  uint32_t line_size; /**< frames of each line */
+  float *phases; /**< (1 << @a phase_bits)+1 phases of @a num_taps taps */
+  float *lines; /**< inputs not consumed of each channel */
+  resampler_kernel kernel; /**< kernel of the instruction set in use */
+} resampler;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t resampler_init (resampler *rs, uint32_t num_channels, uint32_t in_rate,
+                       uint32_t out_rate, resampler_quality quality,
+                       uint32_t max_in_frames);
+uint32_t resampler_input_frames (const resampler *rs, uint32_t out_frames);
+uint32_t resampler_output_frames (const resampler *rs, uint32_t in_frames);
+int8_t resampler_process (resampler *rs, float **in, uint32_t in_frames,
+                          float **out, uint32_t max_out_frames,
+                          uint32_t *out_frames);
+uint32_t resampler_latency (const resampler *rs);
+int8_t resampler_set_ratio (resampler *rs, double adjust);
+double resampler_get_ratio (const resampler *rs);
+double resampler_pending_input (const resampler *rs);
+void resampler_reset (resampler *rs);
+void resampler_destroy (resampler *rs);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
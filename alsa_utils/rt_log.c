@@ -0,0 +1,280 @@
+/*******************************************************************************
+ * @file      rt_log.c
+ *
+ * @brief      Lock-free log drained by a separate thread
+ *
+ * Log for the real time paths, see @ref rt_log.
+ *
+ * @note Link using -lpthread
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <sched.h>
+#include <stdarg.h>
+#include <string.h>
+#include "alsa_utils.h"
+#include "rt_log.h"
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ ------------------------------------------------------------------------------*/
+/** Message stored in the queue */
+typedef struct
+{
+  char text[RT_LOG_MESSAGE_SIZE]; /**< formatted message */
+} rt_log_message;
+
+/*------------------------------------------------------------------------------
+ * Module Variable Definitions
+ ------------------------------------------------------------------------------*/
+/** Log used by @ref rt_log_printf, NULL to print directly */
+static _Atomic(rt_log*) active_log = NULL;
+
+/** Calls of @ref rt_log_printf that can be using @ref active_log, the log
+ * can't be drained nor destroyed until they are finished */
+static atomic_uint active_writers = 0;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn void rt_log_drain (rt_log*)
+ *
+ * @brief Write all the queued messages to the output
+ *
+ ******************************************************************************/
+static void rt_log_drain (rt_log *log)
+{
+  rt_log_message message;
+
+  while ( S_SUCCESS==mpsc_queue_pop (&log->queue, &message) )
+  {
+    fputs (message.text, log->output);
+  }
+  fflush (log->output);
+}
+
+/******************************************************************************
+ *
+ * @fn void* drain_thread (void*)
+ *
+ * @brief Thread writing the messages until the log is stopped
+ *
+ ******************************************************************************/
+static void* drain_thread (void *arg)
+{
+  rt_log *log = (rt_log*)arg;
+
+  while ( 0u!=atomic_load (&log->running) )
+  {
+    sem_wait (&log->pending);
+    rt_log_drain (log);
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t rt_log_init (rt_log*, size_t, FILE*)
+ *
+ * @brief Create the queue of the log
+ *
+ * @param[out] *log           pointer to the log
+ * @param       num_messages  messages that can be queued, power of 2
+ * @param[in]  *output        where the messages are written, e.g. stdout
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t rt_log_init (rt_log *log, size_t num_messages, FILE *output)
+{
+  if ( (NULL==log)||(NULL==output) )
+  {
+    return S_ERROR;
+  }
+
+  memset (log, 0, sizeof(*log));
+  if ( S_SUCCESS!=mpsc_queue_init (&log->queue, num_messages,
+                                   sizeof(rt_log_message)) )
+  {
+    return S_ERROR;
+  }
+  if ( 0!=sem_init (&log->pending, 0, 0u) )
+  {
+    mpsc_queue_destroy (&log->queue);
+    return S_ERROR;
+  }
+  log->output = output;
+  atomic_init (&log->running, 0u);
+  atomic_init (&log->dropped, 0u);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t rt_log_start (rt_log*)
+ *
+ * @brief Start the drain thread and send @ref rt_log_printf to this log
+ *
+ * @param[in,out] *log  pointer to the log
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t rt_log_start (rt_log *log)
+{
+  if ( NULL==log )
+  {
+    return S_ERROR;
+  }
+
+  atomic_store (&log->running, 1u);
+  if ( 0!=pthread_create (&log->drain_thread, NULL, drain_thread, log) )
+  {
+    atomic_store (&log->running, 0u);
+    return S_ERROR;
+  }
+  atomic_store (&active_log, log);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void rt_log_stop (rt_log*)
+ *
+ * @brief Stop the drain thread and write the messages left
+ *
+ * After this call @ref rt_log_printf prints directly again, the calls that
+ * were already queuing a message are waited for before the drain, so the
+ * log can be destroyed even with threads still logging
+ *
+ * @param[in,out] *log  pointer to the log
+ *
+ ******************************************************************************/
+void rt_log_stop (rt_log *log)
+{
+  rt_log *expected = log;
+  unsigned long long dropped;
+
+  if ( (NULL==log)||(0u==atomic_load (&log->running)) )
+  {
+    return;
+  }
+
+  atomic_compare_exchange_strong (&active_log, &expected, NULL);
+  /* a writer that loaded the log before the exchange can still push to it
+   * and post the semaphore, the ones starting now print directly */
+  while ( 0u!=atomic_load (&active_writers) )
+  {
+    sched_yield ();
+  }
+  atomic_store (&log->running, 0u);
+  sem_post (&log->pending);
+  pthread_join (log->drain_thread, NULL);
+
+  rt_log_drain (log);
+  dropped = atomic_load (&log->dropped);
+  if ( 0u!=dropped )
+  {
+    fprintf (log->output, "rt_log Warning: %llu messages dropped\n", dropped);
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void rt_log_destroy (rt_log*)
+ *
+ * @brief Stop the log and release its memory
+ *
+ * @param[in,out] *log  pointer to the log
+ *
+ ******************************************************************************/
+void rt_log_destroy (rt_log *log)
+{
+  if ( NULL==log )
+  {
+    return;
+  }
+
+  rt_log_stop (log);
+  sem_destroy (&log->pending);
+  mpsc_queue_destroy (&log->queue);
+}
+
+/******************************************************************************
+ *
+ * @fn void rt_log_printf (const char*, ...)
+ *
+ * @brief Log a message with the format of @a printf
+ *
+ * With an active log the message is formatted in the stack of the caller
+ * and queued, the only system call is the wake up of the drain thread when
+ * it's waiting. Without an active log it's the same as @a printf
+ *
+ * @param[in] *format  format of @a printf
+ *
+ ******************************************************************************/
+void rt_log_printf (const char *format, ...)
+{
+  va_list args;
+  rt_log_message message;
+  rt_log *log;
+
+  /* counted before loading the log, so rt_log_stop either sees this writer
+   * or this writer sees the log cleared */
+  atomic_fetch_add (&active_writers, 1u);
+  log = atomic_load (&active_log);
+
+  va_start(args, format);
+  if ( NULL==log )
+  {
+    atomic_fetch_sub_explicit (&active_writers, 1u, memory_order_release);
+    vprintf (format, args);
+    va_end(args);
+    return;
+  }
+  vsnprintf (message.text, sizeof(message.text), format, args);
+  va_end(args);
+
+  if ( S_SUCCESS!=mpsc_queue_push (&log->queue, &message) )
+  {
+    atomic_fetch_add_explicit (&log->dropped, 1u, memory_order_relaxed);
+  }
+  else
+  {
+    sem_post (&log->pending);
+  }
+  atomic_fetch_sub_explicit (&active_writers, 1u, memory_order_release);
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,89 @@
+/*******************************************************************************
+ * @file      rt_log.h
+ *
+ * @brief      Lock-free log drained by a separate thread
+ *
+ * Log for the real time paths (configuration, recovery and the audio
+ * threads):
+ *      @li @ref rt_log_printf formats the message in a fixed size cell and
+ *          pushes it to a lock-free @ref mpsc_queue, it never does I/O nor takes
+ *          the lock of stdout, so it can be called from any thread
+ *      @li a drain thread pops the messages and writes them to the output
+ *      @li when the queue is full the message is dropped and counted, the
+ *          writers never wait
+ *      @li without an active log @ref rt_log_printf just calls @a vprintf, so
+ *          the programs that don't start a log keep the same output
+ *
+ * @note Link using -lpthread
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "mpsc_queue.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _RT_LOG_
+#define _RT_LOG_
+
+#define RT_LOG_MESSAGE_SIZE     (128u) /**< bytes of each message, longer
+                                            messages are truncated */
+#define RT_LOG_DEFAULT_MESSAGES (256u) /**< messages in the queue */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Log drained by a thread */
+typedef struct
+{
+  mpsc_queue queue; /**< formatted messages */
+  sem_t pending; /**< posted for each message pushed */
+  FILE *output; /**< where the messages are written */
+  pthread_t drain_thread; /**< writes the messages to the output */
+  atomic_uint running; /**< cleared by @ref rt_log_stop */
+  atomic_ullong dropped; /**< messages lost because the queue was full */
+} rt_log;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t rt_log_init (rt_log *log, size_t num_messages, FILE *output);
+int8_t rt_log_start (rt_log *log);
+void rt_log_stop (rt_log *log);
+void rt_log_destroy (rt_log *log);
+void rt_log_printf (const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,270 @@
+/*******************************************************************************
+ * @file      rt_setup.c
+ *
+ * @brief      Real time setup for the audio threads
+ *
+ * Standard bring-up of a real time audio thread, see @ref rt_configuration.
+ *
+ * All the steps are tried even if one of them fails, typically because of
+ * missing privileges, in that case a warning is printed and @a S_ERROR is
+ * returned so the caller can decide to continue without real time.
+ *
+ * @note Link using -lpthread
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "rt_setup.h"
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define STACK_PREFAULT_MARGIN   (16u*1024u) /**< stack left below the
+                                                 prefault, for the functions
+                                                 called by the thread */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn size_t stack_left (void)
+ *
+ * @brief Bytes of stack of the calling thread below the current frame, 0 if
+ *        they can't be read
+ *
+ ******************************************************************************/
+__attribute__((noinline))
+static size_t stack_left (void)
+{
+  pthread_attr_t attr;
+  void *stack_addr;
+  size_t stack_size;
+  size_t left = 0;
+  uintptr_t here = (uintptr_t)__builtin_frame_address (0);
+
+  if ( 0!=pthread_getattr_np (pthread_self (), &attr) )
+  {
+    return 0u;
+  }
+  /* the stack grows down from stack_addr+stack_size */
+  if ( (0==pthread_attr_getstack (&attr, &stack_addr, &stack_size))&&
+       ((uintptr_t)stack_addr<here)&&
+       ((uintptr_t)stack_addr+stack_size>here) )
+  {
+    left = (size_t)(here-(uintptr_t)stack_addr);
+  }
+  pthread_attr_destroy (&attr);
+
+  return left;
+}
+
+/******************************************************************************
+ *
+ * @fn void prefault_stack (size_t)
+ *
+ * @brief Touch the stack so its pages are mapped (and locked) before
+ *        streaming
+ *
+ * It's not inlined so the memory is really taken from the stack of the
+ * thread calling @ref configure_rt_thread
+ *
+ * @param size  bytes of stack to touch, less than @ref stack_left
+ *
+ ******************************************************************************/
+__attribute__((noinline))
+static void prefault_stack (size_t size)
+{
+  volatile uint8_t *stack = (volatile uint8_t*)__builtin_alloca (size);
+  long page_size = sysconf (_SC_PAGESIZE);
+
+  if ( 0>=page_size )
+  {
+    return;
+  }
+  for (size_t n = 0; n<size; n += (size_t)page_size)
+  {
+    stack[n] = 0u;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t configure_rt_thread (const rt_configuration*)
+ *
+ * @brief Apply the real time configuration to the calling thread
+ *
+ * @param[in] *rt_config  real time configuration
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if any of the
+ *         steps failed
+ *
+ ******************************************************************************/
+int8_t configure_rt_thread (const rt_configuration *rt_config)
+{
+  int8_t status = S_SUCCESS;
+  size_t prefault_size;
+  size_t left;
+  cpu_set_t cpu_set;
+  int err;
+
+  if ( NULL==rt_config )
+  {
+    return S_ERROR;
+  }
+
+  if ( 0u!=rt_config->lock_memory )
+  {
+    /** @b mlockall lock the current pages and all the pages mapped in the
+     * future, the heap is never given back to the system so the memory freed
+     * stays locked and mapped for the next allocations */
+    if ( 0!=mlockall (MCL_CURRENT|MCL_FUTURE) )
+    {
+      printf ("configure_rt_thread Warning: mlockall failed, Err = %d\n",
+              errno);
+      status = S_ERROR;
+    }
+    mallopt (M_TRIM_THRESHOLD, -1);
+    mallopt (M_MMAP_MAX, 0);
+  }
+
+  if ( 0u<rt_config->stack_prefault_size )
+  {
+    /* the alloca can't go past the end of the stack of the thread, e.g. a
+     * thread created with a small stack size */
+    prefault_size = rt_config->stack_prefault_size;
+    left = stack_left ();
+    if ( prefault_size+STACK_PREFAULT_MARGIN>left )
+    {
+      prefault_size = (left>STACK_PREFAULT_MARGIN) ?
+          left-STACK_PREFAULT_MARGIN : 0u;
+      printf ("configure_rt_thread Warning: %zu bytes of stack left, "
+              "pre-faulting %zu\n", left, prefault_size);
+      status = S_ERROR;
+    }
+    if ( 0u<prefault_size )
+    {
+      prefault_stack (prefault_size);
+    }
+  }
+
+  /* the CPUs online can have gaps in their numbers and the process can be
+   * restricted to some of them (cpuset, taskset), the CPU must be in the
+   * affinity mask of the process */
+  if ( RT_KEEP_AFFINITY!=rt_config->cpu )
+  {
+    CPU_ZERO(&cpu_set);
+    if ( (0>rt_config->cpu)||(CPU_SETSIZE<=rt_config->cpu)||
+         (0!=sched_getaffinity (getpid (), sizeof(cpu_set), &cpu_set))||
+         (0==CPU_ISSET(rt_config->cpu, &cpu_set)) )
+    {
+      printf ("configure_rt_thread Warning: CPU %d is not available\n",
+              rt_config->cpu);
+      status = S_ERROR;
+    }
+    else
+    {
+      CPU_ZERO(&cpu_set);
+      CPU_SET(rt_config->cpu, &cpu_set);
+      err = pthread_setaffinity_np (pthread_self (), sizeof(cpu_set),
+                                    &cpu_set);
+      if ( 0!=err )
+      {
+        printf ("configure_rt_thread Warning: pinning to CPU %d failed, "
+                "Err = %d\n", rt_config->cpu, err);
+        status = S_ERROR;
+      }
+    }
+  }
+
+  if ( RT_KEEP_POLICY!=rt_config->priority )
+  {
+    struct sched_param param;
+
+    memset (&param, 0, sizeof(param));
+    param.sched_priority = rt_config->priority;
+    err = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param);
+    if ( 0!=err )
+    {
+      printf ("configure_rt_thread Warning: setting SCHED_FIFO %d failed, "
+              "Err = %d\n", rt_config->priority, err);
+      status = S_ERROR;
+    }
+  }
+
+  return status;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t prefault_buffer (void*, size_t)
+ *
+ * @brief Touch every page of a buffer so it's mapped before streaming
+ *
+ * The content of the buffer is not modified
+ *
+ * @param[in,out] *buffer  buffer to pre-fault
+ * @param          size    size of the buffer in bytes
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t prefault_buffer (void *buffer, size_t size)
+{
+  volatile uint8_t *data = (volatile uint8_t*)buffer;
+  long page_size = sysconf (_SC_PAGESIZE);
+
+  if ( (NULL==buffer)||(0>=page_size) )
+  {
+    return S_ERROR;
+  }
+
+  for (size_t n = 0; n<size; n += (size_t)page_size)
+  {
+    data[n] = data[n];
+  }
+  if ( 0u<size )
+  {
+    data[size-1u] = data[size-1u];
+  }
+
+  return S_SUCCESS;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
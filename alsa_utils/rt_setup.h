@@ -0,0 +1,83 @@
+/*******************************************************************************
+ * @file      rt_setup.h
+ *
+ * @brief      Real time setup for the audio threads
+ *
+ * Standard bring-up of a real time audio thread:
+ *      @li lock all the pages of the process in RAM (mlockall) and keep the
+ *          freed memory in the heap, so a later malloc doesn't page fault
+ *      @li pre-fault the stack of the thread and the audio buffers
+ *      @li pin the thread to a CPU
+ *      @li set a SCHED_FIFO priority
+ *
+ * This should be done before the sound card starts, any page fault or
+ * preemption while streaming can produce an xrun.
+ *
+ * @note Setting SCHED_FIFO and locking memory requires CAP_SYS_NICE and
+ *       CAP_IPC_LOCK (or the matching rtprio/memlock limits)
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _RT_SETUP_
+#define _RT_SETUP_
+
+#define RT_KEEP_AFFINITY        (-1) /**< don't pin the thread to a CPU */
+#define RT_KEEP_POLICY          (0)  /**< don't change the scheduling policy */
+#define RT_DEFAULT_STACK_SIZE   (256u*1024u) /**< stack bytes pre-faulted */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Real time configuration of a thread */
+typedef struct
+{
+  int priority; /**< SCHED_FIFO priority (1-99), @ref RT_KEEP_POLICY to keep
+   the current policy */
+  int cpu; /**< CPU where the thread runs (in the affinity mask of the
+   process, the one of its main thread), @ref RT_KEEP_AFFINITY to keep the
+   current affinity */
+  uint8_t lock_memory; /**< 1 to lock all the pages of the process */
+  size_t stack_prefault_size; /**< bytes of stack to pre-fault, 0 to skip,
+   limited to the stack left in the thread */
+} rt_configuration;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t configure_rt_thread (const rt_configuration *rt_config);
+int8_t prefault_buffer (void *buffer, size_t size);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,823 @@
+/*******************************************************************************
+ * @file      rtp_source.c
+ *
+ * @brief      RTP/UDP ingest with an adaptive jitter buffer
+ *
+ * Reception of an RTP stream in the blocks of a @ref playback_pipeline, see
+ * @ref rtp_source.
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "rtp_source.h"
+#include "sample_convert.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define RTP_HEADER_SIZE         (12u) /**< fixed part of the header */
+#define RTP_VERSION             (2u) /**< version in the first byte */
+#define RTP_JITTER_FACTOR       (3.0) /**< jitters of margin over a packet in
+                                           the target delay */
+#define RTP_SHRINK_BLOCKS       (50u) /**< consecutive blocks over the target
+                                           before a packet is dropped */
+#define RTP_REBASE_FRAMES       (0x40000000u) /**< the origin is moved before
+                                                   the positions wrap */
+#define RTP_RECEIVE_BUFFER      (1u<<20) /**< bytes of the socket buffer */
+#define RTP_CONTROL_SIZE        (64u) /**< bytes of the ancillary data */
+
+/*------------------------------------------------------------------------------
+ * Module Typedefs
+ ------------------------------------------------------------------------------*/
+/** Buffers given to recvmmsg, kept here so the header doesn't need
+ * _GNU_SOURCE */
+struct rtp_receive_batch
+{
+  struct mmsghdr messages[RTP_SOURCE_BATCH]; /**< one per datagram */
+  struct iovec vectors[RTP_SOURCE_BATCH]; /**< data of each datagram */
+  uint8_t control[RTP_SOURCE_BATCH][RTP_CONTROL_SIZE]; /**< timestamps */
+  rtp_packet *packets[RTP_SOURCE_BATCH]; /**< packets receiving the data */
+};
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn void release_packet (rtp_source*, uint32_t)
+ *
+ * @brief Return the packet of a slot to the free stack
+ *
+ ******************************************************************************/
+static void release_packet (rtp_source *source, uint32_t slot)
+{
+  if ( NULL!=source->slots[slot] )
+  {
+    source->free_packets[source->num_free++] = source->slots[slot];
+    source->slots[slot] = NULL;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void resync (rtp_source*)
+ *
+ * @brief Empty the jitter buffer, the next packet starts a new stream
+ *
+ ******************************************************************************/
+static void resync (rtp_source *source)
+{
+  for (uint32_t slot = 0; slot<RTP_SOURCE_SLOTS; slot++)
+  {
+    release_packet (source, slot);
+  }
+  source->synchronized = 0u;
+  source->playing = 0u;
+  source->has_transit = 0u;
+  source->shrink_count = 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn uint64_t arrival_time_ns (struct msghdr*)
+ *
+ * @brief Get the time the kernel received a datagram
+ *
+ ******************************************************************************/
+static uint64_t arrival_time_ns (struct msghdr *header)
+{
+  struct cmsghdr *cmsg;
+  struct timespec time;
+
+  for (cmsg = CMSG_FIRSTHDR (header); NULL!=cmsg;
+      cmsg = CMSG_NXTHDR (header, cmsg))
+  {
+    if ( (SOL_SOCKET==cmsg->cmsg_level)&&(SCM_TIMESTAMPNS==cmsg->cmsg_type) )
+    {
+      memcpy (&time, CMSG_DATA (cmsg), sizeof(time));
+      return (uint64_t)time.tv_sec*1000000000u+(uint64_t)time.tv_nsec;
+    }
+  }
+
+  /* same clock as the kernel timestamps */
+  clock_gettime (CLOCK_REALTIME, &time);
+
+  return (uint64_t)time.tv_sec*1000000000u+(uint64_t)time.tv_nsec;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t parse_packet (rtp_source*, rtp_packet*, size_t)
+ *
+ * @brief Validate the RTP header of a datagram and find its payload
+ *
+ * @param[in]     *source  stream received
+ * @param[in,out] *packet  packet with the datagram in @a data
+ * @param          length  bytes of the datagram
+ *
+ * @return int8_t @a S_SUCCESS if it's a packet of the stream, @a S_ERROR
+ *         otherwise
+ *
+ ******************************************************************************/
+static int8_t parse_packet (rtp_source *source, rtp_packet *packet,
+                            size_t length)
+{
+  const uint8_t *data = packet->data;
+  size_t header = RTP_HEADER_SIZE+4u*(data[0]&0x0Fu);
+  size_t payload;
+
+  if ( (RTP_HEADER_SIZE>length)||(RTP_VERSION!=(data[0]>>6))||
+       ((RTP_ANY_PAYLOAD_TYPE!=source->config.payload_type)&&
+        (source->config.payload_type!=(data[1]&0x7Fu))) )
+  {
+    return S_ERROR;
+  }
+
+  /* header extension, its length is in words after the profile */
+  if ( (0u!=(data[0]&0x10u))&&(header+4u<=length) )
+  {
+    header += 4u+4u*(((size_t)data[header+2u]<<8)|data[header+3u]);
+  }
+  /* padding, the last byte has its length */
+  if ( 0u!=(data[0]&0x20u) )
+  {
+    length = (data[length-1u]<length) ? length-data[length-1u] : 0u;
+  }
+  if ( header>=length )
+  {
+    return S_ERROR;
+  }
+
+  payload = length-header;
+  if ( 0u!=(payload%source->frame_bytes) )
+  {
+    return S_ERROR;
+  }
+
+  packet->payload = data+header;
+  packet->frames = (uint32_t)(payload/source->frame_bytes);
+  packet->sequence = (uint16_t)(((uint16_t)data[2]<<8)|data[3]);
+  packet->timestamp = ((uint32_t)data[4]<<24)|((uint32_t)data[5]<<16)|
+      ((uint32_t)data[6]<<8)|data[7];
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void update_jitter (rtp_source*, uint32_t, uint64_t)
+ *
+ * @brief Update the interarrival jitter (RFC 3550) and the target delay
+ *
+ * @param[in,out] *source       stream received
+ * @param          position     position of the packet from the origin
+ * @param          arrival_ns   time the packet was received
+ *
+ ******************************************************************************/
+static void update_jitter (rtp_source *source, uint32_t position,
+                           uint64_t arrival_ns)
+{
+  double transit;
+  double target;
+  /* a packet further than this from the play position starts a new stream */
+  double capacity = (double)((RTP_SOURCE_SLOTS-1u)*source->packet_frames);
+
+  /* the arrival times are taken from the first packet so the frames keep
+   * their precision */
+  if ( 0u==source->has_transit )
+  {
+    source->first_arrival_ns = arrival_ns;
+  }
+  transit = (double)(int64_t)(arrival_ns-source->first_arrival_ns)*1e-9*
+      source->config.sample_rate-(double)position;
+  if ( 0u!=source->has_transit )
+  {
+    source->jitter += (fabs (transit-source->last_transit)-source->jitter)/
+        16.0;
+  }
+  source->last_transit = transit;
+  source->has_transit = 1u;
+
+  /* a whole block is taken at once, plus the packet being received */
+  target = (double)source->block_frames+(double)source->packet_frames+
+      RTP_JITTER_FACTOR*source->jitter;
+  if ( target<(double)source->min_frames )
+  {
+    target = (double)source->min_frames;
+  }
+  else if ( target>(double)source->max_frames )
+  {
+    target = (double)source->max_frames;
+  }
+  /* with short packets the slots can hold less than max_delay_ms */
+  if ( target>capacity )
+  {
+    target = capacity;
+  }
+  source->target_frames = (uint32_t)target;
+}
+
+/******************************************************************************
+ *
+ * @fn void insert_packet (rtp_source*, rtp_packet*, uint64_t)
+ *
+ * @brief Put a packet received in its slot of the jitter buffer
+ *
+ * @param[in,out] *source      stream received
+ * @param[in]     *packet      packet parsed
+ * @param          arrival_ns  time the packet was received
+ *
+ * @return int8_t @a S_SUCCESS if the packet was stored, @a S_ERROR if it
+ *         has to be released
+ *
+ ******************************************************************************/
+static int8_t insert_packet (rtp_source *source, rtp_packet *packet,
+                             uint64_t arrival_ns)
+{
+  uint32_t position;
+  uint32_t index;
+  uint32_t slot;
+  int32_t distance;
+
+  if ( 0u==source->synchronized )
+  {
+    source->synchronized = 1u;
+    source->base_sequence = packet->sequence;
+    source->base_timestamp = packet->timestamp;
+    source->packet_frames = packet->frames;
+    source->play_position = 0u;
+    source->received_end = 0u;
+  }
+
+  /* the packets of the recent past are just late, older ones mean that the
+   * sender restarted */
+  position = packet->timestamp-source->base_timestamp;
+  distance = (int32_t)(position-source->play_position);
+  if ( (0>=distance+(int32_t)packet->frames)&&
+       (-(int32_t)(RTP_SOURCE_SLOTS*source->packet_frames)<distance) )
+  {
+    source->stats.late++;
+    return S_ERROR;
+  }
+
+  /* the sender restarted or changed the packets: new stream */
+  index = position/source->packet_frames;
+  if ( (packet->frames!=source->packet_frames)||
+       (0u!=(position%source->packet_frames))||
+       ((uint16_t)(source->base_sequence+index)!=packet->sequence)||
+       (0>=distance+(int32_t)packet->frames)||
+       ((int32_t)((RTP_SOURCE_SLOTS-1u)*source->packet_frames)<distance) )
+  {
+    source->stats.resyncs++;
+    resync (source);
+    return insert_packet (source, packet, arrival_ns);
+  }
+
+  slot = packet->sequence&(RTP_SOURCE_SLOTS-1u);
+  if ( (NULL!=source->slots[slot])&&
+       (source->slots[slot]->sequence==packet->sequence) )
+  {
+    source->stats.duplicated++;
+    return S_ERROR;
+  }
+
+  release_packet (source, slot);
+  source->slots[slot] = packet;
+  source->stats.received++;
+  if ( 0<(int32_t)(position+packet->frames-source->received_end) )
+  {
+    source->received_end = position+packet->frames;
+  }
+  update_jitter (source, position, arrival_ns);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void receive_packets (rtp_source*)
+ *
+ * @brief Drain the socket into the jitter buffer
+ *
+ * Each @a recvmmsg receives up to @ref RTP_SOURCE_BATCH datagrams directly
+ * in the packets on top of the free stack, the socket is read until it's
+ * empty
+ *
+ ******************************************************************************/
+static void receive_packets (rtp_source *source)
+{
+  struct rtp_receive_batch *batch = source->batch;
+  struct msghdr *header;
+  uint32_t count;
+  int received;
+
+  do
+  {
+    count = (source->num_free<RTP_SOURCE_BATCH) ?
+        source->num_free : RTP_SOURCE_BATCH;
+    for (uint32_t n = 0; n<count; n++)
+    {
+      batch->packets[n] = source->free_packets[source->num_free-1u-n];
+      batch->vectors[n].iov_base = batch->packets[n]->data;
+      batch->messages[n].msg_hdr.msg_controllen = RTP_CONTROL_SIZE;
+    }
+
+    received = recvmmsg (source->socket_fd, batch->messages, count,
+                         MSG_DONTWAIT, NULL);
+    if ( 0>=received )
+    {
+      break;
+    }
+    source->stats.receive_calls++;
+
+    /* the packets received leave the free stack, the ones not kept in the
+     * jitter buffer go back */
+    source->num_free -= (uint32_t)received;
+    for (uint32_t n = 0; n<(uint32_t)received; n++)
+    {
+      header = &batch->messages[n].msg_hdr;
+      if ( (0u!=(header->msg_flags&MSG_TRUNC))||
+           (S_SUCCESS!=parse_packet (source, batch->packets[n],
+                                     batch->messages[n].msg_len)) )
+      {
+        source->stats.invalid++;
+        source->free_packets[source->num_free++] = batch->packets[n];
+      }
+      else if ( S_SUCCESS!=insert_packet (source, batch->packets[n],
+                                          arrival_time_ns (header)) )
+      {
+        source->free_packets[source->num_free++] = batch->packets[n];
+      }
+    }
+  } while ( (uint32_t)received==count );
+}
+
+/******************************************************************************
+ *
+ * @fn void decode_frames (rtp_source*, const uint8_t*, uint8_t*, uint32_t)
+ *
+ * @brief Convert frames of the payload to the format of the sound card
+ *
+ ******************************************************************************/
+static void decode_frames (rtp_source *source, const uint8_t *in,
+                           uint8_t *out, uint32_t frames)
+{
+  uint32_t samples = frames*source->config.num_channels;
+  int16_t *out16 = (int16_t*)out;
+  int32_t value;
+
+  /* the usual case is only a byte swap */
+  if ( (E_RTP_L16==source->config.encoding)&&
+       (SND_PCM_FORMAT_S16_LE==source->format) )
+  {
+    for (uint32_t n = 0; n<samples; n++)
+    {
+      out16[n] = (int16_t)(((uint16_t)in[2u*n]<<8)|in[2u*n+1u]);
+    }
+    return;
+  }
+
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    if ( E_RTP_L16==source->config.encoding )
+    {
+      value = (int16_t)(((uint16_t)in[2u*n]<<8)|in[2u*n+1u]);
+      source->scratch[n] = (float)value*(1.0f/32768.0f);
+    }
+    else
+    {
+      value = (int32_t)(((uint32_t)in[3u*n]<<24)|((uint32_t)in[3u*n+1u]<<16)|
+          ((uint32_t)in[3u*n+2u]<<8))>>8;
+      source->scratch[n] = (float)value*(1.0f/8388608.0f);
+    }
+  }
+  convert_float_to_format (source->scratch, out, samples, source->format);
+}
+
+/******************************************************************************
+ *
+ * @fn void skip_frames (rtp_source*, uint32_t)
+ *
+ * @brief Move the playback position, releasing the packets passed
+ *
+ ******************************************************************************/
+static void skip_frames (rtp_source *source, uint32_t frames)
+{
+  uint32_t first = source->play_position/source->packet_frames;
+  uint32_t last;
+  uint32_t slot;
+
+  source->play_position += frames;
+  last = source->play_position/source->packet_frames;
+  for (uint32_t index = first; index<last; index++)
+  {
+    slot = (uint16_t)(source->base_sequence+index)&(RTP_SOURCE_SLOTS-1u);
+    if ( (NULL!=source->slots[slot])&&
+         (source->slots[slot]->sequence==
+             (uint16_t)(source->base_sequence+index)) )
+    {
+      release_packet (source, slot);
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void rebase (rtp_source*)
+ *
+ * @brief Move the origin of the positions to the current packet
+ *
+ * The positions are kept small so the packet indexes don't wrap
+ *
+ ******************************************************************************/
+static void rebase (rtp_source *source)
+{
+  uint32_t packets = source->play_position/source->packet_frames;
+  uint32_t frames = packets*source->packet_frames;
+
+  source->base_sequence = (uint16_t)(source->base_sequence+packets);
+  source->base_timestamp += frames;
+  source->play_position -= frames;
+  source->received_end -= frames;
+  source->last_transit += (double)frames;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t rtp_source_open (rtp_source*, const rtp_source_configuration*,
+ *                             const hw_configuration*)
+ *
+ * @brief Open the socket and allocate the jitter buffer
+ *
+ * All the memory is allocated here, nothing is allocated while streaming.
+ * The stream must have the rate and channels of the sound card, and the
+ * sound card an interleaved access
+ *
+ * @param[out] *source     stream received
+ * @param[in]  *config     configuration of the stream
+ * @param[in]  *hw_config  configuration returned by @ref configure_hw
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t rtp_source_open (rtp_source *source,
+                        const rtp_source_configuration *config,
+                        const hw_configuration *hw_config)
+{
+  struct sockaddr_in local = { 0 };
+  struct ip_mreq membership;
+  struct rtp_receive_batch *batch;
+  uint32_t num_packets = RTP_SOURCE_SLOTS+RTP_SOURCE_BATCH;
+  int enable = 1;
+  int size = RTP_RECEIVE_BUFFER;
+
+  if ( NULL==source )
+  {
+    return S_ERROR;
+  }
+
+  memset (source, 0, sizeof(*source));
+  source->socket_fd = -1;
+  if ( (NULL==config)||(NULL==hw_config)||(0u==config->num_channels)||
+       (config->sample_rate!=hw_config->sample_rate)||
+       (config->num_channels!=hw_config->num_channels)||
+       (E_LAYOUT_INTERLEAVED!=get_channel_layout (hw_config->access_type))||
+       (config->min_delay_ms>config->max_delay_ms) )
+  {
+    printf ("rtp_source_open Error: invalid configuration\n");
+    return S_ERROR;
+  }
+
+  source->config = *config;
+  source->config.address = NULL;
+  source->format = hw_config->format;
+  source->frame_bytes = ((E_RTP_L16==config->encoding) ? 2u : 3u)*
+      config->num_channels;
+  source->out_frame_bytes = (uint32_t)snd_pcm_format_size (
+      hw_config->format, config->num_channels);
+  source->min_frames = (uint32_t)((uint64_t)config->min_delay_ms*
+      config->sample_rate/1000u);
+  source->max_frames = (uint32_t)((uint64_t)config->max_delay_ms*
+      config->sample_rate/1000u);
+  source->target_frames = source->min_frames;
+
+  source->storage = malloc ((size_t)num_packets*RTP_SOURCE_MAX_PACKET);
+  source->scratch = malloc (sizeof(float)*RTP_SOURCE_MAX_PACKET);
+  source->batch = calloc (1u, sizeof(*source->batch));
+  if ( (NULL==source->storage)||(NULL==source->scratch)||
+       (NULL==source->batch)||(0u==source->out_frame_bytes) )
+  {
+    printf ("rtp_source_open Error: allocating the jitter buffer\n");
+    rtp_source_close (source);
+    return S_ERROR;
+  }
+
+  for (uint32_t n = 0; n<num_packets; n++)
+  {
+    source->packets[n].data = source->storage+(size_t)n*RTP_SOURCE_MAX_PACKET;
+    source->free_packets[n] = &source->packets[n];
+  }
+  source->num_free = num_packets;
+
+  batch = source->batch;
+  for (uint32_t n = 0; n<RTP_SOURCE_BATCH; n++)
+  {
+    batch->vectors[n].iov_len = RTP_SOURCE_MAX_PACKET;
+    batch->messages[n].msg_hdr.msg_iov = &batch->vectors[n];
+    batch->messages[n].msg_hdr.msg_iovlen = 1u;
+    batch->messages[n].msg_hdr.msg_control = batch->control[n];
+  }
+
+  local.sin_family = AF_INET;
+  local.sin_port = htons (config->port);
+  local.sin_addr.s_addr = htonl (INADDR_ANY);
+  if ( (NULL!=config->address)&&
+       (1!=inet_pton (AF_INET, config->address, &local.sin_addr)) )
+  {
+    printf ("rtp_source_open Error: invalid address %s\n", config->address);
+    rtp_source_close (source);
+    return S_ERROR;
+  }
+
+  /** @b SO_TIMESTAMPNS the kernel gives the arrival time of each datagram,
+   * the socket is drained once per block so the time of the call would
+   * hide the jitter */
+  source->socket_fd = socket (AF_INET, SOCK_DGRAM|SOCK_CLOEXEC, 0);
+  if ( (0>source->socket_fd)||
+       (0!=setsockopt (source->socket_fd, SOL_SOCKET, SO_REUSEADDR, &enable,
+                       sizeof(enable)))||
+       (0!=setsockopt (source->socket_fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable,
+                       sizeof(enable)))||
+       (0!=bind (source->socket_fd, (struct sockaddr*)&local, sizeof(local))) )
+  {
+    printf ("rtp_source_open Error: opening port %u, %s\n", config->port,
+            strerror (errno));
+    rtp_source_close (source);
+    return S_ERROR;
+  }
+
+  /* a bigger buffer holds the bursts between two blocks */
+  setsockopt (source->socket_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  if ( IN_MULTICAST(ntohl (local.sin_addr.s_addr)) )
+  {
+    membership.imr_multiaddr = local.sin_addr;
+    membership.imr_interface.s_addr = htonl (INADDR_ANY);
+    if ( 0!=setsockopt (source->socket_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                        &membership, sizeof(membership)) )
+    {
+      printf ("rtp_source_open Error: joining %s, %s\n", config->address,
+              strerror (errno));
+      rtp_source_close (source);
+      return S_ERROR;
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t rtp_source_render (void*, snd_pcm_uframes_t, void*)
+ *
+ * @brief Render a block of the pipeline from the jitter buffer
+ *
+ * Used as @ref pipeline_render_callback. The socket is drained first, then
+ * the frames are converted from the packets directly in the block. Silence
+ * is rendered while the target delay is buffered and for the packets lost
+ *
+ * @param[out] *block      block to fill (interleaved)
+ * @param       frames     number of frames to render
+ * @param[in]  *user_data  pointer to the @ref rtp_source
+ *
+ * @return int8_t @a S_SUCCESS
+ *
+ ******************************************************************************/
+int8_t rtp_source_render (void *block, snd_pcm_uframes_t frames,
+                          void *user_data)
+{
+  rtp_source *source = (rtp_source*)user_data;
+  uint8_t *out = (uint8_t*)block;
+  rtp_packet *packet;
+  uint32_t done = 0;
+  uint32_t index;
+  uint32_t offset;
+  uint32_t count;
+  uint32_t slot;
+  int32_t level;
+
+  source->block_frames = (uint32_t)frames;
+  receive_packets (source);
+
+  /* start when the target is buffered, with the delay of the target */
+  level = (int32_t)(source->received_end-source->play_position);
+  if ( (0u==source->playing)&&(0u!=source->synchronized)&&
+       (level>=(int32_t)source->target_frames) )
+  {
+    source->playing = 1u;
+    skip_frames (source, (uint32_t)level-source->target_frames);
+    level = (int32_t)source->target_frames;
+  }
+
+  /* a burst left more than the target, drop a packet once the level has
+   * been high for a while */
+  if ( (0u!=source->playing)&&
+       (level>(int32_t)(source->target_frames+source->packet_frames)) )
+  {
+    if ( ++source->shrink_count>=RTP_SHRINK_BLOCKS )
+    {
+      skip_frames (source, source->packet_frames);
+      source->stats.dropped_frames += source->packet_frames;
+      source->shrink_count = 0u;
+    }
+  }
+  else
+  {
+    source->shrink_count = 0u;
+  }
+
+  while ( (0u!=source->playing)&&(done<frames) )
+  {
+    index = source->play_position/source->packet_frames;
+    offset = source->play_position%source->packet_frames;
+    count = source->packet_frames-offset;
+    if ( count>frames-done )
+    {
+      count = (uint32_t)frames-done;
+    }
+
+    slot = (uint16_t)(source->base_sequence+index)&(RTP_SOURCE_SLOTS-1u);
+    packet = source->slots[slot];
+    if ( (NULL!=packet)&&
+         (packet->sequence==(uint16_t)(source->base_sequence+index)) )
+    {
+      decode_frames (source, packet->payload+(size_t)offset*source->frame_bytes,
+                     out+(size_t)done*source->out_frame_bytes, count);
+    }
+    else if ( 0>=(int32_t)(source->received_end-source->play_position) )
+    {
+      /* nothing left, buffer the target delay again */
+      source->stats.underruns++;
+      source->playing = 0u;
+      break;
+    }
+    else
+    {
+      snd_pcm_format_set_silence (source->format,
+                                  out+(size_t)done*source->out_frame_bytes,
+                                  count*source->config.num_channels);
+      if ( offset+count==source->packet_frames )
+      {
+        source->stats.lost++;
+      }
+    }
+
+    skip_frames (source, count);
+    done += count;
+  }
+
+  if ( done<frames )
+  {
+    snd_pcm_format_set_silence (source->format,
+                                out+(size_t)done*source->out_frame_bytes,
+                                (uint32_t)(frames-done)*
+                                    source->config.num_channels);
+  }
+
+  if ( (0u!=source->synchronized)&&(RTP_REBASE_FRAMES<source->play_position) )
+  {
+    rebase (source);
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t rtp_source_delay (const rtp_source*)
+ *
+ * @brief Get the frames buffered in the jitter buffer
+ *
+ * @param[in] *source  stream received
+ *
+ * @return uint32_t frames received and not played yet
+ *
+ ******************************************************************************/
+uint32_t rtp_source_delay (const rtp_source *source)
+{
+  int32_t level;
+
+  if ( (NULL==source)||(0u==source->synchronized) )
+  {
+    return 0u;
+  }
+
+  level = (int32_t)(source->received_end-source->play_position);
+
+  return (0<level) ? (uint32_t)level : 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn void rtp_source_print_stats (const rtp_source*)
+ *
+ * @brief Print the counters of the stream
+ *
+ * @param[in] *source  stream received
+ *
+ ******************************************************************************/
+void rtp_source_print_stats (const rtp_source *source)
+{
+  const rtp_source_stats *stats;
+  double ms_per_frame;
+
+  if ( NULL==source )
+  {
+    return;
+  }
+
+  stats = &source->stats;
+  ms_per_frame = 1000.0/source->config.sample_rate;
+  printf ("RTP: received = %llu (%.1f per recvmmsg), lost = %llu, late = %llu,"
+          " duplicated = %llu, invalid = %llu, resyncs = %llu\n",
+          (unsigned long long)stats->received,
+          (0u!=stats->receive_calls) ?
+              (double)stats->received/stats->receive_calls : 0.0,
+          (unsigned long long)stats->lost, (unsigned long long)stats->late,
+          (unsigned long long)stats->duplicated,
+          (unsigned long long)stats->invalid,
+          (unsigned long long)stats->resyncs);
+  printf ("RTP: jitter = %.2fms, target = %.2fms, underruns = %llu, "
+          "dropped = %.2fms\n", source->jitter*ms_per_frame,
+          source->target_frames*ms_per_frame,
+          (unsigned long long)stats->underruns,
+          stats->dropped_frames*ms_per_frame);
+}
+
+/******************************************************************************
+ *
+ * @fn void rtp_source_close (rtp_source*)
+ *
+ * @brief Close the socket and release the jitter buffer
+ *
+ * @param[in] *source  stream received
+ *
+ ******************************************************************************/
+void rtp_source_close (rtp_source *source)
+{
+  if ( NULL==source )
+  {
+    return;
+  }
+
+  if ( 0<=source->socket_fd )
+  {
+    close (source->socket_fd);
+    source->socket_fd = -1;
+  }
+  free (source->batch);
+  free (source->scratch);
+  free (source->storage);
+  source->batch = NULL;
+  source->scratch = NULL;
+  source->storage = NULL;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,173 @@
+/*******************************************************************************
+ * @file      rtp_source.h
+ *
+ * @brief      RTP/UDP ingest with an adaptive jitter buffer
+ *
+ * Source for the @ref playback_pipeline receiving the audio over RTP/UDP
+ * (L16 or L24 payloads, RFC 3551 / RFC 3190):
+ *      @li the datagrams are received in batches with @a recvmmsg, straight
+ *          into the packets of the jitter buffer, the only copy left is the
+ *          conversion from network byte order to the format of the sound card
+ *          done in the blocks of the @ref spsc_ring
+ *      @li the socket is drained by the producer thread each time a block is
+ *          rendered, the kernel timestamps (SO_TIMESTAMPNS) give the real
+ *          arrival time of each datagram for the jitter estimation
+ *      @li the jitter buffer is a table of packets indexed by the sequence
+ *          number, the reordered packets are put in place and the lost ones
+ *          are played as silence
+ *      @li the delay of the buffer follows the interarrival jitter
+ *          (RFC 3550): the playback starts when the target is buffered, and
+ *          if the level stays over the target a packet is dropped, so the
+ *          latency goes down again after a burst
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include <stdint.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _RTP_SOURCE_
+#define _RTP_SOURCE_
+
+#define RTP_SOURCE_SLOTS        (256u) /**< packets of the jitter buffer,
+                                            power of 2 */
+#define RTP_SOURCE_BATCH        (32u) /**< datagrams of each recvmmsg */
+#define RTP_SOURCE_MAX_PACKET   (1500u) /**< biggest datagram received */
+#define RTP_ANY_PAYLOAD_TYPE    (0xFFu) /**< accept any payload type */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Encoding of the payload, the samples are big endian and interleaved */
+typedef enum
+{
+  E_RTP_L16 = 0, /**< 16 bits linear (RFC 3551) */
+  E_RTP_L24 /**< 24 bits linear (RFC 3190) */
+} rtp_encoding;
+
+/** Configuration of the stream received */
+typedef struct
+{
+  const char *address; /**< local IPv4 address or multicast group, NULL to
+   receive from any interface */
+  uint16_t port; /**< UDP port */
+  uint8_t payload_type; /**< RTP payload type accepted or
+   @ref RTP_ANY_PAYLOAD_TYPE */
+  rtp_encoding encoding; /**< encoding of the payload */
+  uint32_t sample_rate; /**< rate of the stream (RTP clock) */
+  uint32_t num_channels; /**< channels of the stream */
+  uint32_t min_delay_ms; /**< smallest delay of the jitter buffer */
+  uint32_t max_delay_ms; /**< biggest delay of the jitter buffer */
+} rtp_source_configuration;
+
+/** Packet of the jitter buffer */
+typedef struct
+{
+  uint8_t *data; /**< datagram received */
+  const uint8_t *payload; /**< samples in @a data */
+  uint32_t frames; /**< frames of the payload */
+  uint32_t timestamp; /**< RTP timestamp of the first frame */
+  uint16_t sequence; /**< RTP sequence number */
+} rtp_packet;
+
+/** Counters of the stream */
+typedef struct
+{
+  uint64_t received; /**< packets put in the jitter buffer */
+  uint64_t receive_calls; /**< calls to recvmmsg */
+  uint64_t lost; /**< packets missing when they had to be played */
+  uint64_t late; /**< packets received after their time */
+  uint64_t duplicated; /**< packets received twice */
+  uint64_t invalid; /**< datagrams that aren't RTP of this stream */
+  uint64_t resyncs; /**< times the sender restarted the stream */
+  uint64_t underruns; /**< times the buffer got empty */
+  uint64_t dropped_frames; /**< frames dropped to reduce the delay */
+} rtp_source_stats;
+
+struct rtp_receive_batch;
+
+/** Stream received */
+typedef struct
+{
+  int socket_fd; /**< UDP socket */
+  rtp_source_configuration config; /**< configuration of the stream */
+  snd_pcm_format_t format; /**< format of the sound card */
+  uint32_t frame_bytes; /**< bytes of a frame of the payload */
+  uint32_t out_frame_bytes; /**< bytes of a frame of the sound card */
+  float *scratch; /**< samples of a packet converted to float */
+
+  uint8_t *storage; /**< memory of all the packets */
+  rtp_packet packets[RTP_SOURCE_SLOTS+RTP_SOURCE_BATCH]; /**< all the
+   packets, the extra batch is always free to receive */
+  rtp_packet *slots[RTP_SOURCE_SLOTS]; /**< jitter buffer, indexed by the
+   sequence number */
+  rtp_packet *free_packets[RTP_SOURCE_SLOTS+RTP_SOURCE_BATCH]; /**< stack of
+   the packets not in use */
+  uint32_t num_free; /**< packets in @a free_packets */
+  struct rtp_receive_batch *batch; /**< buffers of recvmmsg */
+
+  uint8_t synchronized; /**< 1 once the first packet was received */
+  uint8_t playing; /**< 0 while the target delay is buffered */
+  uint16_t base_sequence; /**< sequence of the packet at @a base_timestamp */
+  uint32_t base_timestamp; /**< origin of the positions */
+  uint32_t packet_frames; /**< frames of each packet */
+  uint32_t play_position; /**< next frame to play, from @a base_timestamp */
+  uint32_t received_end; /**< end of the newest packet received */
+
+  double jitter; /**< interarrival jitter in frames */
+  uint64_t first_arrival_ns; /**< origin of the arrival times */
+  double last_transit; /**< relative transit time of the last packet */
+  uint8_t has_transit; /**< 1 if @a last_transit is valid */
+  uint32_t min_frames; /**< smallest delay in frames */
+  uint32_t max_frames; /**< biggest delay in frames */
+  uint32_t block_frames; /**< frames of each block rendered */
+  uint32_t target_frames; /**< delay wanted in the buffer */
+  uint32_t shrink_count; /**< consecutive blocks over the target */
+  rtp_source_stats stats; /**< counters of the stream */
+} rtp_source;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t rtp_source_open (rtp_source *source,
+                        const rtp_source_configuration *config,
+                        const hw_configuration *hw_config);
+int8_t rtp_source_render (void *block, snd_pcm_uframes_t frames,
+                          void *user_data);
+uint32_t rtp_source_delay (const rtp_source *source);
+void rtp_source_print_stats (const rtp_source *source);
+void rtp_source_close (rtp_source *source);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
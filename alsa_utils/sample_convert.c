@@ -0,0 +1,954 @@
+/*******************************************************************************
+ * @file      sample_convert.c
+ *
+ * @brief      Conversion between float samples and the PCM formats
+ *
+ * Kernels to convert float buffers (range [-1.0, 1.0)) to the sample formats
+ * used by the sound cards, the values out of range are saturated.
+ *
+ * All the kernels saturate in float before converting to integer, this way
+ * the vectorized kernels give exactly the same result as the scalar ones:
+ *      @li x86 @a cvtps2dq returns 0x80000000 for any value out of range
+ *      @li NEON @a vcvtnq saturates to the int32 range, not to the format
+ *          range
+ *
+ * NaN is converted to the positive full scale everywhere, that's what
+ * @a minps gives when the sample is its first operand, the scalar and NEON
+ * kernels map it explicitly.
+ *
+ * The AVX2 kernels are compiled with the @a target attribute so the module
+ * can be built without @a -mavx2, and they're only used when the CPU reports
+ * support for them.
+ *
+ * @note The kernels assume a little endian host
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <math.h>
+#include "sample_convert.h"
+
+#if defined(__x86_64__)||defined(__i386__)
+#include <immintrin.h>
+#define CONVERT_HAVE_X86        (1u) /**< SSE2/AVX2 kernels available */
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CONVERT_HAVE_NEON       (1u) /**< NEON kernels available */
+#endif
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ ------------------------------------------------------------------------------*/
+#define S16_SCALE               (32768.0f) /**< @f$ 2^{15} @f$ */
+#define S16_MAX                 (32767.0f) /**< biggest S16 value */
+#define S24_SCALE               (8388608.0f) /**< @f$ 2^{23} @f$ */
+#define S24_MAX                 (8388607.0f) /**< biggest S24 value */
+#define S32_SCALE               (2147483648.0f) /**< @f$ 2^{31} @f$ */
+#define S32_MAX                 (2147483520.0f) /**< biggest float that fits
+                                                     in an int32 */
+#define RENDER_ANY_CHANNELS     (0u) /**< entry of @ref render_table used for
+                                          any number of channels */
+#define RENDER_BLOCK_SAMPLES    (8u*MAX_CHANNELS) /**< floats interleaved in
+                                                      the stack before each
+                                                      conversion */
+
+/*------------------------------------------------------------------------------
+ * Module Typedefs
+ ------------------------------------------------------------------------------*/
+/** Set of kernels of one instruction set */
+typedef struct
+{
+  convert_kernel s16; /**< float -> SND_PCM_FORMAT_S16_LE */
+  convert_kernel s24_3; /**< float -> SND_PCM_FORMAT_S24_3LE */
+  convert_kernel s32; /**< float -> SND_PCM_FORMAT_S32_LE */
+  convert_kernel flt; /**< float -> SND_PCM_FORMAT_FLOAT_LE */
+} convert_kernels;
+
+/** Render kernel of a (format, channels, layout) tuple */
+typedef struct
+{
+  snd_pcm_format_t format; /**< format of the output */
+  uint32_t num_channels; /**< channels, @ref RENDER_ANY_CHANNELS for the
+                              generic kernels */
+  channel_layout layout; /**< layout of the output */
+  render_kernel kernel; /**< kernel of the tuple */
+} render_entry;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn float saturate (float, float, float)
+ *
+ * @brief Limit a value to the range [min_val, max_val], NaN gives max_val
+ *
+ ******************************************************************************/
+static inline float saturate (float x, float min_val, float max_val)
+{
+  /* every comparison with NaN is false, so it falls to max_val */
+  return (x<min_val) ? min_val : ((x<=max_val) ? x : max_val);
+}
+
+/******************************************************************************
+ *
+ * @fn void store_s24_3le (uint8_t*, int32_t)
+ *
+ * @brief Store the lower 24 bits of a sample in 3 bytes (little endian)
+ *
+ ******************************************************************************/
+static inline void store_s24_3le (uint8_t *out, int32_t sample)
+{
+  out[0] = (uint8_t)sample;
+  out[1] = (uint8_t)(sample>>8);
+  out[2] = (uint8_t)(sample>>16);
+}
+
+/*------------------------------------------------------------------------------
+ * Scalar kernels
+ ------------------------------------------------------------------------------*/
+static void scalar_s16 (const float *in, void *out, uint32_t samples)
+{
+  int16_t *dst = (int16_t*)out;
+
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    dst[n] = (int16_t)lrintf (saturate (in[n]*S16_SCALE, -S16_SCALE, S16_MAX));
+  }
+}
+
+static void scalar_s24_3 (const float *in, void *out, uint32_t samples)
+{
+  uint8_t *dst = (uint8_t*)out;
+
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    store_s24_3le (&dst[3*n], (int32_t)lrintf (saturate (in[n]*S24_SCALE,
+                                                         -S24_SCALE, S24_MAX)));
+  }
+}
+
+static void scalar_s32 (const float *in, void *out, uint32_t samples)
+{
+  int32_t *dst = (int32_t*)out;
+
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    dst[n] = (int32_t)lrintf (saturate (in[n]*S32_SCALE, -S32_SCALE, S32_MAX));
+  }
+}
+
+static void scalar_float (const float *in, void *out, uint32_t samples)
+{
+  float *dst = (float*)out;
+
+  for (uint32_t n = 0; n<samples; n++)
+  {
+    dst[n] = saturate (in[n], -1.0f, 1.0f);
+  }
+}
+
+static const convert_kernels scalar_kernels = { .s16 = scalar_s16, .s24_3 =
+    scalar_s24_3, .s32 = scalar_s32, .flt = scalar_float };
+
+#ifdef CONVERT_HAVE_X86
+/*------------------------------------------------------------------------------
+ * SSE2 kernels
+ ------------------------------------------------------------------------------*/
+static void sse2_s16 (const float *in, void *out, uint32_t samples)
+{
+  int16_t *dst = (int16_t*)out;
+  const __m128 one = _mm_set1_ps (1.0f);
+  const __m128 minus_one = _mm_set1_ps (-1.0f);
+  const __m128 scale = _mm_set1_ps (S16_SCALE);
+  uint32_t n = 0;
+
+  for (; n+8u<=samples; n += 8u)
+  {
+    __m128 a = _mm_max_ps (_mm_min_ps (_mm_loadu_ps (&in[n]), one), minus_one);
+    __m128 b = _mm_max_ps (_mm_min_ps (_mm_loadu_ps (&in[n+4u]), one),
+                           minus_one);
+
+    /* 1.0 gives 32768, packs saturates it to 32767 like the scalar kernel */
+    _mm_storeu_si128 ((__m128i*)&dst[n],
+                      _mm_packs_epi32 (_mm_cvtps_epi32 (_mm_mul_ps (a, scale)),
+                                       _mm_cvtps_epi32 (_mm_mul_ps (b, scale))));
+  }
+  scalar_s16 (&in[n], &dst[n], samples-n);
+}
+
+static void sse2_s24_3 (const float *in, void *out, uint32_t samples)
+{
+  uint8_t *dst = (uint8_t*)out;
+  const __m128 min_val = _mm_set1_ps (-S24_SCALE);
+  const __m128 max_val = _mm_set1_ps (S24_MAX);
+  const __m128 scale = _mm_set1_ps (S24_SCALE);
+  int32_t tmp[4];
+  uint32_t n = 0;
+
+  for (; n+4u<=samples; n += 4u)
+  {
+    __m128 x = _mm_mul_ps (_mm_loadu_ps (&in[n]), scale);
+
+    x = _mm_max_ps (_mm_min_ps (x, max_val), min_val);
+    _mm_storeu_si128 ((__m128i*)tmp, _mm_cvtps_epi32 (x));
+    store_s24_3le (&dst[3*n], tmp[0]);
+    store_s24_3le (&dst[3*n+3], tmp[1]);
+    store_s24_3le (&dst[3*n+6], tmp[2]);
+    store_s24_3le (&dst[3*n+9], tmp[3]);
+  }
+  scalar_s24_3 (&in[n], &dst[3*n], samples-n);
+}
+
+static void sse2_s32 (const float *in, void *out, uint32_t samples)
+{
+  int32_t *dst = (int32_t*)out;
+  const __m128 min_val = _mm_set1_ps (-S32_SCALE);
+  const __m128 max_val = _mm_set1_ps (S32_MAX);
+  const __m128 scale = _mm_set1_ps (S32_SCALE);
+  uint32_t n = 0;
+
+  for (; n+4u<=samples; n += 4u)
+  {
+    __m128 x = _mm_mul_ps (_mm_loadu_ps (&in[n]), scale);
+
+    x = _mm_max_ps (_mm_min_ps (x, max_val), min_val);
+    _mm_storeu_si128 ((__m128i*)&dst[n], _mm_cvtps_epi32 (x));
+  }
+  scalar_s32 (&in[n], &dst[n], samples-n);
+}
+
+static void sse2_float (const float *in, void *out, uint32_t samples)
+{
+  float *dst = (float*)out;
+  const __m128 one = _mm_set1_ps (1.0f);
+  const __m128 minus_one = _mm_set1_ps (-1.0f);
+  uint32_t n = 0;
+
+  for (; n+4u<=samples; n += 4u)
+  {
+    _mm_storeu_ps (&dst[n],
+                   _mm_max_ps (_mm_min_ps (_mm_loadu_ps (&in[n]), one),
+                               minus_one));
+  }
+  scalar_float (&in[n], &dst[n], samples-n);
+}
+
+static const convert_kernels sse2_kernels = { .s16 = sse2_s16, .s24_3 =
+    sse2_s24_3, .s32 = sse2_s32, .flt = sse2_float };
+
+/*------------------------------------------------------------------------------
+ * AVX2 kernels
+ ------------------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static void avx2_s16 (const float *in, void *out, uint32_t samples)
+{
+  int16_t *dst = (int16_t*)out;
+  const __m256 one = _mm256_set1_ps (1.0f);
+  const __m256 minus_one = _mm256_set1_ps (-1.0f);
+  const __m256 scale = _mm256_set1_ps (S16_SCALE);
+  uint32_t n = 0;
+
+  for (; n+16u<=samples; n += 16u)
+  {
+    __m256 a = _mm256_max_ps (_mm256_min_ps (_mm256_loadu_ps (&in[n]), one),
+                              minus_one);
+    __m256 b = _mm256_max_ps (_mm256_min_ps (_mm256_loadu_ps (&in[n+8u]), one),
+                              minus_one);
+    __m256i packed = _mm256_packs_epi32 (
+        _mm256_cvtps_epi32 (_mm256_mul_ps (a, scale)),
+        _mm256_cvtps_epi32 (_mm256_mul_ps (b, scale)));
+
+    /* packs works on each 128 bits lane, put the samples back in order */
+    _mm256_storeu_si256 ((__m256i*)&dst[n],
+                         _mm256_permute4x64_epi64 (packed, 0xD8));
+  }
+  sse2_s16 (&in[n], &dst[n], samples-n);
+}
+
+__attribute__((target("avx2")))
+static void avx2_s32 (const float *in, void *out, uint32_t samples)
+{
+  int32_t *dst = (int32_t*)out;
+  const __m256 min_val = _mm256_set1_ps (-S32_SCALE);
+  const __m256 max_val = _mm256_set1_ps (S32_MAX);
+  const __m256 scale = _mm256_set1_ps (S32_SCALE);
+  uint32_t n = 0;
+
+  for (; n+8u<=samples; n += 8u)
+  {
+    __m256 x = _mm256_mul_ps (_mm256_loadu_ps (&in[n]), scale);
+
+    x = _mm256_max_ps (_mm256_min_ps (x, max_val), min_val);
+    _mm256_storeu_si256 ((__m256i*)&dst[n], _mm256_cvtps_epi32 (x));
+  }
+  sse2_s32 (&in[n], &dst[n], samples-n);
+}
+
+__attribute__((target("avx2")))
+static void avx2_float (const float *in, void *out, uint32_t samples)
+{
+  float *dst = (float*)out;
+  const __m256 one = _mm256_set1_ps (1.0f);
+  const __m256 minus_one = _mm256_set1_ps (-1.0f);
+  uint32_t n = 0;
+
+  for (; n+8u<=samples; n += 8u)
+  {
+    _mm256_storeu_ps (&dst[n],
+                      _mm256_max_ps (_mm256_min_ps (_mm256_loadu_ps (&in[n]),
+                                                    one),
+                                     minus_one));
+  }
+  sse2_float (&in[n], &dst[n], samples-n);
+}
+
+/* S24_3LE is limited by the byte stores, AVX2 doesn't help there */
+static const convert_kernels avx2_kernels = { .s16 = avx2_s16, .s24_3 =
+    sse2_s24_3, .s32 = avx2_s32, .flt = avx2_float };
+#endif
+
+#ifdef CONVERT_HAVE_NEON
+/*------------------------------------------------------------------------------
+ * NEON kernels
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn float32x4_t neon_saturate (float32x4_t, float32x4_t, float32x4_t)
+ *
+ * @brief Limit the values to the range [min_val, max_val], NaN gives max_val
+ *
+ ******************************************************************************/
+static inline float32x4_t neon_saturate (float32x4_t x, float32x4_t min_val,
+                                         float32x4_t max_val)
+{
+  /* vminq propagates NaN, replace it first like the x86 kernels do */
+  x = vbslq_f32 (vceqq_f32 (x, x), x, max_val);
+
+  return vmaxq_f32 (vminq_f32 (x, max_val), min_val);
+}
+
+/******************************************************************************
+ *
+ * @fn int32x4_t neon_round (float32x4_t)
+ *
+ * @brief Round to the nearest (ties to even) like @a lrintf
+ *
+ * ARMv7 has no @a vcvtn, adding and removing @f$ 2^{23} @f$ rounds in the
+ * round to nearest mode that NEON always uses, the floats from @f$ 2^{23} @f$
+ * up are integers already
+ *
+ ******************************************************************************/
+static inline int32x4_t neon_round (float32x4_t x)
+{
+#if defined(__aarch64__)
+  return vcvtnq_s32_f32 (x);
+#else
+  const float32x4_t integer = vdupq_n_f32 (S24_SCALE);
+  const uint32x4_t sign = vdupq_n_u32 (0x80000000u);
+  float32x4_t magnitude = vabsq_f32 (x);
+  float32x4_t rounded = vsubq_f32 (vaddq_f32 (magnitude, integer), integer);
+
+  rounded = vreinterpretq_f32_u32 (vorrq_u32 (
+      vreinterpretq_u32_f32 (rounded),
+      vandq_u32 (vreinterpretq_u32_f32 (x), sign)));
+
+  return vcvtq_s32_f32 (vbslq_f32 (vcltq_f32 (magnitude, integer), rounded,
+                                   x));
+#endif
+}
+
+static void neon_s16 (const float *in, void *out, uint32_t samples)
+{
+  int16_t *dst = (int16_t*)out;
+  const float32x4_t one = vdupq_n_f32 (1.0f);
+  const float32x4_t minus_one = vdupq_n_f32 (-1.0f);
+  uint32_t n = 0;
+
+  for (; n+8u<=samples; n += 8u)
+  {
+    float32x4_t a = neon_saturate (vld1q_f32 (&in[n]), minus_one, one);
+    float32x4_t b = neon_saturate (vld1q_f32 (&in[n+4u]), minus_one, one);
+
+    /* vqmovn saturates 32768 to 32767 like the scalar kernel */
+    vst1q_s16 (&dst[n],
+               vcombine_s16 (vqmovn_s32 (neon_round (vmulq_n_f32 (a,
+                                                         S16_SCALE))),
+                             vqmovn_s32 (neon_round (vmulq_n_f32 (b,
+                                                         S16_SCALE)))));
+  }
+  scalar_s16 (&in[n], &dst[n], samples-n);
+}
+
+static void neon_s24_3 (const float *in, void *out, uint32_t samples)
+{
+  uint8_t *dst = (uint8_t*)out;
+  const float32x4_t min_val = vdupq_n_f32 (-S24_SCALE);
+  const float32x4_t max_val = vdupq_n_f32 (S24_MAX);
+  int32_t tmp[4];
+  uint32_t n = 0;
+
+  for (; n+4u<=samples; n += 4u)
+  {
+    float32x4_t x = vmulq_n_f32 (vld1q_f32 (&in[n]), S24_SCALE);
+
+    x = neon_saturate (x, min_val, max_val);
+    vst1q_s32 (tmp, neon_round (x));
+    store_s24_3le (&dst[3*n], tmp[0]);
+    store_s24_3le (&dst[3*n+3], tmp[1]);
+    store_s24_3le (&dst[3*n+6], tmp[2]);
+    store_s24_3le (&dst[3*n+9], tmp[3]);
+  }
+  scalar_s24_3 (&in[n], &dst[3*n], samples-n);
+}
+
+static void neon_s32 (const float *in, void *out, uint32_t samples)
+{
+  int32_t *dst = (int32_t*)out;
+  const float32x4_t min_val = vdupq_n_f32 (-S32_SCALE);
+  const float32x4_t max_val = vdupq_n_f32 (S32_MAX);
+  uint32_t n = 0;
+
+  for (; n+4u<=samples; n += 4u)
+  {
+    float32x4_t x = vmulq_n_f32 (vld1q_f32 (&in[n]), S32_SCALE);
+
+    x = neon_saturate (x, min_val, max_val);
+    vst1q_s32 (&dst[n], neon_round (x));
+  }
+  scalar_s32 (&in[n], &dst[n], samples-n);
+}
+
+static void neon_float (const float *in, void *out, uint32_t samples)
+{
+  float *dst = (float*)out;
+  const float32x4_t one = vdupq_n_f32 (1.0f);
+  const float32x4_t minus_one = vdupq_n_f32 (-1.0f);
+  uint32_t n = 0;
+
+  for (; n+4u<=samples; n += 4u)
+  {
+    vst1q_f32 (&dst[n], neon_saturate (vld1q_f32 (&in[n]), minus_one, one));
+  }
+  scalar_float (&in[n], &dst[n], samples-n);
+}
+
+static const convert_kernels neon_kernels = { .s16 = neon_s16, .s24_3 =
+    neon_s24_3, .s32 = neon_s32, .flt = neon_float };
+#endif
+
+/*------------------------------------------------------------------------------
+ * Module Variable Definitions
+ ------------------------------------------------------------------------------*/
+/** kernels used by @ref convert_float_to_format */
+static const convert_kernels *active_kernels = &scalar_kernels;
+
+/** instruction set of @ref active_kernels */
+static convert_isa active_isa = E_ISA_SCALAR;
+
+/*------------------------------------------------------------------------------
+ * Render kernels
+ ------------------------------------------------------------------------------*/
+/** Interleaves the channels in a block of the stack and converts it with the
+ * kernel of the instruction set selected, so the conversion is vectorized
+ * and the block stays in L1. With a constant number of channels the
+ * interleaving is unrolled, the generic kernels pass @a num_channels */
+#define RENDER_INTERLEAVED(name, kernel, sample_bytes, channels) \
+  static void name (float **in, void **out, uint32_t frames, \
+                    uint32_t num_channels) \
+  { \
+    float block[RENDER_BLOCK_SAMPLES]; \
+    const uint32_t block_frames = RENDER_BLOCK_SAMPLES/(channels); \
+    uint8_t *dst = (uint8_t*)out[0]; \
+    uint32_t count; \
+    (void)num_channels; \
+    for (uint32_t start = 0; start<frames; start += count) \
+    { \
+      count = (frames-start<block_frames) ? frames-start : block_frames; \
+      for (size_t n = 0; n<count; n++) \
+      { \
+        _Pragma ("GCC unroll 8") \
+        for (size_t ch = 0; ch<(channels); ch++) \
+        { \
+          block[n*(channels)+ch] = in[ch][(size_t)start+n]; \
+        } \
+      } \
+      active_kernels->kernel (block, &dst[start*(channels)*(sample_bytes)], \
+                              count*(channels)); \
+    } \
+  }
+
+/** Converts each channel with the kernel of the instruction set selected,
+ * the buffers of a channel are contiguous so nothing has to be moved */
+#define RENDER_PLANAR(name, kernel, channels) \
+  static void name (float **in, void **out, uint32_t frames, \
+                    uint32_t num_channels) \
+  { \
+    (void)num_channels; \
+    for (uint32_t ch = 0; ch<(channels); ch++) \
+    { \
+      active_kernels->kernel (in[ch], out[ch], frames); \
+    } \
+  }
+
+RENDER_INTERLEAVED(render_s16_i1, s16, 2u, 1u)
+RENDER_INTERLEAVED(render_s16_i2, s16, 2u, 2u)
+RENDER_INTERLEAVED(render_s16_i8, s16, 2u, 8u)
+RENDER_INTERLEAVED(render_s16_in, s16, 2u, num_channels)
+RENDER_INTERLEAVED(render_s24_3_in, s24_3, 3u, num_channels)
+RENDER_INTERLEAVED(render_s32_i1, s32, 4u, 1u)
+RENDER_INTERLEAVED(render_s32_i2, s32, 4u, 2u)
+RENDER_INTERLEAVED(render_s32_i8, s32, 4u, 8u)
+RENDER_INTERLEAVED(render_s32_in, s32, 4u, num_channels)
+RENDER_INTERLEAVED(render_float_i1, flt, 4u, 1u)
+RENDER_INTERLEAVED(render_float_i2, flt, 4u, 2u)
+RENDER_INTERLEAVED(render_float_i8, flt, 4u, 8u)
+RENDER_INTERLEAVED(render_float_in, flt, 4u, num_channels)
+
+RENDER_PLANAR(render_s16_p1, s16, 1u)
+RENDER_PLANAR(render_s16_p2, s16, 2u)
+RENDER_PLANAR(render_s16_p8, s16, 8u)
+RENDER_PLANAR(render_s16_pn, s16, num_channels)
+RENDER_PLANAR(render_s24_3_pn, s24_3, num_channels)
+RENDER_PLANAR(render_s32_p1, s32, 1u)
+RENDER_PLANAR(render_s32_p2, s32, 2u)
+RENDER_PLANAR(render_s32_p8, s32, 8u)
+RENDER_PLANAR(render_s32_pn, s32, num_channels)
+RENDER_PLANAR(render_float_p1, flt, 1u)
+RENDER_PLANAR(render_float_p2, flt, 2u)
+RENDER_PLANAR(render_float_p8, flt, 8u)
+RENDER_PLANAR(render_float_pn, flt, num_channels)
+
+/** kernels of @ref sample_convert_get_render_kernel, the specialized ones go
+ * before the generic kernel of their format */
+static const render_entry render_table[] = {
+    { SND_PCM_FORMAT_S16_LE, 1u, E_LAYOUT_INTERLEAVED, render_s16_i1 },
+    { SND_PCM_FORMAT_S16_LE, 2u, E_LAYOUT_INTERLEAVED, render_s16_i2 },
+    { SND_PCM_FORMAT_S16_LE, 8u, E_LAYOUT_INTERLEAVED, render_s16_i8 },
+    { SND_PCM_FORMAT_S16_LE, RENDER_ANY_CHANNELS, E_LAYOUT_INTERLEAVED,
+        render_s16_in },
+    { SND_PCM_FORMAT_S16_LE, 1u, E_LAYOUT_PLANAR, render_s16_p1 },
+    { SND_PCM_FORMAT_S16_LE, 2u, E_LAYOUT_PLANAR, render_s16_p2 },
+    { SND_PCM_FORMAT_S16_LE, 8u, E_LAYOUT_PLANAR, render_s16_p8 },
+    { SND_PCM_FORMAT_S16_LE, RENDER_ANY_CHANNELS, E_LAYOUT_PLANAR,
+        render_s16_pn },
+    { SND_PCM_FORMAT_S24_3LE, RENDER_ANY_CHANNELS, E_LAYOUT_INTERLEAVED,
+        render_s24_3_in },
+    { SND_PCM_FORMAT_S24_3LE, RENDER_ANY_CHANNELS, E_LAYOUT_PLANAR,
+        render_s24_3_pn },
+    { SND_PCM_FORMAT_S32_LE, 1u, E_LAYOUT_INTERLEAVED, render_s32_i1 },
+    { SND_PCM_FORMAT_S32_LE, 2u, E_LAYOUT_INTERLEAVED, render_s32_i2 },
+    { SND_PCM_FORMAT_S32_LE, 8u, E_LAYOUT_INTERLEAVED, render_s32_i8 },
+    { SND_PCM_FORMAT_S32_LE, RENDER_ANY_CHANNELS, E_LAYOUT_INTERLEAVED,
+        render_s32_in },
+    { SND_PCM_FORMAT_S32_LE, 1u, E_LAYOUT_PLANAR, render_s32_p1 },
+    { SND_PCM_FORMAT_S32_LE, 2u, E_LAYOUT_PLANAR, render_s32_p2 },
+    { SND_PCM_FORMAT_S32_LE, 8u, E_LAYOUT_PLANAR, render_s32_p8 },
+    { SND_PCM_FORMAT_S32_LE, RENDER_ANY_CHANNELS, E_LAYOUT_PLANAR,
+        render_s32_pn },
+    { SND_PCM_FORMAT_FLOAT_LE, 1u, E_LAYOUT_INTERLEAVED, render_float_i1 },
+    { SND_PCM_FORMAT_FLOAT_LE, 2u, E_LAYOUT_INTERLEAVED, render_float_i2 },
+    { SND_PCM_FORMAT_FLOAT_LE, 8u, E_LAYOUT_INTERLEAVED, render_float_i8 },
+    { SND_PCM_FORMAT_FLOAT_LE, RENDER_ANY_CHANNELS, E_LAYOUT_INTERLEAVED,
+        render_float_in },
+    { SND_PCM_FORMAT_FLOAT_LE, 1u, E_LAYOUT_PLANAR, render_float_p1 },
+    { SND_PCM_FORMAT_FLOAT_LE, 2u, E_LAYOUT_PLANAR, render_float_p2 },
+    { SND_PCM_FORMAT_FLOAT_LE, 8u, E_LAYOUT_PLANAR, render_float_p8 },
+    { SND_PCM_FORMAT_FLOAT_LE, RENDER_ANY_CHANNELS, E_LAYOUT_PLANAR,
+        render_float_pn } };
+
+/******************************************************************************
+ *
+ * @fn int8_t sample_convert_init (void)
+ *
+ * @brief Select the fastest kernels supported by the CPU
+ *
+ * @note This should be called once before starting the audio threads
+ *
+ * @return int8_t @a S_SUCCESS
+ *
+ ******************************************************************************/
+int8_t sample_convert_init (void)
+{
+#ifdef CONVERT_HAVE_X86
+  if ( S_SUCCESS==sample_convert_set_isa (E_ISA_AVX2) )
+  {
+    return S_SUCCESS;
+  }
+  if ( S_SUCCESS==sample_convert_set_isa (E_ISA_SSE2) )
+  {
+    return S_SUCCESS;
+  }
+#endif
+#ifdef CONVERT_HAVE_NEON
+  if ( S_SUCCESS==sample_convert_set_isa (E_ISA_NEON) )
+  {
+    return S_SUCCESS;
+  }
+#endif
+
+  return sample_convert_set_isa (E_ISA_SCALAR);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t sample_convert_set_isa (convert_isa)
+ *
+ * @brief Force the kernels of an instruction set, e.g. to compare them
+ *
+ * @param isa   instruction set to use
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if the
+ *         instruction set is not supported by this build or by the CPU
+ *
+ ******************************************************************************/
+int8_t sample_convert_set_isa (convert_isa isa)
+{
+  const convert_kernels *kernels = NULL;
+
+  switch (isa)
+  {
+    case E_ISA_SCALAR:
+      kernels = &scalar_kernels;
+      break;
+#ifdef CONVERT_HAVE_X86
+    case E_ISA_SSE2:
+      __builtin_cpu_init ();
+      if ( __builtin_cpu_supports ("sse2") )
+      {
+        kernels = &sse2_kernels;
+      }
+      break;
+    case E_ISA_AVX2:
+      __builtin_cpu_init ();
+      if ( __builtin_cpu_supports ("avx2") )
+      {
+        kernels = &avx2_kernels;
+      }
+      break;
+#endif
+#ifdef CONVERT_HAVE_NEON
+    case E_ISA_NEON:
+      /* NEON is mandatory in aarch64, ARMv7 builds only get here when the
+       * compiler targets a CPU with NEON */
+      kernels = &neon_kernels;
+      break;
+#endif
+    default:
+      break;
+  }
+
+  if ( NULL==kernels )
+  {
+    return S_ERROR;
+  }
+
+  active_kernels = kernels;
+  active_isa = isa;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn convert_isa sample_convert_get_isa (void)
+ *
+ * @brief Get the instruction set of the kernels in use
+ *
+ * @return convert_isa instruction set in use
+ *
+ ******************************************************************************/
+convert_isa sample_convert_get_isa (void)
+{
+  return active_isa;
+}
+
+/******************************************************************************
+ *
+ * @fn const char* sample_convert_isa_name (convert_isa)
+ *
+ * @brief Get a printable name of an instruction set
+ *
+ * @param isa   instruction set
+ *
+ * @return const char* name of the instruction set
+ *
+ ******************************************************************************/
+const char* sample_convert_isa_name (convert_isa isa)
+{
+  switch (isa)
+  {
+    case E_ISA_SCALAR:
+      return "scalar";
+    case E_ISA_SSE2:
+      return "sse2";
+    case E_ISA_AVX2:
+      return "avx2";
+    case E_ISA_NEON:
+      return "neon";
+    default:
+      return "unknown";
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn convert_kernel sample_convert_get_kernel (snd_pcm_format_t)
+ *
+ * @brief Get the active kernel for a format, useful to resolve it once
+ *        outside of the audio loop
+ *
+ * @param format    output format
+ *
+ * @return convert_kernel kernel for the format, NULL if the format is not
+ *         supported
+ *
+ ******************************************************************************/
+convert_kernel sample_convert_get_kernel (snd_pcm_format_t format)
+{
+  switch (format)
+  {
+    case SND_PCM_FORMAT_S16_LE:
+      return active_kernels->s16;
+    case SND_PCM_FORMAT_S24_3LE:
+      return active_kernels->s24_3;
+    case SND_PCM_FORMAT_S32_LE:
+      return active_kernels->s32;
+    case SND_PCM_FORMAT_FLOAT_LE:
+      return active_kernels->flt;
+    default:
+      return NULL;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn render_kernel sample_convert_get_render_kernel (snd_pcm_format_t,
+ *                                                    uint32_t,
+ *                                                    channel_layout)
+ *
+ * @brief Get the kernel that converts one float buffer per channel to a
+ *        format and layout, @ref configure_hw stores it in
+ *        @ref hw_configuration
+ *
+ * S16_LE, S32_LE and FLOAT_LE with 1, 2 or 8 channels have kernels
+ * specialized at build time, without branches in the loop and with the
+ * channels unrolled, the rest of channel counts (up to @ref MAX_CHANNELS)
+ * and S24_3LE use a generic kernel. The result is the same as
+ * @ref convert_float_channels.
+ *
+ * @param format        format of the output
+ * @param num_channels  number of channels
+ * @param layout        layout of the output, the input is always planar
+ *
+ * @return render_kernel kernel of the tuple, NULL if the format or the
+ *         number of channels are not supported
+ *
+ ******************************************************************************/
+render_kernel sample_convert_get_render_kernel (snd_pcm_format_t format,
+                                                uint32_t num_channels,
+                                                channel_layout layout)
+{
+  if ( (0u==num_channels)||(MAX_CHANNELS<num_channels) )
+  {
+    return NULL;
+  }
+
+  for (uint32_t n = 0; n<sizeof(render_table)/sizeof(render_table[0]); n++)
+  {
+    const render_entry *entry = &render_table[n];
+
+    if ( (format==entry->format)&&(layout==entry->layout)&&
+         ((num_channels==entry->num_channels)||
+          (RENDER_ANY_CHANNELS==entry->num_channels)) )
+    {
+      return entry->kernel;
+    }
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t convert_float_to_format (const float*, void*, uint32_t,
+ *                                     snd_pcm_format_t)
+ *
+ * @brief Convert float samples to a PCM format with saturation
+ *
+ * The conversion works sample by sample, so it can be used for interleaved
+ * buffers (@a samples = frames*channels) or for each channel of a non
+ * interleaved buffer
+ *
+ * @param[in]  *in      float samples in the range [-1.0, 1.0)
+ * @param[out] *out     buffer for the converted samples
+ * @param       samples number of samples to convert
+ * @param       format  output format
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t convert_float_to_format (const float *in, void *out, uint32_t samples,
+                                snd_pcm_format_t format)
+{
+  convert_kernel kernel = sample_convert_get_kernel (format);
+
+  if ( (NULL==in)||(NULL==out)||(NULL==kernel) )
+  {
+    return S_ERROR;
+  }
+
+  kernel (in, out, samples);
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t convert_float_channels (float**, void**, uint32_t, uint32_t,
+ *                                    channel_layout, snd_pcm_format_t)
+ *
+ * @brief Convert a multichannel float buffer to a PCM format
+ *
+ * Input and output use the same @ref channel_layout, in interleaved mode only
+ * the first pointer of @a in and @a out is used
+ *
+ * @param[in]  *in              float buffers
+ * @param[out] *out             buffers for the converted samples
+ * @param       frames          number of frames to convert
+ * @param       num_channels    number of channels
+ * @param       layout          organization of the buffers
+ * @param       format          output format
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t convert_float_channels (float **in, void **out, uint32_t frames,
+                               uint32_t num_channels, channel_layout layout,
+                               snd_pcm_format_t format)
+{
+  if ( (NULL==in)||(NULL==out) )
+  {
+    return S_ERROR;
+  }
+
+  if ( E_LAYOUT_INTERLEAVED==layout )
+  {
+    return convert_float_to_format (in[0], out[0], frames*num_channels,
+                                    format);
+  }
+
+  for (uint32_t ch = 0; ch<num_channels; ch++)
+  {
+    if ( S_SUCCESS!=convert_float_to_format (in[ch], out[ch], frames,
+                                             format) )
+    {
+      return S_ERROR;
+    }
+  }
+
+  return S_SUCCESS;
+}
+/******************************************************************************
+ *
+ * @fn int8_t convert_format_to_float (const void*, float**, uint32_t,
+ *                                     uint32_t, snd_pcm_format_t)
+ *
+ * @brief Convert an interleaved PCM buffer to one float buffer per channel
+ *
+ * This is the opposite of @ref convert_float_channels for the captured
+ * audio, the samples are scaled to the range [-1.0, 1.0)
+ *
+ * @param[in]  *in            interleaved samples
+ * @param[out] *out           one float buffer for each channel
+ * @param       frames        number of frames to convert
+ * @param       num_channels  number of channels
+ * @param       format        format of @a in (S16_LE, S24_3LE, S32_LE or
+ *                            FLOAT_LE)
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t convert_format_to_float (const void *in, float **out, uint32_t frames,
+                                uint32_t num_channels, snd_pcm_format_t format)
+{
+  const int16_t *s16 = (const int16_t*)in;
+  const uint8_t *s24 = (const uint8_t*)in;
+  const int32_t *s32 = (const int32_t*)in;
+  const float *flt = (const float*)in;
+  int32_t value;
+
+  if ( (NULL==in)||(NULL==out) )
+  {
+    return S_ERROR;
+  }
+
+  for (uint32_t ch = 0; ch<num_channels; ch++)
+  {
+    float *channel = out[ch];
+
+    switch (format)
+    {
+      case SND_PCM_FORMAT_S16_LE:
+        for (uint32_t n = 0; n<frames; n++)
+        {
+          channel[n] = (float)s16[n*num_channels+ch]*(1.0f/32768.0f);
+        }
+        break;
+      case SND_PCM_FORMAT_S24_3LE:
+        for (uint32_t n = 0; n<frames; n++)
+        {
+          const uint8_t *bytes = &s24[(n*num_channels+ch)*3u];
+
+          /* the sample goes to the top of the int32 to extend the sign */
+          value = (int32_t)((uint32_t)bytes[0]<<8|(uint32_t)bytes[1]<<16|
+              (uint32_t)bytes[2]<<24);
+          channel[n] = (float)value*(1.0f/2147483648.0f);
+        }
+        break;
+      case SND_PCM_FORMAT_S32_LE:
+        for (uint32_t n = 0; n<frames; n++)
+        {
+          channel[n] = (float)s32[n*num_channels+ch]*(1.0f/2147483648.0f);
+        }
+        break;
+      case SND_PCM_FORMAT_FLOAT_LE:
+        for (uint32_t n = 0; n<frames; n++)
+        {
+          channel[n] = flt[n*num_channels+ch];
+        }
+        break;
+      default:
+        return S_ERROR;
+    }
+  }
+
+  return S_SUCCESS;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
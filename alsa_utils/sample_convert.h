@@ -0,0 +1,93 @@
+/*******************************************************************************
+ * @file      sample_convert.h
+ *
+ * @brief      Conversion between float samples and the PCM formats
+ *
+ * Kernels to convert float buffers (range [-1.0, 1.0)) to the sample formats
+ * used by the sound cards, the values out of range are saturated:
+ *      @li SND_PCM_FORMAT_S16_LE
+ *      @li SND_PCM_FORMAT_S24_3LE
+ *      @li SND_PCM_FORMAT_S32_LE
+ *      @li SND_PCM_FORMAT_FLOAT_LE
+ *
+ * The kernels are vectorized with SSE2/AVX2 on x86 and NEON on aarch64 and
+ * on the 32 bit ARM builds with NEON (e.g. -mfpu=neon on a Cortex-A7), the
+ * best implementation is selected at runtime by @ref sample_convert_init,
+ * before that the scalar kernels are used.
+ *
+ * @note The kernels assume a little endian host
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include <stdint.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _SAMPLE_CONVERT_
+#define _SAMPLE_CONVERT_
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Instruction sets that can be used by the conversion kernels */
+typedef enum
+{
+  E_ISA_SCALAR = 0, /**< plain C, always available */
+  E_ISA_SSE2, /**< x86 SSE2 */
+  E_ISA_AVX2, /**< x86 AVX2 */
+  E_ISA_NEON /**< ARM NEON, aarch64 or ARMv7 */
+} convert_isa;
+
+/** Kernel converting @a samples floats from @a in into @a out */
+typedef void (*convert_kernel) (const float *in, void *out, uint32_t samples);
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t sample_convert_init (void);
+int8_t sample_convert_set_isa (convert_isa isa);
+convert_isa sample_convert_get_isa (void);
+const char* sample_convert_isa_name (convert_isa isa);
+convert_kernel sample_convert_get_kernel (snd_pcm_format_t format);
+render_kernel sample_convert_get_render_kernel (snd_pcm_format_t format,
+                                                uint32_t num_channels,
+                                                channel_layout layout);
+int8_t convert_float_to_format (const float *in, void *out, uint32_t samples,
+                                snd_pcm_format_t format);
+int8_t convert_float_channels (float **in, void **out, uint32_t frames,
+                               uint32_t num_channels, channel_layout layout,
+                               snd_pcm_format_t format);
+int8_t convert_format_to_float (const void *in, float **out, uint32_t frames,
+                                uint32_t num_channels, snd_pcm_format_t format);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,210 @@
+/*******************************************************************************
+ * @file      signal_source.c
+ *
+ * @brief      Sources of audio pulled once per period
+ *
+ * The sample @a n of the channel @a ch is @a data[ch][n] in planar mode and
+ * @a data[0][n*num_channels+ch] in interleaved mode, like in
+ * @ref oscillator_fill.
+ *
+ * @note
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <string.h>
+#include "signal_source.h"
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t signal_source_fill (const signal_source*, float**, uint32_t,
+ *                                uint32_t, channel_layout, fill_mode)
+ *
+ * @brief Pull the next frames of a source with its gain
+ *
+ * @param[in]     *source        source to pull
+ * @param[in,out] **data         buffers of the period
+ * @param           frames       frames to render
+ * @param           num_channels channels of the period
+ * @param           layout       organization of @a data
+ * @param           mode         write or add the samples
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t signal_source_fill (const signal_source *source, float **data,
+                           uint32_t frames, uint32_t num_channels,
+                           channel_layout layout, fill_mode mode)
+{
+  if ( (NULL==source)||(NULL==source->fill)||(NULL==data)||
+       (0u==num_channels)||(MAX_CHANNELS<num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  return source->fill (source->context, data, frames, num_channels, layout,
+                       mode, source->gain);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t signal_mix (const signal_source*, uint32_t, float**, uint32_t,
+ *                        uint32_t, channel_layout)
+ *
+ * @brief Render the sum of several sources in a period
+ *
+ * The first source writes the period and the others add to it, the period
+ * is silence without sources
+ *
+ * @param[in]     *sources       sources to mix
+ * @param          num_sources   number of sources
+ * @param[out]   **data          buffers of the period
+ * @param          frames        frames to render
+ * @param          num_channels  channels of the period
+ * @param          layout        organization of @a data
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR if a source
+ *         failed
+ *
+ ******************************************************************************/
+int8_t signal_mix (const signal_source *sources, uint32_t num_sources,
+                   float **data, uint32_t frames, uint32_t num_channels,
+                   channel_layout layout)
+{
+  if ( 0u==num_sources )
+  {
+    return signal_silence (data, frames, num_channels, layout);
+  }
+  if ( NULL==sources )
+  {
+    return S_ERROR;
+  }
+
+  for (uint32_t s = 0; s<num_sources; s++)
+  {
+    if ( S_SUCCESS!=signal_source_fill (&sources[s], data, frames,
+                                        num_channels, layout,
+                                        (0u==s) ? E_FILL_REPLACE : E_FILL_ADD) )
+    {
+      return S_ERROR;
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t signal_silence (float**, uint32_t, uint32_t, channel_layout)
+ *
+ * @brief Clear a period
+ *
+ * @param[out] **data         buffers of the period
+ * @param        frames       frames to clear
+ * @param        num_channels channels of the period
+ * @param        layout       organization of @a data
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t signal_silence (float **data, uint32_t frames, uint32_t num_channels,
+                       channel_layout layout)
+{
+  if ( (NULL==data)||(0u==num_channels)||(MAX_CHANNELS<num_channels) )
+  {
+    return S_ERROR;
+  }
+
+  if ( E_LAYOUT_PLANAR!=layout )
+  {
+    memset (data[0], 0, sizeof(float)*frames*num_channels);
+    return S_SUCCESS;
+  }
+
+  for (uint32_t ch = 0; ch<num_channels; ch++)
+  {
+    memset (data[ch], 0, sizeof(float)*frames);
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t signal_oscillator_fill (void*, float**, uint32_t, uint32_t,
+ *                                    channel_layout, fill_mode, float)
+ *
+ * @brief @ref signal_fill_callback of an @ref oscillator, the same wave is
+ *        rendered in all the channels
+ *
+ * The phase is kept in the oscillator, so any frequency joins the periods
+ * without discontinuities
+ *
+ * @param[in,out] *context       pointer to the @ref oscillator
+ * @param[in,out] **data         buffers of the period
+ * @param           frames       frames to render
+ * @param           num_channels channels of the period
+ * @param           layout       organization of @a data
+ * @param           mode         write or add the samples
+ * @param           gain         gain applied to the wave
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t signal_oscillator_fill (void *context, float **data, uint32_t frames,
+                               uint32_t num_channels, channel_layout layout,
+                               fill_mode mode, float gain)
+{
+  oscillator *osc = (oscillator*)context;
+  float sample;
+  float *out;
+
+  if ( (NULL==osc)||(NULL==data) )
+  {
+    return S_ERROR;
+  }
+
+  /* the wave is computed once per frame and copied to the channels */
+  for (uint32_t n = 0; n<frames; n++)
+  {
+    sample = gain*oscillator_tick (osc);
+    for (uint32_t ch = 0; ch<num_channels; ch++)
+    {
+      out = (E_LAYOUT_PLANAR==layout) ? &data[ch][n] :
+          &data[0][n*num_channels+ch];
+      *out = (E_FILL_ADD==mode) ? *out+sample : sample;
+    }
+  }
+
+  return S_SUCCESS;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
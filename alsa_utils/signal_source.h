@@ -0,0 +1,107 @@
+/*******************************************************************************
+ * @file      signal_source.h
+ *
+ * @brief      Sources of audio pulled once per period
+ *
+ * A source renders the next frames of a stream each time it's pulled and
+ * keeps its state (phase, position...) between calls, so a stream of any
+ * length only needs the buffer of a period and the periods join without
+ * discontinuities.
+ *
+ * The sources can write the period or add to it, @ref signal_mix pulls
+ * several sources into the same buffer, the first one writes and the rest add
+ * their samples, so no intermediate buffers are needed to mix them.
+ *
+ * @note
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "alsa_utils.h"
+#include "oscillator.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _SIGNAL_SOURCE_
+#define _SIGNAL_SOURCE_
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** What a source does with the samples already in the period */
+typedef enum
+{
+  E_FILL_REPLACE = 0, /**< overwrite the period */
+  E_FILL_ADD /**< add to the period, used to mix */
+} fill_mode;
+
+/** Callback rendering the next frames of a source
+ *
+ * @param[in,out] *context       state of the source
+ * @param[in,out] **data         buffers of the period, like
+ *                               @ref oscillator_fill
+ * @param           frames       frames to render
+ * @param           num_channels channels of the period
+ * @param           layout       organization of @a data
+ * @param           mode         write or add the samples
+ * @param           gain         gain applied to the samples
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise */
+typedef int8_t (*signal_fill_callback) (void *context, float **data,
+                                        uint32_t frames,
+                                        uint32_t num_channels,
+                                        channel_layout layout, fill_mode mode,
+                                        float gain);
+
+/** Source of a stream */
+typedef struct
+{
+  signal_fill_callback fill; /**< renders the next frames */
+  void *context; /**< state given to @a fill */
+  float gain; /**< linear gain of the source in the mix */
+} signal_source;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t signal_source_fill (const signal_source *source, float **data,
+                           uint32_t frames, uint32_t num_channels,
+                           channel_layout layout, fill_mode mode);
+int8_t signal_mix (const signal_source *sources, uint32_t num_sources,
+                   float **data, uint32_t frames, uint32_t num_channels,
+                   channel_layout layout);
+int8_t signal_silence (float **data, uint32_t frames, uint32_t num_channels,
+                       channel_layout layout);
+int8_t signal_oscillator_fill (void *context, float **data, uint32_t frames,
+                               uint32_t num_channels, channel_layout layout,
+                               fill_mode mode, float gain);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
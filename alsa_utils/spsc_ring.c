@@ -0,0 +1,244 @@
+/*******************************************************************************
+ * @file      spsc_ring.c
+ *
+ * @brief      Lock-free single producer/single consumer ring of blocks
+ *
+ * Ring buffer of fixed size blocks shared between exactly one producer thread
+ * and one consumer thread, see @ref spsc_ring.
+ *
+ * The producer publishes a block with a release store of @a head, the consumer
+ * reads it with an acquire load, this guarantees that the content of the
+ * block is visible before the consumer uses it (and the same for @a tail in
+ * the other direction).
+ *
+ * @note
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "spsc_ring.h"
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t spsc_ring_init (spsc_ring*, uint32_t, size_t)
+ *
+ * @brief Create a ring and allocate all its blocks
+ *
+ * The storage is page aligned and each block starts on a cache line, so two
+ * threads never write to the same cache line
+ *
+ * @param[out] *ring         pointer to the ring
+ * @param       num_blocks   number of blocks, it must be a power of 2
+ * @param       block_bytes  size of each block in bytes
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t spsc_ring_init (spsc_ring *ring, uint32_t num_blocks,
+                       size_t block_bytes)
+{
+  void *storage;
+  long page_size = sysconf (_SC_PAGESIZE);
+
+  if ( (NULL==ring)||(0u==num_blocks)||(0u!=(num_blocks&(num_blocks-1u)))||
+       (0u==block_bytes) )
+  {
+    return S_ERROR;
+  }
+
+  ring->block_bytes = block_bytes;
+  ring->block_stride = (block_bytes+CACHE_LINE_SIZE-1u)&
+      ~((size_t)CACHE_LINE_SIZE-1u);
+  ring->num_blocks = num_blocks;
+  ring->mask = num_blocks-1u;
+
+  if ( 0!=posix_memalign (&storage, (0<page_size) ? (size_t)page_size : 4096u,
+                          ring->block_stride*num_blocks) )
+  {
+    return S_ERROR;
+  }
+
+  /* touch all the blocks now so we don't get page faults while streaming */
+  memset (storage, 0, ring->block_stride*num_blocks);
+  ring->storage = (uint8_t*)storage;
+
+  atomic_init (&ring->head, 0u);
+  atomic_init (&ring->tail, 0u);
+  ring->cached_head = 0u;
+  ring->cached_tail = 0u;
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn void spsc_ring_destroy (spsc_ring*)
+ *
+ * @brief Free the memory of the ring, both threads must be stopped
+ *
+ * @param[in] *ring  pointer to the ring
+ *
+ ******************************************************************************/
+void spsc_ring_destroy (spsc_ring *ring)
+{
+  if ( NULL!=ring )
+  {
+    free (ring->storage);
+    ring->storage = NULL;
+  }
+}
+
+/******************************************************************************
+ *
+ * @fn void* spsc_ring_write_block (spsc_ring*)
+ *
+ * @brief Get the next free block (producer side)
+ *
+ * The block is not visible to the consumer until @ref spsc_ring_commit_write
+ * is called, calling this again without commit returns the same block
+ *
+ * @param[in] *ring  pointer to the ring
+ *
+ * @return void* pointer to the free block, NULL if the ring is full
+ *
+ ******************************************************************************/
+void* spsc_ring_write_block (spsc_ring *ring)
+{
+  uint32_t head = (uint32_t)atomic_load_explicit (&ring->head,
+                                                  memory_order_relaxed);
+
+  if ( (head-ring->cached_tail)>=ring->num_blocks )
+  {
+    ring->cached_tail = (uint32_t)atomic_load_explicit (&ring->tail,
+                                                        memory_order_acquire);
+    if ( (head-ring->cached_tail)>=ring->num_blocks )
+    {
+      return NULL;
+    }
+  }
+
+  return ring->storage+(head&ring->mask)*ring->block_stride;
+}
+
+/******************************************************************************
+ *
+ * @fn void spsc_ring_commit_write (spsc_ring*)
+ *
+ * @brief Publish the block returned by @ref spsc_ring_write_block
+ *
+ * @param[in] *ring  pointer to the ring
+ *
+ ******************************************************************************/
+void spsc_ring_commit_write (spsc_ring *ring)
+{
+  uint32_t head = (uint32_t)atomic_load_explicit (&ring->head,
+                                                  memory_order_relaxed);
+
+  atomic_store_explicit (&ring->head, head+1u, memory_order_release);
+}
+
+/******************************************************************************
+ *
+ * @fn void* spsc_ring_read_block (spsc_ring*)
+ *
+ * @brief Get the oldest published block (consumer side)
+ *
+ * The block belongs to the consumer until @ref spsc_ring_release_read is
+ * called
+ *
+ * @param[in] *ring  pointer to the ring
+ *
+ * @return void* pointer to the block, NULL if the ring is empty
+ *
+ ******************************************************************************/
+void* spsc_ring_read_block (spsc_ring *ring)
+{
+  uint32_t tail = (uint32_t)atomic_load_explicit (&ring->tail,
+                                                  memory_order_relaxed);
+
+  if ( tail==ring->cached_head )
+  {
+    ring->cached_head = (uint32_t)atomic_load_explicit (&ring->head,
+                                                        memory_order_acquire);
+    if ( tail==ring->cached_head )
+    {
+      return NULL;
+    }
+  }
+
+  return ring->storage+(tail&ring->mask)*ring->block_stride;
+}
+
+/******************************************************************************
+ *
+ * @fn void spsc_ring_release_read (spsc_ring*)
+ *
+ * @brief Give the block returned by @ref spsc_ring_read_block back to the
+ *        producer
+ *
+ * @param[in] *ring  pointer to the ring
+ *
+ ******************************************************************************/
+void spsc_ring_release_read (spsc_ring *ring)
+{
+  uint32_t tail = (uint32_t)atomic_load_explicit (&ring->tail,
+                                                  memory_order_relaxed);
+
+  atomic_store_explicit (&ring->tail, tail+1u, memory_order_release);
+}
+
+/******************************************************************************
+ *
+ * @fn uint32_t spsc_ring_count (spsc_ring*)
+ *
+ * @brief Get the number of published blocks, it can be called from any
+ *        thread but the value is only a snapshot
+ *
+ * @param[in] *ring  pointer to the ring
+ *
+ * @return uint32_t number of blocks waiting to be read
+ *
+ ******************************************************************************/
+uint32_t spsc_ring_count (spsc_ring *ring)
+{
+  uint32_t tail = (uint32_t)atomic_load_explicit (&ring->tail,
+                                                  memory_order_acquire);
+  uint32_t head = (uint32_t)atomic_load_explicit (&ring->head,
+                                                  memory_order_acquire);
+
+  return head-tail;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,98 @@
+/*******************************************************************************
+ * @file      spsc_ring.h
+ *
+ * @brief      Lock-free single producer/single consumer ring of blocks
+ *
+ * Ring buffer of fixed size blocks (e.g. one period each) shared between
+ * exactly one producer thread and one consumer thread. The blocks are
+ * preallocated when the ring is created, the producer renders directly in the
+ * block returned by @ref spsc_ring_write_block and the consumer uses it in
+ * place, so no data is copied and no lock is taken.
+ *
+ * Usage:
+ *      @li producer: @ref spsc_ring_write_block, fill the block,
+ *          @ref spsc_ring_commit_write
+ *      @li consumer: @ref spsc_ring_read_block, use the block,
+ *          @ref spsc_ring_release_read
+ *
+ * @note
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _SPSC_RING_
+#define _SPSC_RING_
+
+#define CACHE_LINE_SIZE         (64u) /**< used to keep the producer and
+                                           consumer data on different lines */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Ring of blocks, @a head and @a tail are free running counters, the ring is
+ * empty when they're equal and full when they differ by @a num_blocks. Each
+ * side keeps a copy of the counter of the other side so the shared cache
+ * line is only read when the copy says the ring is full/empty */
+typedef struct
+{
+  _Alignas(CACHE_LINE_SIZE) atomic_uint head; /**< next block to be
+   written, only modified by the producer */
+  uint32_t cached_tail; /**< last @a tail seen by the producer */
+
+  _Alignas(CACHE_LINE_SIZE) atomic_uint tail; /**< next block to be
+   read, only modified by the consumer */
+  uint32_t cached_head; /**< last @a head seen by the consumer */
+
+  _Alignas(CACHE_LINE_SIZE) uint8_t *storage; /**< memory of all the blocks */
+  size_t block_bytes; /**< usable size of each block */
+  size_t block_stride; /**< distance between blocks (cache line multiple) */
+  uint32_t num_blocks; /**< number of blocks, power of 2 */
+  uint32_t mask; /**< num_blocks-1, used to wrap the counters */
+} spsc_ring;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t spsc_ring_init (spsc_ring *ring, uint32_t num_blocks,
+                       size_t block_bytes);
+void spsc_ring_destroy (spsc_ring *ring);
+void* spsc_ring_write_block (spsc_ring *ring);
+void spsc_ring_commit_write (spsc_ring *ring);
+void* spsc_ring_read_block (spsc_ring *ring);
+void spsc_ring_release_read (spsc_ring *ring);
+uint32_t spsc_ring_count (spsc_ring *ring);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
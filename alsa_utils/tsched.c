@@ -0,0 +1,493 @@
+/*******************************************************************************
+ * @file      tsched.c
+ *
+ * @brief      Timer based scheduling of a playback stream
+ *
+ * Timer based scheduling of a playback stream in MMAP mode, see
+ * @ref tsched_stream.
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ ------------------------------------------------------------------------------*/
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "pcm_stats.h"
+#include "rt_log.h"
+#include "tsched.h"
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ ------------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn snd_pcm_uframes_t tsched_us_to_frames (uint32_t, uint32_t)
+ *
+ * @brief Convert a time in us to frames at the given rate
+ *
+ ******************************************************************************/
+static snd_pcm_uframes_t tsched_us_to_frames (uint32_t us, uint32_t rate)
+{
+  return (snd_pcm_uframes_t)(((uint64_t)us*rate)/1000000u);
+}
+
+/******************************************************************************
+ *
+ * @fn void tsched_grow_margin (tsched_stream*)
+ *
+ * @brief Double the safety margin, up to the maximum
+ *
+ ******************************************************************************/
+static void tsched_grow_margin (tsched_stream *stream)
+{
+  stream->margin *= 2u;
+  if ( stream->margin>stream->margin_max )
+  {
+    stream->margin = stream->margin_max;
+  }
+  stream->wakeups_in_time = 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn void tsched_decay_margin (tsched_stream*)
+ *
+ * @brief Reduce the safety margin after @ref TSCHED_DECAY_WAKEUPS in time
+ *
+ ******************************************************************************/
+static void tsched_decay_margin (tsched_stream *stream)
+{
+  stream->wakeups_in_time++;
+  if ( TSCHED_DECAY_WAKEUPS>stream->wakeups_in_time )
+  {
+    return;
+  }
+
+  /* slowly, an eighth each time, a single late wakeup doubles it again */
+  stream->margin -= stream->margin/8u;
+  if ( stream->margin<stream->margin_min )
+  {
+    stream->margin = stream->margin_min;
+  }
+  stream->wakeups_in_time = 0u;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t tsched_arm (tsched_stream*, uint64_t, snd_pcm_sframes_t)
+ *
+ * @brief Arm the timer for the moment the queued frames reach the margin
+ *
+ ******************************************************************************/
+static int8_t tsched_arm (tsched_stream *stream, uint64_t now_ns,
+                          snd_pcm_sframes_t queued)
+{
+  snd_pcm_uframes_t sleep_frames;
+  uint64_t deadline_ns;
+  struct itimerspec timer = { .it_interval = { 0, 0 } };
+
+  /* if the buffer couldn't be filled over the margin try again soon */
+  sleep_frames = ( (snd_pcm_sframes_t)stream->margin<queued ) ?
+      (snd_pcm_uframes_t)queued-stream->margin : stream->margin_min/2u+1u;
+
+  deadline_ns = now_ns+((uint64_t)sleep_frames*1000000000u)/stream->sample_rate;
+  timer.it_value.tv_sec = (time_t)(deadline_ns/1000000000u);
+  timer.it_value.tv_nsec = (long)(deadline_ns%1000000000u);
+
+  if ( S_SUCCESS>timerfd_settime (stream->timer_fd, TFD_TIMER_ABSTIME, &timer,
+                                  NULL) )
+  {
+    rt_log_printf ("tsched_arm Error: arming the timer, errno = %d\n", errno);
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t tsched_refill (tsched_stream*)
+ *
+ * @brief Measure the level of the buffer, render up to the target and arm
+ *        the next wakeup
+ *
+ ******************************************************************************/
+static int8_t tsched_refill (tsched_stream *stream)
+{
+  int err;
+  uint64_t now_ns;
+  uint64_t tstamp_ns;
+  snd_htimestamp_t tstamp;
+  snd_pcm_state_t state;
+  snd_pcm_uframes_t avail;
+  snd_pcm_uframes_t target;
+  snd_pcm_sframes_t queued;
+  snd_pcm_sframes_t written;
+
+  /** @b snd_pcm_status updates the hardware pointer and returns in one call
+   * the state, the free frames and the time of the pointer update, the
+   * frames played since then are estimated from the rate */
+  err = snd_pcm_status (stream->sound_card_handle, stream->status);
+  now_ns = pcm_stats_now_ns ();
+  if ( S_SUCCESS>err )
+  {
+    rt_log_printf ("tsched_refill Error: reading the status, Err = %d\n", err);
+    return S_ERROR;
+  }
+
+  state = snd_pcm_status_get_state (stream->status);
+  avail = snd_pcm_status_get_avail (stream->status);
+
+  if ( (SND_PCM_STATE_XRUN==state)||(SND_PCM_STATE_SUSPENDED==state) )
+  {
+    err = snd_pcm_recover (stream->sound_card_handle,
+                           (SND_PCM_STATE_XRUN==state) ? -EPIPE : -ESTRPIPE,
+                           1);
+    if ( S_SUCCESS>err )
+    {
+      rt_log_printf ("tsched_refill Error: recovering the stream, Err = %d\n",
+                     err);
+      return S_ERROR;
+    }
+    stream->xruns++;
+    tsched_grow_margin (stream);
+    state = snd_pcm_state (stream->sound_card_handle);
+    avail = stream->buffer_size;
+  }
+
+  if ( (SND_PCM_STATE_RUNNING==state)&&(0u!=stream->extrapolate) )
+  {
+    snd_pcm_status_get_htstamp (stream->status, &tstamp);
+    tstamp_ns = (uint64_t)tstamp.tv_sec*1000000000u+(uint64_t)tstamp.tv_nsec;
+    if ( (0u!=tstamp_ns)&&(now_ns>tstamp_ns) )
+    {
+      avail += (snd_pcm_uframes_t)(((now_ns-tstamp_ns)*stream->sample_rate)/
+          1000000000u);
+    }
+  }
+  if ( avail>stream->buffer_size )
+  {
+    avail = stream->buffer_size;
+  }
+  queued = (snd_pcm_sframes_t)(stream->buffer_size-avail);
+
+  /* the timer was armed for the moment the level reached the margin, what
+   * is left of it is the slack of this wakeup */
+  if ( SND_PCM_STATE_RUNNING==state )
+  {
+    if ( queued<stream->min_queued )
+    {
+      stream->min_queued = queued;
+    }
+    if ( queued<(snd_pcm_sframes_t)(stream->margin/2u) )
+    {
+      stream->late_wakeups++;
+      tsched_grow_margin (stream);
+    }
+    else
+    {
+      tsched_decay_margin (stream);
+    }
+  }
+
+  target = stream->margin+stream->wakeup_frames;
+  if ( (snd_pcm_sframes_t)target>queued )
+  {
+    written = mmap_write_available (stream->sound_card_handle,
+                                    target-(snd_pcm_uframes_t)queued,
+                                    stream->render, stream->user_data);
+    if ( 0>written )
+    {
+      rt_log_printf ("tsched_refill Error: writing to the sound card, "
+                     "Err = %ld\n", (long)written);
+      return S_ERROR;
+    }
+    stream->frames_written += (uint64_t)written;
+    queued += written;
+  }
+
+  /* the start threshold is the boundary, we start once there is audio */
+  if ( (SND_PCM_STATE_PREPARED==snd_pcm_state (stream->sound_card_handle))&&
+       (0<queued) )
+  {
+    err = snd_pcm_start (stream->sound_card_handle);
+    if ( S_SUCCESS>err )
+    {
+      rt_log_printf ("tsched_refill Error: starting the stream, Err = %d\n",
+                     err);
+      return S_ERROR;
+    }
+  }
+
+  return tsched_arm (stream, now_ns, queued);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t tsched_init (tsched_stream*, snd_pcm_t*,
+ *                         const tsched_configuration*, mmap_render_callback,
+ *                         void*)
+ *
+ * @brief Configure a playback stream to be refilled from a timer
+ *
+ * The HW parameters must be already set (@ref configure_hw) with an MMAP
+ * access, a big buffer gives the margin room to adapt and big periods keep
+ * the IRQ rate low. The SW parameters are replaced:
+ * @li avail_min is the whole buffer and the period events are disabled, so
+ *     poll on the PCM doesn't wake up on the period interrupts
+ * @li the start threshold is the boundary, @ref tsched_start starts the
+ *     stream after the first refill
+ * @li the timestamps are enabled with CLOCK_MONOTONIC, the same clock of the
+ *     timer
+ *
+ * @note Devices that only update the hardware pointer on the period
+ *       interrupts (@a snd_pcm_hw_params_is_batch) can't be extrapolated
+ *       between them, the smallest margin is raised to one period
+ *
+ * @param[out] *stream             pointer to the stream to initialize
+ * @param[in]  *sound_card_handle  handle of the sound card
+ * @param[in]  *tsched_config      wakeup interval and margins
+ * @param       render             callback rendering in the ring buffer
+ * @param[in]  *user_data          pointer given to the callback
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t tsched_init (tsched_stream *stream, snd_pcm_t *sound_card_handle,
+                    const tsched_configuration *tsched_config,
+                    mmap_render_callback render, void *user_data)
+{
+  int err;
+  unsigned int rate = 0u;
+  snd_pcm_uframes_t period_size;
+  snd_pcm_hw_params_t *hw_params;
+  sw_configuration sw_config;
+
+  if ( (NULL==stream)||(NULL==sound_card_handle)||(NULL==tsched_config)||
+       (NULL==render) )
+  {
+    return S_ERROR;
+  }
+
+  memset (stream, 0, sizeof(*stream));
+  stream->sound_card_handle = sound_card_handle;
+  stream->render = render;
+  stream->user_data = user_data;
+  stream->timer_fd = -1;
+
+  snd_pcm_hw_params_alloca(&hw_params);
+  err = snd_pcm_hw_params_current (sound_card_handle, hw_params);
+  if ( S_SUCCESS<=err )
+  {
+    err = snd_pcm_hw_params_get_rate (hw_params, &rate, NULL);
+  }
+  if ( S_SUCCESS<=err )
+  {
+    err = snd_pcm_get_params (sound_card_handle, &stream->buffer_size,
+                              &period_size);
+  }
+  if ( (S_SUCCESS>err)||(0u==rate) )
+  {
+    rt_log_printf ("tsched_init Error: reading the HW configuration, Err = %d\n",
+                   err);
+    return S_ERROR;
+  }
+  stream->sample_rate = rate;
+
+  /* the margin can't take more than half of the buffer and the wakeup must
+   * fit in the rest */
+  stream->margin_max = tsched_us_to_frames (tsched_config->margin_max_us,
+                                            rate);
+  if ( stream->margin_max>stream->buffer_size/2u )
+  {
+    stream->margin_max = stream->buffer_size/2u;
+  }
+  stream->margin_min = tsched_us_to_frames (tsched_config->margin_min_us,
+                                            rate);
+  if ( 0!=snd_pcm_hw_params_is_batch (hw_params) )
+  {
+    if ( stream->margin_min<period_size )
+    {
+      stream->margin_min = period_size;
+    }
+    rt_log_printf ("tsched_init Warning: batch device, margin of one period\n");
+  }
+  if ( stream->margin_min>stream->margin_max )
+  {
+    stream->margin_min = stream->margin_max;
+  }
+  stream->wakeup_frames = tsched_us_to_frames (tsched_config->wakeup_us, rate);
+  if ( stream->wakeup_frames>stream->buffer_size-stream->margin_max )
+  {
+    stream->wakeup_frames = stream->buffer_size-stream->margin_max;
+  }
+  if ( (0u==stream->margin_min)||(0u==stream->wakeup_frames) )
+  {
+    rt_log_printf ("tsched_init Error: buffer of %lu frames is too small\n",
+                   (unsigned long)stream->buffer_size);
+    return S_ERROR;
+  }
+  stream->margin = stream->margin_min;
+  stream->min_queued = (snd_pcm_sframes_t)stream->buffer_size;
+
+  sw_config = (sw_configuration){ .avail_min = stream->buffer_size,
+      .start_threshold = SW_BOUNDARY, .stop_threshold = SW_KEEP_DEFAULT,
+      .silence_threshold = 0u, .silence_size = 0u, .period_event = 0u,
+      .timestamps = 1u };
+  if ( S_SUCCESS!=configure_sw (sound_card_handle, &sw_config) )
+  {
+    return S_ERROR;
+  }
+
+  /* without the monotonic timestamps the extrapolation would mix clocks,
+   * this only costs some latency so it's not an error */
+  if ( S_SUCCESS!=set_monotonic_timestamps (sound_card_handle) )
+  {
+    rt_log_printf ("tsched_init Warning: no monotonic timestamps, the level "
+                   "is not extrapolated\n");
+  }
+  else
+  {
+    stream->extrapolate = 1u;
+  }
+
+  if ( S_SUCCESS>snd_pcm_status_malloc (&stream->status) )
+  {
+    rt_log_printf ("tsched_init Error: allocating the status\n");
+    return S_ERROR;
+  }
+
+  stream->timer_fd = timerfd_create (CLOCK_MONOTONIC,
+                                     TFD_NONBLOCK|TFD_CLOEXEC);
+  if ( 0>stream->timer_fd )
+  {
+    rt_log_printf ("tsched_init Error: creating the timer, errno = %d\n", errno);
+    snd_pcm_status_free (stream->status);
+    stream->status = NULL;
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t tsched_start (tsched_stream*)
+ *
+ * @brief Render the first frames, start the stream and arm the timer
+ *
+ * After this call the stream is serviced by @ref tsched_on_timer, e.g. from
+ * a @ref pcm_event_loop:
+ * @code
+ * event_loop_add_fd (&loop, stream.timer_fd, POLLIN, tsched_on_timer,
+ *                    &stream);
+ * @endcode
+ *
+ * @param[in,out] *stream  pointer to the stream
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int8_t tsched_start (tsched_stream *stream)
+{
+  if ( (NULL==stream)||(0>stream->timer_fd) )
+  {
+    return S_ERROR;
+  }
+
+  return tsched_refill (stream);
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t tsched_on_timer (int, short, void*)
+ *
+ * @brief Service a wakeup of the timer, used as @ref fd_ready_callback
+ *
+ * @param      fd         timer_fd of the stream
+ * @param      revents    events returned by poll
+ * @param[in] *user_data  pointer to the @ref tsched_stream
+ *
+ * @return int8_t @a S_SUCCESS to continue, @a S_ERROR to stop the loop
+ *
+ ******************************************************************************/
+int8_t tsched_on_timer (int fd, short revents, void *user_data)
+{
+  uint64_t expirations;
+  tsched_stream *stream = (tsched_stream*)user_data;
+
+  if ( (NULL==stream)||(0u!=((unsigned)revents&(POLLERR|POLLNVAL))) )
+  {
+    return S_ERROR;
+  }
+
+  /* the timer is one shot, nothing to read means a spurious wakeup */
+  if ( (ssize_t)sizeof(expirations)!=read (fd, &expirations,
+                                           sizeof(expirations)) )
+  {
+    return (EAGAIN==errno) ? S_SUCCESS : S_ERROR;
+  }
+  stream->wakeups++;
+
+  return tsched_refill (stream);
+}
+
+/******************************************************************************
+ *
+ * @fn void tsched_close (tsched_stream*)
+ *
+ * @brief Release the timer and the status, the sound card is not closed
+ *
+ * @param[in,out] *stream  pointer to the stream
+ *
+ ******************************************************************************/
+void tsched_close (tsched_stream *stream)
+{
+  if ( NULL==stream )
+  {
+    return;
+  }
+
+  if ( 0<=stream->timer_fd )
+  {
+    close (stream->timer_fd);
+    stream->timer_fd = -1;
+  }
+  if ( NULL!=stream->status )
+  {
+    snd_pcm_status_free (stream->status);
+    stream->status = NULL;
+  }
+}
+/*-------------- END OF FILE -------------------------------------------------*/
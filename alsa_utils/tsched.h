@@ -0,0 +1,118 @@
+/*******************************************************************************
+ * @file      tsched.h
+ *
+ * @brief      Timer based scheduling of a playback stream
+ *
+ * Timer based scheduling (tsched) of a playback stream in MMAP mode:
+ *      @li the buffer is big and the period interrupts don't wake up the
+ *          application (@a snd_pcm_sw_params_set_period_event disabled and
+ *          avail_min set to the whole buffer), so big periods can be used and
+ *          the IRQ rate is low
+ *      @li the wakeups come from a timerfd, the fill level of the buffer is
+ *          read with @a snd_pcm_status and extrapolated from the time of the
+ *          hardware pointer update to the current time
+ *      @li each wakeup renders only up to @a margin + @a wakeup of queued audio
+ *          and the timer is armed for the moment the level reaches the margin,
+ *          so the latency is the margin plus one wakeup interval whatever the
+ *          buffer size is
+ *      @li the margin is adaptive, it's doubled when a wakeup comes late (more
+ *          than half of the margin was used) or on xrun, and it decays slowly
+ *          after many wakeups in time
+ *
+ * @note Link using -lasound
+ *
+ * @author      hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include <stdint.h>
+#include "alsa_utils.h"
+
+/*------------------------------------------------------------------------------
+ * Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#ifndef _TSCHED_
+#define _TSCHED_
+
+#define TSCHED_DEFAULT_WAKEUP_US     (10000u) /**< time between wakeups */
+#define TSCHED_DEFAULT_MARGIN_MIN_US (2000u) /**< smallest safety margin */
+#define TSCHED_DEFAULT_MARGIN_MAX_US (100000u) /**< biggest safety margin */
+#define TSCHED_DECAY_WAKEUPS         (200u) /**< wakeups in time before the
+                                                 margin is reduced */
+
+/*------------------------------------------------------------------------------
+ * Typedefs
+ -----------------------------------------------------------------------------*/
+/** Configuration of the timer scheduling, the times are converted to frames
+ * with the rate of the stream and limited by the buffer size */
+typedef struct
+{
+  uint32_t wakeup_us; /**< audio rendered ahead of the margin on each
+   wakeup, i.e. the time between wakeups */
+  uint32_t margin_min_us; /**< starting and smallest safety margin, the
+   audio still queued when the timer expires */
+  uint32_t margin_max_us; /**< biggest safety margin */
+} tsched_configuration;
+
+/** Playback stream scheduled with a timer, the statistics can be read from
+ * the thread running the stream or after it stopped */
+typedef struct
+{
+  snd_pcm_t *sound_card_handle; /**< handle of the sound card */
+  mmap_render_callback render; /**< renders in the ring buffer */
+  void *user_data; /**< pointer given to the render callback */
+  snd_pcm_status_t *status; /**< status read on each wakeup */
+  int timer_fd; /**< timerfd on CLOCK_MONOTONIC driving the wakeups */
+  uint32_t sample_rate; /**< rate of the stream */
+  snd_pcm_uframes_t buffer_size; /**< size of the ring buffer */
+  snd_pcm_uframes_t wakeup_frames; /**< frames rendered over the margin */
+  snd_pcm_uframes_t margin_min; /**< smallest margin in frames */
+  snd_pcm_uframes_t margin_max; /**< biggest margin in frames */
+  snd_pcm_uframes_t margin; /**< current margin in frames */
+  uint8_t extrapolate; /**< 1 when the timestamps use CLOCK_MONOTONIC */
+  uint32_t wakeups_in_time; /**< wakeups in time since the last change of the
+   margin */
+  uint64_t wakeups; /**< timer expirations serviced */
+  uint64_t late_wakeups; /**< wakeups that used more than half the margin */
+  uint64_t xruns; /**< underruns recovered */
+  uint64_t frames_written; /**< frames rendered since the start */
+  snd_pcm_sframes_t min_queued; /**< smallest level seen on a wakeup */
+} tsched_stream;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+int8_t tsched_init (tsched_stream *stream, snd_pcm_t *sound_card_handle,
+                    const tsched_configuration *tsched_config,
+                    mmap_render_callback render, void *user_data);
+int8_t tsched_start (tsched_stream *stream);
+int8_t tsched_on_timer (int fd, short revents, void *user_data);
+void tsched_close (tsched_stream *stream);
+#endif
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -0,0 +1,171 @@
+/*******************************************************************************
+ * @file          basic_pcm_capture.c
+ *
+ * @brief         Simple client for the ALSA capture
+ *
+ * Records a sound card into a WAV or raw file with a @ref capture_engine,
+ * the capture thread never waits for the disk:
+ *
+ * Usage: basic_pcm_capture output [seconds] [device]
+ *
+ * By default the @a default device is recorded for 10 seconds
+ *
+ * @note          Link using -lasound, -lalsa_utils, -lpthread,
+ *                -L${workspace_loc:/alsa_utils/Debug/} and
+ *                -I${workspace_loc:/alsa_utils}
+ *
+ * @author        hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 Hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include <stdlib.h>
+#include "alsa_utils.h"
+#include "capture_engine.h"
+#include "rt_setup.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#define CAPTURE_SECONDS         (10u) /**< default duration of the record */
+#define CAPTURE_BLOCKS          (16u) /**< blocks between the capture and the
+                                           writer threads */
+#define RT_PRIORITY             (80) /**< SCHED_FIFO priority of the thread
+                                         reading the sound card */
+#define RT_CPU                  (RT_KEEP_AFFINITY) /**< CPU for the thread
+                                         reading the sound card */
+#define CAPTURE_ACCESS_TYPE     (SND_PCM_ACCESS_RW_INTERLEAVED) /**< use
+                                  SND_PCM_ACCESS_MMAP_INTERLEAVED to copy
+                                  directly from the ring buffer */
+
+/******************************************************************************
+ *
+ * @fn int main (int, char**)
+ *
+ * @brief Main function of the program
+ *
+ * @param argc  number of arguments
+ * @param argv  output file, optional seconds and device
+ *
+ * @return int  @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int main (int argc, char **argv)
+{
+  /** @b snd_pcm_t  pcm_handle  Handle for the PCM device */
+  snd_pcm_t *pcm_handle;
+
+  /** @b hw_configuration Hardware configuration that we want
+   * @li sample rate = 48KHz
+   * @li 4 periods of 1024 frames, the capture thread reads a period at once
+   * @li access type = interleaved, the blocks are written as they are */
+  hw_configuration hw_configuration = { .sample_rate = 48000u, .periods = 4,
+      .period_size = 1024, .sample_rate_direction = E_EXACT_CONFIG,
+      .access_type = CAPTURE_ACCESS_TYPE, .num_channels = 2,
+      .frame_size_direction = E_EXACT_CONFIG, .format = SND_PCM_FORMAT_S16_LE };
+
+  /** @b rt_configuration real time setup of the thread reading the sound
+   * card, the writer thread is a normal thread */
+  rt_configuration rt_config = { .priority = RT_PRIORITY, .cpu = RT_CPU,
+      .lock_memory = 0u, .stack_prefault_size = RT_DEFAULT_STACK_SIZE };
+  rt_configuration lock_config = { .priority = RT_KEEP_POLICY, .cpu =
+      RT_KEEP_AFFINITY, .lock_memory = 1u, .stack_prefault_size = 0u };
+
+  capture_engine engine;
+  char *pcm_name = "default";
+  uint32_t seconds = CAPTURE_SECONDS;
+  int8_t err = 0u;
+  int pcm_err;
+
+  if ( 2>argc )
+  {
+    printf ("Usage: basic_pcm_capture output [seconds] [device]\n");
+    return S_ERROR;
+  }
+  if ( 2<argc )
+  {
+    seconds = (uint32_t)strtoul (argv[2], NULL, 10);
+  }
+  if ( 3<argc )
+  {
+    pcm_name = argv[3];
+  }
+
+  pcm_err = snd_pcm_open (&pcm_handle, pcm_name, SND_PCM_STREAM_CAPTURE,
+                          PCM_OPEN_STANDARD_MODE);
+  if ( S_SUCCESS>pcm_err )
+  {
+    printf ("Error opening sound card, Err = %d\n", pcm_err);
+    return S_ERROR;
+  }
+
+  /* configure_hw returns S_ERROR, not an ALSA error code */
+  err = configure_hw (pcm_handle, &hw_configuration);
+  if ( S_SUCCESS!=err )
+  {
+    printf ("Unable to configure HW\n");
+    snd_pcm_close (pcm_handle);
+
+    return S_ERROR;
+  }
+
+  /** @b capture_engine all the blocks are allocated here, after that the
+   * memory is locked so the capture thread never takes a page fault */
+  if ( S_SUCCESS!=capture_engine_init (&engine, pcm_handle, &hw_configuration,
+                                       argv[1], CAPTURE_BLOCKS) )
+  {
+    printf ("Error creating the capture engine\n");
+    snd_pcm_close (pcm_handle);
+
+    return S_ERROR;
+  }
+  engine.capture_rt_config = &rt_config;
+  configure_rt_thread (&lock_config);
+
+  printf ("Recording %us from %s to %s (%s)\n", seconds, pcm_name, argv[1],
+          (0u!=engine.direct_io) ? "O_DIRECT" : "buffered");
+  err = capture_engine_start (&engine,
+                              (uint64_t)seconds*hw_configuration.sample_rate);
+  if ( S_SUCCESS==err )
+  {
+    err = capture_engine_wait (&engine);
+  }
+
+  printf ("Frames captured = %llu, bytes written = %llu\n",
+          (unsigned long long)atomic_load (&engine.frames_captured),
+          (unsigned long long)atomic_load (&engine.bytes_written));
+  printf ("Dropped blocks = %llu, xruns = %llu\n",
+          (unsigned long long)atomic_load (&engine.dropped_blocks),
+          (unsigned long long)atomic_load (&engine.xruns));
+
+  capture_engine_destroy (&engine);
+  snd_pcm_close (pcm_handle);
+
+  return (S_SUCCESS==err) ? S_SUCCESS : S_ERROR;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
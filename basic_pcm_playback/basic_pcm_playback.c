@@ -3,10 +3,14 @@
  *
  * @brief         Simple client for the ALSA playback
  *
- * Simple client for the ALSA playback
+ * Simple client for the ALSA playback, it plays a sine wave or the WAV/raw
+ * file given in the command line, or with @ref USE_RTP_SOURCE the RTP
+ * stream received in @ref RTP_PORT:
+ *
+ * Usage: basic_pcm_playback [file]
  *
  * @note          Link using -lasound and -lm, -lalsa_utils,
- *                -L${workspace_loc:/alsa_utils/Debug/} and
+ *                -lpthread, -L${workspace_loc:/alsa_utils/Debug/} and
  *                -I${workspace_loc:/alsa_utils}, based on the HOWTO
  *                 https://users.suse.com/~mana/alsa090_howto.html
  *
@@ -40,36 +44,449 @@
  * Includes
  -----------------------------------------------------------------------------*/
 #include <alsa/asoundlib.h>
+#include <stdlib.h>
+#include <string.h>
 #include "alsa_utils.h"
+#include "buffer_pool.h"
+#include "device_probe.h"
+#include "file_source.h"
+#include "latency_tuner.h"
+#include "oscillator.h"
+#include "pcm_event_loop.h"
+#include "pcm_recovery.h"
+#include "pcm_stats.h"
+#include "playback_pipeline.h"
+#include "resampler.h"
+#include "rt_log.h"
+#include "rt_setup.h"
+#include "rtp_source.h"
+#include "sample_convert.h"
+#include "signal_source.h"
+#include "tsched.h"
 
 /*------------------------------------------------------------------------------
  * Module Preprocessor Constants
  -----------------------------------------------------------------------------*/
-#define FREQUENCY               (469u) /**< I choose this frequency to test
-                                            because for 2048samples at 48Khz the
-                                             mismatch between frames will be
-                                              minimized */
+#define FREQUENCY               (469u) /**< frequency of the test sine, the
+                                         phase is kept between periods so any
+                                         frequency can be used */
+#define USE_PLAYBACK_PIPELINE   (0u) /**< set to 1 to render in a producer
+                                         thread and write from an I/O thread,
+                                         only for the RW access types */
+#define PIPELINE_BLOCKS         (4u) /**< periods buffered in the pipeline */
+#define USE_RTP_SOURCE          (0u) /**< set to 1 to play the L16 RTP/UDP
+                                         stream received in RTP_PORT through
+                                         the pipeline instead of the sine */
+#define RTP_PORT                (5004u) /**< UDP port of the RTP stream */
+#define RTP_PLAY_TIME_S         (60u) /**< time to play the RTP stream */
+#define RT_PRIORITY             (80) /**< SCHED_FIFO priority of the thread
+                                         writing to the sound card */
+#define RT_CPU                  (RT_KEEP_AFFINITY) /**< CPU for the thread
+                                         writing to the sound card */
+#define PLAYBACK_ACCESS_TYPE    (SND_PCM_ACCESS_RW_INTERLEAVED) /**< use
+                                  SND_PCM_ACCESS_MMAP_INTERLEAVED or
+                                  SND_PCM_ACCESS_MMAP_NONINTERLEAVED to render
+                                  directly in the ring buffer */
+#define USE_TIMER_SCHEDULING    (0u) /**< set to 1 with an MMAP access to
+                                         refill from a timer instead of the
+                                         period interrupts */
+#define TSCHED_BUFFER_MS        (500u) /**< buffer used with timer scheduling,
+                                         the latency is set by the margin */
+#define CALIBRATE_LATENCY       (0u) /**< set to 1 to search the smallest
+                                         period configuration without xruns
+                                         and store it in TUNER_RESULT_FILE */
+#define TUNER_RESULT_FILE       ("latency_tuner.conf") /**< calibrated period
+                                         configurations, loaded at startup */
+#define TUNER_TRIAL_MS          (2000u) /**< duration of each trial stream */
+#define SRC_QUALITY             (E_SRC_MEDIUM) /**< converter used when the
+                                         sound card doesn't support the rate
+                                         of the file */
 
 /*------------------------------------------------------------------------------
  * Module Typedefs
  -----------------------------------------------------------------------------*/
+/** State of the sine rendered period by period (MMAP and pipeline modes),
+ * it's kept between periods */
+typedef struct
+{
+  oscillator osc; /**< oscillator generating the sine in Q14 */
+  uint32_t num_channels; /**< number of channels to fill */
+  channel_layout layout; /**< layout of the pipeline blocks */
+} sine_render_state;
 
 /*------------------------------------------------------------------------------
  * Function Prototypes
  -----------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t render_sine_mmap (const snd_pcm_channel_area_t*,
+ *                              snd_pcm_uframes_t, snd_pcm_uframes_t, void*)
+ *
+ * @brief Render the sine wave directly in the ring buffer of the sound card
+ *
+ * Used as @ref mmap_render_callback, the samples are stored in Q14 like
+ * @ref generate_sin does, the oscillator keeps the phase between periods so
+ * any frequency can be used
+ *
+ * @param[in] *areas      channel areas of the ring buffer
+ * @param      offset     first frame to write
+ * @param      frames     number of frames to write
+ * @param[in] *user_data  pointer to the @ref sine_render_state
+ *
+ * @return int8_t @a S_SUCCESS
+ *
+ ******************************************************************************/
+static int8_t render_sine_mmap (const snd_pcm_channel_area_t *areas,
+                                snd_pcm_uframes_t offset,
+                                snd_pcm_uframes_t frames, void *user_data)
+{
+  sine_render_state *state = (sine_render_state*)user_data;
+  int16_t sample;
+
+  for (snd_pcm_uframes_t i = 0; i<frames; i++)
+  {
+    sample = (int16_t)oscillator_tick (&state->osc);
+    for (uint32_t ch = 0; ch<state->num_channels; ch++)
+    {
+      *(int16_t*)mmap_area_address (&areas[ch], offset+i) = sample;
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t render_sine_block (void*, snd_pcm_uframes_t, void*)
+ *
+ * @brief Render a period of the sine wave in a block of the pipeline
+ *
+ * Used as @ref pipeline_render_callback, the samples are stored in Q14
+ *
+ * @param[out] *block      block to fill
+ * @param       frames     number of frames to render
+ * @param[in]  *user_data  pointer to the @ref sine_render_state
+ *
+ * @return int8_t @a S_SUCCESS
+ *
+ ******************************************************************************/
+static int8_t render_sine_block (void *block, snd_pcm_uframes_t frames,
+                                 void *user_data)
+{
+  sine_render_state *state = (sine_render_state*)user_data;
+  int16_t *data = (int16_t*)block;
+  int16_t sample;
+
+  for (snd_pcm_uframes_t n = 0; n<frames; n++)
+  {
+    sample = (int16_t)oscillator_tick (&state->osc);
+    for (uint32_t ch = 0; ch<state->num_channels; ch++)
+    {
+      if ( E_LAYOUT_PLANAR==state->layout )
+      {
+        data[ch*frames+n] = sample;
+      }
+      else
+      {
+        data[n*state->num_channels+ch] = sample;
+      }
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t write_interleaved (snd_pcm_t*, const hw_configuration*,
+ *                               const void*, snd_pcm_uframes_t)
+ *
+ * @brief Write a whole interleaved buffer, with @a snd_pcm_writei or
+ *        @a snd_pcm_mmap_writei depending on the access type
+ *
+ ******************************************************************************/
+static int8_t write_interleaved (snd_pcm_t *pcm_handle,
+                                 const hw_configuration *hw_config,
+                                 const void *data, snd_pcm_uframes_t frames)
+{
+  const uint8_t *buffer = (const uint8_t*)data;
+  ssize_t frame_bytes = snd_pcm_format_size (hw_config->format,
+                                             hw_config->num_channels);
+  snd_pcm_sframes_t written;
+
+  while ( 0u<frames )
+  {
+    if ( SND_PCM_ACCESS_MMAP_INTERLEAVED==hw_config->access_type )
+    {
+      written = snd_pcm_mmap_writei (pcm_handle, buffer, frames);
+    }
+    else
+    {
+      written = snd_pcm_writei (pcm_handle, buffer, frames);
+    }
+    if ( 0>written )
+    {
+      written = snd_pcm_recover (pcm_handle, (int)written, 1);
+      if ( 0>written )
+      {
+        return S_ERROR;
+      }
+      continue;
+    }
+    buffer += written*frame_bytes;
+    frames -= (snd_pcm_uframes_t)written;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t play_file_resampled (snd_pcm_t*, const hw_configuration*,
+ *                                 file_source*)
+ *
+ * @brief Play a file whose rate is not supported by the sound card
+ *
+ * Each period pulls from the file the frames that the @ref resampler needs,
+ * they are converted to float, resampled to the rate of the sound card and
+ * converted back to the format of the file, so the pitch is right without
+ * using the resampler of the @a plug layer
+ *
+ * @param[in]     *pcm_handle  handle of the configured sound card
+ * @param[in]     *hw_config   configuration of the sound card
+ * @param[in,out] *source      file to play
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+static int8_t play_file_resampled (snd_pcm_t *pcm_handle,
+                                   const hw_configuration *hw_config,
+                                   file_source *source)
+{
+  resampler rs;
+  const uint32_t num_channels = hw_config->num_channels;
+  const uint32_t period = (uint32_t)hw_config->period_size;
+  /* a period of output plus the look ahead of the filter */
+  const uint32_t max_in_frames = (uint32_t)(((uint64_t)period*
+      source->sample_rate)/hw_config->sample_rate)+RESAMPLER_MAX_TAPS+2u;
+  float *in[MAX_CHANNELS];
+  float *out[MAX_CHANNELS];
+  float *storage;
+  float *interleaved;
+  void *pcm_buffer;
+  const void *data;
+  uint32_t needed;
+  uint32_t produced;
+  uint32_t flush = 0u;
+  int8_t err = S_SUCCESS;
+
+  if ( SND_PCM_ACCESS_MMAP_NONINTERLEAVED==hw_config->access_type )
+  {
+    printf ("Error: the resampler needs an interleaved access type\n");
+    return S_ERROR;
+  }
+
+  /* the samples are resampled in float, only the formats that
+   * convert_format_to_float knows can go through it (e.g. no U8) */
+  switch (source->format)
+  {
+    case SND_PCM_FORMAT_S16_LE:
+    case SND_PCM_FORMAT_S24_3LE:
+    case SND_PCM_FORMAT_S32_LE:
+    case SND_PCM_FORMAT_FLOAT_LE:
+      break;
+    default:
+      printf ("Error: the resampler doesn't support the format %s\n",
+              snd_pcm_format_name (source->format));
+      return S_ERROR;
+  }
+
+  if ( S_SUCCESS!=resampler_init (&rs, num_channels, source->sample_rate,
+                                  hw_config->sample_rate, SRC_QUALITY,
+                                  max_in_frames) )
+  {
+    printf ("Error creating the resampler\n");
+    return S_ERROR;
+  }
+
+  storage = (float*)calloc ((size_t)(max_in_frames+2u*period)*num_channels,
+                            sizeof(float));
+  pcm_buffer = calloc (period, source->frame_bytes);
+  if ( (NULL==storage)||(NULL==pcm_buffer) )
+  {
+    free (storage);
+    free (pcm_buffer);
+    resampler_destroy (&rs);
+    return S_ERROR;
+  }
+  for (uint32_t ch = 0; ch<num_channels; ch++)
+  {
+    in[ch] = storage+(size_t)ch*max_in_frames;
+    out[ch] = storage+(size_t)num_channels*max_in_frames+(size_t)ch*period;
+  }
+  interleaved = storage+(size_t)num_channels*(max_in_frames+period);
+
+  printf ("Resampling the file from %u Hz to %u Hz\n", source->sample_rate,
+          hw_config->sample_rate);
+
+  /* after the end of the file the look ahead of the filter is filled with
+   * silence, so the last frames are played too */
+  while ( flush<resampler_latency (&rs) )
+  {
+    needed = resampler_input_frames (&rs, period);
+    if ( 0u==file_source_eof (source) )
+    {
+      needed = (uint32_t)file_source_peek (source, needed, &data);
+      if ( S_SUCCESS!=convert_format_to_float (data, in, needed, num_channels,
+                                               source->format) )
+      {
+        printf ("Error converting the file to float\n");
+        err = S_ERROR;
+        break;
+      }
+      file_source_advance (source, needed);
+    }
+    else
+    {
+      needed = resampler_latency (&rs)-flush;
+      for (uint32_t ch = 0; ch<num_channels; ch++)
+      {
+        memset (in[ch], 0, sizeof(float)*needed);
+      }
+      flush += needed;
+    }
+
+    if ( S_SUCCESS!=resampler_process (&rs, in, needed, out, period,
+                                       &produced) )
+    {
+      err = S_ERROR;
+      break;
+    }
+    for (uint32_t n = 0; n<produced; n++)
+    {
+      for (uint32_t ch = 0; ch<num_channels; ch++)
+      {
+        interleaved[n*num_channels+ch] = out[ch][n];
+      }
+    }
+    if ( (0u<produced)&&
+         ((S_SUCCESS!=convert_float_to_format (interleaved, pcm_buffer,
+                                               produced*num_channels,
+                                               hw_config->format))||
+          (S_SUCCESS!=write_interleaved (pcm_handle, hw_config, pcm_buffer,
+                                         produced))) )
+    {
+      printf ("Error writing data to the sound card\n");
+      err = S_ERROR;
+      break;
+    }
+  }
+
+  free (storage);
+  free (pcm_buffer);
+  resampler_destroy (&rs);
+
+  return err;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t play_file (snd_pcm_t*, const hw_configuration*, file_source*,
+ *                       const rt_configuration*)
+ *
+ * @brief Play a file from the beginning to the end
+ *
+ * In RW mode the periods of the mapping are given directly to
+ * @a snd_pcm_writei, in MMAP mode they are copied to the ring buffer by
+ * @ref file_source_render_mmap. If the sound card doesn't support the rate
+ * of the file the periods go through @ref play_file_resampled
+ *
+ * @param[in]     *pcm_handle  handle of the configured sound card
+ * @param[in]     *hw_config   configuration of the sound card
+ * @param[in,out] *source      file to play
+ * @param[in]     *rt_config   real time setup of this thread
+ *
+ * @return int8_t @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+static int8_t play_file (snd_pcm_t *pcm_handle,
+                         const hw_configuration *hw_config,
+                         file_source *source, const rt_configuration *rt_config)
+{
+  const void *data;
+  snd_pcm_uframes_t frames;
+  snd_pcm_sframes_t written;
+
+  /* the prefetch thread is created before going real time, it must not
+   * compete with this thread */
+  if ( S_SUCCESS!=file_source_start (source, FILE_SOURCE_WINDOW_MS) )
+  {
+    return S_ERROR;
+  }
+  configure_rt_thread (rt_config);
+  printf ("Playing %llu frames from the file\n",
+          (unsigned long long)source->total_frames);
+
+  if ( hw_config->sample_rate!=source->sample_rate )
+  {
+    if ( S_SUCCESS!=play_file_resampled (pcm_handle, hw_config, source) )
+    {
+      return S_ERROR;
+    }
+  }
+
+  while ( 0u==file_source_eof (source) )
+  {
+    if ( (SND_PCM_ACCESS_MMAP_INTERLEAVED==hw_config->access_type)||
+         (SND_PCM_ACCESS_MMAP_NONINTERLEAVED==hw_config->access_type) )
+    {
+      if ( S_SUCCESS!=mmap_write_period (pcm_handle, hw_config->period_size,
+                                         file_source_render_mmap, source) )
+      {
+        printf ("Error writing data to the sound card\n");
+        return S_ERROR;
+      }
+      continue;
+    }
+
+    frames = file_source_peek (source, hw_config->period_size, &data);
+    written = snd_pcm_writei (pcm_handle, data, frames);
+    if ( 0>written )
+    {
+      written = snd_pcm_recover (pcm_handle, (int)written, 1);
+      if ( 0>written )
+      {
+        printf ("Error writing data to the sound card\n");
+        return S_ERROR;
+      }
+      continue;
+    }
+    file_source_advance (source, (snd_pcm_uframes_t)written);
+  }
+
+  snd_pcm_drain (pcm_handle);
+  printf ("Periods played beyond the prefetched window = %llu\n",
+          (unsigned long long)atomic_load (&source->late_periods));
+
+  return S_SUCCESS;
+}
 
 /******************************************************************************
  *
- * @fn int main (void)
+ * @fn int main (int, char**)
  *
  * @brief Main function of the program
  *
- * Main function of the program
+ * Without arguments a sine wave is played, with a WAV or raw PCM file in
+ * the command line the file is played
+ *
+ * @param argc  number of arguments
+ * @param argv  optional file to play
  *
  * @return int  @a S_SUCCESS in case of success, @a S_ERROR otherwise
  *
  ******************************************************************************/
-int main (void)
+int main (int argc, char **argv)
 {
   /** @b snd_pcm_t  pcm_handle  Handle for the PCM device */
   snd_pcm_t *pcm_handle;
@@ -85,7 +502,7 @@ int main (void)
    *                   the sample data for the second channel */
   hw_configuration hw_configuration = { .sample_rate = 48000u, .periods = 2,
       .period_size = 2048, .sample_rate_direction = E_EXACT_CONFIG,
-      .access_type = SND_PCM_ACCESS_RW_INTERLEAVED, .num_channels = 2,
+      .access_type = PLAYBACK_ACCESS_TYPE, .num_channels = 2,
       .frame_size_direction = E_EXACT_CONFIG, .format = SND_PCM_FORMAT_S16_LE };
 
   /** @b pcm_name Name of the PCM device, like @a plughw:0,0
@@ -94,6 +511,83 @@ int main (void)
   char *pcm_name = "default"; /* Use default system audio card */
 
   int8_t err = 0u;
+  int pcm_err;
+
+  /** @b rt_configuration real time setup of the thread writing to the sound
+   * card, if we don't have the privileges we just continue without it */
+  rt_configuration rt_config = { .priority = RT_PRIORITY, .cpu = RT_CPU,
+      .lock_memory = 1u, .stack_prefault_size = RT_DEFAULT_STACK_SIZE };
+
+  /** @b tune_latency search the smallest period configuration that plays
+   * the sine without xruns, the result is stored so the next runs just load
+   * it with @ref tuner_load_result */
+  if ( 0u!=CALIBRATE_LATENCY )
+  {
+    tuner_result result;
+    sine_render_state sine_state = { .num_channels =
+        hw_configuration.num_channels };
+    tuner_configuration tuner_config = { .device_name = pcm_name, .hw_config =
+        hw_configuration, .trial_ms = TUNER_TRIAL_MS, .max_periods = 4u,
+        .workload = render_sine_mmap, .user_data = &sine_state };
+
+    oscillator_init (&sine_state.osc, FREQUENCY, hw_configuration.sample_rate,
+                     Q_14);
+    if ( (S_SUCCESS==tune_latency (&tuner_config, &result))&&
+         (S_SUCCESS==tuner_save_result (TUNER_RESULT_FILE, pcm_name,
+                                        &hw_configuration, &result)) )
+    {
+      printf ("Calibrated: period_size = %lu, periods = %u (%.2fms)\n",
+              (unsigned long)result.period_size, result.periods,
+              result.latency_ms);
+    }
+    else
+    {
+      printf ("Warning: calibration failed, using the default periods\n");
+    }
+  }
+
+  /** @b file_source the file given in the command line is mapped and played
+   * instead of the sine, the stream uses the format of the file (raw files
+   * use the format of @a hw_configuration). The file is interleaved, so the
+   * RW non interleaved access is changed to interleaved, and the memory is
+   * not locked because it would lock the whole file */
+  file_source source;
+  uint8_t play_from_file = (1<argc) ? 1u : 0u;
+
+  if ( 0u!=play_from_file )
+  {
+    if ( S_SUCCESS!=file_source_open (&source, argv[1], &hw_configuration) )
+    {
+      return S_ERROR;
+    }
+    if ( SND_PCM_ACCESS_RW_NONINTERLEAVED==hw_configuration.access_type )
+    {
+      hw_configuration.access_type = SND_PCM_ACCESS_RW_INTERLEAVED;
+    }
+    rt_config.lock_memory = 0u;
+  }
+
+  /** @b device_cache_load capabilities of the devices written by
+   * get_alsa_version, without the file the configuration is just negotiated
+   * with the device */
+  device_cache_load (DEVICE_CACHE_PATH);
+
+  if ( S_SUCCESS==tuner_load_result (TUNER_RESULT_FILE, pcm_name,
+                                     &hw_configuration) )
+  {
+    printf ("Using calibrated period_size = %lu, periods = %u\n",
+            (unsigned long)hw_configuration.period_size,
+            hw_configuration.periods);
+  }
+
+  /* with timer scheduling the buffer is big and has only two periods, the
+   * wakeups don't depend on the period size */
+  if ( 0u!=USE_TIMER_SCHEDULING )
+  {
+    hw_configuration.periods = 2u;
+    hw_configuration.period_size = (snd_pcm_uframes_t)(
+        hw_configuration.sample_rate*TSCHED_BUFFER_MS/2000u);
+  }
 
   /** @b snd_pcm_open Create a handle and open a connection to a specified
    * audio interface, this function receives as arguments:
@@ -109,33 +603,272 @@ int main (void)
    *          receive asynchronous notification after specified time periods
    * After successfully calling this function the sound card should be in
    * @a SND_PCM_STATE_OPEN state */
-  err = snd_pcm_open (&pcm_handle, pcm_name, stream_direction,
-  PCM_OPEN_STANDARD_MODE);
-  if ( S_SUCCESS>err )
+  pcm_err = snd_pcm_open (&pcm_handle, pcm_name, stream_direction,
+                          PCM_OPEN_STANDARD_MODE);
+  if ( S_SUCCESS>pcm_err )
   {
-    printf ("Error opening sound card, Err = %d\n", err);
+    printf ("Error opening sound card, Err = %d\n", pcm_err);
+    if ( 0u!=play_from_file )
+    {
+      file_source_close (&source);
+    }
     return S_ERROR;
   }
 
+  /* kernels of the float conversions and the resampler */
+  sample_convert_init ();
+
+  /* configure_hw/configure_sw return S_ERROR, not an ALSA error code */
   err = configure_hw (pcm_handle, &hw_configuration);
-  if ( S_SUCCESS>err )
+  if ( S_SUCCESS!=err )
+  {
+    printf ("Unable to configure HW\n");
+    if ( 0u!=play_from_file )
+    {
+      file_source_close (&source);
+    }
+    snd_pcm_close (pcm_handle);
+
+    return S_ERROR;
+  }
+
+  /** @b sw_configuration wake up every period and don't start until the
+   * whole buffer is full, so we have the maximum margin before the first
+   * underrun. @b snd_pcm_get_params gives the buffer size really negotiated,
+   * with a bigger start threshold the stream would never start */
+  snd_pcm_uframes_t buffer_size;
+  snd_pcm_uframes_t period_size;
+
+  snd_pcm_get_params (pcm_handle, &buffer_size, &period_size);
+  sw_configuration sw_configuration = { .avail_min = period_size,
+      .start_threshold = buffer_size, .stop_threshold = SW_KEEP_DEFAULT,
+      .silence_threshold = 0u, .silence_size = 0u, .period_event = 0u,
+      .timestamps = 1u };
+
+  err = configure_sw (pcm_handle, &sw_configuration);
+  if ( S_SUCCESS!=err )
   {
-    printf ("Unable to configure HW, Err = %d\n", err);
+    printf ("Unable to configure SW\n");
+    if ( 0u!=play_from_file )
+    {
+      file_source_close (&source);
+    }
     snd_pcm_close (pcm_handle);
 
     return S_ERROR;
   }
 
+  if ( 0u!=play_from_file )
+  {
+    err = play_file (pcm_handle, &hw_configuration, &source, &rt_config);
+    file_source_close (&source);
+    snd_pcm_close (pcm_handle);
+
+    return err;
+  }
+
   /* Now it's time to generate a signal to test the output of the sound card */
-  int16_t *sine_wave;
-  uint32_t sine_size;
-  uint8_t number_of_frames = 46; /*40*2048/4800 = 1.96s ~= 2s*/
+  channel_layout layout;
+  snd_pcm_sframes_t written;
+  /* ~2s whatever the period size is (46 periods of 2048 frames at 48KHz) */
+  uint32_t number_of_frames = (2u*hw_configuration.sample_rate)/period_size;
+
+  if ( (0u!=USE_PLAYBACK_PIPELINE)||(0u!=USE_RTP_SOURCE) )
+  {
+    /* The sine is rendered by the producer thread of the pipeline while the
+     * I/O thread keeps the sound card busy */
+    playback_pipeline pipeline;
+    static rtp_source rtp;
+    rtp_source_configuration rtp_config = { .address = NULL, .port = RTP_PORT,
+        .payload_type = RTP_ANY_PAYLOAD_TYPE, .encoding = E_RTP_L16,
+        .sample_rate = hw_configuration.sample_rate, .num_channels =
+            hw_configuration.num_channels, .min_delay_ms = 5u,
+        .max_delay_ms = 100u };
+    rt_configuration lock_config = { .priority = RT_KEEP_POLICY, .cpu =
+        RT_KEEP_AFFINITY, .lock_memory = 1u, .stack_prefault_size = 0u };
+    sine_render_state sine_state = { .num_channels =
+        hw_configuration.num_channels, .layout = get_channel_layout (
+        hw_configuration.access_type) };
+
+    /* no socket until rtp_source_open, so the error path can close it */
+    rtp.socket_fd = -1;
+    err = oscillator_init (&sine_state.osc, FREQUENCY,
+                           hw_configuration.sample_rate, Q_14);
+
+    /** @b rtp_source the producer thread drains the socket and renders the
+     * blocks from the jitter buffer */
+    if ( (S_SUCCESS==err)&&(0u!=USE_RTP_SOURCE) )
+    {
+      err = rtp_source_open (&rtp, &rtp_config, &hw_configuration);
+      number_of_frames = (RTP_PLAY_TIME_S*hw_configuration.sample_rate)/
+          period_size;
+    }
+    if ( (S_SUCCESS!=err)||
+         (S_SUCCESS!=playback_pipeline_init (&pipeline, pcm_handle,
+                                             &hw_configuration,
+                                             PIPELINE_BLOCKS,
+                                             (0u!=USE_RTP_SOURCE) ?
+                                                 rtp_source_render :
+                                                 render_sine_block,
+                                             (0u!=USE_RTP_SOURCE) ?
+                                                 (void*)&rtp :
+                                                 (void*)&sine_state)) )
+    {
+      printf ("Error creating the playback pipeline\n");
+      if ( 0u!=USE_RTP_SOURCE )
+      {
+        rtp_source_close (&rtp);
+      }
+      snd_pcm_close (pcm_handle);
+
+      return S_ERROR;
+    }
 
-  printf ("Generating random noise\n");
-  sine_size = hw_configuration.period_size*hw_configuration.periods;
-  sine_wave = (int16_t*)malloc (sizeof(sine_wave)*sine_size);
+    /* only the I/O thread needs real time, the producer has the ring as
+     * headroom */
+    pipeline.io_rt_config = &rt_config;
+    configure_rt_thread (&lock_config);
 
-  if ( NULL==sine_wave )
+    printf ("Sending data to sound card (pipeline)\n");
+    err = playback_pipeline_start (&pipeline, number_of_frames);
+    if ( S_SUCCESS==err )
+    {
+      err = playback_pipeline_wait (&pipeline);
+    }
+    printf ("Pipeline underruns = %llu, xruns = %llu\n",
+            (unsigned long long)atomic_load (&pipeline.pipeline_underruns),
+            (unsigned long long)atomic_load (&pipeline.xruns));
+
+    playback_pipeline_destroy (&pipeline);
+    if ( 0u!=USE_RTP_SOURCE )
+    {
+      rtp_source_print_stats (&rtp);
+      rtp_source_close (&rtp);
+    }
+    snd_pcm_drain (pcm_handle);
+    snd_pcm_close (pcm_handle);
+
+    return (S_SUCCESS==err) ? S_SUCCESS : S_ERROR;
+  }
+
+  if ( (SND_PCM_ACCESS_MMAP_INTERLEAVED==hw_configuration.access_type)||
+       (SND_PCM_ACCESS_MMAP_NONINTERLEAVED==hw_configuration.access_type) )
+  {
+    /* In MMAP mode there is no intermediate buffer, the sine is rendered
+     * directly in the ring buffer of the sound card */
+    sine_render_state sine_state = { .num_channels =
+        hw_configuration.num_channels };
+
+    err = oscillator_init (&sine_state.osc, FREQUENCY,
+                           hw_configuration.sample_rate, Q_14);
+    if ( S_SUCCESS!=err )
+    {
+      printf ("Error initializing the oscillator\n");
+      snd_pcm_close (pcm_handle);
+
+      return S_ERROR;
+    }
+
+    configure_rt_thread (&rt_config);
+
+    /** @b tsched_stream the ring buffer is kept filled just over the margin,
+     * the wakeups come from a timer registered in a @ref pcm_event_loop */
+    if ( 0u!=USE_TIMER_SCHEDULING )
+    {
+      pcm_event_loop loop;
+      tsched_stream tsched;
+      tsched_configuration tsched_config = { .wakeup_us =
+          TSCHED_DEFAULT_WAKEUP_US, .margin_min_us =
+          TSCHED_DEFAULT_MARGIN_MIN_US, .margin_max_us =
+          TSCHED_DEFAULT_MARGIN_MAX_US };
+      uint64_t total_frames = (uint64_t)number_of_frames*period_size;
+
+      err = tsched_init (&tsched, pcm_handle, &tsched_config,
+                         render_sine_mmap, &sine_state);
+      if ( (S_SUCCESS==err)&&(S_SUCCESS==event_loop_init (&loop))&&
+           (S_SUCCESS==event_loop_add_fd (&loop, tsched.timer_fd, POLLIN,
+                                          tsched_on_timer, &tsched)) )
+      {
+        printf ("Sending data to sound card (timer scheduling)\n");
+        err = tsched_start (&tsched);
+        while ( (S_SUCCESS==err)&&(total_frames>tsched.frames_written) )
+        {
+          err = event_loop_run_once (&loop, -1);
+        }
+        printf ("Wakeups = %llu, late = %llu, xruns = %llu, margin = %lu "
+                "frames\n", (unsigned long long)tsched.wakeups,
+                (unsigned long long)tsched.late_wakeups,
+                (unsigned long long)tsched.xruns,
+                (unsigned long)tsched.margin);
+      }
+      else
+      {
+        err = S_ERROR;
+      }
+      tsched_close (&tsched);
+      snd_pcm_drain (pcm_handle);
+      snd_pcm_close (pcm_handle);
+
+      return (S_SUCCESS==err) ? S_SUCCESS : S_ERROR;
+    }
+
+    printf ("Sending data to sound card (MMAP)\n");
+    for (uint32_t i = 0u; i<number_of_frames; i++)
+    {
+      err = mmap_write_period (pcm_handle, hw_configuration.period_size,
+                               render_sine_mmap, &sine_state);
+      if ( S_SUCCESS!=err )
+      {
+        printf ("Error writing data to the sound card\n");
+        snd_pcm_close (pcm_handle);
+
+        return S_ERROR;
+      }
+    }
+
+    /* play what is left in the ring buffer, this also starts the stream when
+     * less than a buffer was written */
+    snd_pcm_drain (pcm_handle);
+    snd_pcm_close (pcm_handle);
+
+    return S_SUCCESS;
+  }
+
+  printf ("Generating the sine period by period\n");
+  layout = get_channel_layout (hw_configuration.access_type);
+
+  /** @b signal_source the sine is pulled once per period, the oscillator
+   * keeps the phase between periods so they join without discontinuities.
+   * The pool holds one float period and the same period converted for the
+   * sound card, the memory doesn't depend on the duration of the stream.
+   * The float period is always planar, the @a render kernel selected by
+   * @ref configure_hw converts it to the format and layout of the card in a
+   * single pass */
+  buffer_pool pool;
+  oscillator osc;
+  signal_source sources[] = { { .fill = signal_oscillator_fill, .context =
+      &osc, .gain = 1.0f } };
+  uint32_t num_sources = sizeof(sources)/sizeof(sources[0]);
+  float *period_buffer = NULL;
+  float *float_channels[MAX_CHANNELS];
+  void *pcm_period = NULL;
+  void *pcm_channels[MAX_CHANNELS];
+  uint32_t frames = (uint32_t)hw_configuration.period_size;
+  ssize_t sample_bytes = snd_pcm_format_size (hw_configuration.format, 1u);
+
+  /* the same level as generate_sin (Q14) */
+  err = oscillator_init (&osc, FREQUENCY, hw_configuration.sample_rate,
+                         0.5f);
+  if ( (S_SUCCESS==err)&&(MAX_CHANNELS>=hw_configuration.num_channels)&&
+       (NULL!=hw_configuration.render)&&
+       (S_SUCCESS==buffer_pool_init (&pool, sizeof(float)*frames*
+                                     hw_configuration.num_channels, 2u,
+                                     BUFFER_POOL_HUGE_PAGES|BUFFER_POOL_LOCK)) )
+  {
+    period_buffer = (float*)buffer_pool_acquire (&pool);
+    pcm_period = buffer_pool_acquire (&pool);
+  }
+  if ( (NULL==period_buffer)||(NULL==pcm_period) )
   {
     printf ("Error allocating memory for the audio signal\n");
     snd_pcm_close (pcm_handle);
@@ -143,48 +876,130 @@ int main (void)
     return S_ERROR;
   }
 
-  err = generate_sin (sine_wave, FREQUENCY, hw_configuration.sample_rate,
-                      sine_size);
-  if ( S_ERROR==err )
+  /* each float channel gets its own part of the buffer, the PCM buffer is
+   * split the same way in planar mode, in interleaved mode only the first
+   * pointer is used */
+  for (uint32_t ch = 0; ch<hw_configuration.num_channels; ch++)
+  {
+    float_channels[ch] = &period_buffer[ch*frames];
+    pcm_channels[ch] = (uint8_t*)pcm_period+ch*frames*sample_bytes;
+  }
+
+  /* lock everything before streaming, the pool is already pre-faulted */
+  configure_rt_thread (&rt_config);
+  printf ("Sending data to sound card\n");
+
+  /** @b pcm_stats xruns, write times, delay and headroom of the stream, the
+   * headroom is measured after rendering each period */
+  pcm_stats stats;
+  pcm_stats_data snapshot;
+  uint64_t write_start;
+
+  if ( S_SUCCESS!=pcm_stats_init (&stats, hw_configuration.sample_rate) )
   {
-    printf ("Error generating sine wave\n");
-    free (sine_wave);
+    buffer_pool_release (&pool, period_buffer);
+    buffer_pool_release (&pool, pcm_period);
+    buffer_pool_destroy (&pool);
     snd_pcm_close (pcm_handle);
 
     return S_ERROR;
   }
-  printf ("Sending data to sound card\n");
+
+  /** @b pcm_recovery after an xrun the buffer is refilled with silence up to
+   * one period before the start threshold, the period that failed completes
+   * it and the stream restarts with the whole buffer queued. The messages of
+   * the recovery go through the @ref rt_log, so the loop never prints */
+  rt_log log;
+  pcm_recovery recovery;
+  uint8_t log_ready = 0u;
+  uint8_t recovery_ready = 0u;
+
+  err = rt_log_init (&log, RT_LOG_DEFAULT_MESSAGES, stdout);
+  if ( S_SUCCESS==err )
+  {
+    log_ready = 1u;
+    err = pcm_recovery_init (&recovery, pcm_handle, &hw_configuration,
+                             buffer_size-period_size, NULL, NULL);
+  }
+  if ( S_SUCCESS==err )
+  {
+    recovery_ready = 1u;
+    rt_log_start (&log);
+  }
 
   /** @b snd_pcm_writei With everything set we can start writing data the API
    *  is different depending of the access_type:
-   * @li snd_pcm_writei for SND_PCM_ACCESS_MMAP_INTERLEAVED
-   * @li snd_pcm_writen for SND_PCM_ACCESS_MMAP_NONINTERLEAVED */
-  for (uint8_t i = 0u; i<number_of_frames; i++)
+   * @li snd_pcm_writei for SND_PCM_ACCESS_RW_INTERLEAVED
+   * @li snd_pcm_writen for SND_PCM_ACCESS_RW_NONINTERLEAVED
+   * @li @ref mmap_write_period for the MMAP access types (see above) */
+  for (uint32_t i = 0u; (S_SUCCESS==err)&&(i<number_of_frames); i++)
   {
-    err = snd_pcm_writei (pcm_handle, sine_wave, hw_configuration.period_size);
-
-    /* if we fail we try to recover the stream state*/
-    if ( S_SUCCESS>err )
+    if ( S_SUCCESS!=signal_mix (sources, num_sources, float_channels, frames,
+                                hw_configuration.num_channels,
+                                E_LAYOUT_PLANAR) )
     {
-      err = snd_pcm_recover (pcm_handle, err, 1);
+      rt_log_printf ("Error rendering the period\n");
+      err = S_ERROR;
+      break;
     }
+    hw_configuration.render (float_channels, pcm_channels, frames,
+                             hw_configuration.num_channels);
+    pcm_stats_render_done (&stats, pcm_handle);
 
-    /* if we fail from recovery we suspend everything*/
-    if ( S_SUCCESS>err )
+    /* if we fail we recover the stream state, the period wasn't played so
+     * it's written again instead of rendering the next one */
+    do
     {
-      printf ("Error writing data to the sound card\n");
-      free (sine_wave);
-      snd_pcm_close (pcm_handle);
+      write_start = pcm_stats_now_ns ();
+      if ( E_LAYOUT_PLANAR==layout )
+      {
+        written = snd_pcm_writen (pcm_handle, pcm_channels, frames);
+      }
+      else
+      {
+        written = snd_pcm_writei (pcm_handle, pcm_period, frames);
+      }
 
-      return S_ERROR;
+      pcm_stats_write_done (&stats, pcm_handle, write_start, written);
+      if ( 0>written )
+      {
+        err = pcm_recovery_recover (&recovery, (int)written);
+        pcm_stats_recovery (&stats, (S_SUCCESS==err) ? S_SUCCESS : -EIO);
+      }
+    } while ( (0>written)&&(S_SUCCESS==err) );
+    pcm_stats_publish (&stats);
+
+    /* if we fail from recovery we suspend everything*/
+    if ( 0>written )
+    {
+      rt_log_printf ("Error writing data to the sound card\n");
+      err = S_ERROR;
     }
   }
 
-  free (sine_wave);
+  /* the log is flushed before printing the statistics */
+  if ( 0u!=log_ready )
+  {
+    rt_log_destroy (&log);
+  }
+  if ( S_SUCCESS==err )
+  {
+    pcm_stats_snapshot (&stats, &snapshot);
+    pcm_stats_print (&snapshot);
+    pcm_recovery_print (&recovery);
+  }
+  if ( 0u!=recovery_ready )
+  {
+    pcm_recovery_destroy (&recovery);
+  }
+  pcm_stats_destroy (&stats);
+  buffer_pool_release (&pool, period_buffer);
+  buffer_pool_release (&pool, pcm_period);
+  buffer_pool_destroy (&pool);
   /* close the sound card */
   snd_pcm_close (pcm_handle);
 
-  return S_SUCCESS;
+  return (S_SUCCESS==err) ? S_SUCCESS : S_ERROR;
 }
 
 /*-------------- END OF FILE -------------------------------------------------*/
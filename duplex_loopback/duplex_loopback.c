@@ -0,0 +1,259 @@
+/*******************************************************************************
+ * @file          duplex_loopback.c
+ *
+ * @brief         Full duplex client, from the capture to the playback
+ *
+ * Plays what is captured through a gain stage of a @ref duplex_engine, or
+ * measures the round trip latency when the output is connected to the
+ * input:
+ *
+ * Usage: duplex_loopback [seconds|latency] [capture] [playback]
+ *
+ * By default the @a default devices are used for 10 seconds
+ *
+ * @note          Link using -lasound, -lalsa_utils, -lpthread, -lm,
+ *                -L${workspace_loc:/alsa_utils/Debug/} and
+ *                -I${workspace_loc:/alsa_utils}
+ *
+ * @author        hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 Hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alsa_utils.h"
+#include "duplex_engine.h"
+#include "rt_setup.h"
+#include "sample_convert.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#define LOOPBACK_SECONDS        (10u) /**< default duration */
+#define LOOPBACK_GAIN           (0.5f) /**< gain of the example stage */
+#define LATENCY_IMPULSES        (20u) /**< impulses of the measurement */
+#define RT_PRIORITY             (80) /**< SCHED_FIFO priority of the loop */
+#define RT_CPU                  (RT_KEEP_AFFINITY) /**< CPU of the loop */
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t gain_stage (float**, uint32_t, uint32_t, void*)
+ *
+ * @brief Example stage, scales all the channels
+ *
+ * @param[in,out] **channels     audio of the period
+ * @param           num_channels number of channels
+ * @param           frames       frames of each channel
+ * @param[in]      *user_data    pointer to the gain (float)
+ *
+ * @return int8_t @a S_SUCCESS
+ *
+ ******************************************************************************/
+static int8_t gain_stage (float **channels, uint32_t num_channels,
+                          uint32_t frames, void *user_data)
+{
+  float gain = *(const float*)user_data;
+
+  for (uint32_t ch = 0; ch<num_channels; ch++)
+  {
+    for (uint32_t n = 0; n<frames; n++)
+    {
+      channels[ch][n] *= gain;
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int8_t open_stream (snd_pcm_t**, const char*, snd_pcm_stream_t,
+ *                         hw_configuration*)
+ *
+ * @brief Open and configure one of the streams
+ *
+ * The start threshold is set to the whole buffer, the engine starts the
+ * streams itself once the playback is filled
+ *
+ ******************************************************************************/
+static int8_t open_stream (snd_pcm_t **handle, const char *name,
+                           snd_pcm_stream_t direction,
+                           hw_configuration *hw_config)
+{
+  snd_pcm_uframes_t buffer_size;
+  snd_pcm_uframes_t period_size;
+  int8_t result;
+  int err;
+
+  err = snd_pcm_open (handle, name, direction, PCM_OPEN_STANDARD_MODE);
+  if ( S_SUCCESS>err )
+  {
+    printf ("Error opening %s, Err = %d\n", name, err);
+    return S_ERROR;
+  }
+
+  /* configure_hw/configure_sw return S_ERROR, not an ALSA error code */
+  result = configure_hw (*handle, hw_config);
+  if ( S_SUCCESS==result )
+  {
+    snd_pcm_get_params (*handle, &buffer_size, &period_size);
+    sw_configuration sw_config = { .avail_min = period_size,
+        .start_threshold = buffer_size, .stop_threshold = SW_KEEP_DEFAULT,
+        .silence_threshold = 0u, .silence_size = 0u, .period_event = 0u,
+        .timestamps = 0u };
+
+    result = configure_sw (*handle, &sw_config);
+  }
+  if ( S_SUCCESS!=result )
+  {
+    printf ("Unable to configure %s\n", name);
+    snd_pcm_close (*handle);
+    return S_ERROR;
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int main (int, char**)
+ *
+ * @brief Main function of the program
+ *
+ * @param argc  number of arguments
+ * @param argv  optional mode, capture device and playback device
+ *
+ * @return int  @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int main (int argc, char **argv)
+{
+  snd_pcm_t *capture_handle;
+  snd_pcm_t *playback_handle;
+  hw_configuration playback_config;
+
+  /** @b hw_configuration both streams use the same configuration, with 2
+   * periods of 64 frames one period of silence is kept in the playback
+   * buffer, 1.33ms at 48KHz plus the converters */
+  hw_configuration hw_configuration = { .sample_rate = 48000u, .periods = 2,
+      .period_size = 64, .sample_rate_direction = E_EXACT_CONFIG,
+      .access_type = SND_PCM_ACCESS_RW_INTERLEAVED, .num_channels = 2,
+      .frame_size_direction = E_EXACT_CONFIG, .format = SND_PCM_FORMAT_S16_LE };
+
+  rt_configuration rt_config = { .priority = RT_PRIORITY, .cpu = RT_CPU,
+      .lock_memory = 1u, .stack_prefault_size = RT_DEFAULT_STACK_SIZE };
+
+  duplex_engine engine;
+  duplex_latency latency;
+  float gain = LOOPBACK_GAIN;
+  uint8_t measure = 0u;
+  uint32_t seconds = LOOPBACK_SECONDS;
+  char *capture_name = "default";
+  char *playback_name = "default";
+  int8_t err;
+
+  if ( 1<argc )
+  {
+    if ( 0==strcmp (argv[1], "latency") )
+    {
+      measure = 1u;
+    }
+    else
+    {
+      seconds = (uint32_t)strtoul (argv[1], NULL, 10);
+    }
+  }
+  if ( 2<argc )
+  {
+    capture_name = argv[2];
+  }
+  if ( 3<argc )
+  {
+    playback_name = argv[3];
+  }
+
+  sample_convert_init ();
+  playback_config = hw_configuration;
+  if ( S_SUCCESS!=open_stream (&capture_handle, capture_name,
+                               SND_PCM_STREAM_CAPTURE, &hw_configuration) )
+  {
+    return S_ERROR;
+  }
+  if ( S_SUCCESS!=open_stream (&playback_handle, playback_name,
+                               SND_PCM_STREAM_PLAYBACK, &playback_config) )
+  {
+    snd_pcm_close (capture_handle);
+    return S_ERROR;
+  }
+
+  /* both streams must have ended with the same period */
+  if ( (hw_configuration.period_size!=playback_config.period_size)||
+       (hw_configuration.sample_rate!=playback_config.sample_rate)||
+       (S_SUCCESS!=duplex_engine_init (&engine, capture_handle,
+                                       playback_handle, &hw_configuration)) )
+  {
+    printf ("Error creating the duplex engine\n");
+    snd_pcm_close (playback_handle);
+    snd_pcm_close (capture_handle);
+    return S_ERROR;
+  }
+  duplex_engine_add_stage (&engine, gain_stage, &gain);
+  configure_rt_thread (&rt_config);
+
+  if ( 0u!=measure )
+  {
+    err = duplex_engine_measure_latency (&engine, LATENCY_IMPULSES, &latency);
+    if ( S_SUCCESS==err )
+    {
+      printf ("Round trip latency: min %.2fms, avg %.2fms, max %.2fms "
+              "(%u detected, %u missed)\n", latency.min_ms, latency.avg_ms,
+              latency.max_ms, latency.measurements, latency.missed);
+    }
+  }
+  else
+  {
+    printf ("Processing %s -> %s for %us\n", capture_name, playback_name,
+            seconds);
+    err = duplex_engine_run (&engine, (uint64_t)seconds*
+                             hw_configuration.sample_rate);
+  }
+  printf ("Periods = %llu, xruns = %llu\n",
+          (unsigned long long)engine.periods,
+          (unsigned long long)engine.xruns);
+
+  duplex_engine_destroy (&engine);
+  snd_pcm_close (playback_handle);
+  snd_pcm_close (capture_handle);
+
+  return (S_SUCCESS==err) ? S_SUCCESS : S_ERROR;
+}
+/*-------------- END OF FILE -------------------------------------------------*/
@@ -2,10 +2,20 @@
  * @file         : get_alsa_version.c
  *
  * @brief        : this program will show the version of alsa-lib installed
+ *                 and the capabilities of every PCM
  *
+ * Each card and PCM is probed in both directions (@ref device_probe_all),
+ * the supported rates, formats, channels, period and buffer sizes and access
+ * types (MMAP included) are printed and written to a cache file, the
+ * programs load it at startup with @ref device_cache_load so they don't
+ * need to try configurations that the devices can't play.
  *
+ * Usage: get_alsa_version [cache_file], by default the cache is written to
+ * @ref DEVICE_CACHE_PATH
  *
- * @notes        : link using -lasound
+ * @notes        : link using -lasound, -lalsa_utils,
+ *                 -L${workspace_loc:/alsa_utils/Debug/} and
+ *                 -I${workspace_loc:/alsa_utils}
  *
  * @author       : hkxs
  *
@@ -38,6 +48,8 @@
  *******************************************************************************/
 #include <stdio.h>
 #include <alsa/asoundlib.h>
+#include "alsa_utils.h"
+#include "device_probe.h"
 
 /*------------------------------------------------------------------------------
  * Module Preprocessor Constants
@@ -51,21 +63,46 @@
  *
  * @brief Main function
  *
- *  Prints the alsa-lib version
+ *  Prints the alsa-lib version and the capabilities of the PCMs, and stores
+ *  them in the cache file
  *
- * @param None
+ * @param argc  number of arguments
+ * @param argv  optional path of the cache file
  *
  * @return return 0 in success
  *
  *******************************************************************************/
-int main (void)
+int main (int argc, char **argv)
 {
-  char *alsa_version;
+  static device_caps caps[DEVICE_PROBE_MAX_DEVICES];
+  const char *cache_path = (1<argc) ? argv[1] : DEVICE_CACHE_PATH;
+  uint32_t num_devices;
+  const char *alsa_version;
 
   /* Returns the ALSA sound library version in ASCII format.  */
   alsa_version = snd_asoundlib_version ();
   printf ("ALSA library version: %s\n", alsa_version);
 
+  if ( S_SUCCESS!=device_probe_all (caps, DEVICE_PROBE_MAX_DEVICES,
+                                    &num_devices) )
+  {
+    printf ("Error listing the sound cards\n");
+    return S_ERROR;
+  }
+
+  for (uint32_t n = 0; n<num_devices; n++)
+  {
+    device_caps_print (stdout, &caps[n]);
+  }
+
+  if ( S_SUCCESS!=device_cache_save (cache_path, caps, num_devices) )
+  {
+    printf ("Error writing %s\n", cache_path);
+    return S_ERROR;
+  }
+  printf ("%u devices written to %s\n", num_devices, cache_path);
+
+  return S_SUCCESS;
 }
 
 /*-------------- END OF FILE -------------------------------------------------*/
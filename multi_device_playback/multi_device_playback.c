@@ -0,0 +1,194 @@
+/*******************************************************************************
+ * @file          multi_device_playback.c
+ *
+ * @brief         Playback of a sine wave in several devices
+ *
+ * Plays a sine wave in all the devices given in the command line at the same
+ * time, the devices are linked so they start together and serviced from one
+ * thread by a @ref pcm_engine, at the end the timing of each device is
+ * printed. With @ref DRIFT_COMPENSATION the devices follow the clock of the
+ * first one and the drift measured is printed too.
+ *
+ * Usage: multi_device_playback hw:0,0 hw:1,0 ...
+ *
+ * @note          Link using -lasound and -lm, -lalsa_utils,
+ *                -L${workspace_loc:/alsa_utils/Debug/} and
+ *                -I${workspace_loc:/alsa_utils}
+ *
+ * @author        hkxs
+ *
+ *
+ * MIT License
+ *
+ * Copyright (c) 2020 Hkxs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *******************************************************************************/
+
+/*------------------------------------------------------------------------------
+ * Includes
+ -----------------------------------------------------------------------------*/
+#include <alsa/asoundlib.h>
+#include "alsa_utils.h"
+#include "device_probe.h"
+#include "oscillator.h"
+#include "pcm_engine.h"
+
+/*------------------------------------------------------------------------------
+ * Module Preprocessor Constants
+ -----------------------------------------------------------------------------*/
+#define FREQUENCY               (440.0f) /**< frequency of the first device,
+                                              the device n plays the
+                                              harmonic n+1 (880, 1320 ...),
+                                              wrapped below the Nyquist
+                                              frequency */
+#define PLAYBACK_TIME_MS        (5000u) /**< time to play */
+#define DRIFT_COMPENSATION      (1u) /**< 1 to resample the devices to the
+                                          clock of the first one */
+
+/*------------------------------------------------------------------------------
+ * Module Typedefs
+ -----------------------------------------------------------------------------*/
+/** State of the sine of each device */
+typedef struct
+{
+  oscillator osc; /**< oscillator generating the sine in Q14 */
+  uint32_t num_channels; /**< number of channels to fill */
+} sine_render_state;
+
+/*------------------------------------------------------------------------------
+ * Function Prototypes
+ -----------------------------------------------------------------------------*/
+/******************************************************************************
+ *
+ * @fn int8_t render_sine (const snd_pcm_channel_area_t*, snd_pcm_uframes_t,
+ *                         snd_pcm_uframes_t, void*)
+ *
+ * @brief Render the sine wave of a device, used as @ref mmap_render_callback
+ *
+ * @param[in] *areas      channel areas to fill
+ * @param      offset     first frame to write
+ * @param      frames     number of frames to write
+ * @param[in] *user_data  pointer to the @ref sine_render_state
+ *
+ * @return int8_t @a S_SUCCESS
+ *
+ ******************************************************************************/
+static int8_t render_sine (const snd_pcm_channel_area_t *areas,
+                           snd_pcm_uframes_t offset, snd_pcm_uframes_t frames,
+                           void *user_data)
+{
+  sine_render_state *state = (sine_render_state*)user_data;
+  int16_t sample;
+
+  for (snd_pcm_uframes_t i = 0; i<frames; i++)
+  {
+    sample = (int16_t)oscillator_tick (&state->osc);
+    for (uint32_t ch = 0; ch<state->num_channels; ch++)
+    {
+      *(int16_t*)mmap_area_address (&areas[ch], offset+i) = sample;
+    }
+  }
+
+  return S_SUCCESS;
+}
+
+/******************************************************************************
+ *
+ * @fn int main (int, char**)
+ *
+ * @brief Main function of the program
+ *
+ * @param argc  number of arguments
+ * @param argv  names of the devices
+ *
+ * @return int  @a S_SUCCESS in case of success, @a S_ERROR otherwise
+ *
+ ******************************************************************************/
+int main (int argc, char **argv)
+{
+  static pcm_engine engine;
+  static sine_render_state sines[ENGINE_MAX_DEVICES];
+  uint32_t num_devices = (uint32_t)argc-1u;
+  uint32_t rate;
+  uint32_t harmonics;
+  uint32_t harmonic;
+  int8_t err;
+
+  if ( (2>argc)||(ENGINE_MAX_DEVICES<num_devices) )
+  {
+    printf ("Usage: %s device [device ...]\n", argv[0]);
+    return S_ERROR;
+  }
+
+  /* the devices that can't play the configuration are rejected without
+   * opening them, see get_alsa_version */
+  device_cache_load (DEVICE_CACHE_PATH);
+  pcm_engine_init (&engine);
+  if ( 0u!=DRIFT_COMPENSATION )
+  {
+    pcm_engine_enable_drift_compensation (&engine, E_SRC_MEDIUM);
+  }
+  for (uint32_t n = 0; n<num_devices; n++)
+  {
+    hw_configuration hw_configuration = { .sample_rate = 48000u, .periods = 2,
+        .period_size = 1024, .sample_rate_direction = E_EXACT_CONFIG,
+        .access_type = SND_PCM_ACCESS_MMAP_INTERLEAVED, .num_channels = 2,
+        .frame_size_direction = E_EXACT_CONFIG, .format =
+            SND_PCM_FORMAT_S16_LE };
+
+    sines[n].num_channels = hw_configuration.num_channels;
+    err = pcm_engine_add_device (&engine, argv[n+1u], &hw_configuration,
+                                 render_sine, &sines[n]);
+    /* with the compensation all the content is rendered at the rate of
+     * the first device, with many devices the harmonics start again from
+     * the first one before they reach the Nyquist frequency */
+    if ( S_SUCCESS==err )
+    {
+      rate = (0u!=DRIFT_COMPENSATION) ?
+          engine.devices[0].hw_config.sample_rate :
+          hw_configuration.sample_rate;
+      harmonics = (uint32_t)(((float)rate-1.0f)/(2.0f*FREQUENCY));
+      harmonic = (0u<harmonics) ? n%harmonics+1u : 1u;
+      err = oscillator_init (&sines[n].osc, FREQUENCY*(float)harmonic, rate,
+                             Q_14);
+    }
+    if ( S_SUCCESS!=err )
+    {
+      printf ("Error adding device %s\n", argv[n+1u]);
+      pcm_engine_close (&engine);
+      return S_ERROR;
+    }
+  }
+
+  err = pcm_engine_start (&engine);
+  if ( S_SUCCESS==err )
+  {
+    printf ("Playing in %u devices (%s)\n", num_devices,
+            (0u!=engine.linked) ? "linked" : "not linked");
+    err = pcm_engine_run (&engine, PLAYBACK_TIME_MS);
+  }
+
+  pcm_engine_print_stats (&engine);
+  pcm_engine_close (&engine);
+
+  return (S_SUCCESS==err) ? S_SUCCESS : S_ERROR;
+}
+
+/*-------------- END OF FILE -------------------------------------------------*/